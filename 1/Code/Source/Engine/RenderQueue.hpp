@@ -0,0 +1,132 @@
+#pragma once
+
+#include "Render.hpp"
+
+namespace ge
+{
+	//----------------------------------------------------------------------------//
+	// RenderKey
+	//----------------------------------------------------------------------------//
+
+	/// Layout of 64-bit sort key of draw, from high to low bits. Draws are sorted by layer first and by depth last.
+	enum RenderKeyLayout : uint
+	{
+		RKL_DepthBits = 20,
+		RKL_VertexFormatBits = 8,
+		RKL_MaterialBits = 16,
+		RKL_ProgramBits = 12,
+		RKL_PassBits = 4,
+		RKL_LayerBits = 4,
+
+		RKL_DepthShift = 0,
+		RKL_VertexFormatShift = RKL_DepthShift + RKL_DepthBits,
+		RKL_MaterialShift = RKL_VertexFormatShift + RKL_VertexFormatBits,
+		RKL_ProgramShift = RKL_MaterialShift + RKL_MaterialBits,
+		RKL_PassShift = RKL_ProgramShift + RKL_ProgramBits,
+		RKL_LayerShift = RKL_PassShift + RKL_PassBits,
+	};
+
+	struct RenderKey
+	{
+		/// Build sort key. Ids are truncated to size of their fields.
+		///\param[in] _depth normalized depth in range 0..1.
+		///\param[in] _backToFront invert order of depth (for translucent geometry).
+		static uint64 Make(uint _layer, uint _pass, uint _program, uint _material, uint _vertexFormat, float _depth, bool _backToFront = false)
+		{
+			const uint _maxDepth = (1 << RKL_DepthBits) - 1;
+			uint _d = _depth <= 0 ? 0 : (_depth >= 1 ? _maxDepth : (uint)(_depth * _maxDepth));
+			if (_backToFront)
+				_d = _maxDepth - _d;
+
+			return
+				_Field(_layer, RKL_LayerBits, RKL_LayerShift) |
+				_Field(_pass, RKL_PassBits, RKL_PassShift) |
+				_Field(_program, RKL_ProgramBits, RKL_ProgramShift) |
+				_Field(_material, RKL_MaterialBits, RKL_MaterialShift) |
+				_Field(_vertexFormat, RKL_VertexFormatBits, RKL_VertexFormatShift) |
+				_Field(_d, RKL_DepthBits, RKL_DepthShift);
+		}
+
+		static uint GetLayer(uint64 _key) { return _Get(_key, RKL_LayerBits, RKL_LayerShift); }
+		static uint GetPass(uint64 _key) { return _Get(_key, RKL_PassBits, RKL_PassShift); }
+		static uint GetProgram(uint64 _key) { return _Get(_key, RKL_ProgramBits, RKL_ProgramShift); }
+		static uint GetMaterial(uint64 _key) { return _Get(_key, RKL_MaterialBits, RKL_MaterialShift); }
+		static uint GetVertexFormat(uint64 _key) { return _Get(_key, RKL_VertexFormatBits, RKL_VertexFormatShift); }
+
+		static uint64 _Field(uint _value, uint _bits, uint _shift) { return (uint64)(_value & ((1u << _bits) - 1)) << _shift; }
+		static uint _Get(uint64 _key, uint _bits, uint _shift) { return (uint)(_key >> _shift) & ((1u << _bits) - 1); }
+	};
+
+	//----------------------------------------------------------------------------//
+	// RenderQueue
+	//----------------------------------------------------------------------------//
+
+	/// Queue of draws for one frame. Draws are sorted by key and executed with filtering of redundant state changes.
+	///\note Queue is not thread-safe. Use one queue per thread and execute them in render thread.
+	class ENGINE_API RenderQueue : public NonCopyable
+	{
+	public:
+
+		/// Bind program and material. Called only if one of them was changed.
+		typedef void(*BindCallback)(uint _program, uint _material, void* _param);
+
+		struct Stats
+		{
+			uint numDraws = 0;
+			uint submittedStates = 0; ///!< Number of state changes without filtering (program, material and geometry for each draw).
+			uint issuedStates = 0; ///!< Number of state changes which were passed to render system.
+		};
+
+		RenderQueue(void);
+		~RenderQueue(void);
+
+		void SetBindCallback(BindCallback _callback, void* _param = nullptr) { m_bindCallback = _callback; m_bindParam = _param; }
+
+		/// Remove all draws. Memory is not released.
+		void Clear(void);
+		/// Add draw. Draw is not indexed if _indices is null.
+		///\warning Queue doesn't hold references to geometry. It must be valid until execution.
+		void Push(uint64 _key, VertexArray* _vertices, HardwareBuffer* _indices, IndexType _indexType, uint _indexOffset, PrimitiveType _type, uint _baseVertex, uint _baseIndex, uint _numElements, uint _numInstances = 1);
+		/// Sort draws by key. Order of draws with equal keys is kept.
+		void Sort(void);
+		/// Execute sorted draws. State of render system is unknown at start, so first changes are never filtered.
+		///\param[in] _rs render system for execution. If it is null, queue is executed in headless mode without draws, only for statistics.
+		void Execute(RenderSystem* _rs);
+
+		uint GetSize(void) { return (uint)m_items.size(); }
+		/// Get statistics of last execution.
+		const Stats& GetStats(void) { return m_stats; }
+
+	protected:
+
+		struct Item
+		{
+			VertexArray* vertices;
+			HardwareBuffer* indices;
+			IndexType indexType;
+			PrimitiveType type;
+			uint indexOffset;
+			uint baseVertex;
+			uint baseIndex;
+			uint numElements;
+			uint numInstances;
+		};
+
+		struct SortItem
+		{
+			uint64 key;
+			uint index;
+		};
+
+		Array<Item> m_items;
+		Array<SortItem> m_keys;
+		Array<SortItem> m_temp;
+		BindCallback m_bindCallback;
+		void* m_bindParam;
+		Stats m_stats;
+	};
+
+	//----------------------------------------------------------------------------//
+	// 
+	//----------------------------------------------------------------------------//
+}
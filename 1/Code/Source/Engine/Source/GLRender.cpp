@@ -1727,8 +1727,11 @@ namespace ge
 	{
 		CHECK_RENDER_THREAD();
 
-		GLRenderState::vertexArray = static_cast<GLVertexArray*>(_vertices);
-		GLRenderState::indexBuffer = static_cast<GLBuffer*>(_indices);
+		// avoid changing of reference counters for same geometry
+		if (GLRenderState::vertexArray.Get() != _vertices)
+			GLRenderState::vertexArray = static_cast<GLVertexArray*>(_vertices);
+		if (GLRenderState::indexBuffer.Get() != _indices)
+			GLRenderState::indexBuffer = static_cast<GLBuffer*>(_indices);
 		GLRenderState::indexOffset = _indexOffset;
 		GLRenderState::indexType = _indexType;
 	}
@@ -1825,7 +1828,7 @@ namespace ge
 					}
 
 					// enable primitive restart
-					if (GLRenderState::primitveRestartEnabled)
+					if (!GLRenderState::primitveRestartEnabled)
 					{
 						GLRenderState::primitveRestartEnabled = true;
 						glEnable(GL_PRIMITIVE_RESTART);
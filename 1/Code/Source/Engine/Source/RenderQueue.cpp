@@ -0,0 +1,167 @@
+#include "RenderQueue.hpp"
+
+namespace ge
+{
+	//----------------------------------------------------------------------------//
+	// RenderQueue
+	//----------------------------------------------------------------------------//
+
+	//----------------------------------------------------------------------------//
+	RenderQueue::RenderQueue(void) :
+		m_bindCallback(nullptr),
+		m_bindParam(nullptr)
+	{
+	}
+	//----------------------------------------------------------------------------//
+	RenderQueue::~RenderQueue(void)
+	{
+	}
+	//----------------------------------------------------------------------------//
+	void RenderQueue::Clear(void)
+	{
+		m_items.clear();
+		m_keys.clear();
+	}
+	//----------------------------------------------------------------------------//
+	void RenderQueue::Push(uint64 _key, VertexArray* _vertices, HardwareBuffer* _indices, IndexType _indexType, uint _indexOffset, PrimitiveType _type, uint _baseVertex, uint _baseIndex, uint _numElements, uint _numInstances)
+	{
+		ASSERT(_vertices != nullptr);
+
+		SortItem _sortItem = { _key, (uint)m_items.size() };
+		m_keys.push_back(_sortItem);
+
+		m_items.push_back(Item());
+		Item& _item = m_items.back();
+		_item.vertices = _vertices;
+		_item.indices = _indices;
+		_item.indexType = _indexType;
+		_item.type = _type;
+		_item.indexOffset = _indexOffset;
+		_item.baseVertex = _baseVertex;
+		_item.baseIndex = _baseIndex;
+		_item.numElements = _numElements;
+		_item.numInstances = _numInstances;
+	}
+	//----------------------------------------------------------------------------//
+	void RenderQueue::Sort(void)
+	{
+		uint _count = (uint)m_keys.size();
+		if (_count < 2)
+			return;
+
+		// LSD radix sort by bytes. Histograms of all bytes are built in one pass.
+		uint _hist[8][256];
+		memset(_hist, 0, sizeof(_hist));
+		for (uint i = 0; i < _count; ++i)
+		{
+			uint64 _key = m_keys[i].key;
+			for (uint b = 0; b < 8; ++b)
+				++_hist[b][(_key >> (b << 3)) & 0xff];
+		}
+
+		m_temp.resize(_count);
+		SortItem* _src = &m_keys[0];
+		SortItem* _dst = &m_temp[0];
+
+		for (uint b = 0; b < 8; ++b)
+		{
+			uint* _h = _hist[b];
+			uint _shift = b << 3;
+
+			// all keys have same byte, pass can be skipped (unused fields of key)
+			if (_h[(_src[0].key >> _shift) & 0xff] == _count)
+				continue;
+
+			for (uint i = 0, _sum = 0; i < 256; ++i)
+			{
+				uint _n = _h[i];
+				_h[i] = _sum;
+				_sum += _n;
+			}
+
+			for (uint i = 0; i < _count; ++i)
+				_dst[_h[(_src[i].key >> _shift) & 0xff]++] = _src[i];
+
+			Swap(_src, _dst);
+		}
+
+		if (_src != &m_keys[0])
+			m_keys.swap(m_temp);
+	}
+	//----------------------------------------------------------------------------//
+	void RenderQueue::Execute(RenderSystem* _rs)
+	{
+		m_stats = Stats();
+
+		// shadow state
+		bool _first = true;
+		uint _program = 0;
+		uint _material = 0;
+		VertexArray* _vertices = nullptr;
+		HardwareBuffer* _indices = nullptr;
+		IndexType _indexType = IF_UShort;
+		uint _indexOffset = 0;
+
+		for (const SortItem& _key : m_keys)
+		{
+			const Item& _item = m_items[_key.index];
+			uint _newProgram = RenderKey::GetProgram(_key.key);
+			uint _newMaterial = RenderKey::GetMaterial(_key.key);
+
+			m_stats.submittedStates += 3;
+			++m_stats.numDraws;
+
+			bool _changed = false;
+			if (_first || _newProgram != _program)
+			{
+				++m_stats.issuedStates;
+				_program = _newProgram;
+				_changed = true;
+			}
+			if (_first || _newMaterial != _material)
+			{
+				++m_stats.issuedStates;
+				_material = _newMaterial;
+				_changed = true;
+			}
+			if (_changed && _rs && m_bindCallback)
+				m_bindCallback(_program, _material, m_bindParam);
+
+			if (_first || _item.vertices != _vertices || _item.indices != _indices || (_indices && (_item.indexType != _indexType || _item.indexOffset != _indexOffset)))
+			{
+				++m_stats.issuedStates;
+				_vertices = _item.vertices;
+				_indices = _item.indices;
+				_indexType = _item.indexType;
+				_indexOffset = _item.indexOffset;
+				if (_rs)
+					_rs->SetGeometry(_vertices, _indices, _indexType, _indexOffset);
+			}
+
+			_first = false;
+
+			if (!_rs)
+				continue;
+
+			if (_item.indices)
+			{
+				if (_item.numInstances > 1)
+					_rs->DrawIndexedInstanced(_item.type, _item.baseVertex, _item.baseIndex, _item.numElements, _item.numInstances);
+				else
+					_rs->DrawIndexed(_item.type, _item.baseVertex, _item.baseIndex, _item.numElements);
+			}
+			else
+			{
+				if (_item.numInstances > 1)
+					_rs->DrawInstanced(_item.type, _item.baseVertex, _item.numElements, _item.numInstances);
+				else
+					_rs->Draw(_item.type, _item.baseVertex, _item.numElements);
+			}
+		}
+	}
+	//----------------------------------------------------------------------------//
+
+	//----------------------------------------------------------------------------//
+	// 
+	//----------------------------------------------------------------------------//
+}
@@ -204,6 +204,12 @@ namespace ge
 #endif
 	}
 	//----------------------------------------------------------------------------//
+	uint Thread::GetNumCores(void)
+	{
+		uint _numCores = std::thread::hardware_concurrency();
+		return _numCores ? _numCores : 1;
+	}
+	//----------------------------------------------------------------------------//
 	void Thread::Sleep(uint _timeMs)
 	{
 #ifdef _WIN32
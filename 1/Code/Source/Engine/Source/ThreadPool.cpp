@@ -4,6 +4,75 @@
 
 namespace ge
 {
+	//----------------------------------------------------------------------------//
+	// ThreadTask
+	//----------------------------------------------------------------------------//
+
+	//----------------------------------------------------------------------------//
+	void ThreadTask::Wakeup(void)
+	{
+		if (gThreadPool)
+			gThreadPool->_Notify(true);
+	}
+	//----------------------------------------------------------------------------//
+
+	//----------------------------------------------------------------------------//
+	// JobQueue
+	//----------------------------------------------------------------------------//
+
+	//----------------------------------------------------------------------------//
+	bool JobQueue::Push(ThreadJob* _job)
+	{
+		int64 _b = m_bottom.load(std::memory_order_relaxed);
+		int64 _t = m_top.load(std::memory_order_acquire);
+		if (_b - _t >= JOB_QUEUE_SIZE)
+			return false;
+
+		m_items[_b & (JOB_QUEUE_SIZE - 1)].store(_job, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		m_bottom.store(_b + 1, std::memory_order_relaxed);
+		return true;
+	}
+	//----------------------------------------------------------------------------//
+	ThreadJob* JobQueue::Pop(void)
+	{
+		int64 _b = m_bottom.load(std::memory_order_relaxed) - 1;
+		m_bottom.store(_b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64 _t = m_top.load(std::memory_order_relaxed);
+
+		if (_t > _b) // empty
+		{
+			m_bottom.store(_b + 1, std::memory_order_relaxed);
+			return nullptr;
+		}
+
+		ThreadJob* _job = m_items[_b & (JOB_QUEUE_SIZE - 1)].load(std::memory_order_relaxed);
+		if (_t == _b) // last item, race with thieves
+		{
+			if (!m_top.compare_exchange_strong(_t, _t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+				_job = nullptr;
+			m_bottom.store(_b + 1, std::memory_order_relaxed);
+		}
+		return _job;
+	}
+	//----------------------------------------------------------------------------//
+	ThreadJob* JobQueue::Steal(void)
+	{
+		int64 _t = m_top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64 _b = m_bottom.load(std::memory_order_acquire);
+
+		if (_t < _b)
+		{
+			ThreadJob* _job = m_items[_t & (JOB_QUEUE_SIZE - 1)].load(std::memory_order_relaxed);
+			if (m_top.compare_exchange_strong(_t, _t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+				return _job;
+		}
+		return nullptr;
+	}
+	//----------------------------------------------------------------------------//
+
 	//----------------------------------------------------------------------------//
 	// ThreadPool
 	//----------------------------------------------------------------------------//
@@ -11,6 +80,19 @@ namespace ge
 	namespace
 	{
 		THREAD_LOCAL int tls_threadIndex = -1;
+
+		struct ExecInEachThreadParam
+		{
+			ThreadPool::Callback callback;
+			void* param;
+			uint index;
+		};
+
+		void _ExecInEachThreadJob(void* _param)
+		{
+			ExecInEachThreadParam* _p = reinterpret_cast<ExecInEachThreadParam*>(_param);
+			_p->callback(_p->index, _p->param);
+		}
 	}
 
 	ThreadPool::InitParams ThreadPool::s_initParams;
@@ -30,55 +112,95 @@ namespace ge
 		return _pool;
 	}
 	//----------------------------------------------------------------------------//
-	ThreadPool::ThreadPool(void)
+	ThreadPool::ThreadPool(void) :
+		m_stopThreads(true),
+		m_numThreads(0),
+		m_numThreadsWithRc(0),
+		m_threads(nullptr),
+		m_numSharedJobs(0),
+		m_numStolenJobs(0),
+		m_epoch(0),
+		m_numSleeping(0)
 	{
 
 	}
 	//----------------------------------------------------------------------------//
 	ThreadPool::~ThreadPool(void)
 	{
-
+		_Shutdown();
 	}
 	//----------------------------------------------------------------------------//
 	bool ThreadPool::_Init(void)
 	{
-		TODO("read cpu num cores");
+		uint _numCores = Thread::GetNumCores();
 
 		if (s_initParams.numThreads == 0)
-			s_initParams.numThreads = MIN_THREADS; //TODO: cpu.numCores;
+			s_initParams.numThreads = _numCores > 1 ? _numCores - 1 : 1; // main thread uses one core
 		if (s_initParams.numThreads < MIN_THREADS)
 			s_initParams.numThreads = MIN_THREADS;
 		if (s_initParams.numThreads > MAX_THREADS)
 			s_initParams.numThreads = MAX_THREADS;
 
-		if (s_initParams.numThreadsWithRc < MIN_THREADS)
-			s_initParams.numThreadsWithRc = MIN_THREADS;
+		if (s_initParams.numThreadsWithRc == 0)
+			s_initParams.numThreadsWithRc = MAX_THREADS_WITH_RC;
 		if (s_initParams.numThreadsWithRc > MAX_THREADS_WITH_RC)
 			s_initParams.numThreadsWithRc = MAX_THREADS_WITH_RC;
 		if (s_initParams.numThreadsWithRc > s_initParams.numThreads)
 			s_initParams.numThreadsWithRc = s_initParams.numThreads;
 
-		for (uint i = 0; i < s_initParams.numThreads; ++i)
+		m_numThreads = s_initParams.numThreads;
+		m_numThreadsWithRc = s_initParams.numThreadsWithRc;
+		m_threads = new Item[m_numThreads];
+		m_stopThreads = false;
+
+		for (uint i = 0; i < m_numThreads; ++i)
+			m_threads[i].thread = Thread(_ThreadEntry, i);
+
+		LOG_INFO("Background threads: %d (%d with render context), %d cores", m_numThreads, m_numThreadsWithRc, _numCores);
+		return true;
+	}
+	//----------------------------------------------------------------------------//
+	void ThreadPool::_Shutdown(void)
+	{
+		if (m_threads)
 		{
-			
+			m_stopThreads = true;
+			_Notify(true);
+
+			for (uint i = 0; i < m_numThreads; ++i)
+				m_threads[i].thread.Wait();
+
+			delete[] m_threads;
+			m_threads = nullptr;
 		}
-		return true;
 	}
 	//----------------------------------------------------------------------------//
 	void ThreadPool::_ExecInEachThread(Callback _callback, void* _param)
 	{
 		if (_callback)
 		{
-			// init
-			m_cmdDone = 0;
-			m_callbackParam = _param;
-			m_callback = _callback;
-			// wait
-			while (m_cmdDone < (int)m_numThreads)
-				Thread::Sleep(1);
-			// reset
-			m_callback = nullptr;
-			m_cmdDone = 0;
+			ASSERT(tls_threadIndex < 0, "Cannot be used from background thread");
+
+			AtomicInt _counter(0);
+			Array<ExecInEachThreadParam> _params(m_numThreads);
+			Array<ThreadJob> _jobs(m_numThreads);
+
+			for (uint i = 0; i < m_numThreads; ++i)
+			{
+				_params[i].callback = _callback;
+				_params[i].param = _param;
+				_params[i].index = i;
+				_jobs[i].func = _ExecInEachThreadJob;
+				_jobs[i].param = &_params[i];
+				_jobs[i].counter = &_counter;
+				++_counter;
+
+				SCOPE_LOCK(m_threads[i].mutex);
+				m_threads[i].pinnedJobs.push_back(&_jobs[i]);
+			}
+
+			_Notify(true);
+			Wait(_counter);
 		}
 	}
 	//----------------------------------------------------------------------------//
@@ -86,20 +208,27 @@ namespace ge
 	{
 		if (_task)
 		{
-			uint _first = (_flags & TTF_RequestRenderContext) ? 0 : (m_numThreads - m_numThreadsWithRc);
-			uint _last = (_flags & TTF_RequestRenderContext) ? m_numThreadsWithRc : m_numThreads;
+			_task->m_requiredRc = (_flags & TTF_RequestRenderContext) != 0;
+			_task->m_needRemove = false;
+
 			if (_flags & TTF_DisableMoving)
 			{
-				uint _numTasks = 0, _index = 0;
-				for (uint i = 0; i < _last; ++i)
-				{
-					
-				}
+				uint _last = _task->m_requiredRc ? m_numThreadsWithRc : m_numThreads;
+				Item& _ctx = m_threads[_thread % _last];
+				_task->m_maxThreads = 1;
+
+				SCOPE_LOCK(_ctx.mutex);
+				_ctx.tasksToAdd.push_back(_task);
 			}
 			else
 			{
+				_task->m_maxThreads = _thread ? _thread : 1;
 
+				SCOPE_LOCK(m_tasksMutex);
+				m_tasks.push_back(_task);
 			}
+
+			_Notify(true);
 		}
 	}
 	//----------------------------------------------------------------------------//
@@ -107,41 +236,172 @@ namespace ge
 	{
 		if (_task)
 		{
+			_task->m_needRemove = true;
 
+			SCOPE_LOCK(m_tasksMutex);
+			for (size_t i = 0; i < m_tasks.size(); ++i)
+			{
+				if (m_tasks[i] == _task)
+				{
+					m_tasks[i] = m_tasks.back();
+					m_tasks.pop_back();
+					break;
+				}
+			}
 		}
 	}
 	//----------------------------------------------------------------------------//
+	void ThreadPool::Push(ThreadJob* _job)
+	{
+		ASSERT(_job && _job->func);
+
+		if (_job->counter)
+			++*_job->counter;
+
+		bool _rc = (_job->flags & TTF_RequestRenderContext) != 0;
+		int _index = tls_threadIndex;
+
+		// local queue of current thread. render context is not shared between threads, such jobs cannot be stolen
+		if (!_rc && _index >= 0 && m_threads[_index].jobs.Push(_job))
+		{
+			_Notify(false);
+			return;
+		}
+
+		{
+			SCOPE_LOCK(m_sharedJobsMutex);
+			(_rc ? m_rcJobs : m_sharedJobs).push_back(_job);
+			++m_numSharedJobs;
+		}
+		_Notify(_rc);
+	}
+	//----------------------------------------------------------------------------//
+	void ThreadPool::Wait(AtomicInt& _counter)
+	{
+		int _index = tls_threadIndex;
+		bool _hasRc = _index >= 0 && (uint)_index < m_numThreadsWithRc;
+
+		while (_counter > 0)
+		{
+			uint _epoch = m_epoch;
+			ThreadJob* _job = _GetJob(_index, _hasRc);
+			if (_job)
+				_Exec(_job);
+			else
+				_Park(_epoch, &_counter);
+		}
+	}
+	//----------------------------------------------------------------------------//
+	bool ThreadPool::ExecPending(void)
+	{
+		int _index = tls_threadIndex;
+		ThreadJob* _job = _GetJob(_index, _index >= 0 && (uint)_index < m_numThreadsWithRc);
+		if (_job)
+		{
+			_Exec(_job);
+			return true;
+		}
+		return false;
+	}
+	//----------------------------------------------------------------------------//
+	uint ThreadPool::GetThreadIndex(void)
+	{
+		return (uint)(tls_threadIndex + 1);
+	}
+	//----------------------------------------------------------------------------//
+	ThreadJob* ThreadPool::_GetJob(int _index, bool _hasRc)
+	{
+		ThreadJob* _job = nullptr;
+
+		// local queue
+		if (_index >= 0 && (_job = m_threads[_index].jobs.Pop()) != nullptr)
+			return _job;
+
+		// shared queue
+		if (m_numSharedJobs > 0)
+		{
+			SCOPE_LOCK(m_sharedJobsMutex);
+			List<ThreadJob*>& _queue = (_hasRc && !m_rcJobs.empty()) ? m_rcJobs : m_sharedJobs;
+			if (!_queue.empty())
+			{
+				_job = _queue.front();
+				_queue.pop_front();
+				--m_numSharedJobs;
+				return _job;
+			}
+		}
+
+		// steal from other threads
+		uint _start = _index >= 0 ? (uint)_index + 1 : 0;
+		for (uint i = 0; i < m_numThreads; ++i)
+		{
+			uint _victim = (_start + i) % m_numThreads;
+			if ((int)_victim != _index && (_job = m_threads[_victim].jobs.Steal()) != nullptr)
+			{
+				++m_numStolenJobs;
+				return _job;
+			}
+		}
+
+		return nullptr;
+	}
+	//----------------------------------------------------------------------------//
+	void ThreadPool::_Exec(ThreadJob* _job)
+	{
+		AtomicInt* _counter = _job->counter;
+		_job->func(_job->param);
+		if (_counter && --*_counter == 0) // job can be deleted after this
+			_Notify(true);
+	}
+	//----------------------------------------------------------------------------//
+	void ThreadPool::_Notify(bool _all)
+	{
+		++m_epoch;
+		if (m_numSleeping > 0)
+		{
+			{
+				std::lock_guard<std::mutex> _lock(m_parkMutex);
+			}
+			if (_all)
+				m_parkCond.notify_all();
+			else
+				m_parkCond.notify_one();
+		}
+	}
+	//----------------------------------------------------------------------------//
+	void ThreadPool::_Park(uint _epoch, AtomicInt* _counter)
+	{
+		std::unique_lock<std::mutex> _lock(m_parkMutex);
+		++m_numSleeping;
+		while (m_epoch == _epoch && !m_stopThreads && (!_counter || *_counter > 0))
+			m_parkCond.wait(_lock);
+		--m_numSleeping;
+	}
+	//----------------------------------------------------------------------------//
 	void ThreadPool::_BackgroundThread(uint _index)
 	{
-		uint _bit = 1 << _index;
+		tls_threadIndex = (int)_index;
+
 		uint _publicIndex = _index + 1;
 		bool _hasRc = _index < m_numThreadsWithRc;
 
 		Array<ThreadTaskPtr> _commonTasks;
-
-		// wait starting all threads
-		++m_cmdDone;
-		while (m_cmdDone < (int)m_numThreads)
-			Thread::Sleep(1);
-
-		uint _frame = 0;
-		double _frameTime, _avgFrameTime = 0;
 		Item& _ctx = m_threads[_index];
 
 		while (!m_stopThreads)
 		{
-			// execution in each thread
-			if (m_callback)
-			{
-				m_callback(_index, (void*)m_callbackParam);
-				++m_cmdDone;
-				while (m_cmdDone < (int)m_numThreads)
-					Thread::Sleep(1);
-			}
+			uint _epoch = m_epoch;
+			bool _active = false;
+			ThreadJob* _pinnedJob = nullptr;
 
 			// add tasks
 			{
 				SCOPE_LOCK(_ctx.mutex);
+				if (!_ctx.pinnedJobs.empty())
+				{
+					_pinnedJob = _ctx.pinnedJobs.back();
+					_ctx.pinnedJobs.pop_back();
+				}
 				if (!_ctx.tasksToAdd.empty())
 				{
 					_ctx.tasks.reserve(_ctx.tasks.size() + _ctx.tasksToAdd.size());
@@ -155,23 +415,35 @@ namespace ge
 				}
 			}
 
+			// execution in each thread
+			if (_pinnedJob)
+			{
+				_Exec(_pinnedJob);
+				_active = true;
+			}
+
+			// execute jobs
+			while (ThreadJob* _job = _GetJob(_index, _hasRc))
+			{
+				_Exec(_job);
+				_active = true;
+			}
+
 			// execute tasks
-			for (size_t i = 0, s = _ctx.tasks.size(); i < s; ++i)
+			for (size_t i = 0; i < _ctx.tasks.size();)
 			{
-				for (size_t i = 0; i < _ctx.tasks.size();)
+				ThreadTaskPtr _task = _ctx.tasks[i];
+				if (_task->m_needRemove)
 				{
-					ThreadTaskPtr _task = _ctx.tasks[i];
-					if (_task->m_needRemove)
-					{
-						_ctx.tasks[i] = _ctx.tasks.back();
-						_ctx.tasks.pop_back();
-						--_task->m_numThreads;
-					}
-					else
-					{
-						++i;
-						_task->Tick(_publicIndex);
-					}
+					_ctx.tasks[i] = _ctx.tasks.back();
+					_ctx.tasks.pop_back();
+					--_task->m_numThreads;
+				}
+				else
+				{
+					++i;
+					if (_task->Tick(_publicIndex))
+						_active = true;
 				}
 			}
 
@@ -179,7 +451,7 @@ namespace ge
 			{
 				// get common tasks
 				{
-					SCOPE_LOCK(m_tasksMutex);
+					SCOPE_READ(m_tasksMutex);
 					_commonTasks = m_tasks;
 				}
 
@@ -189,14 +461,17 @@ namespace ge
 					if (_task->m_requiredRc && !_hasRc)
 						continue;
 
-					if (++_task->m_numThreads < (int)_task->m_numThreads)
-					{
-						_task->Tick(_publicIndex);
-					}
+					if (++_task->m_numThreads <= (int)_task->m_maxThreads && _task->Tick(_publicIndex))
+						_active = true;
 					--_task->m_numThreads;
 				}
+				_commonTasks.clear();
 			}
 
+			// sleep until new jobs or tasks
+			if (!_active)
+				_Park(_epoch);
+
 		} // main loop
 
 		// cleanup
@@ -205,10 +480,7 @@ namespace ge
 		_ctx.tasksToAdd.clear();
 		_ctx.tasks.clear();
 
-		// wait stopping all threads
-		++m_cmdDone;
-		while (m_cmdDone < (int)m_numThreads)
-			Thread::Sleep(1);
+		tls_threadIndex = -1;
 	}
 	//----------------------------------------------------------------------------//
 	void ThreadPool::_ThreadEntry(uint _index)
@@ -14,7 +14,7 @@ namespace ge
 	// Atomic
 	//----------------------------------------------------------------------------//
 
-	template <class T> using Atomic = std::atomic<int>;
+	template <class T> using Atomic = std::atomic<T>;
 	typedef Atomic<int> AtomicInt;
 
 	//----------------------------------------------------------------------------//
@@ -160,6 +160,8 @@ namespace ge
 		static uint32 GetCurrentId(void);
 		static uint32 GetMainId(void) { return s_mainId; }
 		static bool IsMain(void) { return GetCurrentId() == s_mainId; }
+		/// Get number of hardware threads.
+		static uint GetNumCores(void);
 		static void Sleep(uint _timeMs);
 		static void SetPriority(ThreadPriority _priority);
 		static void SetMask(uint _mask);
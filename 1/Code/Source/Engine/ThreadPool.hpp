@@ -2,6 +2,8 @@
 
 #include "Thread.hpp"
 #include "Object.hpp"
+#include <mutex>
+#include <condition_variable>
 
 namespace ge
 {
@@ -20,8 +22,9 @@ namespace ge
 	enum : uint
 	{
 		MIN_THREADS = 2,
-		MAX_THREADS = 8,
+		MAX_THREADS = 64,
 		MAX_THREADS_WITH_RC = 2,
+		JOB_QUEUE_SIZE = 4096, ///!< Capacity of local queue of each thread. Must be power of two.
 	};
 
 	//----------------------------------------------------------------------------//
@@ -40,9 +43,14 @@ namespace ge
 	public:
 		OBJECT(ThreadTask);
 
+		ThreadTask(void) : m_maxThreads(1), m_numThreads(0), m_requiredRc(false), m_needRemove(false) { }
+
 		/// Run single step. \return false if this task is inactive.
 		virtual bool Tick(uint _threadIndex = 0) = 0;
 
+		/// Wake up sleeping threads after an inactive task has work again.
+		void Wakeup(void);
+
 	protected:
 
 	private:
@@ -54,6 +62,46 @@ namespace ge
 		volatile bool m_needRemove;
 	};
 
+	//----------------------------------------------------------------------------//
+	// ThreadJob
+	//----------------------------------------------------------------------------//
+
+	/// Lightweight job. Memory of job is owned by caller and must be valid until the counter is reached zero.
+	struct ThreadJob
+	{
+		typedef void(*Func)(void* _param);
+
+		Func func = nullptr;
+		void* param = nullptr;
+		AtomicInt* counter = nullptr; ///!< Incremented in ThreadPool::Push, decremented after execution. Can be null.
+		uint flags = 0; ///!< Only ge::TTF_RequestRenderContext is used.
+	};
+
+	//----------------------------------------------------------------------------//
+	// JobQueue
+	//----------------------------------------------------------------------------//
+
+	/// Lock-free work-stealing deque (Chase-Lev) with fixed capacity.
+	class JobQueue : public NonCopyable
+	{
+	public:
+		JobQueue(void) : m_top(0), m_bottom(0) { }
+
+		/// Add job to bottom. Only for owner thread. \return false if queue is full.
+		bool Push(ThreadJob* _job);
+		/// Get job from bottom. Only for owner thread.
+		ThreadJob* Pop(void);
+		/// Get job from top. Can be used from any thread.
+		ThreadJob* Steal(void);
+
+		bool IsEmpty(void) const { return m_bottom.load(std::memory_order_relaxed) <= m_top.load(std::memory_order_relaxed); }
+
+	protected:
+		Atomic<int64> m_top;
+		Atomic<int64> m_bottom;
+		Atomic<ThreadJob*> m_items[JOB_QUEUE_SIZE];
+	};
+
 	//----------------------------------------------------------------------------//
 	// ThreadPool
 	//----------------------------------------------------------------------------//
@@ -67,12 +115,12 @@ namespace ge
 
 		struct InitParams
 		{
-			uint numThreads = 0;
+			uint numThreads = 0; ///!< Number of background threads. Zero is number of cores minus one.
 			uint numThreadsWithRc = 0;
 		};
 
-		InitParams& GetInitParams(void) { return s_initParams; }
-		ThreadPoolPtr Create(void);
+		static InitParams& GetInitParams(void) { return s_initParams; }
+		static ThreadPoolPtr Create(void);
 
 		/// Run some function in each thread.
 		///\note For experts and internal usage only.
@@ -86,72 +134,80 @@ namespace ge
 
 		void RemoveTask(ThreadTask* _task);
 
-		void EmulateCpu(uint _numCores)
-		{
-
-		}
-		//uint GetIndex(void);
+		/// Add job for asynchronous execution.
+		///\note Can be used from any thread. Jobs pushed from background thread are placed in local queue of this thread.
+		void Push(ThreadJob* _job);
+		/// Wait for the counter to reach zero. Executes pending jobs while waiting.
+		void Wait(AtomicInt& _counter);
+		/// Execute one pending job in current thread. \return false if no jobs are available.
+		bool ExecPending(void);
+		/// Wake up threads in ThreadPool::Wait after changing of counter without ThreadPool.
+		void Notify(void) { _Notify(true); }
+
+		/// Get number of background threads.
+		uint GetNumThreads(void) { return m_numThreads; }
+		/// Get number of background threads with render context.
+		uint GetNumThreadsWithRc(void) { return m_numThreadsWithRc; }
+		/// Get index of current background thread (1..NumThreads). Zero for other threads.
+		static uint GetThreadIndex(void);
+		/// Get number of jobs which were stolen from local queues of other threads.
+		uint GetNumStolenJobs(void) { return (uint)m_numStolenJobs; }
 
 	protected:
 		friend class RenderSystem;
+		friend class ThreadTask;
 
 		ThreadPool(void);
 		~ThreadPool(void);
 		bool _Init(void);
-
-
-		/*struct Task
-		{
-			double timeAccum;
-			double frameTime;
-			double avgFrameTime;
-			ThreadTaskPtr task;
-			uint flags;
-		}; */
+		void _Shutdown(void);
 
 		struct Item
 		{
 			CriticalSection mutex;
 			Array<ThreadTaskPtr> tasks;
 			Array<ThreadTaskPtr> tasksToAdd;
+			Array<ThreadJob*> pinnedJobs; ///!< Jobs for _ExecInEachThread
+			JobQueue jobs;
 			Thread thread;
 			float fps;
-
-			//double frameTime;
-			//double avgFrameTime;
-			//Array<Task> tasksToAdd;
-			//Array<Task> tasks;
-			//uint flags;
-			//uint oldMask;
-
-			//uint numSingleThreadTasks;
-			//uint numMovalbleTasks;
 		};
 
+		/// Find job for thread. _index is -1 for foreign threads.
+		ThreadJob* _GetJob(int _index, bool _hasRc);
+		void _Exec(ThreadJob* _job);
+		/// Wake up sleeping threads.
+		void _Notify(bool _all);
+		/// Sleep until _Notify if nothing was changed since _epoch.
+		void _Park(uint _epoch, AtomicInt* _counter = nullptr);
+
 		void _BackgroundThread(uint _index);
 		static void _ThreadEntry(uint _index);
 
-		volatile Callback m_callback;
-		volatile void* m_callbackParam;
-
-
 		volatile bool m_stopThreads;
-		AtomicInt m_cmdDone;
-		volatile bool m_pauseThreads;
 
 		uint m_numThreads;
 		uint m_numThreadsWithRc;
-		Item m_threads[MAX_THREADS];
-
+		Item* m_threads;
 
 		Mutex m_tasksMutex;
 		Array<ThreadTaskPtr> m_tasks;
-		//Array<ThreadTaskPtr> m_tasksToAdd;
+
+		CriticalSection m_sharedJobsMutex;
+		List<ThreadJob*> m_sharedJobs; ///!< Jobs from foreign threads
+		List<ThreadJob*> m_rcJobs; ///!< Jobs which require render context
+		AtomicInt m_numSharedJobs;
+		AtomicInt m_numStolenJobs;
+
+		Atomic<uint> m_epoch;
+		AtomicInt m_numSleeping;
+		std::mutex m_parkMutex;
+		std::condition_variable m_parkCond;
 
 		static InitParams s_initParams;
 	};
 
 	//----------------------------------------------------------------------------//
-	// 
+	//
 	//----------------------------------------------------------------------------//
 }
@@ -1,8 +1,10 @@
 #include "Render.hpp"
+#include "RenderQueue.hpp"
 #include "Log.hpp"
 #include "File.hpp"
 #include "Thread.hpp"
 #include "Time.hpp"
+#include "ThreadPool.hpp"
 #include "ShaderCompiler.hpp"
 using namespace ge;
 
@@ -29,19 +31,77 @@ namespace Sandbox
 	// 
 	//----------------------------------------------------------------------------//
 
+	class Job;
+	typedef Ptr<Job> JobPtr;
+
+#define gJobManager Sandbox::JobManager::Get()
+
+	//----------------------------------------------------------------------------//
+	// Job
+	//----------------------------------------------------------------------------//
+
 	class Job : public RefCounted
 	{
 	public:
 
-		void Exec(void)
+		Job(uint _flags = 0) :
+			m_dependencies(1), // released in Submit
+			m_unfinished(1), // own execution
+			m_parent(nullptr),
+			m_submitted(false),
+			m_done(false)
+		{
+			m_job.func = _Entry;
+			m_job.param = this;
+			m_job.flags = _flags;
+		}
+
+		/// Start this job after _job is done. Should be used before Submit.
+		void DependsOn(Job* _job)
+		{
+			ASSERT(_job != nullptr);
+			ASSERT(!m_submitted, "Dependencies should be added before Submit");
+			SCOPE_LOCK(_job->m_mutex);
+			if (!_job->m_done)
+			{
+				++m_dependencies;
+				_job->m_continuations.push_back(this);
+			}
+		}
+
+		/// Start _job after this job is done (continuation). Should be used before _job->Submit.
+		void Then(Job* _job) { _job->DependsOn(this); }
+
+		/// Add child job. This job is not done until all childs are done. Should be used before _child->Submit.
+		void AddChild(Job* _child)
+		{
+			ASSERT(_child != nullptr && _child->m_parent == nullptr);
+			++m_unfinished;
+			_child->m_parent = this;
+			AddRef(); // released in _Complete of child
+		}
+
+		/// Queue job for execution. The job is started when all its dependencies are done.
+		void Submit(void)
 		{
-			_ExecImpl();
-			m_done = true;
+			ASSERT(!m_submitted, "Job is already submitted");
+			m_submitted = true;
+			int _dependencies = --m_dependencies;
+			ASSERT(_dependencies >= 0, "Unbalanced dependencies");
+			if (_dependencies == 0)
+				_Run();
 		}
 
+		bool IsDone(void) { return m_done; }
+
+		/// Wait for this job and all its childs. Executes other pending jobs while waiting. The job must be submitted.
 		void Wait(void)
 		{
-			
+			ASSERT(m_submitted, "Job is not submitted"); // counter of unsubmitted job never reaches zero
+			if (gThreadPool)
+				gThreadPool->Wait(m_unfinished);
+			else
+				ASSERT(m_done, "Job is not submitted or has unfinished dependencies");
 		}
 
 	protected:
@@ -49,49 +109,163 @@ namespace Sandbox
 
 		virtual void _ExecImpl(void) = 0;
 
-		bool m_inQueue = false;
-		volatile bool m_done = false;
-		Job* m_prev = nullptr;
-		Job* m_next = nullptr;
+		void _Run(void)
+		{
+			AddRef(); // released in _Entry
+			if (gThreadPool)
+				gThreadPool->Push(&m_job);
+			else
+				_Entry(this);
+		}
+
+		void _Finish(void)
+		{
+			if (--m_unfinished == 0)
+				_Complete();
+		}
+
+		void _Complete(void)
+		{
+			Array<JobPtr> _continuations;
+			{
+				SCOPE_LOCK(m_mutex);
+				m_done = true;
+				m_continuations.swap(_continuations);
+			}
+
+			for (size_t i = 0; i < _continuations.size(); ++i)
+			{
+				if (--_continuations[i]->m_dependencies == 0)
+					_continuations[i]->_Run();
+			}
+
+			if (gThreadPool)
+				gThreadPool->Notify(); // wake up threads in Wait
+
+			if (m_parent)
+			{
+				Job* _parent = m_parent;
+				m_parent = nullptr;
+				_parent->_Finish();
+				_parent->Release();
+			}
+		}
+
+		static void _Entry(void* _param)
+		{
+			Job* _job = reinterpret_cast<Job*>(_param);
+			_job->_ExecImpl();
+			_job->_Finish();
+			_job->Release();
+		}
+
+		ThreadJob m_job;
+		AtomicInt m_dependencies;
+		AtomicInt m_unfinished;
+		Job* m_parent;
+		CriticalSection m_mutex;
+		Array<JobPtr> m_continuations;
+		bool m_submitted;
+		volatile bool m_done;
 	};
 
-	/*template <class... A> class TJob : public Job
+	//----------------------------------------------------------------------------//
+	// TJob
+	//----------------------------------------------------------------------------//
+
+	template <class F> class TJob : public Job
 	{
 	public:
-		typedef Closure<void, A...> Func;
 
-		Job(Func _func) : m_func(_func) { }
- 
+		TJob(const F& _func, uint _flags = 0) : Job(_flags), m_func(_func) { }
+
 	protected:
 		void _ExecImpl(void) override { m_func(); }
 
-		Func m_func;
-	};	*/
+		F m_func;
+	};
 
-	class JobManager : public Singleton<JobManager>
+	//----------------------------------------------------------------------------//
+	// ParallelForJob
+	//----------------------------------------------------------------------------//
+
+	/// Split range [first, last) into childs with size up to grain. F is void(uint _first, uint _last).
+	template <class F> class ParallelForJob : public Job
 	{
 	public:
 
-	protected:
-		friend class RenderSystem;
-
-		/// Register render threads. For ge::RenderSystem.
-		void _RegisterRenderThreads(void);
-		/// Unregister render threads. For ge::RenderSystem.
-		void _UnregisterRenderThreads(void);
+		ParallelForJob(const F& _func, uint _first, uint _last, uint _grain) :
+			m_func(_func),
+			m_first(_first),
+			m_last(_last),
+			m_grain(_grain ? _grain : 1)
+		{
+		}
 
-		static void _Thread(void)
+	protected:
+		void _ExecImpl(void) override
 		{
-			Job* _job = nullptr;
+			uint _last = m_last;
+			while (_last - m_first > m_grain)
 			{
-				SCOPE_LOCK(s_mutex);
-				//if(s_jobs)
+				uint _mid = m_first + (_last - m_first) / 2;
+				JobPtr _child = new ParallelForJob(m_func, _mid, _last, m_grain);
+				AddChild(_child);
+				_child->Submit();
+				_last = _mid;
 			}
+			m_func(m_first, _last);
+		}
+
+		F m_func;
+		uint m_first;
+		uint m_last;
+		uint m_grain;
+	};
 
+	//----------------------------------------------------------------------------//
+	// JobManager
+	//----------------------------------------------------------------------------//
+
+	class JobManager : public Singleton<JobManager>
+	{
+	public:
+
+		/// Start background threads.
+		bool Startup(void)
+		{
+			m_threadPool = ThreadPool::Create();
+			return m_threadPool != nullptr;
+		}
+		/// Stop background threads. All jobs should be done.
+		void Shutdown(void)
+		{
+			m_threadPool = nullptr;
+		}
+
+		/// Create job from functor. The job should be submitted manually.
+		template <class F> JobPtr Create(const F& _func, uint _flags = 0)
+		{
+			return new TJob<F>(_func, _flags);
+		}
+
+		/// Create and submit job from functor.
+		template <class F> JobPtr Run(const F& _func, uint _flags = 0)
+		{
+			JobPtr _job = Create(_func, _flags);
+			_job->Submit();
+			return _job;
+		}
+
+		/// Create job which executes _func over range [first, last) in parallel. The job should be submitted manually.
+		template <class F> JobPtr ParallelFor(uint _first, uint _last, uint _grain, const F& _func)
+		{
+			return new ParallelForJob<F>(_func, _first, _last, _grain);
 		}
 
-		static CriticalSection s_mutex;
-		static Job* s_jobs;
+	protected:
+
+		ThreadPoolPtr m_threadPool;
 	};
 
 	//----------------------------------------------------------------------------//
@@ -751,6 +925,239 @@ void _TestBatches(void)
 	}
 }
 
+class TestVertexArray : public VertexArray
+{
+public:
+	void SetBuffer(uint _slot, HardwareBuffer* _buffer, uint _offset, uint _stride) override { }
+	VertexFormat* GetFormat(void) override { return nullptr; }
+};
+
+void _TestRenderQueue(void)
+{
+	const uint _numDraws = 100000;
+	const uint _numFrames = 20;
+	const uint _numMeshes = 256;
+
+	TestVertexArray _meshes[_numMeshes];
+	RenderQueue _queue;
+
+	// random scene: program and vertex format depend on mesh, material is random from small set per mesh
+	Array<uint64> _keys(_numDraws);
+	Array<uint> _meshIds(_numDraws);
+	for (uint i = 0; i < _numDraws; ++i)
+	{
+		uint _mesh = rand() % _numMeshes;
+		uint _layer = (rand() % 10) == 0; // 10% of translucent
+		float _depth = rand() / (float)RAND_MAX;
+		_meshIds[i] = _mesh;
+		_keys[i] = RenderKey::Make(_layer, 0, _mesh % 32, (_mesh * 4) + rand() % 4, _mesh % 16, _depth, _layer != 0);
+	}
+
+	double _pushTime = 0, _sortTime = 0, _execTime = 0, _stdSortTime = 0;
+	RenderQueue::Stats _unsorted, _sorted;
+
+	for (uint _frame = 0; _frame < _numFrames; ++_frame)
+	{
+		double _st = GetTime();
+		_queue.Clear();
+		for (uint i = 0; i < _numDraws; ++i)
+			_queue.Push(_keys[i], &_meshes[_meshIds[i]], nullptr, IF_UShort, 0, PT_Triangles, 0, 0, 36);
+		double _pushed = GetTime();
+
+		if (_frame == 0)
+		{
+			_queue.Execute(nullptr);
+			_unsorted = _queue.GetStats();
+			_pushed = GetTime();
+		}
+
+		_queue.Sort();
+		double _sortedTime = GetTime();
+		_queue.Execute(nullptr); // headless
+		double _executed = GetTime();
+
+		Array<uint64> _copy = _keys;
+		double _stdSt = GetTime();
+		std::stable_sort(_copy.begin(), _copy.end());
+		_stdSortTime += GetTime() - _stdSt;
+
+		_pushTime += _pushed - _st;
+		_sortTime += _sortedTime - _pushed;
+		_execTime += _executed - _sortedTime;
+		_sorted = _queue.GetStats();
+	}
+
+	printf("%u draws: push %.3f ms, radix sort %.3f ms (std::stable_sort %.3f ms), execute %.3f ms\n", _numDraws, _pushTime / _numFrames, _sortTime / _numFrames, _stdSortTime / _numFrames, _execTime / _numFrames);
+	printf("state changes: submitted %u, issued %u unsorted, %u sorted\n", _sorted.submittedStates, _unsorted.issuedStates, _sorted.issuedStates);
+}
+
+void _TestJobs(void)
+{
+	const uint _numItems = 1000000;
+
+	Sandbox::JobManager _jobManager;
+	_jobManager.Startup();
+
+	Array<float> _items(_numItems, 1.0f);
+	AtomicInt _visible(0);
+
+	// culling -> skinning -> decode
+	double _st = GetTime();
+	Sandbox::JobPtr _culling = gJobManager->ParallelFor(0, _numItems, 4096, [&](uint _first, uint _last)
+	{
+		int _count = 0;
+		for (uint i = _first; i < _last; ++i)
+			_count += _items[i] > 0.5f;
+		_visible += _count;
+	});
+	Sandbox::JobPtr _skinning = gJobManager->ParallelFor(0, _numItems, 4096, [&](uint _first, uint _last)
+	{
+		for (uint i = _first; i < _last; ++i)
+			_items[i] = sqrtf(_items[i] * 2.0f);
+	});
+	Sandbox::JobPtr _decode = gJobManager->Create([&]()
+	{
+		printf("visible: %d\n", (int)_visible);
+	});
+
+	_culling->Then(_skinning);
+	_skinning->Then(_decode);
+	_decode->Submit();
+	_skinning->Submit();
+	_culling->Submit();
+	_decode->Wait();
+	double _dt = GetTime() - _st;
+	printf("job graph: %.3f ms\n", _dt);
+
+	_jobManager.Shutdown();
+}
+
+void _NullJob(void* _param)
+{
+}
+
+void _NullCallback(uint _index, void* _param)
+{
+}
+
+struct FanOutJob // binary tree of jobs. each job pushes its children from background thread
+{
+	ThreadJob job;
+	FanOutJob* tree;
+	uint index;
+	uint size;
+
+	static void Exec(void* _param)
+	{
+		FanOutJob* _self = reinterpret_cast<FanOutJob*>(_param);
+		for (uint i = _self->index * 2 + 1; i <= _self->index * 2 + 2 && i < _self->size; ++i)
+			gThreadPool->Push(&_self->tree[i].job);
+	}
+};
+
+struct PollingBarrier // barrier of previous ThreadPool (polling with Thread::Sleep(1))
+{
+	AtomicInt cmd;
+	AtomicInt cmdDone;
+	volatile bool stop;
+
+	static void Entry(PollingBarrier* _self)
+	{
+		int _cmd = 0;
+		while (!_self->stop)
+		{
+			if (_self->cmd != _cmd)
+			{
+				_cmd = _self->cmd;
+				++_self->cmdDone;
+			}
+			else
+				Thread::Sleep(1);
+		}
+	}
+};
+
+void _TestThreadPool(void)
+{
+	const uint _numJobs = 1000000;
+	const uint _numBarriers = 1000;
+
+	ThreadPoolPtr _pool = ThreadPool::Create();
+	uint _numThreads = _pool->GetNumThreads();
+	printf("%u background threads, %u cores\n", _numThreads, Thread::GetNumCores());
+
+	// throughput
+	{
+		Array<ThreadJob> _jobs(_numJobs);
+		AtomicInt _counter(0);
+		uint _stolen = _pool->GetNumStolenJobs();
+		double _st = GetTime();
+		for (uint i = 0; i < _numJobs; ++i)
+		{
+			_jobs[i].func = _NullJob;
+			_jobs[i].counter = &_counter;
+			_pool->Push(&_jobs[i]);
+		}
+		_pool->Wait(_counter);
+		double _dt = GetTime() - _st;
+		printf("jobs: %.0f jobs/s (%.3f mcs/job), %u stolen\n", (_numJobs / _dt) * 1000, (_dt * 1000) / _numJobs, _pool->GetNumStolenJobs() - _stolen);
+	}
+
+	// recursive fan-out. jobs are pushed to local queues of background threads and are distributed only by stealing
+	{
+		Array<FanOutJob> _jobs(_numJobs);
+		AtomicInt _counter(0);
+		for (uint i = 0; i < _numJobs; ++i)
+		{
+			_jobs[i].job.func = FanOutJob::Exec;
+			_jobs[i].job.param = &_jobs[i];
+			_jobs[i].job.counter = &_counter;
+			_jobs[i].tree = &_jobs[0];
+			_jobs[i].index = i;
+			_jobs[i].size = _numJobs;
+		}
+		uint _stolen = _pool->GetNumStolenJobs();
+		double _st = GetTime();
+		_pool->Push(&_jobs[0].job);
+		_pool->Wait(_counter);
+		double _dt = GetTime() - _st;
+		printf("fan-out: %.0f jobs/s (%.3f mcs/job), %u stolen\n", (_numJobs / _dt) * 1000, (_dt * 1000) / _numJobs, _pool->GetNumStolenJobs() - _stolen);
+	}
+
+	// barrier latency
+	{
+		double _st = GetTime();
+		for (uint i = 0; i < _numBarriers; ++i)
+			_pool->_ExecInEachThread(_NullCallback, nullptr);
+		double _dt = GetTime() - _st;
+		printf("barrier: %.3f mcs\n", (_dt * 1000) / _numBarriers);
+	}
+
+	// barrier latency of previous implementation
+	{
+		PollingBarrier _barrier;
+		_barrier.cmd = 0;
+		_barrier.cmdDone = 0;
+		_barrier.stop = false;
+		Array<Thread> _threads(_numThreads);
+		for (uint i = 0; i < _numThreads; ++i)
+			_threads[i] = Thread(PollingBarrier::Entry, &_barrier);
+
+		double _st = GetTime();
+		for (uint i = 0; i < _numBarriers; ++i)
+		{
+			_barrier.cmdDone = 0;
+			++_barrier.cmd;
+			while (_barrier.cmdDone < (int)_numThreads)
+				Thread::Sleep(1);
+		}
+		double _dt = GetTime() - _st;
+		printf("polling barrier: %.3f mcs\n", (_dt * 1000) / _numBarriers);
+
+		_barrier.stop = true;
+	}
+}
+
 int main(void)
 {
 	//Sandbox::_TestClosure();
@@ -776,6 +1183,9 @@ int main(void)
 	printf("sizeof(long) = %zd\n", sizeof(long));
 	printf("sizeof(size_t) = %zd\n", sizeof(size_t));
 	//_TestBatches();
+	//_TestRenderQueue();
+	//_TestThreadPool();
+	//_TestJobs();
 	RenderSystemPtr _rs = RenderSystem::Create(RST_GL, SM4, RSF_DebugOutput | RSF_GL_CoreProfile);
 	WindowSystemPtr _ws = WindowSystem::Create();
 	if (_rs && _ws)
@@ -132,6 +132,551 @@ protected:
 	}*/
 };
 
+/// Condition of #if for _PreprocessShaderReference.
+struct ShaderReferenceCondition
+{
+	const char* s;
+	const HashMap<String, String>* macros;
+
+	bool Match(const char* _op)
+	{
+		while (*s == ' ' || *s == '\t')
+			++s;
+		size_t _len = strlen(_op);
+		if (strncmp(s, _op, _len))
+			return false;
+		s += _len;
+		return true;
+	}
+	String Ident(void)
+	{
+		Match("");
+		const char* _start = s;
+		while (isalnum((uint8)*s) || *s == '_')
+			++s;
+		return String(_start, s);
+	}
+	int Primary(void)
+	{
+		if (Match("("))
+		{
+			int _val = Or();
+			Match(")");
+			return _val;
+		}
+		if (Match("!"))
+			return !Primary();
+		if (Match("-"))
+			return -Primary();
+		if (isdigit((uint8)*s))
+		{
+			char* _end;
+			int _val = (int)strtol(s, &_end, 0);
+			s = _end;
+			return _val;
+		}
+		String _name = Ident();
+		if (_name == "defined")
+		{
+			bool _paren = Match("(");
+			_name = Ident();
+			if (_paren)
+				Match(")");
+			return macros->find(_name) != macros->end();
+		}
+		auto _macro = macros->find(_name);
+		return _macro != macros->end() ? atoi(_macro->second.c_str()) : 0;
+	}
+	int Compare(void)
+	{
+		int _val = Primary();
+		for (;;)
+		{
+			if (Match("=="))
+				_val = _val == Primary();
+			else if (Match("!="))
+				_val = _val != Primary();
+			else if (Match("<="))
+				_val = _val <= Primary();
+			else if (Match(">="))
+				_val = _val >= Primary();
+			else if (Match("<"))
+				_val = _val < Primary();
+			else if (Match(">"))
+				_val = _val > Primary();
+			else
+				return _val;
+		}
+	}
+	int And(void)
+	{
+		int _val = Compare();
+		while (Match("&&"))
+			_val = Compare() && _val;
+		return _val;
+	}
+	int Or(void)
+	{
+		int _val = And();
+		while (Match("||"))
+			_val = And() || _val;
+		return _val;
+	}
+};
+
+/// Reference preprocessor for _TestShaderPreprocess. Evaluates all conditional blocks as compiler does and returns active lines without directives and comments.
+String _PreprocessShaderReference(const String& _text)
+{
+	String _spliced, _code, _result;
+	for (const char* s = _text.c_str(); *s; ++s)
+	{
+		if (s[0] == '\\' && s[1] == '\n')
+			++s;
+		else
+			_spliced += *s;
+	}
+	for (const char* s = _spliced.c_str(); *s; ++s)
+	{
+		if (s[0] == '/' && s[1] == '/')
+		{
+			while (s[1] && s[1] != '\n')
+				++s;
+		}
+		else if (s[0] == '/' && s[1] == '*')
+		{
+			for (s += 2; *s && (s[0] != '*' || s[1] != '/'); ++s);
+			if (!*s)
+				break;
+			++s;
+			_code += ' ';
+		}
+		else
+			_code += *s;
+	}
+
+	struct Block
+	{
+		bool parent;
+		bool taken;
+	};
+	Array<Block> _blocks;
+	HashMap<String, String> _macros;
+	bool _active = true;
+
+	Array<String> _lines;
+	StrSplit(_code, "\n", _lines);
+	for (const String& _str : _lines)
+	{
+		String _line = StrTrim(_str, " \t\r");
+		if (_line.empty())
+			continue;
+		if (_line[0] != '#')
+		{
+			if (_active)
+				_result += _line + "\n";
+			continue;
+		}
+
+		ShaderReferenceCondition _cond = { _line.c_str() + 1, &_macros };
+		String _dir = _cond.Ident();
+		if (_dir == "if" || _dir == "ifdef" || _dir == "ifndef")
+		{
+			Block _block = { _active, false };
+			if (_active)
+			{
+				if (_dir == "if")
+					_block.taken = _cond.Or() != 0;
+				else
+					_block.taken = (_macros.find(_cond.Ident()) != _macros.end()) == (_dir == "ifdef");
+				_active = _block.taken;
+			}
+			_blocks.push_back(_block);
+		}
+		else if (_dir == "elif")
+		{
+			Block& _block = _blocks.back();
+			_active = _block.parent && !_block.taken && _cond.Or() != 0;
+			_block.taken |= _active;
+		}
+		else if (_dir == "else")
+		{
+			_active = _blocks.back().parent && !_blocks.back().taken;
+			_blocks.back().taken = true;
+		}
+		else if (_dir == "endif")
+		{
+			_active = _blocks.back().parent;
+			_blocks.pop_back();
+		}
+		else if (_active && _dir == "define")
+		{
+			String _name = _cond.Ident();
+			_macros[_name] = StrTrim(_cond.s, " \t");
+		}
+		else if (_active && _dir == "undef")
+			_macros.erase(_cond.Ident());
+	}
+	return _result;
+}
+
+/// Compare pruned permutations of shader text with permutations which are left to compiler. \return number of mismatches.
+uint _CompareShaderPermutations(const String& _text, const Array<ShaderPermutation>& _items)
+{
+	ShaderCodePtr _pruned = new ShaderCode(String(_text));
+	ShaderCodePtr _full = new ShaderCode(String(_text), false);
+	uint _errors = 0;
+	for (const ShaderPermutation& i : _items)
+	{
+		const ShaderDefines& _defs = ShaderDefines::GetUnique(i.defs);
+		if (_PreprocessShaderReference(_pruned->Expand(i.type, _defs)->GetText()) != _PreprocessShaderReference(_full->Expand(i.type, _defs)->GetText()))
+			++_errors;
+	}
+	return _errors;
+}
+
+void _TestShaderPreprocess(void)
+{
+	const char* _flags[] = { "INSTANCE_", "SKINNED", "LIGHTMAP", "TEXGEN_OBJECT", "TEXGEN_REFLECT", "TEXGEN_SPHERE", "LOW_QUALITY", "HIGH_QUALITY" };
+	const uint _numFlags = sizeof(_flags) / sizeof(_flags[0]);
+
+	ShaderSourcePtr _src = gResourceCache->LoadResource<ShaderSource>("Shaders/test.glsl");
+	_src->Touch();
+
+	Array<ShaderPermutation> _items;
+	for (uint _type = ST_Vertex; _type <= ST_Fragment; ++_type)
+	{
+		for (uint i = 0; i < (1u << _numFlags); ++i)
+		{
+			ShaderDefines _defs;
+			for (uint j = 0; j < _numFlags; ++j)
+			{
+				if (i & (1 << j))
+					_defs.AddDef(_flags[j]);
+			}
+
+			ShaderPermutation _item;
+			_item.source = _src;
+			_item.type = (ShaderType)_type;
+			_item.defs = ShaderDefines::AddUnique(_defs);
+			_items.push_back(_item);
+		}
+	}
+
+	double _st;
+	uint _num;
+
+	ShaderSource::ClearPreprocessCache();
+	_st = TimeMs();
+	_num = ShaderSource::Preprocess(_items, 1);
+	LOG_INFO("Preprocess %u permutations, cold, 1 thread: %u expanded, %.2f ms", (uint)_items.size(), _num, TimeMs() - _st);
+
+	ShaderSource::ClearPreprocessCache();
+	_st = TimeMs();
+	_num = ShaderSource::Preprocess(_items);
+	LOG_INFO("Preprocess %u permutations, cold: %u expanded, %.2f ms", (uint)_items.size(), _num, TimeMs() - _st);
+
+	_st = TimeMs();
+	_num = ShaderSource::Preprocess(_items);
+	LOG_INFO("Preprocess %u permutations, warm: %u expanded, %.2f ms", (uint)_items.size(), _num, TimeMs() - _st);
+
+	size_t _size = 0;
+	for (const ShaderPermutation& i : _items)
+		_size += i.code->GetText().length();
+	LOG_INFO("Source %u bytes, permutation %u bytes on average", (uint)_src->GetSource().length(), (uint)(_size / _items.size()));
+
+	// compiler must see the same text in pruned permutations and in permutations with all conditions left to it
+	const char* _text =
+		"#define LOCAL 1\n"
+		"#if defined(SKINNED) /* comment */ && defined(LIGHTMAP)\n"
+		"skinned_lightmap\n"
+		"#elif LOCAL // comment\n"
+		"local\n"
+		"#endif\n"
+		"#ifdef INSTANCE_ /* a */ /* b */\n"
+		"instance\n"
+		"#endif\n"
+		"#if defined(LOW_QUALITY) /* comment\n"
+		" on two lines */ || defined(HIGH_QUALITY)\n"
+		"quality\n"
+		"#endif\n"
+		"#if defined(TEXGEN_OBJECT) \\\n"
+		" && !defined(TEXGEN_SPHERE) /**/\n"
+		"texgen\n"
+		"#else\n"
+		"no_texgen\n"
+		"#endif\n";
+	uint _errors = _CompareShaderPermutations(_src->GetSource(), _items) + _CompareShaderPermutations(_text, _items);
+	LOG_INFO("Compare %u permutations with permutations left to compiler: %u mismatches", (uint)_items.size() * 2, _errors);
+}
+
+void _TestShaderCache(void)
+{
+	const uint _numItems = 2000;
+	const uint _itemSize = 100 * 1024; // ~200 mb
+	const uint _driverId = 1;
+
+	String _name = gFileSystem->GetWriteDir() + "Cache/ShaderCache_Test.bin";
+	remove(_name.c_str());
+
+	Array<uint8> _data(_itemSize);
+	for (uint i = 0; i < _itemSize; ++i)
+		_data[i] = (uint8)(i * 7);
+
+	double _st;
+	ShaderCache::Item _item;
+	ShaderCache _cache;
+
+	_cache.Open(_name, SL_GLSL, _driverId);
+	for (uint i = 0; i < _numItems; ++i)
+		_cache.Set(i, i, 0, _itemSize, &_data[0]);
+	_st = TimeMs();
+	_cache.Save();
+	LOG_INFO("ShaderCache: write %u items, %.2f ms", _numItems, TimeMs() - _st);
+	_cache.Close();
+
+	_st = TimeMs();
+	_cache.Open(_name, SL_GLSL, _driverId);
+	LOG_INFO("ShaderCache: open %u bytes, %.2f ms", _cache.GetSize(), TimeMs() - _st);
+
+	_st = TimeMs();
+	uint _found = 0;
+	for (uint i = 0; i < _numItems; i += 100)
+		_found += _cache.Get(i, i, _item);
+	LOG_INFO("ShaderCache: get %u items, %.2f ms", _found, TimeMs() - _st);
+
+	for (uint i = 0; i < 10; ++i)
+		_cache.Set(_numItems + i, 0, 0, _itemSize, &_data[0]);
+	_st = TimeMs();
+	_cache.Save();
+	LOG_INFO("ShaderCache: append 10 items, %.2f ms", TimeMs() - _st);
+	_cache.Close();
+
+	_st = TimeMs();
+	File _f = gFileSystem->ReadFile(_name);
+	Array<uint8> _all(_f.Size());
+	_f.Read(&_all[0], _f.Size());
+	LOG_INFO("ShaderCache: read whole file, %.2f ms", TimeMs() - _st);
+}
+
+Array<uint8> _ReadWholeFile(const String& _name)
+{
+	File _f = gFileSystem->ReadFile(_name);
+	Array<uint8> _data(_f.Size());
+	if (!_data.empty())
+		_f.Read(&_data[0], (uint)_data.size());
+	return _data;
+}
+
+void _WriteWholeFile(const String& _name, const Array<uint8>& _data)
+{
+	File _f = gFileSystem->WriteFile(_name);
+	if (!_data.empty())
+		_f.Write(&_data[0], (uint)_data.size());
+}
+
+/// Damage cache file in different ways and check that damaged data isn't used and cache is rebuilt by next Save.
+void _TestShaderCacheCorruption(void)
+{
+	const uint _numItems = 20;
+	const uint _itemSize = 1000;
+	const uint _driverId = 1;
+
+	String _name = gFileSystem->GetWriteDir() + "Cache/ShaderCache_Corrupted.bin";
+	remove(_name.c_str());
+
+	Array<uint8> _data[_numItems];
+	for (uint i = 0; i < _numItems; ++i)
+	{
+		uint _seed = i + 1;
+		_data[i].resize(_itemSize);
+		for (uint j = 0; j < _itemSize; ++j)
+		{
+			_seed = _seed * 1664525 + 1013904223;
+			_data[i][j] = (uint8)(_seed >> 24);
+		}
+	}
+
+	ShaderCache _cache;
+	ShaderCache::Item _item;
+	uint _errors = 0;
+
+	// 0: flipped byte of item, 1: flipped byte of tag, 2: flipped byte of index, 3: truncated file
+	for (uint _case = 0; _case < 4; ++_case)
+	{
+		_cache.Open(_name, SL_GLSL, _driverId);
+		for (uint i = 0; i < _numItems; ++i)
+			_cache.Set(i, i, 0, _itemSize, &_data[i][0]);
+		_cache.Save();
+		_cache.Close();
+
+		Array<uint8> _file = _ReadWholeFile(_name);
+		const uint _damaged = 5;
+		if (_case == 0)
+			std::search(_file.begin(), _file.end(), _data[_damaged].begin(), _data[_damaged].end())[_itemSize / 2] ^= 0x10;
+		else if (_case == 1)
+			_file[0] ^= 0x10;
+		else if (_case == 2)
+			_file[_file.size() - 40] ^= 0x10; // index is at end of file
+		else
+			_file.resize(_file.size() / 2);
+		_WriteWholeFile(_name, _file);
+
+		// damaged item or whole cache is dropped, other items are intact
+		bool _opened = _cache.Open(_name, SL_GLSL, _driverId);
+		if (_opened != (_case == 0))
+			++_errors;
+		for (uint i = 0; i < _numItems; ++i)
+		{
+			bool _found = _cache.Get(i, i, _item);
+			if (_found != (_case == 0 && i != _damaged) || (_found && memcmp(_item.data, &_data[i][0], _itemSize)))
+				++_errors;
+		}
+
+		// missed items are compiled again
+		for (uint i = 0; i < _numItems; ++i)
+		{
+			if (!_cache.Get(i, i, _item))
+				_cache.Set(i, i, 0, _itemSize, &_data[i][0]);
+		}
+		_cache.Save();
+		_cache.Close();
+
+		_cache.Open(_name, SL_GLSL, _driverId);
+		if (_cache.GetNumItems() != _numItems)
+			++_errors;
+		for (uint i = 0; i < _numItems; ++i)
+		{
+			if (!_cache.Get(i, i, _item) || _item.size != _itemSize || memcmp(_item.data, &_data[i][0], _itemSize))
+				++_errors;
+		}
+		_cache.Close();
+		remove(_name.c_str());
+	}
+
+	LOG_INFO("ShaderCache: corruption test, %u errors", _errors);
+}
+
+void _TestFrustumCulling(void)
+{
+	const uint _count = 100000;
+	const uint _numQueries = 100;
+
+	Mat34 _view;
+	_view.CreateTransform(Vec3::Zero, Quat::Identity);
+	Mat44 _proj;
+	_proj.CreatePerspective(60, 1.5f, 0.1f, 400);
+	Frustum _frustum;
+	_frustum.FromCameraMatrices(_view, _proj);
+
+	Array<float> _data(_count * 6);
+	AlignedBoxSoA _boxes;
+	_boxes.mnx = &_data[0];
+	_boxes.mny = &_data[_count];
+	_boxes.mnz = &_data[_count * 2];
+	_boxes.mxx = &_data[_count * 3];
+	_boxes.mxy = &_data[_count * 4];
+	_boxes.mxz = &_data[_count * 5];
+	_boxes.count = _count;
+	for (uint i = 0; i < _count; ++i)
+	{
+		Vec3 _center(rand() % 1000 - 500.f, rand() % 100 - 50.f, rand() % 1000 - 500.f);
+		Vec3 _extends(rand() % 3 + 0.5f, rand() % 3 + 0.5f, rand() % 3 + 0.5f);
+		for (uint j = 0; j < 3; ++j)
+		{
+			_data[_count * j + i] = _center[j] - _extends[j];
+			_data[_count * (j + 3) + i] = _center[j] + _extends[j];
+		}
+	}
+
+	Array<uint32_t> _scalar((_count + 31) / 32), _simd((_count + 31) / 32);
+
+	double _st = TimeMs();
+	for (uint q = 0; q < _numQueries; ++q)
+		_frustum.CullBoxes(_boxes, &_scalar[0], false);
+	double _scalarTime = (TimeMs() - _st) / _numQueries;
+
+	_st = TimeMs();
+	for (uint q = 0; q < _numQueries; ++q)
+		_frustum.CullBoxes(_boxes, &_simd[0], true);
+	double _simdTime = (TimeMs() - _st) / _numQueries;
+
+	uint _visible = 0;
+	for (uint i = 0; i < _count; ++i)
+		_visible += (_scalar[i >> 5] >> (i & 31)) & 1;
+
+	LOG_INFO("Frustum culling: %u boxes (%u visible), scalar %.3f ms, simd %.3f ms (%.1fx), %s", _count, _visible, _scalarTime, _simdTime, _scalarTime / _simdTime, _scalar == _simd ? "results are equal" : "RESULTS ARE DIFFERENT");
+
+	// compare with Frustum::Intersects, which tests bounding sphere of box and bounding box of frustum instead of planes
+
+	uint _bySphere = 0, _byBox = 0, _errors = 0;
+	for (uint i = 0; i < _count; ++i)
+	{
+		AlignedBox _box(Vec3(_boxes.mnx[i], _boxes.mny[i], _boxes.mnz[i]), Vec3(_boxes.mxx[i], _boxes.mxy[i], _boxes.mxz[i]));
+		bool _visible = ((_simd[i >> 5] >> (i & 31)) & 1) != 0;
+		if (_visible == _frustum.Intersects(_box))
+			continue;
+
+		if (_visible) // planes don't cull box near edge of frustum, but it's outside of bounding box of frustum
+		{
+			++_byBox;
+			if (_frustum.box.Intersects(_box))
+				++_errors;
+		}
+		else // bounding sphere isn't culled, but box is completely behind one of planes
+		{
+			++_bySphere;
+			Vec3 _corners[8];
+			_box.GetAllCorners(_corners);
+			bool _behind = false;
+			for (uint p = 0; p < 6 && !_behind; ++p)
+			{
+				uint _out = 0;
+				for (uint c = 0; c < 8; ++c)
+					_out += _frustum.planes[p].Distance(_corners[c]) < 0;
+				_behind = _out == 8;
+			}
+			if (!_behind)
+				++_errors;
+		}
+	}
+	LOG_INFO("Frustum::Intersects: %u more visible by bounding sphere, %u less visible by bounding box of frustum, %s", _bySphere, _byBox, _errors ? "RESULTS ARE DIFFERENT" : "other results are equal");
+}
+
+void _TestTransforms(void)
+{
+	const uint _numNodes = 1000000;
+	const uint _numFrames = 10;
+	const uint _threads[] = { 1, 4, 8 };
+
+	Scene _scene;
+	TransformStore& _transforms = _scene.GetTransforms();
+	Array<TransformHandle> _handles(_numNodes);
+
+	double _st = TimeMs();
+	for (uint i = 0; i < _numNodes; ++i)
+		_handles[i] = _transforms.Add(i ? _handles[(i - 1) / 8] : INVALID_TRANSFORM); // 8 children per node
+	LOG_INFO("Transforms: add %u nodes, %u levels, %.2f ms", _numNodes, _transforms.GetNumLevels(), TimeMs() - _st);
+
+	for (uint _numThreads : _threads)
+	{
+		_st = TimeMs();
+		for (uint _frame = 0; _frame < _numFrames; ++_frame)
+		{
+			_transforms.SetRotation(_handles[0], Quat().FromAxisAngle(Vec3::UnitY, _frame * 0.1f)); // all nodes are changed
+			_scene.UpdateTransforms(_numThreads);
+		}
+		LOG_INFO("Transforms: update %u nodes, %u threads, %.2f ms", _numNodes, _numThreads, (TimeMs() - _st) / _numFrames);
+	}
+
+	_st = TimeMs();
+	_transforms.SetParent(_handles[_numNodes - 1], _handles[1]);
+	LOG_INFO("Transforms: move leaf to other level, %.4f ms", TimeMs() - _st);
+
+	_st = TimeMs();
+	_transforms.SetParent(_handles[1], _handles[_numNodes - 2]);
+	LOG_INFO("Transforms: move subtree of 1/8 nodes to other level, %.2f ms", TimeMs() - _st);
+}
+
 
 int main(void)
 {
@@ -158,24 +703,25 @@ int main(void)
 		gResourceCache->SetDeferredLoading(false);
 		ShaderSourcePtr _r = gResourceCache->LoadResource<ShaderSource>("Shaders/test.glsl");
 		gResourceCache->LoadQueuedResources();
+		//_TestShaderPreprocess();
+		//_TestShaderCache();
+		//_TestShaderCacheCorruption();
+		//_TestTransforms();
+		//_TestFrustumCulling();
 		
 		ShaderPtr _s = _r->CreateInstance(ST_Vertex);
 		_r = nullptr;
 		//_s = nullptr;
 		//gResourceCache->RemoveUnusedResources();
 
-		float _ft = 0;
+		gFileSystem->EnableWatching();
 		gDevice->SetVisible();
 		while (gDevice->IsOpened())
 		{
 			gSystem->BeginFrame();
 			gSystem->EndFrame();
-			_ft += gSystem->FrameTime();
-			if (_ft > 1000.0f)
-			{
-				_ft = 0;
-				gRenderContext->ReloadShaders();
-			}
+			gResourceCache->ReloadChangedResources();
+			gRenderContext->CompileShaders();
 		}
 
 		System::DestroyEngine();
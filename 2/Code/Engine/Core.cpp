@@ -11,6 +11,15 @@
 #else
 #	include <dirent.h>
 #endif
+#ifndef _WIN32
+#	include <sys/mman.h>
+#	include <fcntl.h>
+#	include <unistd.h>
+#endif
+#ifdef __linux__
+#	include <sys/inotify.h>
+#	include <errno.h>
+#endif
 
 namespace Engine
 {
@@ -204,6 +213,427 @@ namespace Engine
 	}
 	//----------------------------------------------------------------------------//
 
+	//----------------------------------------------------------------------------//
+	// MappedFile
+	//----------------------------------------------------------------------------//
+
+	//----------------------------------------------------------------------------//
+	MappedFile::MappedFile(void) :
+		m_data(nullptr),
+		m_size(0)
+	{
+	}
+	//----------------------------------------------------------------------------//
+	MappedFile::~MappedFile(void)
+	{
+		Close();
+	}
+	//----------------------------------------------------------------------------//
+	MappedFile::MappedFile(MappedFile&& _temp) :
+		m_name(_temp.m_name),
+		m_data(_temp.m_data),
+		m_size(_temp.m_size)
+	{
+		_temp.m_data = nullptr;
+		_temp.m_size = 0;
+	}
+	//----------------------------------------------------------------------------//
+	MappedFile& MappedFile::operator = (MappedFile&& _temp)
+	{
+		m_name = _temp.m_name;
+		std::swap(m_data, _temp.m_data);
+		std::swap(m_size, _temp.m_size);
+		return *this;
+	}
+	//----------------------------------------------------------------------------//
+	bool MappedFile::Open(const String& _path)
+	{
+		Close();
+
+#ifdef _WIN32
+		HANDLE _file = CreateFileA(_path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (_file == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER _size;
+		if (!GetFileSizeEx(_file, &_size) || _size.QuadPart <= 0 || _size.QuadPart > 0x7fffffff)
+		{
+			CloseHandle(_file);
+			return false;
+		}
+
+		HANDLE _mapping = CreateFileMappingA(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		CloseHandle(_file); // mapping holds the file
+		if (!_mapping)
+			return false;
+
+		void* _data = MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+		CloseHandle(_mapping); // view holds the mapping
+		if (!_data)
+			return false;
+
+		m_size = (uint)_size.QuadPart;
+#else
+		int _fd = open(_path.c_str(), O_RDONLY);
+		if (_fd < 0)
+			return false;
+
+		struct stat _st;
+		if (fstat(_fd, &_st) || !S_ISREG(_st.st_mode) || _st.st_size <= 0 || _st.st_size > 0x7fffffff)
+		{
+			close(_fd);
+			return false;
+		}
+
+		void* _data = mmap(nullptr, (size_t)_st.st_size, PROT_READ, MAP_PRIVATE, _fd, 0);
+		close(_fd); // mapping holds the file
+		if (_data == MAP_FAILED)
+			return false;
+
+		m_size = (uint)_st.st_size;
+#endif
+		m_data = reinterpret_cast<const uint8*>(_data);
+		m_name = _path;
+		return true;
+	}
+	//----------------------------------------------------------------------------//
+	void MappedFile::Close(void)
+	{
+		if (m_data)
+		{
+#ifdef _WIN32
+			UnmapViewOfFile(m_data);
+#else
+			munmap(const_cast<uint8*>(m_data), m_size);
+#endif
+			m_data = nullptr;
+			m_size = 0;
+		}
+	}
+	//----------------------------------------------------------------------------//
+
+	//----------------------------------------------------------------------------//
+	// FileWatcher
+	//----------------------------------------------------------------------------//
+
+#ifdef __linux__
+	const uint FileWatcherEvents = IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ONLYDIR;
+#endif
+
+	//----------------------------------------------------------------------------//
+	FileWatcher::FileWatcher(void) :
+		m_started(false),
+		m_fd(-1),
+		m_overflow(false),
+		m_stop(false),
+		m_scanInterval(500)
+	{
+	}
+	//----------------------------------------------------------------------------//
+	FileWatcher::~FileWatcher(void)
+	{
+		Stop();
+	}
+	//----------------------------------------------------------------------------//
+	void FileWatcher::Start(void)
+	{
+		if (m_started)
+			return;
+
+		m_started = true;
+		m_overflow = false;
+
+#ifdef __linux__
+		m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (m_fd >= 0)
+		{
+			bool _added = true;
+			for (uint i = 0; i < m_dirs.size() && _added; ++i)
+				_added = _AddWatch(m_dirs[i], false);
+			if (_added)
+			{
+				LOG_EVENT("Watching of %u directories is started (inotify)", (uint)m_watches.size());
+				return;
+			}
+		}
+		else
+			LOG_WARNING("inotify is not available (%s)", strerror(errno));
+#endif
+
+		_StartPolling();
+	}
+	//----------------------------------------------------------------------------//
+	void FileWatcher::Stop(void)
+	{
+		if (!m_started)
+			return;
+
+		m_started = false;
+		m_stop = true;
+		if (m_thread.joinable())
+			m_thread.join();
+		m_stop = false;
+
+#ifdef __linux__
+		if (m_fd >= 0)
+			close(m_fd);
+#endif
+		m_fd = -1;
+		m_watches.clear();
+
+		std::lock_guard<std::mutex> _lock(m_mutex);
+		m_changes.clear();
+	}
+	//----------------------------------------------------------------------------//
+	void FileWatcher::AddDir(const String& _path)
+	{
+		String _dir = MakeFullPath(_path);
+		while (_dir.length() > 1 && _dir.back() == '/')
+			_dir.pop_back();
+
+		{
+			std::lock_guard<std::mutex> _lock(m_mutex);
+			for (const String& i : m_dirs)
+			{
+				if (StrCompare(i.c_str(), _dir.c_str(), true) == 0)
+					return;
+			}
+			m_dirs.push_back(_dir);
+		}
+
+		if (m_fd >= 0 && !_AddWatch(_dir, false))
+			_StartPolling();
+	}
+	//----------------------------------------------------------------------------//
+	bool FileWatcher::GetChanges(Array<String>& _files, double _delay)
+	{
+		_files.clear();
+
+		if (m_fd >= 0)
+			_ReadEvents();
+
+		double _time = TimeMs();
+		std::lock_guard<std::mutex> _lock(m_mutex);
+		for (auto i = m_changes.begin(); i != m_changes.end();)
+		{
+			if (_time - i->second >= _delay)
+			{
+				_files.push_back(i->first);
+				i = m_changes.erase(i);
+			}
+			else
+				++i;
+		}
+
+		bool _overflow = m_overflow;
+		m_overflow = false;
+		return !_overflow;
+	}
+	//----------------------------------------------------------------------------//
+	void FileWatcher::_ReadDir(const String& _path, Array<String>* _files, Array<String>* _dirs)
+	{
+#ifdef _MSC_VER
+		_finddata_t _fd;
+		intptr_t _h = _findfirst((_path + "/*").c_str(), &_fd);
+		if (_h != -1)
+		{
+			do
+			{
+				if (_fd.attrib & _A_SUBDIR)
+				{
+					if (_dirs && strcmp(_fd.name, ".") && strcmp(_fd.name, ".."))
+						_dirs->push_back(_path + "/" + _fd.name);
+				}
+				else if (_files)
+					_files->push_back(_path + "/" + _fd.name);
+
+			} while (!_findnext(_h, &_fd));
+			_findclose(_h);
+		}
+#else
+		DIR* _dir = opendir(_path.c_str());
+		if (_dir)
+		{
+			struct stat _st;
+			while (dirent* _e = readdir(_dir))
+			{
+				if (!strcmp(_e->d_name, ".") || !strcmp(_e->d_name, ".."))
+					continue;
+
+				String _name = _path + "/" + _e->d_name;
+				bool _isDir = _e->d_type == DT_DIR;
+				if (_e->d_type == DT_UNKNOWN || _e->d_type == DT_LNK)
+					_isDir = !stat(_name.c_str(), &_st) && (_st.st_mode & _S_IFDIR);
+
+				if (_isDir)
+				{
+					if (_dirs)
+						_dirs->push_back(_name);
+				}
+				else if (_files)
+					_files->push_back(_name);
+			}
+			closedir(_dir);
+		}
+#endif
+	}
+	//----------------------------------------------------------------------------//
+	void FileWatcher::_ScanDir(const String& _path, FileInfoMap& _files)
+	{
+		Array<String> _names, _dirs;
+		_ReadDir(_path, &_names, &_dirs);
+
+		struct stat _st;
+		for (const String& i : _names)
+		{
+			if (!stat(i.c_str(), &_st))
+			{
+				FileInfo& _info = _files[i];
+				_info.time = _st.st_mtime;
+				_info.size = (uint)_st.st_size;
+			}
+		}
+
+		for (const String& i : _dirs)
+			_ScanDir(i, _files);
+	}
+	//----------------------------------------------------------------------------//
+	void FileWatcher::_AddChange(const String& _path)
+	{
+		std::lock_guard<std::mutex> _lock(m_mutex);
+		m_changes[_path] = TimeMs();
+	}
+	//----------------------------------------------------------------------------//
+	bool FileWatcher::_AddWatch(const String& _path, bool _created)
+	{
+#ifdef __linux__
+		int _wd = inotify_add_watch(m_fd, _path.c_str(), FileWatcherEvents);
+		if (_wd < 0)
+		{
+			if (errno == ENOSPC) // limit of watches is reached
+			{
+				LOG_WARNING("Couldn't watch '%s': limit of inotify watches is reached", _path.c_str());
+				return false;
+			}
+			return true;
+		}
+		m_watches[_wd] = _path;
+
+		// files of new directory could be written before adding of watch
+		Array<String> _files, _dirs;
+		_ReadDir(_path, _created ? &_files : nullptr, &_dirs);
+		for (const String& i : _files)
+			_AddChange(i);
+		for (const String& i : _dirs)
+		{
+			if (!_AddWatch(i, _created))
+				return false;
+		}
+#endif
+		return true;
+	}
+	//----------------------------------------------------------------------------//
+	void FileWatcher::_ReadEvents(void)
+	{
+#ifdef __linux__
+		alignas(inotify_event) char _buf[4096];
+		while (m_fd >= 0)
+		{
+			ssize_t _size = read(m_fd, _buf, sizeof(_buf));
+			if (_size <= 0)
+				break;
+
+			for (char* _ptr = _buf; _ptr < _buf + _size;)
+			{
+				const inotify_event* _e = reinterpret_cast<const inotify_event*>(_ptr);
+				_ptr += sizeof(inotify_event) + _e->len;
+
+				if (_e->mask & IN_Q_OVERFLOW)
+				{
+					std::lock_guard<std::mutex> _lock(m_mutex);
+					m_overflow = true;
+					continue;
+				}
+				if (_e->mask & IN_IGNORED) // directory was removed
+				{
+					m_watches.erase(_e->wd);
+					continue;
+				}
+
+				auto _dir = m_watches.find(_e->wd);
+				if (_dir == m_watches.end() || !_e->len)
+					continue;
+
+				String _path = _dir->second + "/" + _e->name;
+				if (_e->mask & IN_ISDIR)
+				{
+					if (!_AddWatch(_path, true))
+					{
+						_StartPolling();
+						std::lock_guard<std::mutex> _lock(m_mutex);
+						m_overflow = true; // events of this buffer are dropped, first scan is reference
+						return;
+					}
+				}
+				else
+					_AddChange(_path);
+			}
+		}
+#endif
+	}
+	//----------------------------------------------------------------------------//
+	void FileWatcher::_StartPolling(void)
+	{
+		if (m_thread.joinable())
+			return;
+
+#ifdef __linux__
+		if (m_fd >= 0)
+			close(m_fd);
+#endif
+		m_fd = -1;
+		m_watches.clear();
+		m_stop = false;
+		m_thread = std::thread(&FileWatcher::_ScanThread, this);
+		LOG_EVENT("Watching of %u directories is started (polling, %u ms)", (uint)m_dirs.size(), (uint)m_scanInterval);
+	}
+	//----------------------------------------------------------------------------//
+	void FileWatcher::_ScanThread(void)
+	{
+		HashMap<String, FileInfoMap> _roots;
+		Array<String> _dirs;
+
+		while (!m_stop)
+		{
+			{
+				std::lock_guard<std::mutex> _lock(m_mutex);
+				_dirs = m_dirs;
+			}
+
+			for (const String& _dir : _dirs)
+			{
+				FileInfoMap _files;
+				_ScanDir(_dir, _files);
+
+				auto _root = _roots.find(_dir);
+				if (_root != _roots.end()) // first scan of directory is used as reference
+				{
+					for (const auto& i : _files)
+					{
+						auto _prev = _root->second.find(i.first);
+						if (_prev == _root->second.end() || _prev->second.time != i.second.time || _prev->second.size != i.second.size)
+							_AddChange(i.first);
+					}
+				}
+				_roots[_dir].swap(_files);
+			}
+
+			for (double _st = TimeMs(); !m_stop && TimeMs() - _st < m_scanInterval;)
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+	}
+	//----------------------------------------------------------------------------//
+
 	//----------------------------------------------------------------------------//
 	// FileSystem
 	//----------------------------------------------------------------------------//
@@ -249,6 +679,7 @@ namespace Engine
 		if (!stat(_fpath.c_str(), &_st) && (_st.st_mode & _S_IFDIR))
 		{
 			m_paths.push_front(_fpath + "/");
+			m_watcher.AddDir(_fpath);
 			return true;
 		}
 
@@ -337,6 +768,15 @@ namespace Engine
 		return File(_nname, _file, false);
 	}
 	//----------------------------------------------------------------------------//
+	MappedFile FileSystem::MapFile(const String& _name)
+	{
+		MappedFile _file;
+		String _path = FindFile(MakeFullPath(_name));
+		if (!_path.empty() && !_file.Open(_path))
+			LOG_ERROR("Couldn't map file '%s'", _name.c_str());
+		return _file;
+	}
+	//----------------------------------------------------------------------------//
 	bool FileSystem::CreateDir(const String& _path)
 	{
 		String _fpath = MakeFullPath(_path, m_rootDir);
@@ -348,6 +788,27 @@ namespace Engine
 		return true;
 	}
 	//----------------------------------------------------------------------------//
+	void FileSystem::GetRelativeNames(const String& _path, Array<String>& _names)
+	{
+		String _npath = MakeFullPath(_path);
+		_names.clear();
+		_names.push_back(_npath);
+
+		for (const String& _dir : m_paths)
+		{
+			if (_npath.length() > _dir.length() && StrCompare(_npath.substr(0, _dir.length()).c_str(), _dir.c_str(), true) == 0)
+				_names.push_back(_npath.substr(_dir.length()));
+		}
+	}
+	//----------------------------------------------------------------------------//
+	void FileSystem::EnableWatching(bool _enabled)
+	{
+		if (_enabled)
+			m_watcher.Start();
+		else
+			m_watcher.Stop();
+	}
+	//----------------------------------------------------------------------------//
 	bool FileSystem::_CreateDir(const String& _path)
 	{
 		struct stat _st;
@@ -825,10 +1286,12 @@ namespace Engine
 			m_resourceMgr->_RemoveRefs(this);
 	}
 	//----------------------------------------------------------------------------//
-	bool Resource::BeginReload(void)
+	bool Resource::BeginReload(bool _force)
 	{
 		if (m_resourceFlags & RF_Manually)
 			return false;
+		if (_force)
+			return true;
 
 		time_t _time = gFileSystem->FileTime(m_fileName);
 		return _time > m_fileTime;
@@ -976,6 +1439,7 @@ namespace Engine
 		_r = _Create(_name, _id, _flags);
 
 		m_resources[_id] = _r;
+		m_files[NameHash(MakeFullPath(_r->m_fileName))] = _r;
 		if (!(_flags & RF_Temp))
 			m_cache[_id] = _r;
 
@@ -1037,6 +1501,44 @@ namespace Engine
 	}
 	//----------------------------------------------------------------------------//
 	uint ResourceManager::ReloadResources(bool _wait)
+	{
+		Array<Resource*> _resources;
+		_resources.reserve(m_resources.size());
+		for (auto& i : m_resources)
+			_resources.push_back(i.second);
+
+		return _Reload(_resources, false, _wait);
+	}
+	//----------------------------------------------------------------------------//
+	uint ResourceManager::ReloadResources(const Array<Resource*>& _resources, bool _wait)
+	{
+		return _Reload(_resources, true, _wait);
+	}
+	//----------------------------------------------------------------------------//
+	void ResourceManager::AddResourceForReload(Resource* _r)
+	{
+		if (_r && m_reloading > 0)
+		{
+			m_resourcesToReload.insert(_r);
+		}
+	}
+	//----------------------------------------------------------------------------//
+	Resource* ResourceManager::FindResourceByFile(const String& _name)
+	{
+		auto _it = m_files.find(NameHash(MakeFullPath(_name)));
+		return _it != m_files.end() ? _it->second : nullptr;
+	}
+	//----------------------------------------------------------------------------//
+	void ResourceManager::_RemoveRefs(Resource* _r)
+	{
+		m_resources.erase(_r->m_id);
+
+		auto _file = m_files.find(NameHash(MakeFullPath(_r->m_fileName)));
+		if (_file != m_files.end() && _file->second == _r)
+			m_files.erase(_file);
+	}
+	//----------------------------------------------------------------------------//
+	uint ResourceManager::_Reload(const Array<Resource*>& _resources, bool _force, bool _wait)
 	{
 		uint _flags = RLF_ForceReload | (_wait ? RLF_Wait : RLF_Async);
 		uint _num = 0;
@@ -1049,10 +1551,10 @@ namespace Engine
 		}
 
 		// get resources for reloading
-		for (auto& i : m_resources)
+		for (Resource* i : _resources)
 		{
-			if (!i.second->IsQueued() && i.second->BeginReload())
-				m_resourcesToReload.insert(i.second);
+			if (!i->IsQueued() && i->BeginReload(_force))
+				m_resourcesToReload.insert(i);
 		}
 
 		// reload resources
@@ -1079,19 +1581,6 @@ namespace Engine
 		return _num;
 	}
 	//----------------------------------------------------------------------------//
-	void ResourceManager::AddResourceForReload(Resource* _r)
-	{
-		if (_r && m_reloading > 0)
-		{
-			m_resourcesToReload.insert(_r);
-		}
-	}
-	//----------------------------------------------------------------------------//
-	void ResourceManager::_RemoveRefs(Resource* _r)
-	{
-		m_resources.erase(_r->m_id);
-	}
-	//----------------------------------------------------------------------------//
 	void ResourceManager::_RemoveAllResources(void)
 	{
 		for (auto i : m_resources)
@@ -1101,6 +1590,7 @@ namespace Engine
 		}
 
 		m_resources.clear();
+		m_files.clear();
 		m_cache.clear();
 	}
 	//----------------------------------------------------------------------------//
@@ -1246,6 +1736,49 @@ namespace Engine
 			_mgr->ReloadResources(!m_deferredLoading);
 	}
 	//----------------------------------------------------------------------------//
+	uint ResourceCache::ReloadChangedResources(void)
+	{
+		if (!gFileSystem->IsWatching())
+			return 0;
+
+		Array<String> _files;
+		if (!gFileSystem->GetChangedFiles(_files))
+		{
+			LOG_WARNING("Some changes of files were lost, check all resources");
+			uint _num = 0;
+			for (auto i : m_managers)
+				_num += i.second->ReloadResources(!m_deferredLoading);
+			return _num;
+		}
+
+		if (_files.empty())
+			return 0;
+
+		HashMap<ResourceManager*, Array<Resource*>> _changed;
+		Array<String> _names;
+		for (const String& _file : _files)
+		{
+			gFileSystem->GetRelativeNames(_file, _names);
+			for (auto& _mgr : m_managers)
+			{
+				for (const String& _name : _names)
+				{
+					Resource* _r = _mgr.second->FindResourceByFile(_name);
+					if (_r)
+					{
+						_changed[_mgr.second].push_back(_r);
+						break;
+					}
+				}
+			}
+		}
+
+		uint _num = 0;
+		for (auto& i : _changed)
+			_num += i.first->ReloadResources(i.second, !m_deferredLoading);
+		return _num;
+	}
+	//----------------------------------------------------------------------------//
 	void ResourceCache::_Signal(Resource* _r)
 	{
 		//m_mutex.Lock();
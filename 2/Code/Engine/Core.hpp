@@ -1,6 +1,8 @@
 #pragma once
 
 #include "Lib.hpp"
+#include <thread>
+#include <mutex>
 
 namespace Engine
 {
@@ -263,6 +265,90 @@ namespace Engine
 		bool m_readOnly;
 	};
 
+	//----------------------------------------------------------------------------//
+	// MappedFile
+	//----------------------------------------------------------------------------//
+
+	/// Read-only file mapped into memory. Pages are read by the OS on first access.
+	class MappedFile : public NonCopyable
+	{
+	public:
+		MappedFile(void);
+		~MappedFile(void);
+		MappedFile(MappedFile&& _temp);
+		MappedFile& operator = (MappedFile&& _temp);
+
+		operator bool(void) const { return m_data != nullptr; }
+		const String& Name(void) { return m_name; }
+		const uint8* Data(void) const { return m_data; }
+		uint Size(void) const { return m_size; }
+
+		/// Map whole file. \return false if file not exists, is empty or couldn't be mapped.
+		bool Open(const String& _path);
+		void Close(void);
+
+	protected:
+		String m_name;
+		const uint8* m_data;
+		uint m_size;
+	};
+
+	//----------------------------------------------------------------------------//
+	// FileWatcher
+	//----------------------------------------------------------------------------//
+
+	/// Watcher of changes of files in directories and all subdirectories.
+	/// Uses inotify on Linux. Otherwise (or if inotify is not available) directories are scanned in background thread.
+	class FileWatcher : public NonCopyable
+	{
+	public:
+		FileWatcher(void);
+		~FileWatcher(void);
+
+		void Start(void);
+		void Stop(void);
+		bool IsStarted(void) { return m_started; }
+		/// \return true if changes are received from OS.
+		bool IsNative(void) { return m_fd >= 0; }
+		/// Add directory with all subdirectories to watching.
+		void AddDir(const String& _path);
+		/// Get full names of changed files. A burst of events for one file is reported once, after _delay ms without new events.
+		///\return false if some events were lost and all files should be checked.
+		bool GetChanges(Array<String>& _files, double _delay = 100);
+
+		/// Interval of scanning in polling mode.
+		void SetScanInterval(uint _ms) { m_scanInterval = _ms; }
+
+	protected:
+		struct FileInfo
+		{
+			time_t time;
+			uint size;
+		};
+		typedef HashMap<String, FileInfo> FileInfoMap;
+
+		static void _ReadDir(const String& _path, Array<String>* _files, Array<String>* _dirs);
+		static void _ScanDir(const String& _path, FileInfoMap& _files);
+		void _AddChange(const String& _path);
+		/// Watch directory and all subdirectories. \return false if limit of inotify watches is reached.
+		bool _AddWatch(const String& _path, bool _created);
+		void _ReadEvents(void);
+		/// Close inotify descriptor and start scanning thread. Does nothing if thread is already started.
+		void _StartPolling(void);
+		void _ScanThread(void);
+
+		bool m_started;
+		int m_fd; //!< inotify descriptor, -1 in polling mode
+		HashMap<int, String> m_watches; //!< inotify watch descriptor -> directory
+		Array<String> m_dirs;
+		std::mutex m_mutex;
+		HashMap<String, double> m_changes; //!< changed file -> time of last event
+		bool m_overflow;
+		std::thread m_thread;
+		Atomic<bool> m_stop;
+		Atomic<uint> m_scanInterval;
+	};
+
 	//----------------------------------------------------------------------------//
 	// FileSystem
 	//----------------------------------------------------------------------------//
@@ -283,7 +369,16 @@ namespace Engine
 		time_t FileTime(const String& _path);
 		File ReadFile(const String& _name);
 		File WriteFile(const String& _name, bool _overwrite = true);
+		MappedFile MapFile(const String& _name);
 		bool CreateDir(const String& _path);
+		/// Get names of full path relative to each search path which contains it.
+		void GetRelativeNames(const String& _path, Array<String>& _names);
+
+		/// Enable watching of changes in all search paths.
+		void EnableWatching(bool _enabled = true);
+		bool IsWatching(void) { return m_watcher.IsStarted(); }
+		/// Get full names of changed files in search paths. \return false if some changes were lost. \see FileWatcher::GetChanges
+		bool GetChangedFiles(Array<String>& _files) { return m_watcher.GetChanges(_files); }
 
 	protected:
 
@@ -295,6 +390,7 @@ namespace Engine
 		String m_rootDir;
 		String m_writeDir; 
 		List<String> m_paths;
+		FileWatcher m_watcher;
 
 		static FileSystem s_instance;
 	};
@@ -437,7 +533,8 @@ namespace Engine
 		bool IsLoaded(void) { return m_resourceState == RS_Loaded; }
 		bool IsQueued(void) { return m_resourceState == RS_Queued; }
 
-		virtual bool BeginReload(void);
+		/// Check a file of resource before reloading. \return true if resource should be reloaded.
+		virtual bool BeginReload(bool _force = false);
 		virtual void Load(uint _flags = 0);
 		virtual bool Touch(bool _wait = true);
 
@@ -484,8 +581,13 @@ namespace Engine
 		Resource* AddResource(const String& _name, uint _flags = 0);
 		virtual void RemoveResource(Resource* _r, bool _unqueue = true);
 		virtual uint RemoveUnusedResources(void);
+		/// Reload all resources which files were changed. Time of each file is checked.
 		virtual uint ReloadResources(bool _wait = true);
+		/// Reload given resources and resources which depend on them.
+		virtual uint ReloadResources(const Array<Resource*>& _resources, bool _wait = true);
 		virtual void AddResourceForReload(Resource* _r);
+		/// Find resource by name of file.
+		Resource* FindResourceByFile(const String& _name);
 
 	protected:
 		friend class Resource;
@@ -493,6 +595,7 @@ namespace Engine
 
 		void _RemoveRefs(Resource* _r);
 		void _RemoveAllResources(void);
+		uint _Reload(const Array<Resource*>& _resources, bool _force, bool _wait);
 		virtual ResourcePtr	_Create(const String& _name, uint _id, uint _flags);
 		virtual ResourcePtr _Factory(void) = 0;
 		virtual void _BeginReloading(bool _wait) { }
@@ -502,6 +605,7 @@ namespace Engine
 		uint m_classID;
 		HashMap<uint, ResourcePtr> m_cache;
 		HashMap<uint, Resource*> m_resources; // all resources
+		HashMap<uint, Resource*> m_files; // NameHash(file name) -> resource
 		HashSet<ResourcePtr> m_resourcesToReload;
 		Atomic<uint> m_reloading;
 	};
@@ -563,6 +667,8 @@ namespace Engine
 
 		void ReloadAllResources(uint _type);
 		template <class T> void ReloadAllResources(void) { ReloadAllResources(T::StaticClassID()); }
+		/// Reload resources which files were changed (see FileSystem::EnableWatching). Call it once per frame.
+		uint ReloadChangedResources(void);
 
 		void EnableTracking(bool _enabled = true) { m_trackingEnabled = _enabled; }
 		bool IsTrackingEnabled(void) { return m_trackingEnabled; }
@@ -1,6 +1,8 @@
 #include "GraphicsCore.hpp"
 #include "GL/glLoad.h"
 #include <SDL.h>
+#include <thread>
+#include <algorithm>
 
 namespace Engine
 {
@@ -333,16 +335,16 @@ namespace Engine
 	const ShaderDefines& ShaderDefines::GetUnique(uint _id)
 	{
 		auto _exists = s_instances.find(_id);
-		if (_exists == s_instances.end())
+		if (_exists != s_instances.end())
 			return _exists->second;
 		return Empty;
 	}
 	//----------------------------------------------------------------------------//
 	
 	//----------------------------------------------------------------------------//
-	// ShaderResource
+	// ShaderCode
 	//----------------------------------------------------------------------------//
-	
+
 	const char* ShaderTypePrefix[] =
 	{
 		"VS", // ST_Vertex
@@ -350,27 +352,529 @@ namespace Engine
 		"GS", // ST_Geometry
 	};
 
+	/// Evaluator of conditions of preprocessor. Result is unknown if condition depends on macros which are not defined by ShaderDefines.
+	struct ShaderCondition
+	{
+		const char* s;
+		const char* e;
+		const ShaderDefines* defs;
+		const HashSet<String>* macros;
+		const char* typeDef;
+		bool known;
+
+		/// Skip spaces, line continuations and comments.
+		void Skip(void)
+		{
+			for (;;)
+			{
+				while (s < e && strchr(" \t\r\n\\", *s))
+					++s;
+
+				if (e - s < 2 || s[0] != '/' || (s[1] != '/' && s[1] != '*'))
+					return;
+
+				if (s[1] == '/') // to end of line
+				{
+					s = e;
+					return;
+				}
+
+				const char* _end = s + 2;
+				while (_end + 1 < e && (_end[0] != '*' || _end[1] != '/'))
+					++_end;
+				if (_end + 1 >= e) // condition is continued on next lines after end of comment
+				{
+					known = false;
+					s = e;
+					return;
+				}
+				s = _end + 2;
+			}
+		}
+		bool Match(const char* _op)
+		{
+			Skip();
+			size_t _len = strlen(_op);
+			if ((size_t)(e - s) >= _len && !strncmp(s, _op, _len))
+			{
+				s += _len;
+				return true;
+			}
+			return false;
+		}
+		bool Ident(String& _name)
+		{
+			Skip();
+			const char* _start = s;
+			while (s < e && (isalnum((uint8)*s) || *s == '_'))
+				++s;
+			if (_start == s || isdigit((uint8)*_start))
+			{
+				s = _start;
+				return false;
+			}
+			_name.assign(_start, s);
+			return true;
+		}
+		/// \return -1 if it's unknown
+		int Defined(const String& _name)
+		{
+			if (_name == typeDef)
+				return 1;
+			if (macros->find(_name) != macros->end())
+				return -1; // defined or undefined in text
+			if (defs->GetDefs().find(_name) != defs->GetDefs().end())
+				return 1;
+			if (!strncmp(_name.c_str(), "GL_", 3) || !strncmp(_name.c_str(), "__", 2))
+				return -1; // defined by compiler
+			return 0;
+		}
+		int Value(const String& _name)
+		{
+			auto _def = defs->GetDefs().find(_name);
+			if (_def != defs->GetDefs().end() && macros->find(_name) == macros->end())
+			{
+				const char* _str = _def->second.c_str();
+				char* _end = nullptr;
+				int _val = (int)strtol(_str, &_end, 0);
+				if (_end != _str && !*StrTrim(String(_end), " \t").c_str())
+					return _val;
+			}
+			known = false; // not a number or undefined identifier (error in GLSL)
+			return 0;
+		}
+		int Primary(void)
+		{
+			Skip();
+			if (Match("("))
+			{
+				int _val = Or();
+				if (!Match(")"))
+					known = false;
+				return _val;
+			}
+			if (s < e && isdigit((uint8)*s))
+			{
+				char* _end = nullptr;
+				int _val = (int)strtol(s, &_end, 0);
+				s = _end;
+				if (s < e && (*s == 'u' || *s == 'U'))
+					++s;
+				return _val;
+			}
+			String _name;
+			if (!Ident(_name))
+			{
+				known = false;
+				s = e;
+				return 0;
+			}
+			if (_name == "defined")
+			{
+				bool _paren = Match("(");
+				if (!Ident(_name) || (_paren && !Match(")")))
+				{
+					known = false;
+					return 0;
+				}
+				int _def = Defined(_name);
+				if (_def < 0)
+					known = false;
+				return _def > 0;
+			}
+			return Value(_name);
+		}
+		int Unary(void)
+		{
+			if (Match("!"))
+				return !Unary();
+			if (Match("-"))
+				return -Unary();
+			if (Match("+"))
+				return Unary();
+			return Primary();
+		}
+		int Compare(void)
+		{
+			int _val = Unary();
+			for (;;)
+			{
+				if (Match("=="))
+					_val = _val == Unary();
+				else if (Match("!="))
+					_val = _val != Unary();
+				else if (Match("<="))
+					_val = _val <= Unary();
+				else if (Match(">="))
+					_val = _val >= Unary();
+				else if (Match("<"))
+					_val = _val < Unary();
+				else if (Match(">"))
+					_val = _val > Unary();
+				else
+					return _val;
+			}
+		}
+		int And(void)
+		{
+			int _val = Compare();
+			while (Match("&&"))
+			{
+				int _rhs = Compare();
+				_val = _val && _rhs;
+			}
+			return _val;
+		}
+		int Or(void)
+		{
+			int _val = And();
+			while (Match("||"))
+			{
+				int _rhs = And();
+				_val = _val || _rhs;
+			}
+			return _val;
+		}
+	};
+
+	//----------------------------------------------------------------------------//
+	ShaderCode::ShaderCode(String&& _text, bool _scan) :
+		m_text(std::move(_text)),
+		m_checksum(_scan ? StrHash(m_text) : 0),
+		m_balanced(false)
+	{
+		if (_scan)
+			_Scan();
+	}
+	//----------------------------------------------------------------------------//
+	ShaderCodePtr ShaderCode::Expand(ShaderType _type, const ShaderDefines& _defs) const
+	{
+		String _text;
+		_text.reserve(m_text.length() + 1024);
+
+		_text += "#version 330\n#define COMPILE_";
+		_text += ShaderTypePrefix[_type];
+		_text += "\n";
+
+		/*if (!ogl_IsVersionGEQ(4, 1))
+		{
+			_text += "#extension GL_ARB_separate_shader_objects : enable\n";
+		}
+
+		if (!ogl_IsVersionGEQ(4, 4))
+		{
+			_text += "#extension GL_ARB_enhanced_layouts : enable\n";
+		}*/
+
+		for (const auto& i : _defs.GetDefs())
+		{
+			if (!i.first.empty())
+			{
+				_text += "#define ";
+				_text += i.first;
+				_text += " ";
+				_text += i.second;
+				_text += "\n";
+			}
+		}
+
+		if (!m_balanced) // leave it to compiler
+		{
+			_text += m_text;
+			return new ShaderCode(std::move(_text), false);
+		}
+
+		struct Block
+		{
+			bool parent; // parent block is active
+			bool taken; // one of branches was selected
+			bool verbatim; // branch with unknown condition was found, rest of block is passed to compiler
+		};
+
+		Array<Block> _blocks;
+		_blocks.reserve(16);
+		bool _active = true;
+		const char* _src = m_text.c_str();
+
+		for (const Line& _line : m_lines)
+		{
+			const char* _str = _src + _line.start;
+			bool _emit = _active;
+
+			switch (_line.type)
+			{
+			case LT_Line:
+				_emit = true;
+				break;
+
+			case LT_If:
+			case LT_Ifdef:
+			case LT_Ifndef:
+			{
+				Block _block = { _active, false, false };
+				if (_active)
+				{
+					int _r = _Eval(_line, _type, _defs);
+					if (_r < 0)
+					{
+						_block.verbatim = true;
+					}
+					else
+					{
+						_block.taken = _r > 0;
+						_active = _block.taken;
+						_emit = false;
+					}
+				}
+				_blocks.push_back(_block);
+			} break;
+
+			case LT_Elif:
+			{
+				Block& _block = _blocks.back();
+				if (_block.verbatim)
+				{
+					_active = _block.parent;
+					_emit = _active;
+				}
+				else if (!_block.parent || _block.taken)
+				{
+					_active = false;
+					_emit = false;
+				}
+				else
+				{
+					int _r = _Eval(_line, _type, _defs);
+					if (_r < 0) // all previous branches are removed, so this branch begins the block
+					{
+						_block.verbatim = true;
+						_active = true;
+						_emit = false;
+						_text += "#if ";
+						_text.append(_str + _line.args, _line.length - _line.args);
+						continue;
+					}
+					_block.taken = _r > 0;
+					_active = _block.taken;
+					_emit = false;
+				}
+			} break;
+
+			case LT_Else:
+			{
+				Block& _block = _blocks.back();
+				if (_block.verbatim)
+				{
+					_active = _block.parent;
+					_emit = _active;
+				}
+				else
+				{
+					_active = _block.parent && !_block.taken;
+					_block.taken = true;
+					_emit = false;
+				}
+			} break;
+
+			case LT_Endif:
+			{
+				_emit = _blocks.back().verbatim && _blocks.back().parent;
+				_active = _blocks.back().parent;
+				_blocks.pop_back();
+			} break;
+
+			default:
+				break;
+			}
+
+			if (_emit)
+				_text.append(_str, _line.length);
+			else
+				_text.append(_line.breaks, '\n'); // keep numbers of lines
+		}
+
+		return new ShaderCode(std::move(_text), false);
+	}
+	//----------------------------------------------------------------------------//
+	void ShaderCode::_Scan(void)
+	{
+		const char* _text = m_text.c_str();
+		const char* s = _text;
+		bool _comment = false; // in multiline comment
+		int _depth = 0;
+
+		m_balanced = true;
+		m_lines.reserve(m_text.length() / 32);
+
+		while (*s)
+		{
+			Line _line;
+			_line.start = (uint)(s - _text);
+			_line.args = 0;
+			_line.breaks = 0;
+			_line.type = LT_Text;
+
+			const char* p = s;
+			if (!_comment)
+			{
+				while (*p == ' ' || *p == '\t')
+					++p;
+
+				if (*p == '#')	// preprocessor
+				{
+					++p;
+					while (*p == ' ' || *p == '\t')
+						++p;
+
+					const char* _kw = p;
+					while (isalpha((uint8)*p))
+						++p;
+					String _dir(_kw, p);
+
+					if (_dir == "if")
+						_line.type = LT_If;
+					else if (_dir == "ifdef")
+						_line.type = LT_Ifdef;
+					else if (_dir == "ifndef")
+						_line.type = LT_Ifndef;
+					else if (_dir == "elif")
+						_line.type = LT_Elif;
+					else if (_dir == "else")
+						_line.type = LT_Else;
+					else if (_dir == "endif")
+						_line.type = LT_Endif;
+					else if (_dir == "line")
+						_line.type = LT_Line;
+
+					while (*p == ' ' || *p == '\t')
+						++p;
+
+					if (_dir == "define" || _dir == "undef")
+					{
+						const char* _name = p;
+						while (isalnum((uint8)*p) || *p == '_')
+							++p;
+						m_macros.insert(String(_name, p));
+					}
+
+					_line.args = (uint16)Min<size_t>(p - s, 0xffff);
+
+					if (_line.type >= LT_If && _line.type <= LT_Ifndef)
+						++_depth;
+					else if (_line.type >= LT_Elif && _line.type <= LT_Endif && _depth <= 0)
+						m_balanced = false;
+					else if (_line.type == LT_Endif)
+						--_depth;
+				}
+			}
+
+			// end of line
+			while (*p)
+			{
+				if (*p == '\n')
+				{
+					++_line.breaks;
+					const char* _end = p;
+					if (_end > s && _end[-1] == '\r')
+						--_end;
+					++p;
+					if (_end > s && _end[-1] == '\\') // line continuation
+						continue;
+					break;
+				}
+
+				if (_comment)
+				{
+					if (p[0] == '*' && p[1] == '/')
+					{
+						_comment = false;
+						++p;
+					}
+				}
+				else if (p[0] == '/' && p[1] == '*')
+				{
+					_comment = true;
+					++p;
+				}
+				else if (p[0] == '/' && p[1] == '/')
+				{
+					while (p[1] && p[1] != '\n')
+						++p;
+				}
+				++p;
+			}
+
+			_line.length = (uint)(p - s);
+			m_lines.push_back(_line);
+			s = p;
+		}
+
+		if (_depth != 0)
+			m_balanced = false;
+	}
+	//----------------------------------------------------------------------------//
+	int ShaderCode::_Eval(const Line& _line, ShaderType _type, const ShaderDefines& _defs) const
+	{
+		String _typeDef = String("COMPILE_") + ShaderTypePrefix[_type];
+
+		ShaderCondition _cond;
+		_cond.s = m_text.c_str() + _line.start + _line.args;
+		_cond.e = m_text.c_str() + _line.start + _line.length;
+		_cond.defs = &_defs;
+		_cond.macros = &m_macros;
+		_cond.typeDef = _typeDef.c_str();
+		_cond.known = true;
+
+		int _r;
+		if (_line.type == LT_Ifdef || _line.type == LT_Ifndef)
+		{
+			String _name;
+			if (!_cond.Ident(_name))
+				return -1;
+			_r = _cond.Defined(_name);
+			if (_r < 0)
+				return -1;
+			if (_line.type == LT_Ifndef)
+				_r = !_r;
+		}
+		else
+		{
+			_r = _cond.Or() != 0;
+		}
+
+		_cond.Skip();
+		return (_cond.known && _cond.s == _cond.e) ? _r : -1;
+	}
+	//----------------------------------------------------------------------------//
+
+	//----------------------------------------------------------------------------//
+	// ShaderSource
+	//----------------------------------------------------------------------------//
+
 	Array<String> ShaderSource::s_names;
 	HashMap<uint, uint16> ShaderSource::s_nameIndices;
+	HashMap<uint, HashMap<uint, ShaderCodePtr>> ShaderSource::s_cache;
 
 	//----------------------------------------------------------------------------//
 	ShaderSource::ShaderSource(void) :
 		m_nameId(0),
-		m_checksum(0),
 		m_processed(false),
-		m_loaded(false)
+		m_loaded(false),
+		m_scanned(false),
+		m_code(new ShaderCode("", false))
 	{
 
 	}
 	//----------------------------------------------------------------------------//
 	ShaderSource::~ShaderSource(void)
 	{
+		s_cache.erase(m_code->GetChecksum());
 		m_includes.clear();
 	}
 	//----------------------------------------------------------------------------//
-	bool ShaderSource::BeginReload(void)
+	bool ShaderSource::BeginReload(bool _force)
 	{
-		if (Resource::BeginReload())
+		if (Resource::BeginReload(_force))
 		{
 			m_loaded = false;
 			_Invalidate();
@@ -382,14 +886,13 @@ namespace Engine
 	ShaderPtr ShaderSource::CreateInstance(ShaderType _type, const ShaderDefines& _defs)
 	{
 		uint _defsId = ShaderDefines::AddUnique(_defs);
+		String _name = m_name + StrFormat("@%s@%08x", ShaderTypePrefix[_type], _defsId);
+		uint _uid = NameHash(_name);
 
-		auto _exists = m_instances.find(_defsId);
+		auto _exists = m_instances.find(_uid);
 		if (_exists != m_instances.end())
 			return _exists->second;
 
-		String _name = m_name + StrFormat("@%s@%08x", ShaderTypePrefix[_type], _defsId);
-		uint _uid = NameHash(_name);
-
 		Touch();
 
 		ShaderPtr _instance = new Shader(_type, this, _defsId, _name, _uid);
@@ -398,6 +901,92 @@ namespace Engine
 		return _instance;
 	}
 	//----------------------------------------------------------------------------//
+	ShaderCodePtr ShaderSource::Preprocess(ShaderType _type, uint _defs)
+	{
+		if (m_loaded)
+			_ProcessSource();
+
+		uint _key = Hash(&_type, sizeof(_type), _defs);
+		HashMap<uint, ShaderCodePtr>& _permutations = s_cache[m_code->GetChecksum()];
+		auto _exists = _permutations.find(_key);
+		if (_exists != _permutations.end() && _exists->second)
+			return _exists->second;
+
+		ShaderCodePtr _code = m_code->Expand(_type, ShaderDefines::GetUnique(_defs));
+		_permutations[_key] = _code;
+		return _code;
+	}
+	//----------------------------------------------------------------------------//
+	uint ShaderSource::Preprocess(Array<ShaderPermutation>& _items, uint _numThreads)
+	{
+		struct Job
+		{
+			ShaderPermutation* item;
+			ShaderCodePtr code;
+			const ShaderDefines* defs;
+			uint key;
+		};
+
+		Array<Job> _jobs, _duplicates;
+
+		// find in cache (main thread)
+		for (ShaderPermutation& i : _items)
+		{
+			i.code = nullptr;
+			if (!i.source)
+				continue;
+
+			if (i.source->m_loaded)
+				i.source->_ProcessSource();
+
+			Job _job = { &i, i.source->m_code, &ShaderDefines::GetUnique(i.defs), Hash(&i.type, sizeof(i.type), i.defs) };
+			HashMap<uint, ShaderCodePtr>& _permutations = s_cache[_job.code->GetChecksum()];
+			auto _exists = _permutations.find(_job.key);
+			if (_exists == _permutations.end())
+			{
+				_permutations[_job.key] = nullptr; // will be expanded by this call
+				_jobs.push_back(_job);
+			}
+			else if (_exists->second)
+				i.code = _exists->second;
+			else
+				_duplicates.push_back(_job);
+		}
+
+		if (_jobs.empty())
+			return 0;
+
+		// expand
+		if (!_numThreads)
+			_numThreads = Max(std::thread::hardware_concurrency(), 1u);
+		_numThreads = Min(_numThreads, (uint)_jobs.size());
+
+		Atomic<uint> _next(0);
+		auto _worker = [&_jobs, &_next](void)
+		{
+			for (uint i; (i = _next++) < _jobs.size();)
+			{
+				Job& _job = _jobs[i];
+				_job.item->code = _job.code->Expand(_job.item->type, *_job.defs);
+			}
+		};
+
+		Array<std::thread> _threads;
+		for (uint i = 1; i < _numThreads; ++i)
+			_threads.push_back(std::thread(_worker));
+		_worker();
+		for (std::thread& i : _threads)
+			i.join();
+
+		// add to cache
+		for (Job& i : _jobs)
+			s_cache[i.code->GetChecksum()][i.key] = i.item->code;
+		for (Job& i : _duplicates)
+			i.item->code = s_cache[i.code->GetChecksum()][i.key];
+
+		return (uint)_jobs.size();
+	}
+	//----------------------------------------------------------------------------//
 	void ShaderSource::_InitResource(ResourceManager* _mgr, const String& _name, uint _uid, uint _flags)
 	{
 		Resource::_InitResource(_mgr, _name, _uid, _flags);
@@ -457,35 +1046,26 @@ namespace Engine
 	{
 		if (m_processed)
 		{
+			// instances are invalidated in _ProcessSource if checksum was changed
 			m_processed = false;
 			gResourceCache->GetManager<ShaderSource>()->AddResourceForReload(this);
 			for (ShaderSource* i : m_dependents)
 				i->_Invalidate();
-
-			for (auto& i : m_instances)
-				i.second->_Invalidate();
 		}
 	}
 	//----------------------------------------------------------------------------//
 	void ShaderSource::_SetSource(const String& _src)
 	{
-		for (ShaderSource* i : m_includes)
-			i->m_dependents.erase(this);
-		m_includes.clear();
-
 		m_rawSource = _src;
-		m_source.clear();
+		m_chunks.clear();
+		m_scanned = false;
 		m_loaded = true;
 		m_processed = false;
-		m_checksum = 0;
 		m_errors.clear();
 		m_valid = true;	// reset invalid flag
 
 		for (ShaderSource* i : m_dependents)
 			i->_Invalidate();
-
-		for (auto& i : m_instances)
-			i.second->_Invalidate();
 	}
 	//----------------------------------------------------------------------------//
 	bool ShaderSource::_ProcessSource(void)
@@ -494,15 +1074,22 @@ namespace Engine
 			return m_valid;
 		m_processed = true;
 
-		m_errors = _Parse(m_rawSource.c_str());
-		m_checksum = StrHash(m_source);
+		uint _checksum = m_code->GetChecksum();
+		m_errors = _Parse();
+
+		if (m_code->GetChecksum() != _checksum)
+		{
+			s_cache.erase(_checksum);
+			for (auto& i : m_instances)
+				i.second->_Invalidate();
+		}
 
 #if defined(_DEBUG) && 1
 		String _name = "Data/Shaders/_Processed/" + StrReplace(m_name, ":\\/", '_');
 		File _f = gFileSystem->WriteFile(_name);
 		if (_f)
 		{
-			_f.Write(m_source.c_str(), (uint)m_source.length());
+			_f.Write(m_code->GetText().c_str(), (uint)m_code->GetText().length());
 			//LOG_DEBUG("Processed ShaderSource '%s' saved to '%s'", m_name.c_str(), _name.c_str());
 		}
 #endif
@@ -518,13 +1105,11 @@ namespace Engine
 		return true;
 	}
 	//----------------------------------------------------------------------------//
-	String ShaderSource::_Parse(const char* s)
+	String ShaderSource::_Scan(const char* _src)
 	{
-		if (!s || !s[0])
-			return ""; // empty source
-
+		const char* s = _src;
+		const char* _text = _src; // start of current chunk of text
 		uint l = 1;
-		m_source = StrFormat("#line %d %d // %s\n", l, m_nameId, m_name.c_str());
 
 		while (*s)
 		{
@@ -534,12 +1119,9 @@ namespace Engine
 					++s;
 				++s;
 				++l;
-				m_source += "\n";
 			}
 			else if (*s == '/' && strchr("/*", s[1])) // comment
 			{
-				const char* _start = s;
-
 				if (s[1] == '/') // line
 				{
 					s += 2;
@@ -563,8 +1145,6 @@ namespace Engine
 						return StrFormat("> %s(%d): Unexpected End of file in multiline comment\n", m_name.c_str(), l);
 					s += 2;
 				}
-
-				m_source.append(_start, s);
 			}
 			else if (*s == '#')	// preprocessor
 			{
@@ -573,44 +1153,119 @@ namespace Engine
 				while (*s && strchr(" \t", *s))
 					++s;
 
-				if (strncmp(s, "include", 7) == 0)
-				{
-					s += 7;
-					while (*s && strchr(" \t", *s))
-						++s;
+				if (strncmp(s, "include", 7) == 0)
+				{
+					s += 7;
+					while (*s && strchr(" \t", *s))
+						++s;
+
+					const char* _name = s;
+					while (*s && !strchr("\n\r", *s) && !(*s == '/' && strchr("/*", s[1])))
+						++s;
+
+					Chunk _chunk;
+					_chunk.start = (uint)(_text - _src);
+					_chunk.end = (uint)(_start - _src);
+					_chunk.line = l;
+					if (_chunk.start < _chunk.end)
+						m_chunks.push_back(_chunk);
+
+					_chunk.start = _chunk.end;
+					_chunk.include = StrTrim(String(_name, s), " \t\"");
+					m_chunks.push_back(_chunk);
+
+					_text = s;
+				}
+			}
+			else
+				++s;
+		}
+
+		if (_text < s)
+		{
+			Chunk _chunk;
+			_chunk.start = (uint)(_text - _src);
+			_chunk.end = (uint)(s - _src);
+			_chunk.line = l;
+			m_chunks.push_back(_chunk);
+		}
+
+		return ""; // no error
+	}
+	//----------------------------------------------------------------------------//
+	String ShaderSource::_Parse(void)
+	{
+		for (ShaderSource* i : m_includes)
+			i->m_dependents.erase(this);
+		m_includes.clear();
+
+		m_code = new ShaderCode("", false);
+
+		// the raw source is scanned only once, dependents are relinked without scanning
+		if (!m_scanned)
+		{
+			m_chunks.clear();
+			String _errors = _Scan(m_rawSource.c_str());
+			if (!_errors.empty())
+				return _errors;
+			m_scanned = true;
+		}
+
+		if (m_chunks.empty())
+			return ""; // empty source
+
+		String _header = StrFormat("#line %d %d // %s\n", 1, m_nameId, m_name.c_str());
+		uint _size = (uint)_header.length();
+		Array<ShaderSource*> _includes;
+
+		for (const Chunk& i : m_chunks)
+		{
+			if (i.include.empty())
+			{
+				_size += i.end - i.start;
+				continue;
+			}
 
-					String _name;
-					while (*s && !strchr("\n\r", *s) && !(*s == '/' && strchr("/*", s[1])))
-						_name += *s++;
-					_name = StrTrim(_name, " \t\"");
+			ShaderSourcePtr _inc = gResourceCache->LoadResource<ShaderSource>(i.include);
+			if (!_inc)
+				return StrFormat("> %s(%d): File '%s' not was found\n", m_name.c_str(), i.line, i.include.c_str());
 
-					ShaderSourcePtr _inc = gResourceCache->LoadResource<ShaderSource>(_name);
-					if (!_inc)
-						return StrFormat("> %s(%d): File '%s' not was found\n", m_name.c_str(), l, _name.c_str());
+			if (!_inc || _inc == this || _inc->_IsIncluded(this))
+				return StrFormat("> %s(%d): Unable to include file '%s'\n", m_name.c_str(), i.line, i.include.c_str());
 
-					if (!_inc || _inc == this || _inc->_IsIncluded(this))
-						return StrFormat("> %s(%d): Unable to include file '%s'\n", m_name.c_str(), l, _name.c_str());
-					
-					m_includes.insert(_inc);
-					_inc->m_dependents.insert(this);
+			m_includes.insert(_inc);
+			_inc->m_dependents.insert(this);
 
-					_inc->Touch(); // load now
-					if (!_inc->_ProcessSource())
-					{
-						return StrFormat("> %s(%d): Invalid included file '%s'\n", m_name.c_str(), l, _name.c_str()) + _inc->m_errors;
-					}
+			_inc->Touch(); // load now
+			if (!_inc->_ProcessSource())
+			{
+				return StrFormat("> %s(%d): Invalid included file '%s'\n", m_name.c_str(), i.line, i.include.c_str()) + _inc->m_errors;
+			}
 
-					m_source += _inc->m_source;
-					m_source += StrFormat("\n#line %d %d // %s\n", l, m_nameId, m_name.c_str());
-				}
-				else
-				{
-					m_source.append(_start, s);
-				}
+			_includes.push_back(_inc);
+			_size += (uint)(_inc->m_code->GetText().length() + _header.length()) + 16;
+		}
+
+		String _text;
+		_text.reserve(_size);
+		_text += _header;
+
+		auto _inc = _includes.begin();
+		for (const Chunk& i : m_chunks)
+		{
+			if (i.include.empty())
+			{
+				_text.append(m_rawSource, i.start, i.end - i.start);
 			}
 			else
-				m_source += *s++;
+			{
+				_text += (*_inc++)->m_code->GetText();
+				_text += StrFormat("\n#line %d %d // %s\n", i.line, m_nameId, m_name.c_str());
+			}
 		}
+
+		m_code = new ShaderCode(std::move(_text));
+
 		return ""; // no error
 	}
 	//----------------------------------------------------------------------------//
@@ -706,6 +1361,335 @@ namespace Engine
 	}
 	//----------------------------------------------------------------------------//
 
+	//----------------------------------------------------------------------------//
+	// ShaderCache
+	//----------------------------------------------------------------------------//
+
+	const uint ShaderCacheVersion = 1;
+	const uint ShaderCacheAlignment = 16;
+
+	const char* ShaderCache::FileName[] =
+	{
+		"Cache/ShaderCache_GLSL.bin", // SL_GLSL
+		"Cache/ShaderCache_HLSL.bin", // SL_HLSL
+		"Cache/ShaderCache_SPIR_V.bin", // SL_SPIR_V
+	};
+
+	//----------------------------------------------------------------------------//
+	bool ShaderCache::Entry::operator < (const Entry& _rhs) const
+	{
+		if (id != _rhs.id)
+			return id < _rhs.id;
+		if (checksum != _rhs.checksum)
+			return checksum < _rhs.checksum;
+		if (format != _rhs.format)
+			return format < _rhs.format;
+		return driver < _rhs.driver;
+	}
+	//----------------------------------------------------------------------------//
+	ShaderCache::ShaderCache(void) :
+		m_language(SL_GLSL),
+		m_driverId(0),
+		m_index(nullptr)
+	{
+		static_assert(sizeof(Header) == 32 && sizeof(Entry) == 32, "Invalid layout of ShaderCache");
+		memset(&m_header, 0, sizeof(m_header));
+	}
+	//----------------------------------------------------------------------------//
+	ShaderCache::~ShaderCache(void)
+	{
+		Close();
+	}
+	//----------------------------------------------------------------------------//
+	bool ShaderCache::Open(const String& _name, ShaderLanguage _lang, uint _driverId)
+	{
+		Close();
+
+		m_name = _name;
+		m_language = _lang;
+		m_driverId = _driverId;
+
+		return _Map();
+	}
+	//----------------------------------------------------------------------------//
+	void ShaderCache::Close(void)
+	{
+		m_file.Close();
+		m_index = nullptr;
+		m_states.clear();
+		m_items.clear();
+		memset(&m_header, 0, sizeof(m_header));
+		m_name.clear();
+	}
+	//----------------------------------------------------------------------------//
+	bool ShaderCache::Get(uint _id, uint _checksum, Item& _item)
+	{
+		auto _new = m_items.find(_id);
+		if (_new != m_items.end())
+		{
+			if (_new->second.checksum != _checksum || _new->second.data.empty())
+				return false;
+
+			_item.checksum = _checksum;
+			_item.format = _new->second.format;
+			_item.size = (uint)_new->second.data.size();
+			_item.data = &_new->second.data[0];
+			return true;
+		}
+
+		// first entry with (_id, _checksum)
+		uint _first = 0, _count = m_header.numEntries;
+		while (_count > 0)
+		{
+			uint _step = _count >> 1;
+			const Entry& _e = m_index[_first + _step];
+			if (_e.id < _id || (_e.id == _id && _e.checksum < _checksum))
+			{
+				_first += _step + 1;
+				_count -= _step + 1;
+			}
+			else
+				_count = _step;
+		}
+
+		for (uint i = _first; i < m_header.numEntries && m_index[i].id == _id && m_index[i].checksum == _checksum; ++i)
+		{
+			const Entry& _e = m_index[i];
+			if (_e.driver == m_driverId && _Check(i))
+			{
+				_item.checksum = _checksum;
+				_item.format = _e.format;
+				_item.size = _e.size;
+				_item.data = m_file.Data() + _e.offset;
+				return _e.size > 0;
+			}
+		}
+
+		return false;
+	}
+	//----------------------------------------------------------------------------//
+	void ShaderCache::Set(uint _id, uint _checksum, uint _format, uint _size, const void* _data)
+	{
+		assert(_data || !_size);
+
+		NewItem& _item = m_items[_id];
+		_item.checksum = _checksum;
+		_item.format = _format;
+		_item.data.assign((const uint8*)_data, (const uint8*)_data + _size);
+	}
+	//----------------------------------------------------------------------------//
+	bool ShaderCache::Save(void)
+	{
+		if (m_name.empty() || m_items.empty())
+			return true;
+
+		double _st = TimeMs();
+		uint _numItems = (uint)m_items.size();
+
+		// entries which are not replaced by new items
+		Array<Entry> _index;
+		_index.reserve(m_header.numEntries + m_items.size());
+		uint _unused = m_header.unused + m_header.numEntries * sizeof(Entry);
+		for (uint i = 0; i < m_header.numEntries; ++i)
+		{
+			const Entry& _e = m_index[i];
+			if ((_e.driver == m_driverId && m_items.find(_e.id) != m_items.end()) || m_states[i] == ES_Corrupted)
+				_unused += _e.size;
+			else
+				_index.push_back(_e);
+		}
+
+		bool _rewrite = !m_file || _unused > m_file.Size() / 2;
+		bool _r = _rewrite ? _Rewrite(_index) : _Append(_index, _unused);
+		m_items.clear();
+		_Map();
+
+		if (_r)
+		{
+			LOG_EVENT("Save ShaderCache: %u new shaders, %u shaders in file, %u bytes %s, %.2f ms", _numItems, m_header.numEntries, m_file.Size(), _rewrite ? "written" : "after appending", TimeMs() - _st);
+		}
+
+		return _r;
+	}
+	//----------------------------------------------------------------------------//
+	bool ShaderCache::_Map(void)
+	{
+		m_file.Close();
+		m_index = nullptr;
+		m_states.clear();
+		memset(&m_header, 0, sizeof(m_header));
+
+		m_file = gFileSystem->MapFile(m_name);
+		if (!m_file)
+			return false; // no cache yet
+
+		const Header* _header = reinterpret_cast<const Header*>(m_file.Data());
+		if (m_file.Size() < sizeof(Header) || strncmp(_header->tag, "SHCH", 4) || _header->version != ShaderCacheVersion || _header->language != m_language)
+		{
+			LOG_EVENT("Load ShaderCache: out of date");
+			m_file.Close();
+			return false;
+		}
+
+		uint _size = m_file.Size();
+		if (_header->indexOffset < sizeof(Header) || _header->indexOffset > _size || (_header->indexOffset & (ShaderCacheAlignment - 1)) ||
+			_header->numEntries > (_size - _header->indexOffset) / sizeof(Entry) ||
+			Hash(m_file.Data() + _header->indexOffset, _header->numEntries * sizeof(Entry)) != _header->indexChecksum)
+		{
+			LOG_ERROR("Couldn't load ShaderCache : Invalid file");
+			m_file.Close();
+			return false;
+		}
+
+		m_header = *_header;
+		m_index = reinterpret_cast<const Entry*>(m_file.Data() + m_header.indexOffset);
+		m_states.resize(m_header.numEntries, ES_Unknown);
+
+		return true;
+	}
+	//----------------------------------------------------------------------------//
+	bool ShaderCache::_Check(uint _index)
+	{
+		if (m_states[_index] == ES_Unknown)
+		{
+			const Entry& _e = m_index[_index];
+			bool _valid = _e.offset >= sizeof(Header) && _e.offset <= m_header.indexOffset && _e.size <= m_header.indexOffset - _e.offset &&
+				Hash(m_file.Data() + _e.offset, _e.size) == _e.dataChecksum;
+
+			m_states[_index] = _valid ? ES_Valid : ES_Corrupted;
+			if (!_valid)
+			{
+				LOG_WARNING("ShaderCache: Item %08x is corrupted", _e.id);
+			}
+		}
+		return m_states[_index] == ES_Valid;
+	}
+	//----------------------------------------------------------------------------//
+	bool ShaderCache::_Rewrite(Array<Entry>& _index)
+	{
+		// write to temporary file while the old one is still mapped
+		String _tempName = m_name + ".tmp";
+		{
+			File _f = gFileSystem->WriteFile(_tempName);
+			if (!_f)
+			{
+				LOG_ERROR("Couldn't save ShaderCache");
+				return false;
+			}
+
+			Header _header;
+			memset(&_header, 0, sizeof(_header));
+			_f.Write(&_header, sizeof(_header));
+
+			uint _pos = 0;
+			uint _offset = sizeof(Header);
+			static const uint8 _padding[ShaderCacheAlignment] = { 0 };
+			for (uint i = 0; i < m_header.numEntries; ++i)
+			{
+				const Entry& _e = m_index[i];
+				if (_pos < _index.size() && !memcmp(&_index[_pos], &_e, sizeof(Entry)))
+				{
+					if (_Check(i))
+					{
+						Entry& _ne = _index[_pos++];
+						_ne.offset = _offset;
+						_f.Write(m_file.Data() + _e.offset, _e.size);
+						_offset += _e.size;
+						uint _pad = (ShaderCacheAlignment - (_offset & (ShaderCacheAlignment - 1))) & (ShaderCacheAlignment - 1);
+						_f.Write(_padding, _pad);
+						_offset += _pad;
+					}
+					else
+						_index.erase(_index.begin() + _pos);
+				}
+			}
+
+			_WriteNewItems(_f, _index);
+			_WriteIndex(_f, _index, 0);
+		}
+
+		m_file.Close();
+		remove(m_name.c_str());
+		if (rename(_tempName.c_str(), m_name.c_str()))
+		{
+			LOG_ERROR("Couldn't save ShaderCache");
+			return false;
+		}
+		return true;
+	}
+	//----------------------------------------------------------------------------//
+	bool ShaderCache::_Append(Array<Entry>& _index, uint _unused)
+	{
+		m_file.Close(); // file can't be written while it's mapped
+
+		// new blobs and new index are written after the old index, header is written last
+		File _f = gFileSystem->WriteFile(m_name, false);
+		if (!_f)
+		{
+			LOG_ERROR("Couldn't save ShaderCache");
+			return false;
+		}
+
+		_f.Seek(0, SEEK_END);
+		_WriteNewItems(_f, _index);
+		_WriteIndex(_f, _index, _unused);
+
+		return true;
+	}
+	//----------------------------------------------------------------------------//
+	void ShaderCache::_WriteNewItems(File& _f, Array<Entry>& _index)
+	{
+		static const uint8 _padding[ShaderCacheAlignment] = { 0 };
+		uint _offset = _f.Tell();
+
+		for (const auto& i : m_items)
+		{
+			uint _size = (uint)i.second.data.size();
+			const uint8* _data = _size ? &i.second.data[0] : nullptr;
+
+			Entry _e;
+			_e.id = i.first;
+			_e.checksum = i.second.checksum;
+			_e.format = i.second.format;
+			_e.driver = m_driverId;
+			_e.offset = _offset;
+			_e.size = _size;
+			_e.dataChecksum = Hash(_data, _size);
+			_e.reserved = 0;
+			_index.push_back(_e);
+
+			_f.Write(_data, _size);
+			_offset += _size;
+			uint _pad = (ShaderCacheAlignment - (_offset & (ShaderCacheAlignment - 1))) & (ShaderCacheAlignment - 1);
+			_f.Write(_padding, _pad);
+			_offset += _pad;
+		}
+	}
+	//----------------------------------------------------------------------------//
+	void ShaderCache::_WriteIndex(File& _f, Array<Entry>& _index, uint _unused)
+	{
+		std::sort(_index.begin(), _index.end());
+
+		Header _header;
+		memcpy(_header.tag, "SHCH", 4);
+		_header.version = ShaderCacheVersion;
+		_header.language = m_language;
+		_header.numEntries = (uint)_index.size();
+		_header.indexOffset = _f.Tell();
+		_header.indexChecksum = Hash(_index.empty() ? nullptr : &_index[0], (uint)(_index.size() * sizeof(Entry)));
+		_header.unused = _unused;
+		_header.reserved = 0;
+
+		if (!_index.empty())
+			_f.Write(&_index[0], (uint)(_index.size() * sizeof(Entry)));
+		_f.Flush();
+
+		_f.Seek(0);
+		_f.Write(&_header, sizeof(_header));
+		_f.Flush();
+	}
+	//----------------------------------------------------------------------------//
+
 	//----------------------------------------------------------------------------//
 	// Shader
 	//----------------------------------------------------------------------------//
@@ -725,8 +1709,7 @@ namespace Engine
 	};
 
 	bool Shader::s_cacheLoaded = false;
-	bool Shader::s_cacheChanged = false;
-	HashMap<uint, Shader::CacheItem> Shader::s_cache;
+	ShaderCache Shader::s_cache;
 	HashSet<Shader*> Shader::s_uncompiledShaders;
 
 	//----------------------------------------------------------------------------//
@@ -782,30 +1765,16 @@ namespace Engine
 		bool _createdFromCache = false;
 		CacheItem _bin;
 
-		if (_GetCacheItem(m_uid, m_source->m_checksum, _bin))
+		if (_GetCacheItem(m_uid, m_source->m_code->GetChecksum(), _bin))
 		{
 			_createdFromCache = true;
 			glProgramBinary(m_handle, _bin.format, _bin.data, _bin.size);
 		}
 		else
 		{
-			String _src = "#version 330\n#define COMPILE_" + String(ShaderTypePrefix[m_type]) + "\n";
-
-			/*if (!ogl_IsVersionGEQ(4, 1))
-			{
-				_src += "#extension GL_ARB_separate_shader_objects : enable\n";
-			}
-
-			if (!ogl_IsVersionGEQ(4, 4))
-			{
-				_src += "#extension GL_ARB_enhanced_layouts : enable\n";
-			}*/
-
-			const ShaderDefines& _defs = ShaderDefines::GetUnique(m_defs);
-			_src += _defs.BuildText();
-			_src += m_source->m_source;
+			ShaderCodePtr _src = m_source->Preprocess(m_type, m_defs);
 
-			const char* _srcv = _src.c_str();
+			const char* _srcv = _src->GetText().c_str();
 			uint _shader = glCreateShader(ShaderType2GL[m_type]);
 			glShaderSource(_shader, 1, &_srcv, nullptr);
 			glCompileShader(_shader);
@@ -858,9 +1827,12 @@ namespace Engine
 			int _size = 0;
 			uint _format = (uint)-1;
 			glGetProgramiv(m_handle, GL_PROGRAM_BINARY_LENGTH, &_size);
-			uint8* _data = new uint8[_size];
-			glGetProgramBinary(m_handle, _size, &_size, &_format, &_data[0]);
-			_SetCacheItem(m_uid, m_source->m_checksum, _format, _size, &_data[0]);
+			if (_size > 0)
+			{
+				Array<uint8> _data(_size);
+				glGetProgramBinary(m_handle, _size, &_size, &_format, &_data[0]);
+				_SetCacheItem(m_uid, m_source->m_code->GetChecksum(), _format, _size, &_data[0]);
+			}
 		}
 
 		LOG_DEBUG("Compile Shader '%s', from %s, %.2f ms", m_name.c_str(), _createdFromCache ? "cache" : "source", TimeMs() - _st);
@@ -1024,161 +1996,56 @@ namespace Engine
 	bool Shader::_InitCache(void)
 	{
 		s_cacheLoaded = false;
-		s_cacheChanged = false;
 		return true;
 	}
 	//----------------------------------------------------------------------------//
 	void Shader::_DestroyCache(void)
 	{
 		_SaveCache();
-
-		for (const auto& i : s_cache)
-		{
-			delete[] i.second.data;
-		}
-		s_cache.clear();
+		s_cache.Close();
 	}
 	//----------------------------------------------------------------------------//
 	void Shader::_LoadCache(void)
 	{
 		if (s_cacheLoaded)
 			return;
-		assert(s_cache.empty());
 		s_cacheLoaded = true;
 
 		double _st = TimeMs();
 
-		String _cacheName = gFileSystem->FindFile("Shaders/ShaderCache.bin"); // todo:
-		if (_cacheName.empty())
-			return; 
-
-		File _f = gFileSystem->ReadFile(_cacheName);
-		if (!_f)
-		{
-			LOG_ERROR("Couldn't load ShaderCache : IO error");
-			return;
-		}
-
-		char _tag[4];
-		uint _driverId, _numItems, _maxSize, _id, _totalSize = 0;
-		_f.Read(_tag, 4);
-		_f.Read(&_driverId, 4);
-		_f.Read(&_maxSize, 4);
-		_f.Read(&_numItems, 4);
-		if (_f.Tell() != 16 || strncmp(_tag, "SHCH", 4) || _maxSize > (_f.Size() - 16)) // empty or corrupted file
-		{
-			LOG_ERROR("Couldn't load ShaderCache : Invalid file");
-			return;
-		}
-
-		if (_driverId != 0) // todo:
+		// binaries are valid only for same driver
+		uint _driverId = 0;
+		const uint _driverStrings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+		for (uint i : _driverStrings)
 		{
-			LOG_EVENT("Load ShaderCache: out of date");
-			return;
+			const char* _str = (const char*)glGetString(i);
+			if (_str)
+				_driverId = StrHash(_str, _driverId);
 		}
 
-		uint8* _tempBuffer = new uint8[_maxSize];
-		HashMap<uint, CacheItem> _cache;
-		for (uint i = 0; i < _numItems; ++i)
+		String _name = gFileSystem->GetWriteDir() + ShaderCache::FileName[SL_GLSL];
+		if (s_cache.Open(_name, SL_GLSL, _driverId))
 		{
-			CacheItem _item;
-			_id = 0;
-			_f.Read(&_id, 4);
-			_f.Read(&_item.checksum, 4);
-			_f.Read(&_item.format, 4);
-			_f.Read(&_item.size, 4);
-			uint _readed = _f.Read(_tempBuffer, _item.size);
-			if (_item.size > _maxSize || _cache.find(_id) != _cache.end() || _readed != _item.size)
-			{
-				LOG_ERROR("Couldn't load ShaderCache : Invalid file");
-				delete[]_tempBuffer;
-				return;
-			}
-
-			_item.data = new uint8[_item.size];
-			memcpy(_item.data, _tempBuffer, _item.size);
-			_cache[_id] = _item;
-			_totalSize += _item.size;
+			LOG_EVENT("Load ShaderCache: %u shaders, %u bytes, %.2f ms", s_cache.GetNumItems(), s_cache.GetSize(), TimeMs() - _st);
 		}
-		delete[]_tempBuffer;
-
-		s_cache = std::move(_cache);
-		LOG_EVENT("Load ShaderCache: %u shaders, %u bytes, %.2f ms", (uint)s_cache.size(), _totalSize, TimeMs() - _st);
 	}
 	//----------------------------------------------------------------------------//
 	void Shader::_SaveCache(void)
 	{
-		if (!s_cacheLoaded || !s_cacheChanged)
-			return;
-
-		double _st = TimeMs();
-
-		File _f = gFileSystem->WriteFile("Data/Shaders/ShaderCache.bin"); // todo:
-		if (!_f)
-		{
-			LOG_ERROR("Couldn't ShaderCache");
-			return;
-		}
-
-		s_cacheChanged = false;
-
-		uint _totalSize = 0, _maxSize = 0, _numItems = (uint)s_cache.size(), _driverId = 0;
-		for (const auto& i : s_cache)
-		{
-			if (i.second.size > _maxSize)
-				_maxSize = i.second.size;
-			_totalSize += i.second.size;
-		}
-
-		_f.Write("SHCH", 4);
-		_f.Write(&_driverId, 4); // todo:
-		_f.Write(&_maxSize, 4);
-		_f.Write(&_numItems, 4);
-		
-		for (const auto& i : s_cache)
-		{
-			_f.Write(&i.first, 4);
-			_f.Write(&i.second.checksum, 4);
-			_f.Write(&i.second.format, 4);
-			_f.Write(&i.second.size, 4);
-			_f.Write(i.second.data, i.second.size);
-		}
-
-		_f.Flush();
-
-		LOG_EVENT("Save ShaderCache: %u shaders, %u bytes, %.2f ms", (uint)s_cache.size(), _totalSize, TimeMs() - _st);
+		if (s_cacheLoaded)
+			s_cache.Save();
 	}
 	//----------------------------------------------------------------------------//
 	bool Shader::_GetCacheItem(uint _id, uint _checksum, CacheItem& _item)
 	{
 		_LoadCache();
-
-		auto _exists = s_cache.find(_id);
-		if (_exists != s_cache.end() && _exists->second.checksum == _checksum && _exists->second.size > 0)
-		{
-			_item = _exists->second;
-			return true;
-		}
-		return false;
+		return s_cache.Get(_id, _checksum, _item);
 	}
 	//----------------------------------------------------------------------------//
-	void Shader::_SetCacheItem(uint _id, uint _checksum, uint _format, uint _size, uint8* _data)
+	void Shader::_SetCacheItem(uint _id, uint _checksum, uint _format, uint _size, const uint8* _data)
 	{
-		s_cacheChanged = true;
-
-		auto _exists = s_cache.find(_id);
-		if (_exists != s_cache.end())
-		{
-			delete[] _exists->second.data;
-			s_cache.erase(_id);
-		}
-		
-		CacheItem _item;
-		_item.checksum = _checksum;
-		_item.format = _format;
-		_item.size = _size;
-		_item.data = _data;
-		s_cache[_id] = _item;
+		_LoadCache();
+		s_cache.Set(_id, _checksum, _format, _size, _data);
 	}
 	//----------------------------------------------------------------------------//
 
@@ -2093,6 +2960,9 @@ namespace Engine
 		glViewport(0, 0, _w, _h);
 		glClearColor(0.6f, 0.6f, 0.7f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT);
+
+		m_submittedStates = 0;
+		m_issuedStates = 0;
 	}
 	//----------------------------------------------------------------------------//
 	void RenderContext::_EndFrame(void)
@@ -2110,7 +2980,11 @@ namespace Engine
 	uint RenderContext::ReloadShaders(void)
 	{
 		gResourceCache->ReloadAllResources<ShaderSource>();
-		
+		return CompileShaders();
+	}
+	//----------------------------------------------------------------------------//
+	uint RenderContext::CompileShaders(void)
+	{
 		uint _num = 0;
 		if (!Shader::s_uncompiledShaders.empty())
 		{
@@ -2118,6 +2992,23 @@ namespace Engine
 			Array<Shader*> _shaders(Shader::s_uncompiledShaders.begin(), Shader::s_uncompiledShaders.end());
 			_num = _shaders.size();
 
+			// preprocess permutations in parallel, GL calls are made from this thread only
+			Array<ShaderPermutation> _permutations;
+			_permutations.reserve(_num);
+			for (Shader* i : _shaders)
+			{
+				Shader::CacheItem _bin;
+				if (!Shader::_GetCacheItem(i->m_uid, i->m_source->m_code->GetChecksum(), _bin))
+				{
+					ShaderPermutation _item;
+					_item.source = i->m_source;
+					_item.type = i->m_type;
+					_item.defs = i->m_defs;
+					_permutations.push_back(_item);
+				}
+			}
+			ShaderSource::Preprocess(_permutations);
+
 			for (Shader* i : _shaders)
 				i->_Compile();
 
@@ -2144,8 +3035,10 @@ namespace Engine
 		if (!_fmt)
 			_fmt = VertexFormat::_GetInstance(0);
 
+		++m_submittedStates;
 		if (m_vertexFormat != _fmt)
 		{
+			++m_issuedStates;
 			_fmt->_Bind(m_vertexFormat->m_attribMask);
 			m_vertexFormat = _fmt;
 		}
@@ -2155,8 +3048,15 @@ namespace Engine
 	{
 		assert(_slot < MAX_VERTEX_STREAMS);
 
-		glBindVertexBuffer(_slot, _buffer ? _buffer->m_handle : 0, _offset, _stride);
-		m_vertexBuffers[_slot] = _buffer;
+		++m_submittedStates;
+		if (m_vertexBuffers[_slot] != _buffer || m_vertexBufferOffsets[_slot] != _offset || m_vertexBufferStrides[_slot] != _stride)
+		{
+			++m_issuedStates;
+			glBindVertexBuffer(_slot, _buffer ? _buffer->m_handle : 0, _offset, _stride);
+			m_vertexBuffers[_slot] = _buffer;
+			m_vertexBufferOffsets[_slot] = _offset;
+			m_vertexBufferStrides[_slot] = _stride;
+		}
 	}
 	//----------------------------------------------------------------------------//
 	void RenderContext::SetIndexFormat(IndexFormat _fmt)
@@ -2171,10 +3071,17 @@ namespace Engine
 	//----------------------------------------------------------------------------//
 	void RenderContext::SetIndexBuffer(BufferObject* _buffer, uint _offset)
 	{
-		m_indexBuffer = _buffer;
+		++m_submittedStates;
 		m_indexBufferOffset = _offset;
-		if (_buffer)
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _buffer->m_handle);
+		if (m_indexBuffer != _buffer)
+		{
+			m_indexBuffer = _buffer;
+			if (_buffer)
+			{
+				++m_issuedStates;
+				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _buffer->m_handle);
+			}
+		}
 	}
 	//----------------------------------------------------------------------------//
 	void RenderContext::SetPrimitiveType(PrimitiveType _type)
@@ -13,6 +13,7 @@ namespace Engine
 	
 	typedef Ptr<class BufferObject> BufferObjectPtr;
 
+	typedef Ptr<class ShaderCode> ShaderCodePtr;
 	typedef Ptr<class ShaderSource> ShaderSourcePtr;
 	typedef Ptr<class Shader> ShaderPtr;
 
@@ -213,19 +214,90 @@ namespace Engine
 		ST_Geometry,
 	};
 
+	//----------------------------------------------------------------------------//
+	// ShaderCode
+	//----------------------------------------------------------------------------//
+
+	/// Immutable preprocessed text of shader. It can be shared between threads.
+	class ShaderCode : public RefCounted
+	{
+	public:
+		///\param[in] _scan is false for text of permutation, it has no checksum and can not be expanded.
+		ShaderCode(String&& _text, bool _scan = true);
+
+		const String& GetText(void) const { return m_text; }
+		uint GetChecksum(void) const { return m_checksum; }
+
+		/// Create text of permutation: header with defines and text without inactive conditional blocks.
+		///\note Conditions which depend on unknown macros are left to compiler.
+		ShaderCodePtr Expand(ShaderType _type, const ShaderDefines& _defs) const;
+
+	protected:
+
+		enum LineType : uint8
+		{
+			LT_Text,
+			LT_If,
+			LT_Ifdef,
+			LT_Ifndef,
+			LT_Elif,
+			LT_Else,
+			LT_Endif,
+			LT_Line, //!< #line is kept in inactive blocks too
+		};
+
+		struct Line
+		{
+			uint start;
+			uint length; //!< with line breaks
+			uint16 args; //!< offset of arguments of directive
+			uint16 breaks; //!< number of line breaks
+			LineType type;
+		};
+
+		void _Scan(void);
+		int _Eval(const Line& _line, ShaderType _type, const ShaderDefines& _defs) const;
+
+		String m_text;
+		uint m_checksum;
+		bool m_balanced; //!< all conditional blocks are closed
+		Array<Line> m_lines;
+		HashSet<String> m_macros; //!< names of macros which are defined or undefined in text
+	};
+
+	//----------------------------------------------------------------------------//
+	// ShaderSource
+	//----------------------------------------------------------------------------//
+
+	struct ShaderPermutation
+	{
+		ShaderSource* source = nullptr;
+		ShaderType type = ST_Vertex;
+		uint defs = 0; //!< identifier of ShaderDefines::AddUnique
+		ShaderCodePtr code; //!< result of ShaderSource::Preprocess
+	};
+
 	class ShaderSource : public Resource
 	{
 	public:
 		CLASS(ShaderSource);
 
-		bool BeginReload(void) override;
+		bool BeginReload(bool _force = false) override;
 
 		bool IsValid(void) { return m_valid; }
-		const String& GetSource(void) { return m_source; }
+		const String& GetSource(void) { return m_code->GetText(); }
 		const String& GetLog(void) { return m_errors; }
 
 		ShaderPtr CreateInstance(ShaderType _type, const ShaderDefines& _defs = ShaderDefines::Empty);
 
+		/// Get text of permutation. Result is cached by checksum of source with includes and hash of defines.
+		ShaderCodePtr Preprocess(ShaderType _type, uint _defs);
+		/// Get text of permutations. Missing permutations are expanded in parallel.
+		///\param[in] _numThreads is number of threads, zero is number of cores.
+		///\return number of permutations which was not found in the cache.
+		static uint Preprocess(Array<ShaderPermutation>& _items, uint _numThreads = 0);
+		static void ClearPreprocessCache(void) { s_cache.clear(); }
+
 
 	protected:
 		friend class RenderContext;
@@ -243,7 +315,8 @@ namespace Engine
  		void _Invalidate(void);
 		void _SetSource(const String& _src);
 		bool _ProcessSource(void);
-		String _Parse(const char* _src);
+		String _Scan(const char* _src);
+		String _Parse(void);
 		static uint16 _AddShaderName(const String& _name);
 		static bool _GetShaderName(uint16 _id, String& _name);
 		static String _ParseGLSLLog(const char* _log);
@@ -251,16 +324,28 @@ namespace Engine
 		uint16 m_nameId;
 		bool m_processed;
 		bool m_loaded;
-		uint m_checksum;
+		bool m_scanned;
 		String m_rawSource;
-		String m_source;
 		String m_errors;		
 		HashSet<ShaderSourcePtr> m_includes;
 		HashSet<ShaderSource*> m_dependents;
 		HashMap<uint, Shader*> m_instances;
 
+		/// Part of raw source. It's text or include directive.
+		struct Chunk
+		{
+			uint start;
+			uint end;
+			uint line; //!< line of include directive
+			String include; //!< name of included file, empty for text
+		};
+
+		Array<Chunk> m_chunks;
+		ShaderCodePtr m_code;
+
 		static Array<String> s_names;
 		static HashMap<uint, uint16> s_nameIndices;
+		static HashMap<uint, HashMap<uint, ShaderCodePtr>> s_cache; //!< [checksum of ShaderCode][hash of permutation]
 	};
 
 	//----------------------------------------------------------------------------//
@@ -346,6 +431,110 @@ namespace Engine
 		HashMap<String, uint> m_textureSlots;
 	};
 
+	//----------------------------------------------------------------------------//
+	// ShaderCache
+	//----------------------------------------------------------------------------//
+
+	enum ShaderLanguage : uint
+	{
+		SL_GLSL,
+		SL_HLSL,
+		SL_SPIR_V,
+	};
+
+	/// Cache of compiled shaders.
+	/// File contains header, blobs and index sorted by (id, checksum, format, driver). The file is mapped into memory and blobs are used in place.
+	/// New items are appended with new index, the file is rewritten only if more than half of it is unused.
+	class ShaderCache : public NonCopyable
+	{
+	public:
+		struct Item
+		{
+			uint checksum = 0;
+			uint format = 0;
+			uint size = 0;
+			const uint8* data = nullptr;
+		};
+
+		ShaderCache(void);
+		~ShaderCache(void);
+
+		/// Map file of cache. Items of other drivers are kept in file but not used. \return false if file not exists or is invalid.
+		bool Open(const String& _name, ShaderLanguage _lang, uint _driverId);
+		void Close(void);
+		/// Find item of current driver. Data of item is valid until Save or Close.
+		bool Get(uint _id, uint _checksum, Item& _item);
+		/// Add or replace item of current driver. Data is copied.
+		void Set(uint _id, uint _checksum, uint _format, uint _size, const void* _data);
+		/// Write new items to file.
+		bool Save(void);
+
+		/// Number of items in file.
+		uint GetNumItems(void) { return m_header.numEntries; }
+		/// Size of file.
+		uint GetSize(void) { return m_file.Size(); }
+
+		static const char* FileName[];
+
+	protected:
+
+		struct Header
+		{
+			char tag[4]; //!< "SHCH"
+			uint version;
+			uint language;
+			uint numEntries;
+			uint indexOffset;
+			uint indexChecksum;
+			uint unused; //!< size of replaced blobs and old indices
+			uint reserved;
+		};
+
+		struct Entry
+		{
+			uint id;
+			uint checksum;
+			uint format;
+			uint driver;
+			uint offset;
+			uint size;
+			uint dataChecksum;
+			uint reserved;
+
+			bool operator < (const Entry& _rhs) const;
+		};
+
+		struct NewItem
+		{
+			uint checksum;
+			uint format;
+			Array<uint8> data;
+		};
+
+		enum EntryState : uint8
+		{
+			ES_Unknown,
+			ES_Valid,
+			ES_Corrupted,
+		};
+
+		bool _Map(void);
+		bool _Check(uint _index);
+		bool _Rewrite(Array<Entry>& _index);
+		bool _Append(Array<Entry>& _index, uint _unused);
+		void _WriteNewItems(File& _f, Array<Entry>& _index);
+		void _WriteIndex(File& _f, Array<Entry>& _index, uint _unused);
+
+		String m_name;
+		ShaderLanguage m_language;
+		uint m_driverId;
+		MappedFile m_file;
+		Header m_header;
+		const Entry* m_index;
+		Array<EntryState> m_states;
+		HashMap<uint, NewItem> m_items;
+	};
+
 	//----------------------------------------------------------------------------//
 	// Shader
 	//----------------------------------------------------------------------------//
@@ -380,24 +569,17 @@ namespace Engine
 		HashMap<String, uint> m_buffers;
 		ShaderBindingsPtr m_bindings;
 
-		struct CacheItem
-		{
-			uint checksum = 0;
-			uint format = 0;
-			uint size = 0;
-			uint8* data = nullptr;
-		};
+		typedef ShaderCache::Item CacheItem;
 
 		static bool _InitCache(void);
 		static void _DestroyCache(void);
 		static void _LoadCache(void);
 		static void _SaveCache(void);
 		static bool _GetCacheItem(uint _id, uint _checksum, CacheItem& _item);
-		static void _SetCacheItem(uint _id, uint _checksum, uint _format, uint _size, uint8* _data);
+		static void _SetCacheItem(uint _id, uint _checksum, uint _format, uint _size, const uint8* _data);
 
 		static bool s_cacheLoaded;
-		static bool s_cacheChanged;
-		static HashMap<uint, CacheItem> s_cache;
+		static ShaderCache s_cache;
 		static HashSet<Shader*> s_uncompiledShaders;
 	};
 
@@ -603,7 +785,10 @@ namespace Engine
 
 		VertexFormat* AddVertexFormat(const VertexAttrib* _attribs);
 
+		/// Check files of all shader sources, reload changed ones and compile invalidated shaders.
 		uint ReloadShaders(void);
+		/// Compile shaders which were invalidated by reloading of sources.
+		uint CompileShaders(void);
 
 		//ShaderObjectPtr CreateShader(ShaderType _type);
 		//ProgramObjectPtr CreateProgram(ShaderObject* _vs, ShaderObject* _fs, ShaderObject* _gs);
@@ -622,7 +807,10 @@ namespace Engine
 		void Draw(uint _baseVertex, uint _count, uint _numInstances = 1);
 		void DrawIndexed(uint _baseVertex, uint _baseIndex, uint _count, uint _numInstances = 1);
 
-		// 
+		/// Number of calls of Set* functions in current frame.
+		uint GetSubmittedStates(void) { return m_submittedStates; }
+		/// Number of state changes passed to driver in current frame. Calls with already bound values are skipped.
+		uint GetIssuedStates(void) { return m_issuedStates; }
 
 
 	protected:
@@ -644,6 +832,8 @@ namespace Engine
 
 		VertexFormat* m_vertexFormat = nullptr;
 		BufferObjectPtr m_vertexBuffers[MAX_VERTEX_STREAMS];
+		uint m_vertexBufferOffsets[MAX_VERTEX_STREAMS] = { 0 };
+		uint m_vertexBufferStrides[MAX_VERTEX_STREAMS] = { 0 };
 
 		IndexFormat m_indexFormat = IF_UShort;
 		uint m_indexFormatGL = 0;
@@ -652,6 +842,9 @@ namespace Engine
 
 		PrimitiveType m_primitiveType = PT_Points;
 		uint m_primitiveTypeGL = 0;
+
+		uint m_submittedStates = 0;
+		uint m_issuedStates = 0;
 	};
 
 	//----------------------------------------------------------------------------//
@@ -1,7 +1,150 @@
 #include "Lib.hpp"
+#ifdef _MSC_VER
+#	include <intrin.h>
+#	define TARGET_AVX
+#	define TARGET_SSE41
+#else
+#	include <immintrin.h>
+#	include <cpuid.h>
+#	define TARGET_AVX __attribute__((target("avx")))
+#	define TARGET_SSE41 __attribute__((target("sse4.1")))
+#endif
 
 namespace Engine
 {
+	//----------------------------------------------------------------------------//
+	// Defs
+	//----------------------------------------------------------------------------//
+
+	namespace
+	{
+		enum : uint
+		{
+			CPU_SSE = 0x1,
+			CPU_AVX = 0x2,
+			CPU_SSE41 = 0x4,
+		};
+
+		uint _GetCpuFeatures(void)
+		{
+			uint _features = 0;
+			int _info[4] = { 0 };
+#ifdef _MSC_VER
+			__cpuid(_info, 1);
+#else
+			__cpuid(1, _info[0], _info[1], _info[2], _info[3]);
+#endif
+			if (_info[3] & (1 << 25))
+				_features |= CPU_SSE;
+			if (_info[2] & (1 << 19))
+				_features |= CPU_SSE41;
+
+			if ((_info[2] & (1 << 27)) && (_info[2] & (1 << 28))) // OSXSAVE, AVX
+			{
+#ifdef _MSC_VER
+				uint64_t _xcr0 = _xgetbv(0);
+#else
+				uint32_t _eax, _edx;
+				__asm__ __volatile__("xgetbv" : "=a"(_eax), "=d"(_edx) : "c"(0));
+				uint64_t _xcr0 = ((uint64_t)_edx << 32) | _eax;
+#endif
+				if ((_xcr0 & 0x6) == 0x6) // xmm and ymm state are enabled by OS
+					_features |= CPU_AVX;
+			}
+			return _features;
+		}
+
+		/// Zero until dynamic initialization of this file, so hashing in static initializers of other files uses portable code.
+		const uint s_cpuFeatures = _GetCpuFeatures();
+	}
+
+	//----------------------------------------------------------------------------//
+	// Hash
+	//----------------------------------------------------------------------------//
+
+	namespace
+	{
+		// Powers of multiplier of sdbm hash: _hash = c + (_hash << 6) + (_hash << 16) - _hash = _hash * 65599 + c.
+		// Block of bytes is added as _hash * M^n + c0 * M^(n-1) + ... + c(n-1), so the result is same as per-byte loop.
+		enum : uint
+		{
+			HASH_M0 = 0x00000001,
+			HASH_M1 = 0x0001003f,
+			HASH_M2 = 0x007e0f81,
+			HASH_M3 = 0x2e86d0bf,
+			HASH_M4 = 0x43ec5f01,
+			HASH_M5 = 0x162c613f,
+			HASH_M6 = 0xd62aee81,
+			HASH_M7 = 0xa311b1bf,
+			HASH_M8 = 0xd319be01,
+			HASH_M9 = 0xb156c23f,
+			HASH_M10 = 0x6698cd81,
+			HASH_M11 = 0x0d1b92bf,
+			HASH_M12 = 0xcc881d01,
+			HASH_M13 = 0x7280233f,
+			HASH_M14 = 0x50c7ac81,
+			HASH_M15 = 0x8da473bf,
+			HASH_M16 = 0x4f377c01,
+		};
+
+		inline uint _HashBlock8(uint _hash, const uint8* _p)
+		{
+			return _hash * HASH_M8 +
+				_p[0] * HASH_M7 + _p[1] * HASH_M6 + _p[2] * HASH_M5 + _p[3] * HASH_M4 +
+				_p[4] * HASH_M3 + _p[5] * HASH_M2 + _p[6] * HASH_M1 + _p[7];
+		}
+
+		/// Hash of 16-byte blocks. Sums of four lanes are multiplied by M^16 for each block and added at the end.
+		TARGET_SSE41 uint _HashBlocks16(uint _hash, const uint8* _p, uint _blocks)
+		{
+			alignas(16) static const uint _pow[16] =
+			{
+				HASH_M15, HASH_M14, HASH_M13, HASH_M12, HASH_M11, HASH_M10, HASH_M9, HASH_M8,
+				HASH_M7, HASH_M6, HASH_M5, HASH_M4, HASH_M3, HASH_M2, HASH_M1, HASH_M0,
+			};
+			const __m128i _p0 = _mm_load_si128((const __m128i*)(_pow + 0));
+			const __m128i _p1 = _mm_load_si128((const __m128i*)(_pow + 4));
+			const __m128i _p2 = _mm_load_si128((const __m128i*)(_pow + 8));
+			const __m128i _p3 = _mm_load_si128((const __m128i*)(_pow + 12));
+			const __m128i _m16 = _mm_set1_epi32((int)HASH_M16);
+			__m128i _acc = _mm_setzero_si128();
+			for (uint i = 0; i < _blocks; ++i, _p += 16)
+			{
+				__m128i _x = _mm_loadu_si128((const __m128i*)_p);
+				__m128i _s0 = _mm_mullo_epi32(_mm_cvtepu8_epi32(_x), _p0);
+				__m128i _s1 = _mm_mullo_epi32(_mm_cvtepu8_epi32(_mm_srli_si128(_x, 4)), _p1);
+				__m128i _s2 = _mm_mullo_epi32(_mm_cvtepu8_epi32(_mm_srli_si128(_x, 8)), _p2);
+				__m128i _s3 = _mm_mullo_epi32(_mm_cvtepu8_epi32(_mm_srli_si128(_x, 12)), _p3);
+				_acc = _mm_add_epi32(_mm_mullo_epi32(_acc, _m16), _mm_add_epi32(_mm_add_epi32(_s0, _s1), _mm_add_epi32(_s2, _s3)));
+				_hash *= HASH_M16;
+			}
+			_acc = _mm_add_epi32(_acc, _mm_shuffle_epi32(_acc, 0x4e));
+			_acc = _mm_add_epi32(_acc, _mm_shuffle_epi32(_acc, 0xb1));
+			return _hash + (uint)_mm_cvtsi128_si32(_acc);
+		}
+	}
+
+	//----------------------------------------------------------------------------//
+	uint Hash(const void* _data, uint _size, uint _hash)
+	{
+		assert(_data || !_size);
+		const uint8* p = (const uint8*)_data;
+		if (_size >= 32 && (s_cpuFeatures & CPU_SSE41))
+		{
+			_hash = _HashBlocks16(_hash, p, _size >> 4);
+			p += _size & ~15u;
+			_size &= 15;
+		}
+
+		const uint8* _end = p + (_size & ~7u);
+		for (; p < _end; p += 8)
+			_hash = _HashBlock8(_hash, p);
+		for (_end += _size & 7; p < _end;)
+			_hash = *p++ + (_hash << 6) + (_hash << 16) - _hash;
+		return _hash;
+	}
+	//----------------------------------------------------------------------------//
+
 	//----------------------------------------------------------------------------//
 	// String utilities
 	//----------------------------------------------------------------------------//
@@ -281,8 +424,9 @@ namespace Engine
 		_b = _b ? _b : "";
 		if (_ignoreCase)
 		{
-			while (*_a && CharLower(*_a++) == CharLower(*_b++));
-			return *_a - *_b;
+			while (*_a && CharLower(*_a) == CharLower(*_b))
+				++_a, ++_b;
+			return CharLower(*_a) - CharLower(*_b);
 		}
 		return strcmp(_a, _b);
 	}
@@ -702,7 +846,7 @@ namespace Engine
 		float _det = _q0[0] * _q1[1] * _q2[2] + _q0[1] * _q1[2] * _q2[0] + _q0[2] * _q1[0] * _q2[1] - _q0[2] * _q1[1] * _q2[0] - _q0[1] * _q1[0] * _q2[2] - _q0[0] * _q1[2] * _q2[1];
 		if (_det < 0)
 			_q0 = -_q0, _q1 = -_q1, _q2 = -_q2;
-		return Quat().FromMatrixRows(*_q0, *_q1, *_q2);
+		return Quat().FromMatrixRows(*_q0, *_q1, *_q2).UnitInverse(); // _q0, _q1, _q2 are columns
 	}
 	//----------------------------------------------------------------------------//
 	Mat34& Mat34::CreateRotation(const Quat& _rotation)
@@ -1142,6 +1286,114 @@ namespace Engine
 	}
 	//----------------------------------------------------------------------------//
 
+	//----------------------------------------------------------------------------//
+	// Frustum culling
+	//----------------------------------------------------------------------------//
+
+	namespace
+	{
+		/// Positive vertex of boxes for plane. Sign of normal is constant for plane, so vertex is selected by pointers.
+		struct CullPlane
+		{
+			float nx, ny, nz, d;
+			const float* x;
+			const float* y;
+			const float* z;
+		};
+
+		void _GetCullPlanes(const Plane* _planes, const AlignedBoxSoA& _boxes, CullPlane* _cp)
+		{
+			for (uint i = 0; i < 6; ++i)
+			{
+				const Plane& _p = _planes[i];
+				_cp[i].nx = _p.normal.x;
+				_cp[i].ny = _p.normal.y;
+				_cp[i].nz = _p.normal.z;
+				_cp[i].d = _p.dist;
+				_cp[i].x = _p.normal.x >= 0 ? _boxes.mxx : _boxes.mnx;
+				_cp[i].y = _p.normal.y >= 0 ? _boxes.mxy : _boxes.mny;
+				_cp[i].z = _p.normal.z >= 0 ? _boxes.mxz : _boxes.mnz;
+			}
+		}
+
+		void _CullBoxesScalar(const CullPlane* _cp, uint _start, uint _end, uint32_t* _visibility)
+		{
+			for (uint i = _start; i < _end; ++i)
+			{
+				bool _visible = true;
+				for (uint p = 0; p < 6; ++p)
+				{
+					const CullPlane& _p = _cp[p];
+					float _d = ((_p.nx * _p.x[i] + _p.ny * _p.y[i]) + _p.nz * _p.z[i]) + _p.d;
+					if (!(_d >= 0)) // NaN is culled, as in _mm_cmpge_ps
+						_visible = false;
+				}
+				if (_visible)
+					_visibility[i >> 5] |= 1u << (i & 31);
+			}
+		}
+
+		uint _CullBoxesSSE(const CullPlane* _cp, uint _count, uint32_t* _visibility)
+		{
+			__m128 _zero = _mm_setzero_ps();
+			uint i = 0;
+			for (; i + 4 <= _count; i += 4)
+			{
+				__m128 _mask = _mm_cmpeq_ps(_zero, _zero);
+				for (uint p = 0; p < 6; ++p)
+				{
+					const CullPlane& _p = _cp[p];
+					__m128 _d = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(_p.nx), _mm_loadu_ps(_p.x + i)), _mm_mul_ps(_mm_set1_ps(_p.ny), _mm_loadu_ps(_p.y + i)));
+					_d = _mm_add_ps(_d, _mm_mul_ps(_mm_set1_ps(_p.nz), _mm_loadu_ps(_p.z + i)));
+					_d = _mm_add_ps(_d, _mm_set1_ps(_p.d));
+					_mask = _mm_and_ps(_mask, _mm_cmpge_ps(_d, _zero));
+				}
+				_visibility[i >> 5] |= (uint32_t)_mm_movemask_ps(_mask) << (i & 31);
+			}
+			return i;
+		}
+
+		TARGET_AVX uint _CullBoxesAVX(const CullPlane* _cp, uint _count, uint32_t* _visibility)
+		{
+			__m256 _zero = _mm256_setzero_ps();
+			uint i = 0;
+			for (; i + 8 <= _count; i += 8)
+			{
+				__m256 _mask = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+				for (uint p = 0; p < 6; ++p)
+				{
+					const CullPlane& _p = _cp[p];
+					__m256 _d = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(_p.nx), _mm256_loadu_ps(_p.x + i)), _mm256_mul_ps(_mm256_set1_ps(_p.ny), _mm256_loadu_ps(_p.y + i)));
+					_d = _mm256_add_ps(_d, _mm256_mul_ps(_mm256_set1_ps(_p.nz), _mm256_loadu_ps(_p.z + i)));
+					_d = _mm256_add_ps(_d, _mm256_set1_ps(_p.d));
+					_mask = _mm256_and_ps(_mask, _mm256_cmp_ps(_d, _zero, _CMP_GE_OQ));
+				}
+				_visibility[i >> 5] |= (uint32_t)_mm256_movemask_ps(_mask) << (i & 31);
+			}
+			_mm256_zeroupper();
+			return i;
+		}
+
+	}
+
+	//----------------------------------------------------------------------------//
+	void Frustum::CullBoxes(const AlignedBoxSoA& _boxes, uint32_t* _visibility, bool _simd) const
+	{
+		memset(_visibility, 0, ((_boxes.count + 31) >> 5) * sizeof(uint32_t));
+
+		CullPlane _cp[6];
+		_GetCullPlanes(planes, _boxes, _cp);
+
+		uint _start = 0;
+		if (_simd && (s_cpuFeatures & CPU_AVX))
+			_start = _CullBoxesAVX(_cp, _boxes.count, _visibility);
+		else if (_simd && (s_cpuFeatures & CPU_SSE))
+			_start = _CullBoxesSSE(_cp, _boxes.count, _visibility);
+
+		_CullBoxesScalar(_cp, _start, _boxes.count, _visibility);
+	}
+	//----------------------------------------------------------------------------//
+
 	//----------------------------------------------------------------------------//
 	//
 	//----------------------------------------------------------------------------//
@@ -68,15 +68,8 @@ namespace Engine
 	// 
 	//----------------------------------------------------------------------------//
 
-	inline uint Hash(const void* _data, uint _size, uint _hash = 0)
-	{
-		assert(_data || !_size);
-		const uint8* p = (const uint8*)_data;
-		while (_size--)
-			_hash = *p++ + (_hash << 6) + (_hash << 16) - _hash;
-		
-		return _hash;
-	}
+	/// sdbm hash of bytes (_hash * 65599 + c). Eight or sixteen bytes are processed per step.
+	uint Hash(const void* _data, uint _size, uint _hash = 0);
 
 	//----------------------------------------------------------------------------//
 	// String utilities
@@ -629,7 +622,7 @@ namespace Engine
 		Vec3 TransformVector(const Vec3& _v) const { return Vec3(m00 * _v.x + m01 * _v.y + m02 * _v.z, m10 * _v.x + m11 * _v.y + m12 * _v.z, m20 * _v.x + m21 * _v.y + m22 * _v.z); }
 
 		Mat34& SetTranslation(const Vec3& _translation) { m03 = _translation.x, m13 = _translation.y, m23 = _translation.z; return *this; }
-		Vec3 GetTranslation(void) const { return Vec3(m03, m12, m23); }
+		Vec3 GetTranslation(void) const { return Vec3(m03, m13, m23); }
 		Mat34& CreateTranslation(const Vec3& _translation) { return (*this = Identity).SetTranslation(_translation); }
 
 		Mat34& SetRotation(const Quat& _rotation);
@@ -878,6 +871,24 @@ namespace Engine
 		static const uint16_t Triangles[36];
 	};
 
+	//----------------------------------------------------------------------------//
+	// AlignedBoxSoA
+	//----------------------------------------------------------------------------//
+
+	/// Boxes as structure of arrays for batch operations. Arrays are not owned.
+	struct AlignedBoxSoA
+	{
+		AlignedBoxSoA(void) : mnx(nullptr), mny(nullptr), mnz(nullptr), mxx(nullptr), mxy(nullptr), mxz(nullptr), count(0) { }
+
+		const float* mnx;
+		const float* mny;
+		const float* mnz;
+		const float* mxx;
+		const float* mxy;
+		const float* mxz;
+		uint count;
+	};
+
 	//----------------------------------------------------------------------------//
 	// Frustum
 	//----------------------------------------------------------------------------//
@@ -902,6 +913,10 @@ namespace Engine
 		bool Intersects(const Vec3& _center, float _radius) const;
 		bool Intersects(const AlignedBox& _box, bool* _contains = nullptr) const;
 		bool Intersects(const Frustum& _frustum, bool* _contains = nullptr) const;
+		/// Test boxes against planes of frustum in batch. Bit i of _visibility is set if box i is not completely outside.
+		///\param[out] _visibility must have (_boxes.count + 31) / 32 elements.
+		///\param[in] _simd enables SSE/AVX path (if supported by CPU). Result does not depend on this.
+		void CullBoxes(const AlignedBoxSoA& _boxes, uint32_t* _visibility, bool _simd = true) const;
 
 		float Distance(const Vec3& _point) const { return origin.Distance(_point); }
 		float Distance(const Vec3& _center, float _radius) const { float _d = origin.Distance(_center); return _d < _radius ? 0 : _d - _radius; }
@@ -2,6 +2,362 @@
 
 namespace Engine
 {
+	//----------------------------------------------------------------------------//
+	// TransformStore
+	//----------------------------------------------------------------------------//
+
+	//----------------------------------------------------------------------------//
+	TransformStore::TransformStore(void) :
+		m_dirty(false),
+		m_changed(false)
+	{
+		m_levels.push_back(0);
+	}
+	//----------------------------------------------------------------------------//
+	TransformStore::~TransformStore(void)
+	{
+	}
+	//----------------------------------------------------------------------------//
+	TransformHandle TransformStore::Add(TransformHandle _parent)
+	{
+		assert(_parent == INVALID_TRANSFORM || IsValid(_parent));
+
+		TransformHandle _handle;
+		if (m_freeHandles.empty())
+		{
+			_handle = (TransformHandle)m_indices.size();
+			m_indices.push_back(INVALID_TRANSFORM);
+			m_depths.push_back(0);
+			m_firstChild.push_back(INVALID_TRANSFORM);
+			m_nextSibling.push_back(INVALID_TRANSFORM);
+			m_prevSibling.push_back(INVALID_TRANSFORM);
+		}
+		else
+		{
+			_handle = m_freeHandles.back();
+			m_freeHandles.pop_back();
+			m_firstChild[_handle] = INVALID_TRANSFORM;
+		}
+
+		uint _level = _parent == INVALID_TRANSFORM ? 0 : m_depths[_parent] + 1;
+		uint _index = _Insert(_level);
+		m_handles[_index] = _handle;
+		m_parents[_index] = _parent;
+		m_positions[_index] = Vec3::Zero;
+		m_rotations[_index] = Quat::Identity;
+		m_scales[_index] = Vec3::One;
+		m_world[_index] = _parent == INVALID_TRANSFORM ? Mat34::Identity : m_world[m_indices[_parent]];
+		m_flags[_index] = 0;
+		_SetDirty(_index);
+
+		m_indices[_handle] = _index;
+		m_depths[_handle] = _level;
+		_Link(_handle, _parent);
+
+		return _handle;
+	}
+	//----------------------------------------------------------------------------//
+	void TransformStore::Remove(TransformHandle _handle)
+	{
+		assert(IsValid(_handle));
+
+		TransformHandle _parent = m_parents[m_indices[_handle]];
+		while (m_firstChild[_handle] != INVALID_TRANSFORM)
+			SetParent(m_firstChild[_handle], _parent, true);
+
+		_Unlink(_handle, _parent);
+		_Erase(m_indices[_handle], m_depths[_handle]);
+		m_indices[_handle] = INVALID_TRANSFORM;
+		m_freeHandles.push_back(_handle);
+	}
+	//----------------------------------------------------------------------------//
+	void TransformStore::SetParent(TransformHandle _handle, TransformHandle _parent, bool _keepWorldPos)
+	{
+		assert(IsValid(_handle));
+		assert(_parent == INVALID_TRANSFORM || IsValid(_parent));
+
+		uint _index = m_indices[_handle];
+		TransformHandle _oldParent = m_parents[_index];
+		if (_parent == _oldParent)
+			return;
+
+		for (TransformHandle i = _parent; i != INVALID_TRANSFORM; i = m_parents[m_indices[i]])
+		{
+			if (i == _handle)
+				return; // new parent is in subtree of this transform
+		}
+
+		if (_keepWorldPos)
+		{
+			Mat34 _world = _ComputeWorldMatrix(_index);
+			if (_parent != INVALID_TRANSFORM)
+				_world = _ComputeWorldMatrix(m_indices[_parent]).Inverse() * _world;
+			m_positions[_index] = _world.GetTranslation();
+			m_rotations[_index] = _world.GetRotation();
+			m_scales[_index] = _world.GetScale();
+		}
+
+		_Unlink(_handle, _oldParent);
+		_Link(_handle, _parent);
+		m_parents[_index] = _parent;
+		_SetDirty(_index);
+
+		uint _depth = _parent == INVALID_TRANSFORM ? 0 : m_depths[_parent] + 1;
+		if (_depth == m_depths[_handle])
+			return;
+
+		// move subtree to new levels: take out all items (parents before children), then insert them back
+
+		struct Item
+		{
+			Vec3 position;
+			Quat rotation;
+			Vec3 scale;
+			Mat34 world;
+			TransformHandle parent;
+			uint8 flags;
+		};
+
+		Array<TransformHandle> _subtree;
+		_subtree.push_back(_handle);
+		for (uint i = 0; i < _subtree.size(); ++i)
+		{
+			for (TransformHandle _child = m_firstChild[_subtree[i]]; _child != INVALID_TRANSFORM; _child = m_nextSibling[_child])
+				_subtree.push_back(_child);
+		}
+
+		Array<Item> _items(_subtree.size());
+		for (uint i = 0; i < _subtree.size(); ++i)
+		{
+			TransformHandle _h = _subtree[i];
+			uint _src = m_indices[_h];
+			Item& _item = _items[i];
+			_item.position = m_positions[_src];
+			_item.rotation = m_rotations[_src];
+			_item.scale = m_scales[_src];
+			_item.world = m_world[_src];
+			_item.parent = m_parents[_src];
+			_item.flags = m_flags[_src];
+			_Erase(_src, m_depths[_h]);
+		}
+
+		for (uint i = 0; i < _subtree.size(); ++i)
+		{
+			TransformHandle _h = _subtree[i];
+			const Item& _item = _items[i];
+			uint _level = _item.parent == INVALID_TRANSFORM ? 0 : m_depths[_item.parent] + 1;
+			uint _dst = _Insert(_level);
+			m_handles[_dst] = _h;
+			m_parents[_dst] = _item.parent;
+			m_positions[_dst] = _item.position;
+			m_rotations[_dst] = _item.rotation;
+			m_scales[_dst] = _item.scale;
+			m_world[_dst] = _item.world;
+			m_flags[_dst] = _item.flags;
+			m_indices[_h] = _dst;
+			m_depths[_h] = _level;
+		}
+	}
+	//----------------------------------------------------------------------------//
+	void TransformStore::SetLocal(TransformHandle _handle, const Vec3& _position, const Quat& _rotation, const Vec3& _scale)
+	{
+		uint _index = m_indices[_handle];
+		m_positions[_index] = _position;
+		m_rotations[_index] = _rotation;
+		m_scales[_index] = _scale;
+		_SetDirty(_index);
+	}
+	//----------------------------------------------------------------------------//
+	void TransformStore::Update(uint _numThreads)
+	{
+		if (!m_dirty && !m_changed)
+			return;
+
+		m_changed = m_dirty; // otherwise only TF_Changed flags of last update are reset
+		m_dirty = false;
+
+		// split each level into chunks; chunks of one level wait for all chunks of previous levels
+
+		struct Chunk
+		{
+			uint start;
+			uint end;
+			uint wait; //!< Number of chunks in previous levels.
+		};
+
+		Array<Chunk> _chunks;
+		for (uint _level = 0; _level < GetNumLevels(); ++_level)
+		{
+			uint _wait = (uint)_chunks.size();
+			for (uint i = m_levels[_level]; i < m_levels[_level + 1]; i += UPDATE_CHUNK_SIZE)
+				_chunks.push_back({ i, Min(i + UPDATE_CHUNK_SIZE, m_levels[_level + 1]), _wait });
+		}
+
+		if (!_numThreads)
+			_numThreads = Max(std::thread::hardware_concurrency(), 1u);
+		_numThreads = Min(_numThreads, (uint)_chunks.size());
+
+		if (_numThreads <= 1)
+		{
+			_UpdateRange(0, Size()); // parents are placed before children
+			return;
+		}
+
+		Atomic<uint> _next(0);
+		Atomic<uint> _done(0);
+		auto _worker = [this, &_chunks, &_next, &_done](void)
+		{
+			for (uint i; (i = _next++) < _chunks.size();)
+			{
+				const Chunk& _chunk = _chunks[i];
+				while (_done < _chunk.wait)
+					std::this_thread::yield();
+				_UpdateRange(_chunk.start, _chunk.end);
+				++_done;
+			}
+		};
+
+		Array<std::thread> _threads;
+		for (uint i = 1; i < _numThreads; ++i)
+			_threads.push_back(std::thread(_worker));
+		_worker();
+		for (std::thread& i : _threads)
+			i.join();
+	}
+	//----------------------------------------------------------------------------//
+	Mat34 TransformStore::_ComputeWorldMatrix(uint _index) const
+	{
+		Mat34 _world, _local;
+		_world.CreateTransform(m_positions[_index], m_rotations[_index], m_scales[_index]);
+		for (TransformHandle _parent = m_parents[_index]; _parent != INVALID_TRANSFORM; _parent = m_parents[_index])
+		{
+			_index = m_indices[_parent];
+			_local.CreateTransform(m_positions[_index], m_rotations[_index], m_scales[_index]);
+			_world = _local * _world;
+		}
+		return _world;
+	}
+	//----------------------------------------------------------------------------//
+	void TransformStore::_UpdateRange(uint _start, uint _end)
+	{
+		Mat34 _local;
+		for (uint i = _start; i < _end; ++i)
+		{
+			TransformHandle _parent = m_parents[i];
+			uint _parentIndex = _parent == INVALID_TRANSFORM ? INVALID_TRANSFORM : m_indices[_parent];
+			bool _changed = (m_flags[i] & TF_Dirty) || (_parentIndex != INVALID_TRANSFORM && (m_flags[_parentIndex] & TF_Changed));
+			if (_changed)
+			{
+				_local.CreateTransform(m_positions[i], m_rotations[i], m_scales[i]);
+				if (_parentIndex != INVALID_TRANSFORM)
+					m_world[i] = m_world[_parentIndex] * _local;
+				else
+					m_world[i] = _local;
+			}
+
+			uint8 _flags = _changed ? TF_Changed : 0;
+			if (m_flags[i] != _flags)
+				m_flags[i] = _flags;
+		}
+	}
+	//----------------------------------------------------------------------------//
+	uint TransformStore::_Insert(uint _level)
+	{
+		assert(_level <= GetNumLevels());
+
+		if (_level == GetNumLevels())
+			m_levels.push_back(m_levels.back());
+
+		uint _hole = Size();
+		m_handles.push_back(INVALID_TRANSFORM);
+		m_parents.push_back(INVALID_TRANSFORM);
+		m_positions.push_back(Vec3::Zero);
+		m_rotations.push_back(Quat::Identity);
+		m_scales.push_back(Vec3::One);
+		m_world.push_back(Mat34::Identity);
+		m_flags.push_back(0);
+		++m_levels.back();
+
+		// first item of each next level is moved to the end of this level
+		for (uint i = GetNumLevels() - 1; i > _level; --i)
+		{
+			uint _first = m_levels[i];
+			if (_first != _hole)
+				_Move(_first, _hole);
+			_hole = _first;
+			++m_levels[i];
+		}
+
+		return _hole;
+	}
+	//----------------------------------------------------------------------------//
+	void TransformStore::_Erase(uint _index, uint _level)
+	{
+		// last item of this level is moved to the hole, then the hole is at the beginning of next level
+		uint _hole = _index;
+		for (uint i = _level + 1; i < m_levels.size(); ++i)
+		{
+			uint _last = m_levels[i] - 1;
+			if (_last != _hole)
+				_Move(_last, _hole);
+			_hole = _last;
+			--m_levels[i];
+		}
+
+		assert(_hole == Size() - 1);
+		m_handles.pop_back();
+		m_parents.pop_back();
+		m_positions.pop_back();
+		m_rotations.pop_back();
+		m_scales.pop_back();
+		m_world.pop_back();
+		m_flags.pop_back();
+
+		while (GetNumLevels() > 0 && m_levels[m_levels.size() - 2] == m_levels.back())
+			m_levels.pop_back();
+	}
+	//----------------------------------------------------------------------------//
+	void TransformStore::_Move(uint _from, uint _to)
+	{
+		m_handles[_to] = m_handles[_from];
+		m_parents[_to] = m_parents[_from];
+		m_positions[_to] = m_positions[_from];
+		m_rotations[_to] = m_rotations[_from];
+		m_scales[_to] = m_scales[_from];
+		m_world[_to] = m_world[_from];
+		m_flags[_to] = m_flags[_from];
+		m_indices[m_handles[_to]] = _to;
+	}
+	//----------------------------------------------------------------------------//
+	void TransformStore::_Link(TransformHandle _handle, TransformHandle _parent)
+	{
+		m_prevSibling[_handle] = INVALID_TRANSFORM;
+		m_nextSibling[_handle] = INVALID_TRANSFORM;
+		if (_parent != INVALID_TRANSFORM)
+		{
+			TransformHandle _next = m_firstChild[_parent];
+			if (_next != INVALID_TRANSFORM)
+				m_prevSibling[_next] = _handle;
+			m_nextSibling[_handle] = _next;
+			m_firstChild[_parent] = _handle;
+		}
+	}
+	//----------------------------------------------------------------------------//
+	void TransformStore::_Unlink(TransformHandle _handle, TransformHandle _parent)
+	{
+		TransformHandle _prev = m_prevSibling[_handle];
+		TransformHandle _next = m_nextSibling[_handle];
+		if (_prev != INVALID_TRANSFORM)
+			m_nextSibling[_prev] = _next;
+		else if (_parent != INVALID_TRANSFORM)
+			m_firstChild[_parent] = _next;
+		if (_next != INVALID_TRANSFORM)
+			m_prevSibling[_next] = _prev;
+		m_prevSibling[_handle] = INVALID_TRANSFORM;
+		m_nextSibling[_handle] = INVALID_TRANSFORM;
+	}
+	//----------------------------------------------------------------------------//
+
 	//----------------------------------------------------------------------------//
 	// Node
 	//----------------------------------------------------------------------------//
@@ -10,22 +366,20 @@ namespace Engine
 	Node::Node(Scene* _scene) :
 		m_scene(_scene),
 		m_parent(nullptr),
-		//m_prev(nullptr),
+		m_prev(nullptr),
 		m_next(nullptr),
 		m_child(nullptr),
 		m_nodeFlags(0),
-		m_position(Vec3::Zero),
-		m_rotation(Quat::Identity),
-		m_scale(Vec3::One),
-		m_matrix(Mat34::Identity),
+		m_transform(INVALID_TRANSFORM),
 		m_components(nullptr)
 	{
 		assert(_scene != nullptr);
+		m_transform = m_scene->GetTransforms().Add();
 	}
 	//----------------------------------------------------------------------------//
 	Node::~Node(void)
 	{
-		
+		m_scene->GetTransforms().Remove(m_transform);
 	}
 	//----------------------------------------------------------------------------//
 	void Node::SetParent(Node* _parent, bool _keepWorldPos)
@@ -36,45 +390,77 @@ namespace Engine
 		if (_parent && _parent->m_scene != m_scene)
 			return;
 
-		if (m_parent)
+		for (Node* i = _parent; i; i = i->m_parent)
 		{
-			for (Node* i = m_parent->m_child, *p = nullptr; ; p = i, i = i->m_next)
-			{
-				assert(i != nullptr);
-				if (i == this)
-				{
-					if (p)
-						p->m_next = m_next;
-					else
-						m_parent->m_child = m_next;
-					break;
-				}
-			}
-			m_next = nullptr;
+			if (i == this)
+				return;
 		}
 
+		if (m_parent)
+			_Unlink(m_parent->m_child);
+
 		m_parent = _parent;
 
 		if (m_parent)
-		{
-			m_next = m_parent->m_child;
-			m_parent->m_child = this;
+			_Link(m_parent->m_child);
 
-			if (_keepWorldPos)
-			{
-				// update local transform
-			}
-			else
-			{
-				// update world matrix
-			}
-		}
+		m_scene->GetTransforms().SetParent(m_transform, m_parent ? m_parent->m_transform : INVALID_TRANSFORM, _keepWorldPos);
+	}
+	//----------------------------------------------------------------------------//
+	void Node::SetPosition(const Vec3& _position)
+	{
+		m_scene->GetTransforms().SetPosition(m_transform, _position);
+	}
+	//----------------------------------------------------------------------------//
+	void Node::SetRotation(const Quat& _rotation)
+	{
+		m_scene->GetTransforms().SetRotation(m_transform, _rotation);
+	}
+	//----------------------------------------------------------------------------//
+	void Node::SetScale(const Vec3& _scale)
+	{
+		m_scene->GetTransforms().SetScale(m_transform, _scale);
+	}
+	//----------------------------------------------------------------------------//
+	const Vec3& Node::GetPosition(void) const
+	{
+		return m_scene->GetTransforms().GetPosition(m_transform);
+	}
+	//----------------------------------------------------------------------------//
+	const Quat& Node::GetRotation(void) const
+	{
+		return m_scene->GetTransforms().GetRotation(m_transform);
+	}
+	//----------------------------------------------------------------------------//
+	const Vec3& Node::GetScale(void) const
+	{
+		return m_scene->GetTransforms().GetScale(m_transform);
+	}
+	//----------------------------------------------------------------------------//
+	const Mat34& Node::GetWorldMatrix(void) const
+	{
+		return m_scene->GetTransforms().GetWorldMatrix(m_transform);
+	}
+	//----------------------------------------------------------------------------//
+	void Node::_Link(Node*& _head)
+	{
+		m_prev = nullptr;
+		m_next = _head;
+		if (_head)
+			_head->m_prev = this;
+		_head = this;
+	}
+	//----------------------------------------------------------------------------//
+	void Node::_Unlink(Node*& _head)
+	{
+		if (m_prev)
+			m_prev->m_next = m_next;
 		else
-		{
-			m_position = m_matrix.GetTranslation();
-			m_rotation = m_matrix.GetRotation();
-			m_scale = m_matrix.GetScale();
-		}
+			_head = m_next;
+		if (m_next)
+			m_next->m_prev = m_prev;
+		m_prev = nullptr;
+		m_next = nullptr;
 	}
 	//----------------------------------------------------------------------------//
 
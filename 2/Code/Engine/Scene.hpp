@@ -44,6 +44,106 @@ namespace Engine
 		NodeComponent* m_next;
 	};
 
+	//----------------------------------------------------------------------------//
+	// TransformStore
+	//----------------------------------------------------------------------------//
+
+	/// Handle of transform. It is not changed when the transform is moved in TransformStore.
+	typedef uint TransformHandle;
+
+	enum : uint
+	{
+		INVALID_TRANSFORM = ~0u,
+	};
+
+	/// Hierarchy of transforms in structure-of-arrays layout.
+	/// Arrays are sorted by depth: each level of hierarchy is contiguous and placed after the level of parents,
+	/// so world matrices can be updated level by level, and items of one level can be updated in parallel.
+	class TransformStore : public NonCopyable
+	{
+	public:
+
+		enum : uint
+		{
+			UPDATE_CHUNK_SIZE = 1024, //!< Number of items processed by one thread at once in Update.
+		};
+
+		TransformStore(void);
+		~TransformStore(void);
+
+		/// Add transform with identity local transform.
+		TransformHandle Add(TransformHandle _parent = INVALID_TRANSFORM);
+		/// Remove transform. Children are attached to parent of removed transform, their world transforms are kept.
+		void Remove(TransformHandle _handle);
+		/// Change parent of transform. Moves the subtree to new levels of hierarchy, the cost depends on size of subtree only.
+		void SetParent(TransformHandle _handle, TransformHandle _parent, bool _keepWorldPos = true);
+		TransformHandle GetParent(TransformHandle _handle) const { return m_parents[m_indices[_handle]]; }
+		uint GetDepth(TransformHandle _handle) const { return m_depths[_handle]; }
+		bool IsValid(TransformHandle _handle) const { return _handle < m_indices.size() && m_indices[_handle] != INVALID_TRANSFORM; }
+
+		void SetPosition(TransformHandle _handle, const Vec3& _position) { uint _index = m_indices[_handle]; m_positions[_index] = _position; _SetDirty(_index); }
+		void SetRotation(TransformHandle _handle, const Quat& _rotation) { uint _index = m_indices[_handle]; m_rotations[_index] = _rotation; _SetDirty(_index); }
+		void SetScale(TransformHandle _handle, const Vec3& _scale) { uint _index = m_indices[_handle]; m_scales[_index] = _scale; _SetDirty(_index); }
+		void SetLocal(TransformHandle _handle, const Vec3& _position, const Quat& _rotation, const Vec3& _scale = Vec3::One);
+		const Vec3& GetPosition(TransformHandle _handle) const { return m_positions[m_indices[_handle]]; }
+		const Quat& GetRotation(TransformHandle _handle) const { return m_rotations[m_indices[_handle]]; }
+		const Vec3& GetScale(TransformHandle _handle) const { return m_scales[m_indices[_handle]]; }
+		/// Get world matrix computed by last Update.
+		const Mat34& GetWorldMatrix(TransformHandle _handle) const { return m_world[m_indices[_handle]]; }
+		/// \return true if world matrix was changed by last Update.
+		bool IsChanged(TransformHandle _handle) const { return (m_flags[m_indices[_handle]] & TF_Changed) != 0; }
+
+		/// Recompute world matrices of changed transforms and their children. Zero _numThreads is number of cores.
+		void Update(uint _numThreads = 0);
+
+		/// Get number of transforms.
+		uint Size(void) const { return (uint)m_handles.size(); }
+		/// Get number of levels of hierarchy.
+		uint GetNumLevels(void) const { return (uint)m_levels.size() - 1; }
+
+	protected:
+
+		enum Flags : uint8
+		{
+			TF_Dirty = 0x1, //!< Local transform was changed.
+			TF_Changed = 0x2, //!< World matrix was changed by last Update.
+		};
+
+		void _SetDirty(uint _index) { m_flags[_index] |= TF_Dirty; m_dirty = true; }
+		/// Compute world matrix from local transforms of all parents. Used for transforms which are not updated yet.
+		Mat34 _ComputeWorldMatrix(uint _index) const;
+		/// Update range of one level.
+		void _UpdateRange(uint _start, uint _end);
+		/// Add item to end of level. \return index of new item.
+		uint _Insert(uint _level);
+		/// Remove item. Last items of this level and each next level are moved to the hole.
+		void _Erase(uint _index, uint _level);
+		void _Move(uint _from, uint _to);
+		void _Link(TransformHandle _handle, TransformHandle _parent);
+		void _Unlink(TransformHandle _handle, TransformHandle _parent);
+
+		// by index, sorted by depth
+		Array<TransformHandle> m_handles;
+		Array<TransformHandle> m_parents;
+		Array<Vec3> m_positions;
+		Array<Quat> m_rotations;
+		Array<Vec3> m_scales;
+		Array<Mat34> m_world;
+		Array<uint8> m_flags;
+
+		Array<uint> m_levels; //!< Index of first item of each level. Last element is number of items.
+		bool m_dirty; //!< Some local transforms were changed after last Update.
+		bool m_changed; //!< Some world matrices were changed by last Update.
+
+		// by handle
+		Array<uint> m_indices; //!< Index of item. INVALID_TRANSFORM for free handles.
+		Array<uint> m_depths;
+		Array<TransformHandle> m_firstChild;
+		Array<TransformHandle> m_nextSibling;
+		Array<TransformHandle> m_prevSibling;
+		Array<TransformHandle> m_freeHandles;
+	};
+
 	//----------------------------------------------------------------------------//
 	// Node
 	//----------------------------------------------------------------------------//
@@ -57,6 +157,15 @@ namespace Engine
 		void SetParent(Node* _parent, bool _keepWorldPos = true);
 		void RemoveFromScene(void);
 
+		void SetPosition(const Vec3& _position);
+		void SetRotation(const Quat& _rotation);
+		void SetScale(const Vec3& _scale);
+		const Vec3& GetPosition(void) const;
+		const Quat& GetRotation(void) const;
+		const Vec3& GetScale(void) const;
+		const Mat34& GetWorldMatrix(void) const;
+		TransformHandle GetTransform(void) const { return m_transform; }
+
 	protected:
 
 		void _Link(Node*& _head);
@@ -66,14 +175,11 @@ namespace Engine
 
 		Scene* m_scene;
 		Node* m_parent;
-		//Node* m_prev;
+		Node* m_prev;
 		Node* m_next;
 		Node* m_child;
 		uint m_nodeFlags;
-		Vec3 m_position;
-		Quat m_rotation;
-		Vec3 m_scale;
-		Mat34 m_matrix;
+		TransformHandle m_transform; //!< Local and world transforms are stored in Scene::GetTransforms.
 
 		NodeComponent* m_components;
 	};
@@ -123,8 +229,13 @@ namespace Engine
 	{
 	public:
 
+		TransformStore& GetTransforms(void) { return m_transforms; }
+		/// Recompute world matrices of changed nodes. Zero _numThreads is number of cores.
+		void UpdateTransforms(uint _numThreads = 0) { m_transforms.Update(_numThreads); }
+
 	protected:
 
+		TransformStore m_transforms;
 		Array<Node*> m_nodesToUpdate;
 		Array<Node*> m_nodesToAdd;
 		Array<Node*> m_nodesToRemove;
@@ -7,6 +7,7 @@
 #include <System.hpp>
 #include <File.hpp>
 #include <Resource.hpp>
+#include <GLGraphicsBackend.hpp>
 #include <timer.hpp>
 #include <typeinfo>
 #include <locale.h>
@@ -165,13 +166,20 @@ public:
 
 	bool _Load(DataStream& _src) override
 	{ 
-		String _str = _src.ReadString();
-		printf("%s\n", *_str);
+		m_text = _src.ReadString();
 		return true;
 	}
 
+	bool _Unload(void) override
+	{
+		m_text = String::Empty;
+		return true;
+	}
+
+	size_t _GetResidentSize(void) override { return m_text.Length(); }
 
 protected:
+	String m_text;
 };
 
 
@@ -273,6 +281,848 @@ struct GLCommandList
   */
 
 
+//----------------------------------------------------------------------------//
+//
+//----------------------------------------------------------------------------//
+
+struct DbvtTestCallback : public Dbvt::Callback
+{
+	void AddResult(void* _object) override { ++count; }
+	uint count = 0;
+};
+
+void _TestDbvt(void)
+{
+	const uint _counts[] = { 1000, 10000, 100000 };
+	const uint _numQueries = 100;
+
+	Mat34 _view;
+	_view.CreateTransform(Vec3::Zero, Quat::Identity);
+	Mat44 _proj;
+	_proj.CreatePerspective(60, 1.5f, 0.1f, 400);
+	Frustum _frustum;
+	_frustum.FromCameraMatrices(_view, _proj);
+
+	for (uint n = 0; n < 3; ++n)
+	{
+		uint _count = _counts[n];
+		Array<AlignedBox> _boxes;
+		Dbvt _tree;
+		for (uint i = 0; i < _count; ++i)
+		{
+			Vec3 _center(rand() % 1000 - 500.f, rand() % 100 - 50.f, rand() % 1000 - 500.f);
+			Vec3 _extends(rand() % 3 + 0.5f, rand() % 3 + 0.5f, rand() % 3 + 0.5f);
+			_boxes.push_back(AlignedBox(_center - _extends, _center + _extends));
+			_tree.Add(nullptr, _boxes[i]);
+		}
+
+		// linear search (previous implementation)
+		uint _visible = 0;
+		double _st = Timer::Ms();
+		for (uint q = 0; q < _numQueries; ++q)
+		{
+			for (uint i = 0; i < _count; ++i)
+			{
+				if (_frustum.Intersects(_boxes[i]))
+					++_visible;
+			}
+		}
+		double _linearTime = (Timer::Ms() - _st) / _numQueries;
+
+		DbvtTestCallback _callback;
+		_st = Timer::Ms();
+		for (uint q = 0; q < _numQueries; ++q)
+			_tree.EnumObjects(_frustum, _callback);
+		double _treeTime = (Timer::Ms() - _st) / _numQueries;
+
+		printf("%u objects: linear %.3f ms (%u visible), dbvt %.3f ms (%u visible, height %d)\n", _count, _linearTime, _visible / _numQueries, _treeTime, _callback.count / _numQueries, _tree.GetHeight());
+	}
+}
+
+void _TestFrustumCulling(void)
+{
+	const uint _count = 100000;
+	const uint _numQueries = 100;
+
+	Mat34 _view;
+	_view.CreateTransform(Vec3::Zero, Quat::Identity);
+	Mat44 _proj;
+	_proj.CreatePerspective(60, 1.5f, 0.1f, 400);
+	Frustum _frustum;
+	_frustum.FromCameraMatrices(_view, _proj);
+
+	Array<float> _data(_count * 6);
+	AlignedBoxSoA _boxes;
+	_boxes.mnx = &_data[0];
+	_boxes.mny = &_data[_count];
+	_boxes.mnz = &_data[_count * 2];
+	_boxes.mxx = &_data[_count * 3];
+	_boxes.mxy = &_data[_count * 4];
+	_boxes.mxz = &_data[_count * 5];
+	_boxes.count = _count;
+	for (uint i = 0; i < _count; ++i)
+	{
+		Vec3 _center(rand() % 1000 - 500.f, rand() % 100 - 50.f, rand() % 1000 - 500.f);
+		Vec3 _extends(rand() % 3 + 0.5f, rand() % 3 + 0.5f, rand() % 3 + 0.5f);
+		for (uint j = 0; j < 3; ++j)
+		{
+			_data[_count * j + i] = _center[j] - _extends[j];
+			_data[_count * (j + 3) + i] = _center[j] + _extends[j];
+		}
+	}
+
+	Array<uint32> _scalar((_count + 31) / 32), _simd((_count + 31) / 32);
+
+	double _st = Timer::Ms();
+	for (uint q = 0; q < _numQueries; ++q)
+		_frustum.CullBoxes(_boxes, &_scalar[0], false);
+	double _scalarTime = (Timer::Ms() - _st) / _numQueries;
+
+	_st = Timer::Ms();
+	for (uint q = 0; q < _numQueries; ++q)
+		_frustum.CullBoxes(_boxes, &_simd[0], true);
+	double _simdTime = (Timer::Ms() - _st) / _numQueries;
+
+	uint _visible = 0;
+	for (uint i = 0; i < _count; ++i)
+		_visible += (_scalar[i >> 5] >> (i & 31)) & 1;
+
+	printf("%u boxes (%u visible): scalar %.3f ms, simd %.3f ms (%.1fx), %s\n", _count, _visible, _scalarTime, _simdTime, _scalarTime / _simdTime, _scalar == _simd ? "results are equal" : "RESULTS ARE DIFFERENT");
+
+	// compare with Frustum::Intersects, which tests bounding sphere of box and bounding box of frustum instead of planes
+
+	uint _bySphere = 0, _byBox = 0, _errors = 0;
+	for (uint i = 0; i < _count; ++i)
+	{
+		AlignedBox _box(Vec3(_boxes.mnx[i], _boxes.mny[i], _boxes.mnz[i]), Vec3(_boxes.mxx[i], _boxes.mxy[i], _boxes.mxz[i]));
+		bool _visible = ((_simd[i >> 5] >> (i & 31)) & 1) != 0;
+		if (_visible == _frustum.Intersects(_box))
+			continue;
+
+		if (_visible) // planes don't cull box near edge of frustum, but it's outside of bounding box of frustum
+		{
+			++_byBox;
+			if (_frustum.box.Intersects(_box))
+				++_errors;
+		}
+		else // bounding sphere isn't culled, but box is completely behind one of planes
+		{
+			++_bySphere;
+			Vec3 _corners[8];
+			_box.GetAllCorners(_corners);
+			bool _behind = false;
+			for (uint p = 0; p < 6 && !_behind; ++p)
+			{
+				uint _out = 0;
+				for (uint c = 0; c < 8; ++c)
+					_out += _frustum.planes[p].Distance(_corners[c]) < 0;
+				_behind = _out == 8;
+			}
+			if (!_behind)
+				++_errors;
+		}
+	}
+	printf("Frustum::Intersects: %u more visible by bounding sphere, %u less visible by bounding box of frustum, %s\n", _bySphere, _byBox, _errors ? "RESULTS ARE DIFFERENT" : "other results are equal");
+}
+
+void _TestFileSearch(void)
+{
+	const uint _numDirs = 4;
+	const uint _numFiles = 1000; // per directory
+	const uint _numQueries = 50000;
+
+	// test data: each directory has own subset of files, some names overlap
+	String _root = "SearchTest";
+	CreateDirectoryA(_root, nullptr);
+	for (uint d = 0; d < _numDirs; ++d)
+	{
+		String _dir = _root + String::Format("/Dir%u", d);
+		CreateDirectoryA(_dir, nullptr);
+		CreateDirectoryA(_dir + "/Sub", nullptr);
+		for (uint i = d * _numFiles / 2; i < d * _numFiles / 2 + _numFiles; ++i)
+		{
+			FILE* _f = fopen(_dir + String::Format(i & 1 ? "/Sub/File%u.txt" : "/File%u.txt", i), "wb");
+			if (_f)
+				fclose(_f);
+		}
+		gFileSystem->AddSearchDir(_dir, false);
+	}
+
+	StringArray _queries(_numQueries);
+	for (uint i = 0; i < _numQueries; ++i)
+	{
+		uint _id = rand() % (_numFiles * (_numDirs + 3) / 2); // ~20% of files don't exist
+		_queries[i] = String::Format(_id & 1 ? "Sub/FILE%u.txt" : "File%u", _id);
+	}
+
+	StringArray _exts = { "txt" };
+	StringArray _results[2];
+	double _time[2];
+	for (uint p = 0; p < 2; ++p)
+	{
+		gFileSystem->SetIndexing(p != 0);
+		_results[p].resize(_numQueries);
+		double _st = Timer::Ms();
+		for (uint i = 0; i < _numQueries; ++i)
+			_results[p][i] = gFileSystem->SearchFile(_queries[i], StringArray(), _exts);
+		_time[p] = Timer::Ms() - _st;
+	}
+
+	uint _found = 0;
+	for (uint i = 0; i < _numQueries; ++i)
+		_found += _results[0][i].NonEmpty();
+
+	printf("%u queries (%u found) in %u dirs: stat %.2f ms, index %.2f ms (%.1fx, first search builds index), %s\n", _numQueries, _found, _numDirs, _time[0], _time[1], _time[0] / _time[1],
+		_results[0] == _results[1] ? "results are equal" : "RESULTS ARE DIFFERENT");
+
+	// root directory is not indexed, paths relative to it are checked by stat
+	String _inRoot[2];
+	for (uint p = 0; p < 2; ++p)
+	{
+		gFileSystem->SetIndexing(p != 0);
+		_inRoot[p] = gFileSystem->Search(_root + "/Dir1/File500.txt");
+	}
+	printf("path relative to root: %s\n", _inRoot[0].NonEmpty() && _inRoot[0] == _inRoot[1] ? "found" : "NOT FOUND");
+
+	for (uint d = 0; d < _numDirs; ++d)
+		gFileSystem->RemoveSearchDir(_root + String::Format("/Dir%u", d));
+}
+
+struct TestQueueCmd
+{
+	double time;
+	uint seq;
+};
+
+struct TestQueueStats
+{
+	uint count = 0;
+	uint errors = 0;
+	double sumLatency = 0;
+	double maxLatency = 0;
+};
+
+TestQueueStats gTestQueueStats;
+
+void _TestQueueCmd(TestQueueCmd* _cmd)
+{
+	double _latency = Timer::Us() - _cmd->time;
+	gTestQueueStats.sumLatency += _latency;
+	if (gTestQueueStats.maxLatency < _latency)
+		gTestQueueStats.maxLatency = _latency;
+	if (_cmd->seq != gTestQueueStats.count++)
+		++gTestQueueStats.errors;
+}
+
+void _TestQueueConsumer(GLCommandQueue* _queue, volatile bool* _stop)
+{
+	while (!*_stop || !_queue->IsEmpty())
+	{
+		if (_queue->Execute())
+			continue;
+		GLCommandQueue::PrepareWait();
+		if (_queue->IsEmpty())
+			GLCommandQueue::Wait(20);
+		else
+			GLCommandQueue::CancelWait();
+	}
+}
+
+/// Command of variable size: sequence number and size of payload, followed by payload.
+void _TestQueueBlob(void* _data)
+{
+	const uint* _header = reinterpret_cast<const uint*>(_data);
+	const uint8* _payload = reinterpret_cast<const uint8*>(_header + 2);
+	for (uint i = 0; i < _header[1]; ++i)
+	{
+		if (_payload[i] != (uint8)(_header[0] + i))
+		{
+			++gTestQueueStats.errors;
+			break;
+		}
+	}
+	if (_header[0] != gTestQueueStats.count++)
+		++gTestQueueStats.errors;
+}
+
+void _TestQueueLateConsumer(GLCommandQueue* _queue, volatile bool* _stop)
+{
+	Thread::Pause(200); // producer fills all chunks and waits
+	_TestQueueConsumer(_queue, _stop);
+}
+
+void _TestCommandQueue(void)
+{
+	const uint _numCmds = 2000000;
+	const uint _burstSize = 64;
+
+	for (uint _burst = 0; _burst < 2; ++_burst)
+	{
+		GLCommandQueue _queue;
+		volatile bool _stop = false;
+		gTestQueueStats = TestQueueStats();
+
+		double _st = Timer::Ms();
+		Thread _consumer(&_TestQueueConsumer, &_queue, &_stop);
+		TestQueueCmd _cmd;
+		uint _count = _burst ? _numCmds / 100 : _numCmds;
+		for (uint i = 0; i < _count; ++i)
+		{
+			// burst mode: producer is idle between small batches, as the render thread between frames
+			if (_burst && i % _burstSize == 0)
+				Thread::Pause(1);
+			_cmd.time = Timer::Us();
+			_cmd.seq = i;
+			_queue.Push(&_TestQueueCmd, &_cmd);
+		}
+		_stop = true;
+		_consumer.Wait();
+		double _time = Timer::Ms() - _st;
+
+		TestQueueStats& _s = gTestQueueStats;
+		printf("%s: %u commands in %.2f ms (%.2f M/s), latency avg %.2f us, max %.2f us, %u chunks, %s\n", _burst ? "burst" : "saturated", _s.count, _time, _s.count / (_time * 1000),
+			_s.count ? _s.sumLatency / _s.count : 0, _s.maxLatency, _queue.GetNumChunks(), _s.errors ? "ORDER IS BROKEN" : "order is preserved");
+	}
+
+	// overflow and commands larger than chunk
+	{
+		GLCommandQueue _queue;
+		volatile bool _stop = false;
+		gTestQueueStats = TestQueueStats();
+
+		Thread _consumer(&_TestQueueLateConsumer, &_queue, &_stop);
+		Array<uint8> _blob(GLCommandQueue::CHUNK_SIZE * 2 + 8);
+		uint _count = 5000, _maxChunks = 0;
+		for (uint i = 0; i < _count; ++i)
+		{
+			uint _size = i % 100 == 50 ? GLCommandQueue::CHUNK_SIZE + rand() % GLCommandQueue::CHUNK_SIZE : rand() % 4096;
+			uint _header[2] = { i, _size };
+			memcpy(&_blob[0], _header, 8);
+			for (uint j = 0; j < _size; ++j)
+				_blob[8 + j] = (uint8)(i + j);
+			_queue.Push(&_TestQueueBlob, &_blob[0], 8 + _size);
+			_maxChunks = Max(_maxChunks, _queue.GetNumChunks());
+		}
+		_stop = true;
+		_consumer.Wait();
+
+		TestQueueStats& _s = gTestQueueStats;
+		printf("overflow: %u of %u commands, max %u chunks, %u chunks at end, %s\n", _s.count, _count, _maxChunks, _queue.GetNumChunks(),
+			_s.count == _count && !_s.errors ? "data is preserved" : "DATA IS BROKEN");
+	}
+}
+
+struct TestNamesParams
+{
+	const StringArray* names;
+	uint seed;
+	uint count;
+	bool useTable;
+};
+
+HashMap<uint, String> gTestNamesMap; // global map with single lock, as the names were interned before
+volatile int gTestNamesLock = 0;
+
+void _TestNamesThread(TestNamesParams* _params)
+{
+	const StringArray& _names = *_params->names;
+	uint _seed = _params->seed;
+	for (uint i = 0; i < _params->count; ++i)
+	{
+		_seed = _seed * 1664525 + 1013904223;
+		const String& _str = _names[(_seed >> 8) % _names.size()];
+		if (_params->useTable)
+		{
+			Name _name(_str);
+		}
+		else
+		{
+			uint _hash = _str.Hashi();
+			AtomicLock(gTestNamesLock);
+			auto _it = gTestNamesMap.find(_hash);
+			if (_it == gTestNamesMap.end())
+				gTestNamesMap[_hash] = _str;
+			AtomicUnlock(gTestNamesLock);
+		}
+	}
+}
+
+void _TestNames(void)
+{
+	const uint _numNames = 50000;
+	const uint _numOps = 400000; // per thread
+
+	StringArray _names(_numNames);
+	for (uint i = 0; i < _numNames; ++i)
+		_names[i] = String::Format(i & 1 ? "Mesh/Part%u_LOD%u" : "material_%u.mtl", i, i % 4);
+
+	for (uint _numThreads = 1; _numThreads <= 8; _numThreads <<= 1)
+	{
+		double _time[2];
+		for (uint p = 0; p < 2; ++p)
+		{
+			TestNamesParams _params[8];
+			Thread* _threads[8];
+			double _st = Timer::Ms();
+			for (uint i = 0; i < _numThreads; ++i)
+			{
+				_params[i] = { &_names, i * 7919, _numOps, p != 0 };
+				_threads[i] = new Thread(&_TestNamesThread, &_params[i]);
+			}
+			for (uint i = 0; i < _numThreads; ++i)
+			{
+				_threads[i]->Wait();
+				delete _threads[i];
+			}
+			_time[p] = Timer::Ms() - _st;
+		}
+		printf("%u threads: %u names, global lock %.2f ms (%.1f ns/name), table %.2f ms (%.1f ns/name), %.1fx\n", _numThreads, _numOps * _numThreads,
+			_time[0], _time[0] * 1e6 / (_numOps * _numThreads), _time[1], _time[1] * 1e6 / (_numOps * _numThreads), _time[0] / _time[1]);
+	}
+
+	uint _errors = 0;
+	for (uint i = 0; i < _numNames; ++i)
+	{
+		Name _a(_names[i]), _b(_names[i].CStr()), _c(_names[(i + 1) % _numNames]);
+		_errors += _a != _b || _a == _c || _a.Hash() != NameHash(_names[i]);
+	}
+
+	uint _count = Name::GetCount();
+	size_t _memory = Name::GetMemoryUse();
+	printf("%u names interned, %.2f KB (%.1f bytes per name), %s\n", _count, _memory / 1024.0, (double)_memory / _count, _errors ? "NAMES ARE DIFFERENT" : "names are equal");
+
+	gTestNamesMap.clear();
+}
+
+uint _TestStringsPaths(const StringArray& _paths, uint _first, uint _count)
+{
+	uint _check = 0;
+	for (uint i = _first; i < _first + _count; ++i)
+	{
+		String _dir, _name, _ext, _device;
+		StringArray _items;
+		SplitFilename(_paths[i], nullptr, &_dir, &_name, nullptr, &_ext);
+		SplitPath(_paths[i], &_device, &_items);
+		_check += MakePath(_device, _items).Length() + _dir.Length() + _name.Length() + _ext.Length();
+	}
+	return _check;
+}
+
+uint _TestStringsConfig(const String& _text)
+{
+	Config _cfg;
+	_cfg.Parse(_text);
+	return _cfg.Size();
+}
+
+struct TestArenaCopy
+{
+	const String* src;
+	String* copy;
+};
+
+void _TestArenaCopyThread(TestArenaCopy* _params)
+{
+	_params->copy = new String(*_params->src); // thread without arena
+}
+
+void _TestStrings(void)
+{
+	const uint _numPaths = 20000;
+	const uint _numParses = 20;
+
+	StringArray _paths(_numPaths);
+	for (uint i = 0; i < _numPaths; ++i)
+		_paths[i] = String::Format("Data/%s/Group%u/../Item%u/./%s_%u.%s", i & 1 ? "Textures" : "Models", i % 7, i % 31, i & 1 ? "diffuse" : "mesh", i, i & 1 ? "dds" : "obj");
+
+	String _text;
+	for (uint i = 0; i < 2000; ++i)
+		_text += String::Format("Material:Item%u = { Name = \"item_%u\", Path = \"Data/Models/item_%u.obj\", Flags = [ Static, CastShadows, Lod%u ], Scale = %u.5, Visible = true }\n", i, i, i, i % 4, i % 10);
+
+	for (uint _useArena = 0; _useArena < 2; ++_useArena)
+	{
+		uint _memory = String::GetTotalMemoryUse();
+		double _st = Timer::Ms();
+		uint _check = 0;
+		for (uint i = 0; i < _numPaths; i += 250)
+		{
+			if (_useArena)
+			{
+				String::Arena _arena; // all temporary strings are freed together
+				_check += _TestStringsPaths(_paths, i, 250);
+			}
+			else
+				_check += _TestStringsPaths(_paths, i, 250);
+		}
+		double _pathTime = Timer::Ms() - _st;
+		uint _pathMemory = String::GetTotalMemoryUse() - _memory;
+
+		_st = Timer::Ms();
+		for (uint i = 0; i < _numParses; ++i)
+		{
+			if (_useArena)
+			{
+				String::Arena _arena;
+				_check += _TestStringsConfig(_text);
+			}
+			else
+				_check += _TestStringsConfig(_text);
+		}
+		double _parseTime = Timer::Ms() - _st;
+
+		printf("%s: %u paths %.2f ms (%.0f ns/path), %u config parses (%u bytes) %.2f ms, %u bytes are not freed, check %u\n", _useArena ? "arena" : "heap", _numPaths, _pathTime, _pathTime * 1e6 / _numPaths,
+			_numParses, _text.Length(), _parseTime, _pathMemory, _check);
+	}
+
+	// strings which are created out of scope of arena must not move to the arena
+	uint _errors = 0;
+	String _longLived = "long lived string";
+	String _assigned;
+	TestArenaCopy _copy = { nullptr, nullptr };
+	{
+		String::Arena _arena;
+		_longLived += " which grows in scope of arena";
+		String _temp = String::Format("temporary string %u of arena", 1);
+		_assigned = _temp;
+
+		_copy.src = &_temp;
+		Thread _thread(&_TestArenaCopyThread, &_copy);
+		_thread.Wait();
+
+		String _outer = "string of outer arena";
+		{
+			String::Arena _nested;
+			_outer += " which grows in scope of nested arena";
+			String _inner = _temp + " assigned in nested arena";
+			_temp = _inner;
+		}
+		_errors += _outer != "string of outer arena which grows in scope of nested arena";
+		_errors += _temp != "temporary string 1 of arena assigned in nested arena";
+	}
+	{
+		String::Arena _arena; // reuse memory of destroyed arenas
+		for (uint i = 0; i < 100; ++i)
+			_text = String(100 + i, '#');
+	}
+	_errors += _longLived != "long lived string which grows in scope of arena";
+	_errors += _assigned != "temporary string 1 of arena";
+	_errors += !_copy.copy || *_copy.copy != "temporary string 1 of arena";
+	delete _copy.copy;
+	printf("arena lifetime: %u errors\n", _errors);
+}
+
+uint32 _TestHashesCrc32(uint32 _crc, const uint8* _data, uint _size)
+{
+	// bitwise reference implementation
+	_crc = ~_crc;
+	while (_size--)
+	{
+		_crc ^= *_data++;
+		for (uint i = 0; i < 8; ++i)
+			_crc = (_crc >> 1) ^ (0xedb88320 & (0 - (_crc & 1)));
+	}
+	return ~_crc;
+}
+
+uint32 _TestHashesHashi(const char* _str, uint _size, uint32 _hash)
+{
+	// per-char reference implementation
+	while (_size--)
+		_hash = ToLower(*_str++) + (_hash << 6) + (_hash << 16) - _hash;
+	return _hash;
+}
+
+void _TestHashes(void)
+{
+	const uint _sizes[] = { 16, 1024, 1 << 20 };
+	const uint _totalSize = 256 << 20;
+
+	Array<uint8> _data(1 << 20);
+	uint32 _rand = 1;
+	for (uint i = 0; i < _data.size(); ++i)
+	{
+		_rand = _rand * 1103515245 + 12345;
+		_data[i] = (uint8)(_rand >> 16);
+	}
+	const char* _str = (const char*)&_data[0];
+
+	uint _errors = 0;
+	for (uint i = 0; i < 4096; ++i)
+	{
+		uint _offset = i & 15, _size = (i * 7) % 2000;
+		_errors += Crc32(i, &_data[_offset], _size) != _TestHashesCrc32(i, &_data[_offset], _size);
+		_errors += String::Hashi(_str + _offset, _size, i) != _TestHashesHashi(_str + _offset, _size, i);
+	}
+	printf("hashes are %s\n", _errors ? "DIFFERENT" : "equal");
+
+	for (uint _size : _sizes)
+	{
+		uint _count = _totalSize / _size;
+		uint64 _check = 0;
+
+		double _st = Timer::Ms();
+		for (uint i = 0; i < _count; ++i)
+			_check += Crc32((uint32)_check, &_data[0], _size);
+		double _crcTime = Timer::Ms() - _st;
+
+		_st = Timer::Ms();
+		for (uint i = 0; i < _count; ++i)
+			_check += Hash64(&_data[0], _size, _check);
+		double _hash64Time = Timer::Ms() - _st;
+
+		_st = Timer::Ms();
+		for (uint i = 0; i < _count; ++i)
+			_check += String::Hashi(_str, _size, (uint32)_check);
+		double _hashiTime = Timer::Ms() - _st;
+
+		_st = Timer::Ms();
+		for (uint i = 0; i < _count / 16; ++i)
+			_check += _TestHashesCrc32((uint32)_check, &_data[0], _size);
+		double _refTime = (Timer::Ms() - _st) * 16;
+
+		double _mb = _totalSize / (1024.0 * 1024.0 / 1000.0);
+		printf("%u bytes: Crc32 %.0f MB/s (bitwise %.0f MB/s), Hash64 %.0f MB/s, Hashi %.0f MB/s, check %llu\n", _size, _mb / _crcTime, _mb / _refTime, _mb / _hash64Time, _mb / _hashiTime, (unsigned long long)_check);
+	}
+}
+
+uint _TestBatchMathUlps(const float* _a, const float* _b, uint _count)
+{
+	uint _maxUlps = 0;
+	for (uint i = 0; i < _count; ++i)
+	{
+		int32 _ia, _ib;
+		memcpy(&_ia, _a + i, 4);
+		memcpy(&_ib, _b + i, 4);
+		if (_ia < 0)
+			_ia = INT32_MIN - _ia; // -0 and +0 are equal
+		if (_ib < 0)
+			_ib = INT32_MIN - _ib;
+		uint _ulps = (uint)(_ia > _ib ? (int64)_ia - _ib : (int64)_ib - _ia);
+		_maxUlps = Max(_maxUlps, _ulps);
+	}
+	return _maxUlps;
+}
+
+float _TestBatchMathRand(float _min, float _max)
+{
+	return _min + (_max - _min) * (rand() / (float)RAND_MAX);
+}
+
+void _TestBatchMath(void)
+{
+	const uint _count = 100000;
+	const uint _numPasses = 100;
+
+	Mat34 _m;
+	_m.CreateTransform(Vec3(1, -2, 3), Quat().FromAxisAngle(Vec3(1, 2, 3).Normalize(), 0.7f), Vec3(1.5f, 0.5f, 2));
+	Mat44 _proj;
+	_proj.CreatePerspective(60, 1.5f, 0.1f, 400);
+	_proj *= _m;
+
+	Array<Vec3> _points(_count), _points2(_count), _points3(_count);
+	Array<Quat> _quats(_count), _quats2(_count), _quats3(_count);
+	Array<Mat34> _ma(_count), _mb(_count), _mats2(_count), _mats3(_count);
+	Array<AlignedBox> _boxes(_count), _boxes2(_count), _boxes3(_count);
+	for (uint i = 0; i < _count; ++i)
+	{
+		_points[i].Set(_TestBatchMathRand(-100, 100), _TestBatchMathRand(-100, 100), _TestBatchMathRand(-100, 100));
+		_quats[i].Set(_TestBatchMathRand(-2, 2), _TestBatchMathRand(-2, 2), _TestBatchMathRand(-2, 2), _TestBatchMathRand(-2, 2));
+		_ma[i].CreateTransform(_points[i], _quats[i].Copy().Normalize(), Vec3(_TestBatchMathRand(0.1f, 3)));
+		_mb[i].CreateTransform(_points[(i * 7) % _count], _quats[(i * 13) % _count].Copy().Normalize());
+		_boxes[i].FromCenterExtends(_points[i], Vec3(_TestBatchMathRand(0, 5), _TestBatchMathRand(0, 5), _TestBatchMathRand(0, 5)));
+	}
+	_quats[1] = Quat::Zero;
+
+	// compare with per-element operators on small arrays to check scalar tails of SIMD paths, for each instruction set supported by CPU
+
+	const char* _levelNames[] = { "scalar", "SSE", "AVX" };
+	SimdLevel _cpuLevel = GetSimdLevel();
+	for (int _level = _cpuLevel; _level >= SL_SSE; --_level)
+	{
+		SetMaxSimdLevel((SimdLevel)_level);
+		uint _maxUlps = 0;
+		for (uint n = 0; n < 40; ++n)
+		{
+			for (uint i = 0; i < n; ++i)
+			{
+				_points3[i] = _m.Transform(_points[i]);
+				_quats3[i] = _quats[i].Copy().Normalize();
+				_mats3[i] = _ma[i] * _mb[i];
+				_boxes3[i] = _boxes[i] * _m;
+			}
+			TransformPoints(_m, &_points[0], &_points2[0], n);
+			_maxUlps = Max(_maxUlps, _TestBatchMathUlps(*_points2[0], *_points3[0], n * 3));
+			NormalizeQuatArray(&_quats[0], &_quats2[0], n);
+			_maxUlps = Max(_maxUlps, _TestBatchMathUlps(_quats2[0].v, _quats3[0].v, n * 4));
+			MultiplyMat34Array(&_ma[0], &_mb[0], &_mats2[0], n);
+			_maxUlps = Max(_maxUlps, _TestBatchMathUlps(_mats2[0].v, _mats3[0].v, n * 12));
+			TransformAlignedBoxes(_m, &_boxes[0], &_boxes2[0], n);
+			_maxUlps = Max(_maxUlps, _TestBatchMathUlps(*_boxes2[0].mn, *_boxes3[0].mn, n * 6));
+
+			for (uint i = 0; i < n; ++i)
+			{
+				_points3[i] = _proj.Transform(_points[i]);
+				_mats3[i].CreateRotation(_quats[i]);
+			}
+			TransformPoints(_proj, &_points[0], &_points2[0], n);
+			_maxUlps = Max(_maxUlps, _TestBatchMathUlps(*_points2[0], *_points3[0], n * 3));
+			QuatToMat34Array(&_quats[0], &_mats2[0], n);
+			_maxUlps = Max(_maxUlps, _TestBatchMathUlps(_mats2[0].v, _mats3[0].v, n * 12));
+		}
+		printf("batch math (%s): max error %u ulps (bound %u), %s\n", _levelNames[_level], _maxUlps, BATCH_MAX_ULP, _maxUlps <= BATCH_MAX_ULP ? "ok" : "FAILED");
+	}
+	SetMaxSimdLevel(_cpuLevel);
+
+	// throughput of per-element operators and batch operations
+
+	double _st, _opTime, _batchTime;
+	double _items = (double)_count * _numPasses / 1000; // thousands, for Mitems/s from ms
+#define BATCH_MATH_BENCHMARK(_name, _op, _batch) \
+	_st = Timer::Ms(); \
+	for (uint p = 0; p < _numPasses; ++p) \
+		for (uint i = 0; i < _count; ++i) \
+			_op; \
+	_opTime = Timer::Ms() - _st; \
+	_st = Timer::Ms(); \
+	for (uint p = 0; p < _numPasses; ++p) \
+		_batch; \
+	_batchTime = Timer::Ms() - _st; \
+	printf("%-22s operators %7.1f Mitems/s, batch %7.1f Mitems/s (%.1fx)\n", _name, _items / _opTime, _items / _batchTime, _opTime / _batchTime)
+
+	BATCH_MATH_BENCHMARK("TransformPoints(Mat34)", _points2[i] = _m.Transform(_points[i]), TransformPoints(_m, &_points[0], &_points2[0], _count));
+	BATCH_MATH_BENCHMARK("TransformPoints(Mat44)", _points2[i] = _proj.Transform(_points[i]), TransformPoints(_proj, &_points[0], &_points2[0], _count));
+	BATCH_MATH_BENCHMARK("MultiplyMat34Array", _mats2[i] = _ma[i] * _mb[i], MultiplyMat34Array(&_ma[0], &_mb[0], &_mats2[0], _count));
+	BATCH_MATH_BENCHMARK("QuatToMat34Array", _mats2[i].CreateRotation(_quats[i]), QuatToMat34Array(&_quats[0], &_mats2[0], _count));
+	BATCH_MATH_BENCHMARK("NormalizeQuatArray", _quats2[i] = _quats[i].Copy().Normalize(), NormalizeQuatArray(&_quats[0], &_quats2[0], _count));
+	BATCH_MATH_BENCHMARK("TransformAlignedBoxes", _boxes2[i] = _boxes[i] * _m, TransformAlignedBoxes(_m, &_boxes[0], &_boxes2[0], _count));
+
+#undef BATCH_MATH_BENCHMARK
+}
+
+void _TestResourceCache(void)
+{
+	const uint _numItems = 64;
+	const uint _itemSize = 4096;
+	uint _errors = 0;
+
+	// load queue returns resources with larger priority first
+	{
+		ResourceQueue _queue;
+		Array<ResourcePtr> _items;
+		for (uint i = 0; i < _numItems; ++i)
+		{
+			_items.push_back(new TestResource);
+			_queue.Push(_items[i], (float)((i * 37) % _numItems)); // all priorities are different
+		}
+		_queue.Update(_items[5], (float)_numItems);
+		_queue.Update(_items[9], -1);
+
+		ResourcePtr _r = _queue.Pop(), _last = _r;
+		_errors += _r != _items[5];
+		while (_r)
+		{
+			_errors += _r->GetPriority() > _last->GetPriority();
+			_last = _r;
+			_r = _queue.Pop();
+		}
+		_errors += _last != _items[9];
+		_errors += _queue.Size() != 0;
+	}
+
+	// test data
+	CreateDirectoryA("ResourceCacheTest", nullptr);
+	for (uint i = 0; i < _numItems; ++i)
+	{
+		FILE* _f = fopen(String::Format("ResourceCacheTest/Item%u.txt", i), "wb");
+		if (_f)
+		{
+			String _text(_itemSize, (char)('a' + i % 26));
+			fwrite(*_text, 1, _text.Length(), _f);
+			fclose(_f);
+		}
+	}
+	gFileSystem->AddSearchDir("ResourceCacheTest", false);
+
+	ResourceType* _rt = gResourceCache->GetType("TestResource");
+	size_t _budget = _itemSize * _numItems / 4;
+	gResourceCache->SetBudget("TestResource", _budget);
+	ResourceCache::Stats _stats = gResourceCache->GetStats();
+
+	// load all items, hold references to each 8th item and keep touching last 8 items
+	Array<Resource*> _items;
+	Array<ResourcePtr> _held;
+	size_t _residentSize = _rt->GetResidentSize();
+	for (uint i = 0; i < _numItems; ++i)
+	{
+		_items.push_back(gResourceCache->LoadResource("TestResource", String::Format("Item%u", i), false));
+		if (i % 8 == 0)
+			_held.push_back(_items[i]);
+	}
+	_errors += _rt->GetResidentSize() - _residentSize != _numItems * _itemSize;
+
+	for (uint _frame = 0; _frame < 3; ++_frame)
+	{
+		for (uint i = _numItems - 8; i < _numItems; ++i)
+			_items[i]->Touch();
+		gResourceCache->Update();
+	}
+
+	ResourceCache::Stats _evicted = gResourceCache->GetStats();
+	uint _numEvicted = _evicted.numEvicted - _stats.numEvicted;
+	_errors += _rt->GetResidentSize() > _budget;
+	_errors += _numEvicted < _numItems - _numItems / 4;
+	for (uint i = 0; i < _numItems; ++i)
+		_errors += (i % 8 == 0 || i >= _numItems - 8) && !_items[i]->IsLoaded(); // referenced and recently touched items are evicted last
+	_held.clear();
+
+	// reload evicted items asynchronously
+	uint _numRequested = 0;
+	Resource* _sync = nullptr;
+	for (uint i = 0; i < _numItems; ++i)
+	{
+		if (!_items[i]->IsLoaded())
+		{
+			_items[i]->Request(Resource::MakePriority((float)i));
+			++_numRequested;
+			_sync = _items[i]; // lowest priority
+		}
+	}
+
+	// synchronous load of requested item removes it from load queue
+	if (_sync)
+	{
+		_sync->Load(false);
+		_errors += !_sync->IsLoaded();
+	}
+	double _st = Timer::Ms();
+	for (uint i = 0; i < _numItems && Timer::Ms() - _st < 10000;)
+	{
+		if (_items[i]->IsLoaded())
+			++i;
+		else
+			Thread::Pause(1);
+	}
+
+	ResourceCache::Stats _loaded = gResourceCache->GetStats();
+	_errors += _loaded.numLoaded - _evicted.numLoaded != _numRequested;
+	_errors += _loaded.numQueued != 0;
+	_errors += !(_loaded.latency50 <= _loaded.latency90 && _loaded.latency90 <= _loaded.latency99 && _loaded.latency99 <= _loaded.latencyMax && _loaded.latencyMax > 0);
+
+	// item loaded synchronously can be requested again
+	if (_sync && _sync->Unload())
+	{
+		_sync->Request(Resource::MakePriority(0));
+		for (_st = Timer::Ms(); !_sync->IsLoaded() && Timer::Ms() - _st < 10000;)
+			Thread::Pause(1);
+		_errors += !_sync->IsLoaded();
+	}
+
+	printf("resource cache: %u items, budget %u KB, evicted %u items (%u KB), reloaded %u items, latency %.2f/%.2f/%.2f/%.2f ms (50/90/99/max), %u errors\n", _numItems, (uint)(_budget >> 10), _numEvicted,
+		(uint)((_evicted.evictedBytes - _stats.evictedBytes) >> 10), _numRequested, _loaded.latency50, _loaded.latency90, _loaded.latency99, _loaded.latencyMax, _errors);
+
+	gResourceCache->SetBudget("TestResource", 0);
+	gFileSystem->RemoveSearchDir("ResourceCacheTest");
+}
 
 int main(void)
 {
@@ -292,6 +1142,15 @@ int main(void)
 	//system("pause");
 	//return 0;
 
+	//_TestDbvt();
+	//_TestFrustumCulling();
+	//_TestFileSearch();
+	//_TestCommandQueue();
+	//_TestNames();
+	//_TestStrings();
+	//_TestHashes();
+	//_TestBatchMath();
+
 	PRINT_SIZEOF(Sandbox::Actor);
 
 
@@ -318,10 +1177,13 @@ int main(void)
 		gResourceCache->LoadResource("TestResource", "test.txt", true);
 		gResourceCache->Load<TestResource>("Test/test.txt", true);
 
+		//_TestResourceCache();
+
 		gWindow->SetVisible();
 		while (gWindow->IsOpened())
 		{
 			gWindow->PollEvents();
+			gResourceCache->Update();
 			//Thread::Pause(1);
 			gRenderContext->BeginFrame();
 			gRenderContext->EndFrame();
@@ -177,38 +177,59 @@ namespace Engine
 	inline char ToLower(char _ch) { return ((_ch >= 'A' && _ch <= 'Z') || (_ch >= 'a' && _ch <= 'z') || ((uint8)_ch >= 0xc0)) ? (_ch | 0x20) : _ch; }
 	inline char ToUpper(char _ch) { return ((_ch >= 'A' && _ch <= 'Z') || (_ch >= 'a' && _ch <= 'z') || ((uint8)_ch >= 0xc0)) ? (_ch & ~0x20) : _ch; }
 
+	/// String with small-string optimization. Strings up to LOCAL_SIZE characters are stored in the object itself,
+	/// larger strings use a shared buffer with a reference counter and copy-on-write.
 	class String
 	{
 	public:
-		String(void) : m_buffer(_Null()) { }
-		~String(void) { _Release(m_buffer); }
-		String(const String& _other) : m_buffer(_AddRef(_other.m_buffer)) { }
-		String(int _ch) : m_buffer(_ch ? _New((const char*)&_ch, 1) : _Null()) { }
-		String(char _ch) : m_buffer(_ch ? _New(&_ch, 1) : _Null()) { }
-		String(const char* _str, int _length = -1) : m_buffer(_New(_str, _Length(_str, _length))) { }
-		String(const char* _first, const char* _last) : m_buffer(_first == _last ? _Null() : _New(_first, (uint)(_last - _first))) { }
-		String(uint _count, char _ch) : m_buffer(_New(nullptr, _count)) { while (_count--) m_buffer->str[_count] = _ch; }
-
-		String& operator = (const String& _str) { _AddRef(_str.m_buffer); _Release(m_buffer); m_buffer = _str.m_buffer; return *this; }
+		class Arena;
+
+		enum : uint
+		{
+			LOCAL_SIZE = 23, //!< Max length of string stored without heap allocation.
+		};
+
+		String(void) { _SetLocalLength(0, s_depth); }
+		~String(void) { if (!_IsLocal()) _Release(m_buffer); }
+		String(const String& _other) { _SetLocalLength(0, s_depth); _Assign(_other, false); }
+		String(String&& _temp) { _SetLocalLength(0, s_depth); _Assign(_temp, true); }
+		String(int _ch) { char _c = (char)_ch; _Init(&_c, _c ? 1 : 0); }
+		String(char _ch) { _Init(&_ch, _ch ? 1 : 0); }
+		String(const char* _str, int _length = -1) { _Init(_str, _Length(_str, _length)); }
+		String(const char* _first, const char* _last) { _Init(_first, (uint)(_last - _first)); }
+		String(uint _count, char _ch) { _Init(nullptr, _count); memset(_Data(), _ch, _count); }
+
+		String& operator = (const String& _str)
+		{
+			if (this != &_str)
+				_Assign(_str, false);
+			return *this;
+		}
+		String& operator = (String&& _temp)
+		{
+			if (this != &_temp)
+				_Assign(_temp, true);
+			return *this;
+		}
 		String& operator = (const char* _str) { return Clear().Append(_str, -1, false); }
 		String& operator = (char _ch) { return Clear().Append(&_ch, 1, false); }
 
-		operator const char* (void) const { return m_buffer->str; }
-		char operator [] (int _idx) const { return ((uint)_idx) < m_buffer->length ? m_buffer->str[_idx] : 0; }
-		const char* operator * (void) const { return m_buffer->str; }
+		operator const char* (void) const { return CStr(); }
+		char operator [] (int _idx) const { return ((uint)_idx) < Length() ? CStr()[_idx] : 0; }
+		const char* operator * (void) const { return CStr(); }
 
-		bool operator == (const String& _lhs) const { return m_buffer == _lhs.m_buffer || (m_buffer->length == _lhs.m_buffer->length && Compare(m_buffer->str, _lhs.m_buffer->str) == 0); }
-		bool operator == (const char* _lhs) const { return Compare(m_buffer->str, _lhs) == 0; }
+		bool operator == (const String& _lhs) const { uint _length = Length(); return _length == _lhs.Length() && memcmp(CStr(), _lhs.CStr(), _length) == 0; }
+		bool operator == (const char* _lhs) const { return Compare(CStr(), _lhs) == 0; }
 		bool operator != (const String& _lhs) const { return !(*this == _lhs); }
 		bool operator != (const char* _lhs) const { return !(*this == _lhs); }
-		bool operator < (const String& _lhs) const { return Compare(m_buffer->str, _lhs.m_buffer->str) < 0; }
-		bool operator < (const char* _lhs) const { return Compare(m_buffer->str, _lhs) < 0; }
-		bool operator <= (const String& _lhs) const { return Compare(m_buffer->str, _lhs.m_buffer->str) <= 0; }
-		bool operator <= (const char* _lhs) const { return Compare(m_buffer->str, _lhs) <= 0; }
-		bool operator > (const String& _lhs) const { return Compare(m_buffer->str, _lhs.m_buffer->str) > 0; }
-		bool operator > (const char* _lhs) const { return Compare(m_buffer->str, _lhs) > 0; }
-		bool operator >= (const String& _lhs) const { return Compare(m_buffer->str, _lhs.m_buffer->str) >= 0; }
-		bool operator >= (const char* _lhs) const { return Compare(m_buffer->str, _lhs) >= 0; }
+		bool operator < (const String& _lhs) const { return Compare(CStr(), _lhs.CStr()) < 0; }
+		bool operator < (const char* _lhs) const { return Compare(CStr(), _lhs) < 0; }
+		bool operator <= (const String& _lhs) const { return Compare(CStr(), _lhs.CStr()) <= 0; }
+		bool operator <= (const char* _lhs) const { return Compare(CStr(), _lhs) <= 0; }
+		bool operator > (const String& _lhs) const { return Compare(CStr(), _lhs.CStr()) > 0; }
+		bool operator > (const char* _lhs) const { return Compare(CStr(), _lhs) > 0; }
+		bool operator >= (const String& _lhs) const { return Compare(CStr(), _lhs.CStr()) >= 0; }
+		bool operator >= (const char* _lhs) const { return Compare(CStr(), _lhs) >= 0; }
 
 		String& operator += (const String& _lhs) { return Append(_lhs); }
 		String& operator += (char _lhs) { return Append(_lhs); }
@@ -224,69 +245,65 @@ namespace Engine
 		String& Reserve(uint _size);
 		String& Append(char _ch) { return _ch ? Append(&_ch, 1) : *this; }
 		String& Append(uint _count, char _ch);
-		String& Append(const String& _str) { return Append(_str.m_buffer->str, _str.m_buffer->length); }
+		String& Append(const String& _str) { return Append(_str.CStr(), _str.Length()); }
 		String& Append(const char* _str, int _length = -1, bool _quantizeMemory = true);
 		String& Append(const char* _first, const char* _last) { ASSERT(_first <= _last); return Append(_first, (uint)(_last - _first)); }
 		String SubStr(uint _offset, int _length = -1) const
 		{
-			ASSERT(_length < 0 || (uint)(_offset + _length) < m_buffer->length);
-			return String(m_buffer->str + _offset, _length);
-		}
-
-		bool IsEmpty(void) const { return m_buffer->length == 0; }
-		bool NonEmpty(void) const { return m_buffer->length != 0; }
-		uint Length(void) const { return m_buffer->length; }
-		char At(uint _idx) const { return _idx < m_buffer->length ? m_buffer->str[_idx] : 0; }
-		char Back(void) const { return m_buffer->length > 1 ? m_buffer->str[m_buffer->length - 1] : 0; }
-		const char* CStr(void) const { return m_buffer->str; }
-		const char* Ptr(void) const { return m_buffer->str; }
-		const char* Ptr(uint _offset) const { ASSERT(_offset < m_buffer->length); return m_buffer->str + _offset; }
-		uint32 Hash(uint32 _hash = 0) const { return Hash(m_buffer->str, _hash); }
-		uint32 Hashi(uint32 _hash = 0) const { return Hashi(m_buffer->str, _hash); }
-		StringArray Split(const char* _delimiters) const { StringArray _dst; Split(m_buffer->str, _delimiters, _dst); return Move(_dst); }
+			ASSERT(_length < 0 || (uint)(_offset + _length) < Length());
+			return String(CStr() + _offset, _length);
+		}
+
+		bool IsEmpty(void) const { return Length() == 0; }
+		bool NonEmpty(void) const { return Length() != 0; }
+		uint Length(void) const { return _IsLocal() ? LOCAL_SIZE - ((uint8)m_local[LOCAL_SIZE] & LENGTH_MASK) : m_buffer->length; }
+		char At(uint _idx) const { return _idx < Length() ? CStr()[_idx] : 0; }
+		char Back(void) const { uint _length = Length(); return _length > 1 ? CStr()[_length - 1] : 0; }
+		const char* CStr(void) const { return _IsLocal() ? m_local : m_buffer->str; }
+		const char* Ptr(void) const { return CStr(); }
+		const char* Ptr(uint _offset) const { ASSERT(_offset < Length()); return CStr() + _offset; }
+		uint32 Hash(uint32 _hash = 0) const { return Hash(CStr(), Length(), _hash); }
+		uint32 Hashi(uint32 _hash = 0) const { return Hashi(CStr(), Length(), _hash); }
+		StringArray Split(const char* _delimiters) const { StringArray _dst; Split(CStr(), _delimiters, _dst); return Move(_dst); }
 		bool Equals(const char* _rhs, bool _ignoreCase = false) const { return Compare(*this, _rhs, _ignoreCase) == 0; }
 		String Trim(const char* _cset, bool _left = true, bool _right = true) const
 		{
 			if (!_cset)
 				return *this;
 
-			const char* _s = m_buffer->str;
-			const char* _e = m_buffer->str + m_buffer->length;
+			uint _length = Length();
+			const char* _s = CStr();
+			const char* _e = _s + _length;
 			while (_left && _s > _e && strchr(_cset, *_s))
 				++_s;
 			while (_right && _s > _e && strchr(_cset, *_e))
 				--_e;
 
-			uint _length = (uint)(_e - _s);
-			if (_length == m_buffer->length)
+			uint _newLength = (uint)(_e - _s);
+			if (_newLength == _length)
 				return *this;
-			if (_length == 0)
+			if (_newLength == 0)
 				return Empty;
 			return String(_s, _e);
 		}
 
 		static String Format(const char* _fmt, ...);
 		static String FormatV(const char* _fmt, va_list _args);
-		static uint32 Hash(const char* _str, uint32 _hash)
-		{
-			if (_str) while (*_str)
-				_hash = *_str++ + (_hash << 6) + (_hash << 16) - _hash;
-			return _hash;
-		}
-		static uint32 Hashi(const char* _str, uint32 _hash)
-		{
-			if (_str) while (*_str)
-				_hash = ToLower(*_str++) + (_hash << 6) + (_hash << 16) - _hash;
-			return _hash;
-		}
+		static uint32 Hash(const char* _str, uint32 _hash) { return _str ? Hash(_str, (uint)strlen(_str), _hash) : _hash; }
+		static uint32 Hashi(const char* _str, uint32 _hash) { return _str ? Hashi(_str, (uint)strlen(_str), _hash) : _hash; }
+		/// sdbm hash of _length chars (_hash * 65599 + c). Eight chars are processed per step.
+		static uint32 Hash(const char* _str, uint _length, uint32 _hash);
+		/// Case-insensitive sdbm hash of _length chars. Same as Hash for ToLower of each char.
+		static uint32 Hashi(const char* _str, uint _length, uint32 _hash);
 		static int Compare(const char* _a, const char* _b, bool _ignoreCase = false)
 		{
 			_a = _a ? _a : "";
 			_b = _b ? _b : "";
 			if (_ignoreCase)
 			{
-				while (*_a && ToLower(*_a++) == ToLower(*_b++));
-				return *_a - *_b;
+				while (*_a && ToLower(*_a) == ToLower(*_b))
+					++_a, ++_b;
+				return ToLower(*_a) - ToLower(*_b);
 			}
 			return strcmp(_a, _b);
 		}
@@ -310,33 +327,59 @@ namespace Engine
 		}
 		static void Split(const char* _str, const char* _delimiters, StringArray& _dst);
 
+		/// Get number of bytes used by buffers of large strings and by arenas.
 		static uint GetTotalMemoryUse(void) { return s_memory; }
 
 		static const String Empty;
 
 	protected:
+		friend class NameTable; // places buffers of names in own memory
+
+		enum : uint8
+		{
+			HEAP_TAG = 0xff, //!< Value of last byte of m_local for string with shared buffer.
+			LENGTH_MASK = 0x1f, //!< Bits of LOCAL_SIZE - length in last byte of m_local for small string.
+			DEPTH_SHIFT = 5, //!< High bits of last byte of small string are depth of arena.
+			MAX_DEPTH = 6, //!< Deeper arenas are treated as arena of this depth.
+		};
 
 		struct Buffer
 		{
-			Buffer(uint _size, uint _length) : refs(1), size(_size), length(_length) { str[_length] = 0; }
+			Buffer(uint _size, uint _length, bool _external, uint _depth = 0) : refs(1), size(_size), length(_length), external(_external), depth((uint8)_depth) { str[_length] = 0; }
 			volatile int refs;
 			uint size;
 			uint length;
+			bool external; //!< Memory of buffer is owned by arena or other allocator and is not freed with last reference.
+			uint8 depth; //!< Depth of arena which owns memory of buffer, zero for heap and other allocators.
 			char str[1];
 		};
 
-		static Buffer* _Null(void);						 
-		static Buffer* _New(const char* _str, uint _length, uint _size = 0);
-		static Buffer* _Unique(Buffer*& _buffer, uint _newLength, bool _quantizeMemory);
+		bool _IsLocal(void) const { return (uint8)m_local[LOCAL_SIZE] != HEAP_TAG; }
+		///\brief Get depth of arena for new buffers of string. It's depth of arena which was current when small string was created or depth of arena of buffer.
+		/// Zero for heap. Small string of LOCAL_SIZE chars has no room for depth, it's zero too.
+		uint _Depth(void) const { return _IsLocal() ? (uint8)m_local[LOCAL_SIZE] >> DEPTH_SHIFT : m_buffer->depth; }
+		/// Set length and depth of small string. Last byte of m_local is LOCAL_SIZE - length, so it also terminates the string of max length.
+		void _SetLocalLength(uint _length, uint _depth) { m_local[LOCAL_SIZE] = (char)((LOCAL_SIZE - _length) | (_depth << DEPTH_SHIFT)); m_local[_length] = 0; }
+		void _SetLocalLength(uint _length) { _SetLocalLength(_length, _Depth()); }
+		void _SetBuffer(Buffer* _buffer) { m_buffer = _buffer; m_local[LOCAL_SIZE] = (char)HEAP_TAG; }
+		void _SetLength(uint _length) { if (_IsLocal()) _SetLocalLength(_length); else m_buffer->str[m_buffer->length = _length] = 0; }
+		char* _Data(void) { return _IsLocal() ? m_local : m_buffer->str; }
+		void _Init(const char* _str, uint _length);
+		/// Assign other string. Buffer of deeper arena is not shared, it's copied to arena of this string or to heap. If _move is true, _str is temporary and is cleared.
+		void _Assign(const String& _str, bool _move);
+		/// Prepare string for modification. \return pointer to unique data with capacity for _newLength characters.
+		char* _Unique(uint _newLength, bool _quantizeMemory);
+
+		/// Allocate buffer in arena of _depth or in heap if _depth is zero.
+		static Buffer* _New(const char* _str, uint _length, uint _size, uint _depth);
 		static Buffer* _AddRef(Buffer* _buffer)
 		{
 			AtomicAdd(_buffer->refs, 1);
 			return _buffer;
 		}
-		static void _Release(Buffer* _buffer, int _refs = -1)
+		static void _Release(Buffer* _buffer)
 		{
-			ASSERT(_refs < 0);
-			if (AtomicAdd(_buffer->refs, _refs) == 0)
+			if (AtomicAdd(_buffer->refs, -1) == 1 && !_buffer->external)
 			{
 				AtomicAdd(s_memory, -int(_buffer->size));
 				delete[] reinterpret_cast<uint8*>(_buffer);
@@ -347,8 +390,50 @@ namespace Engine
 			return _str ? (_length < 0 ? (uint)strlen(_str) : _length) : 0;
 		}
 
-		Buffer* m_buffer;
+		union
+		{
+			Buffer* m_buffer; //!< Shared buffer of large string.
+			char m_local[LOCAL_SIZE + 1]; //!< Small string.
+		};
+
 		static volatile int s_memory;
+		static THREAD_LOCAL Arena* s_arena;
+		static THREAD_LOCAL uint s_depth; //!< Depth of s_arena limited to MAX_DEPTH, zero if there is no arena.
+	};
+
+	//----------------------------------------------------------------------------//
+	// String::Arena
+	//----------------------------------------------------------------------------//
+
+	/// Scoped arena for temporary strings of current thread. Buffers of large strings which are created in scope of the arena
+	/// are allocated from it, also when such strings grow later. All buffers are freed together with the arena. Arenas can be nested.
+	/// Strings created outside of the scope keep using heap. If they are assigned or constructed from a string of arena, its buffer is copied.
+	///\warning Strings created in scope of the arena must not be used after the arena is destroyed.
+	class String::Arena
+	{
+	public:
+		Arena(uint _pageSize = 4096);
+		~Arena(void);
+
+	protected:
+		friend class String;
+
+		struct Page
+		{
+			Page* prev;
+			uint size;
+		};
+
+		Arena(const Arena&) = delete;
+		Arena& operator = (const Arena&) = delete;
+
+		void* _Alloc(uint _size);
+
+		Page* m_page;
+		uint m_pageSize;
+		uint m_used;
+		Arena* m_prev;
+		uint m_depth; //!< One for outer arena.
 	};
 
 	//----------------------------------------------------------------------------//
@@ -359,11 +444,11 @@ namespace Engine
 	{
 		NameHash(void) : hash(0) { }
 		NameHash(uint32 _value) : hash(_value) { }
-		NameHash(const String& _str, uint32 _hash = 0) : hash(String::Hashi(_str, _hash)) { }
+		NameHash(const String& _str, uint32 _hash = 0) : hash(_str.Hashi(_hash)) { }
 		NameHash(const char* _str, uint32 _hash = 0) : hash(String::Hashi(_str, _hash)) { }
 
 		NameHash& operator += (const char* _str) { hash = String::Hashi(_str, hash); return *this; }
-		NameHash& operator += (const String& _str) { hash = String::Hashi(_str, hash); return *this; }
+		NameHash& operator += (const String& _str) { hash = _str.Hashi(hash); return *this; }
 		NameHash operator + (const char* _rhs) const { return NameHash(_rhs, hash); }
 		NameHash operator + (const String& _rhs) const { return NameHash(_rhs, hash); }
 
@@ -381,20 +466,24 @@ namespace Engine
 	// Name
 	//----------------------------------------------------------------------------//
 
+	/// Interned case-insensitive string. Names are compared by pointer.
+	/// Items of names are never deleted, so pointers to them are stable and can be used from any thread.
 	class Name
 	{
 	public:
 		struct Item
 		{
-			Item(const String& _name) : name(_name), hash(_name) { }
-			NameHash hash;
-			String name;
+			Item(const String& _name) : hash(_name), name(_name) { }
+			NameHash hash; //!< Case-insensitive hash, computed once.
+			String name; //!< Spelling of first added name.
 		};
 
 		Name(void) : m_item(&s_empty) { }
-		Name(const String& _str) : m_item(_AddItem(_str)) { }
-		Name& operator = (const String& _str) { m_item = _AddItem(_str); return *this; }
-		bool operator == (const Name& _rhs) const { return m_item == _rhs.m_item || m_item->hash == _rhs.m_item->hash; }
+		Name(const String& _str) : m_item(_AddItem(_str, _str.Length())) { }
+		Name(const char* _str, int _length = -1) : m_item(_AddItem(_str, _length)) { }
+		Name& operator = (const String& _str) { m_item = _AddItem(_str, _str.Length()); return *this; }
+		Name& operator = (const char* _str) { m_item = _AddItem(_str, -1); return *this; }
+		bool operator == (const Name& _rhs) const { return m_item == _rhs.m_item; }
 		bool operator != (const Name& _rhs) const { return !(*this == _rhs); }
 		bool operator == (const NameHash& _rhs) const { return m_item->hash == _rhs; }
 		bool operator != (const NameHash& _rhs) const { return !(*this == _rhs); }
@@ -406,14 +495,17 @@ namespace Engine
 		operator const NameHash& (void) const { return m_item->hash; }
 		operator uint (void) const { return m_item->hash; }
 
+		/// Get number of interned names.
+		static uint GetCount(void);
+		/// Get number of bytes used by interned names, including the table.
+		static size_t GetMemoryUse(void);
+
 	protected:
-		static const Item* _AddItem(const String& _name);
+		static const Item* _AddItem(const char* _str, int _length);
 
 		const Item* m_item;
 
 		static const Item s_empty;
-		static HashMap<uint, const Item*> s_names; // <StrHash, Item>
-		static volatile int s_lock;
 	};
 
 	//----------------------------------------------------------------------------//
@@ -609,12 +701,17 @@ namespace Engine
 	// Checksum
 	//----------------------------------------------------------------------------//
 
+	/// CRC-32 (IEEE 802.3). Large buffers are folded with PCLMULQDQ if it is supported by CPU, others are processed by slice-by-8.
 	uint32 Crc32(uint32 _crc, const void* _buf, uint _size);
 	inline uint32 Crc32(const void* _buf, uint _size) { return Crc32(0, _buf, _size); }
 	inline uint32 Crc32(const char* _str, int _length = -1, uint32 _crc = 0) { return _str ? Crc32(_crc, _str, _length < 0 ? (uint)strlen(_str) : _length) : _crc; }
 	inline uint32 Crc32(const String& _str, uint32 _crc = 0) { return Crc32(_crc, _str, _str.Length()); }
 	template <typename T> uint32 Crc32(const T& _obj, uint32 _crc = 0) { return Crc32(_crc, &_obj, sizeof(_obj)); }
 
+	/// 64-bit hash of binary data (MurmurHash64A). Faster than Crc32 for large blobs.
+	uint64 Hash64(const void* _data, size_t _size, uint64 _seed = 0);
+	inline uint64 Hash64(const String& _str, uint64 _seed = 0) { return Hash64(_str.CStr(), _str.Length(), _seed); }
+
 	//----------------------------------------------------------------------------//
 	// CharStream
 	//----------------------------------------------------------------------------//
@@ -1244,6 +1244,7 @@ namespace Engine
 			{
 				m_root = _fullPath;
 				chdir(m_root);
+				Rescan();
 				return true;
 			}
 		}
@@ -1275,6 +1276,7 @@ namespace Engine
 				}
 			}
 			_highPrio ? m_dirs.push_front(_sd) : m_dirs.push_back(_sd);
+			Rescan();
 		}
 	}
 	//----------------------------------------------------------------------------//
@@ -1288,6 +1290,7 @@ namespace Engine
 				if (!String::Compare(i->fullPath, _fullPath, FS_IGNORE_CASE))
 				{
 					m_dirs.erase(i);
+					Rescan();
 					return;
 				}
 			}
@@ -1321,9 +1324,25 @@ namespace Engine
 			if (IsFullPath(_path))
 				return stat(_path, &_st) == 0 && (_st.st_mode & _st_mode) ? MakeFullPath(_path) : String::Empty;
 
-			// in directories
 			String _fullPath, _npath = MakeFullPath(_path);
-			for (auto i = m_dirs.begin(); i != m_dirs.end(); ++i)
+			bool _indexed = false;
+			if (_IsIndexable(_npath))
+			{
+				SCOPE_LOCK(m_indexMutex);
+				if (_UpdateIndex())
+				{
+					uint64 _found = _FindInIndex(_npath, _mask);
+					for (uint i = 0; _found; ++i, _found >>= 1)
+					{
+						if (_found & 1)
+							return m_indexRoots[i] + "/" + _npath;
+					}
+					_indexed = true;
+				}
+			}
+
+			// in directories
+			for (auto i = m_dirs.begin(); i != m_dirs.end() && !_indexed; ++i)
 			{
 				_fullPath = i->fullPath + "/" + _npath;
 				if (stat(_fullPath, &_st) == 0 && (_st.st_mode & _st_mode))
@@ -1347,8 +1366,41 @@ namespace Engine
 			if (IsFullPath(_path))
 				return stat(_path, &_st) == 0 && (_st.st_mode & S_IFREG) ? MakeFullPath(_path) : String::Empty;
 
+			String _result, _npath = MakeFullPath(_path);
+			if (_IsIndexable(_npath))
+			{
+				// candidates in order of _SearchFile
+				StringArray _candidates;
+				_candidates.reserve((_dirs.size() + 1) * (_exts.size() + 1));
+				for (size_t d = 0, nd = _dirs.size(); d <= nd; ++d)
+				{
+					String _base = d ? MakeFullPath(_dirs[d - 1] + "/" + _npath) : _npath;
+					_candidates.push_back(_base);
+					for (size_t e = 0, ne = _exts.size(); e < ne; ++e)
+						_candidates.push_back(_base + "." + _exts[e]);
+				}
+
+				SCOPE_LOCK(m_indexMutex);
+				if (_UpdateIndex())
+				{
+					Array<uint64> _found(_candidates.size());
+					uint64 _any = 0;
+					for (size_t c = 0; c < _candidates.size(); ++c)
+						_any |= (_found[c] = _FindInIndex(_candidates[c], FF_File));
+
+					for (uint i = 0, n = (uint)m_indexRoots.size(); i < n && (_any >> i); ++i)
+					{
+						for (size_t c = 0; c < _candidates.size(); ++c)
+						{
+							if (_found[c] & (uint64(1) << i))
+								return m_indexRoots[i] + "/" + _candidates[c];
+						}
+					}
+					return String::Empty;
+				}
+			}
+
 			// in directories
-			String _result, _npath = MakeFullPath(_path);;
 			for (auto i = m_dirs.begin(); i != m_dirs.end(); ++i)
 			{
 				if (_SearchFile(_npath, i->fullPath, _dirs, _exts, _result))
@@ -1400,6 +1452,102 @@ namespace Engine
 		return false;
 	}
 	//----------------------------------------------------------------------------//
+	void FileSystem::SetIndexing(bool _enabled)
+	{
+		SCOPE_LOCK(m_indexMutex);
+		m_useIndex = _enabled;
+		m_indexValid = false;
+	}
+	//----------------------------------------------------------------------------//
+	void FileSystem::Rescan(void)
+	{
+		SCOPE_LOCK(m_indexMutex);
+		m_indexValid = false;
+	}
+	//----------------------------------------------------------------------------//
+	bool FileSystem::_UpdateIndex(void)
+	{
+		if (m_dirs.size() > MAX_INDEXED_DIRS)
+			return false;
+
+		time_t _now = time(nullptr);
+		if (m_indexValid && _now != m_indexCheckTime)
+		{
+			m_indexCheckTime = _now;
+			struct stat _st;
+			for (const auto& _dir : m_indexDirs)
+			{
+				// directory modified in the same second as index was built can be modified after building
+				if (stat(_dir.first, &_st) || _st.st_mtime != _dir.second || _st.st_mtime >= m_indexTime)
+				{
+					m_indexValid = false;
+					break;
+				}
+			}
+		}
+
+		if (!m_indexValid)
+		{
+			m_index.clear();
+			m_indexRoots.clear();
+			m_indexDirs.clear();
+			m_indexTime = _now;
+			m_indexCheckTime = _now;
+
+			// only search directories. root is usually working directory with whole project, it's checked by stat after index
+			for (const SearchDir& _sd : m_dirs)
+				m_indexRoots.push_back(_sd.fullPath);
+
+			for (uint i = 0; i < m_indexRoots.size(); ++i)
+				_IndexDir(i, m_indexRoots[i], String::Empty);
+
+			m_indexValid = true;
+		}
+
+		return true;
+	}
+	//----------------------------------------------------------------------------//
+	void FileSystem::_IndexDir(uint _slot, const String& _dir, const String& _prefix)
+	{
+		struct stat _st;
+		if (stat(_dir, &_st) || !(_st.st_mode & S_IFDIR))
+			return;
+		m_indexDirs.push_back({ _dir, _st.st_mtime });
+
+		_finddata_t _fd;
+		intptr_t _fh = _findfirst(_dir + "/*", &_fd);
+		if (_fh == -1)
+			return;
+
+		uint64 _bit = uint64(1) << _slot;
+		do
+		{
+			if (!strcmp(_fd.name, ".") || !strcmp(_fd.name, ".."))
+				continue;
+
+			String _path = _prefix + _fd.name;
+			IndexEntry& _entry = m_index[_path];
+			if (_fd.attrib & _A_SUBDIR)
+			{
+				_entry.dirs |= _bit;
+				_IndexDir(_slot, _dir + "/" + _fd.name, _path + "/");
+			}
+			else
+				_entry.files |= _bit;
+
+		} while (!_findnext(_fh, &_fd));
+
+		_findclose(_fh);
+	}
+	//----------------------------------------------------------------------------//
+	uint64 FileSystem::_FindInIndex(const String& _path, uint _mask)
+	{
+		auto _it = m_index.find(_path);
+		if (_it == m_index.end())
+			return 0;
+		return ((_mask & FF_File) ? _it->second.files : 0) | ((_mask & FF_Dir) ? _it->second.dirs : 0);
+	}
+	//----------------------------------------------------------------------------//
 	bool FileSystem::CreateDir(const String& _path)
 	{
 		LOG_MSG(LL_Error, "Couldn't create dir \"%s\"", *_path);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Base.hpp"
+#include "Thread.hpp"
 
 namespace Engine
 {
@@ -292,17 +293,60 @@ namespace Engine
 		DataStream Open(const String& _name);
 		DataStream Create(const String& _name, bool _overwrite = true);
 
+		/// Enable or disable index of search directories. If disabled, each search checks each directory on disk.
+		void SetIndexing(bool _enabled);
+		/// Rebuild index of search directories before next search.
+		///\note Index is rebuilt automatically when modification time of any indexed directory was changed, but this is checked once per second only.
+		void Rescan(void);
+
 	protected:
 		FileSystem(void);
 		~FileSystem(void);
 		bool _SearchFile(const String& _path, const StringArray& _exts, String& _result);
 		bool _SearchFile(const String& _path, const String& _root, const StringArray& _dirs, const StringArray& _exts, String& _result);
 
+		enum : uint
+		{
+			MAX_INDEXED_DIRS = 64,
+		};
+
+		struct IndexEntry
+		{
+			uint64 files = 0; // mask of search directories which contain file with this path
+			uint64 dirs = 0; // mask of search directories which contain directory with this path
+		};
+
+		struct IndexHash
+		{
+			size_t operator () (const String& _path) const { return FS_IGNORE_CASE ? _path.Hashi() : _path.Hash(); }
+		};
+
+		struct IndexEqual
+		{
+			bool operator () (const String& _a, const String& _b) const { return String::Compare(_a, _b, FS_IGNORE_CASE) == 0; }
+		};
+
+		/// Check and rebuild index if needed. \return false if index cannot be used.
+		bool _UpdateIndex(void);
+		void _IndexDir(uint _slot, const String& _dir, const String& _prefix);
+		/// Get masks of search directories which contain this path. Path must be normalized relative path.
+		uint64 _FindInIndex(const String& _path, uint _mask);
+		bool _IsIndexable(const String& _path) { return m_useIndex && strncmp(_path, "..", 2) != 0; }
+
 		String m_appDir;
 		String m_appName;
 		String m_root;
 		List<SearchDir> m_dirs;
 
+		CriticalSection m_indexMutex;
+		std::unordered_map<String, IndexEntry, IndexHash, IndexEqual> m_index; // <relative path, entry>
+		Array<String> m_indexRoots; // full paths of indexed search directories in order of search. root is not indexed, it's checked by stat.
+		Array<std::pair<String, time_t>> m_indexDirs; // <full path, modification time> of all indexed directories
+		time_t m_indexTime = 0; // when index was built
+		time_t m_indexCheckTime = 0;
+		bool m_indexValid = false;
+		bool m_useIndex = true;
+
 		static FileSystem s_instance;
 	};
 
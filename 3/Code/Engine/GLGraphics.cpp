@@ -1928,17 +1928,20 @@ namespace Engine
 
 			m_initialized.Signal();
 
-			GLCommandFunc _func;
-			uint8_t* _data = new uint8[GLCommandQueue::SIZE]; // ...
-			while (m_runThread || gGLResourceQueue.GetSize() || gGLDrawQueue.GetSize())
+			while (m_runThread || !gGLResourceQueue.IsEmpty() || !gGLDrawQueue.IsEmpty())
 			{
-				while (gGLResourceQueue.Pop(_func, _data, false))
-					_func(_data);
+				// resources are created before each draw command
+				uint _count = gGLResourceQueue.Execute();
+				_count += gGLDrawQueue.Execute(&gGLResourceQueue);
 
-				if (gGLDrawQueue.Pop(_func, _data, false))
-					_func(_data);
-				else
-					GLCommandQueue::Wait(20);
+				if (!_count)
+				{
+					GLCommandQueue::PrepareWait();
+					if (gGLResourceQueue.IsEmpty() && gGLDrawQueue.IsEmpty())
+						GLCommandQueue::Wait(20);
+					else
+						GLCommandQueue::CancelWait();
+				}
 			}
 
 			/*
@@ -86,34 +86,41 @@ namespace Engine
 	GLCommandQueue GLCommandQueue::DQ;
 
 	Condition GLCommandQueue::s_onPush;
+	Atomic<bool> GLCommandQueue::s_waiting;
 
 	//----------------------------------------------------------------------------//
-	GLCommandQueue::GLCommandQueue(void)
+	GLCommandQueue::GLCommandQueue(void) :
+		m_writePos(0),
+		m_numChunks(NUM_CHUNKS),
+		m_readPos(0)
 	{
-		m_end = m_data + SIZE;
-		m_readPos = m_end;
-		m_writePos = m_data;
+		Chunk* _first = nullptr;
+		Chunk* _last = nullptr;
+		for (uint i = 0; i < NUM_CHUNKS; ++i)
+		{
+			Chunk* _chunk = new Chunk;
+			_chunk->data = new uint8[CHUNK_SIZE];
+			_chunk->size = CHUNK_SIZE;
+			_chunk->next = _first;
+			_first = _chunk;
+			if (!_last)
+				_last = _chunk;
+		}
+		_last->next = _first;
 
-		in = 0;
-		out = 0;
+		m_writeChunk = _first;
+		m_readChunk = _first;
 	}
 	//----------------------------------------------------------------------------//
 	GLCommandQueue::~GLCommandQueue(void)
 	{
-	}
-	//----------------------------------------------------------------------------//
-	void GLCommandQueue::PushRaw(const void* _data, size_t _size)
-	{
-		ASSERT(_size <= SIZE);
-
-		if (_size > 0)
+		Chunk* _chunk = m_writeChunk;
+		for (uint i = 0; i < m_numChunks; ++i)
 		{
-			ASSERT(_data != nullptr);
-			m_mutex.Lock();
-			_Wait(_size + sizeof(void*) * 2);
-			_Write(_data, _size);
-			m_mutex.Unlock();
-			s_onPush.Signal();
+			Chunk* _next = _chunk->next;
+			delete[] _chunk->data;
+			delete _chunk;
+			_chunk = _next;
 		}
 	}
 	//----------------------------------------------------------------------------//
@@ -121,188 +128,119 @@ namespace Engine
 	{
 		ASSERT(_func != nullptr);
 		ASSERT(_size == 0 || _data != nullptr);
-		ASSERT(_size <= SIZE);
-
-		++in;
-
-		Command _cmd;
-		_cmd.func = _func;
-		_cmd.size = _size;
 
 		m_mutex.Lock();
-		_Wait(sizeof(Command) + _size + sizeof(void*) * 2);
-#if 0
-		if (_highPriority)
+		Command* _cmd = _Alloc(_size);
+		if (!_cmd)
 		{
-			if (_size > 0)
-				_Write(_data, _size, true);
-			_Write(&_cmd, sizeof(Command), true);
-		}
-		else
-#endif
-		{
-			_Write(&_cmd, sizeof(Command));
-			if (_size > 0)
-				_Write(_data, _size);
+			LOG_MSG(LL_Warning, "Command queue overflow");
+			do
+			{
+				m_mutex.Unlock(); // other producers shouldn't spin on lock while consumer releases chunk
+				Thread::Pause(0);
+				m_mutex.Lock();
+			} while (!(_cmd = _Alloc(_size)));
 		}
+		_cmd->func = _func;
+		if (_size > 0)
+			memcpy(reinterpret_cast<uint8*>(_cmd) + HEADER_SIZE, _data, _size);
+		++m_pushed; // publish
 		m_mutex.Unlock();
-		s_onPush.Signal();
+
+		if (s_waiting)
+			s_onPush.Signal();
 	}
 	//----------------------------------------------------------------------------//
-	bool GLCommandQueue::Pop(GLCommandFunc& _func, void* _data, bool _wait)
+	uint GLCommandQueue::Execute(GLCommandQueue* _priority)
 	{
-		ASSERT(_data != nullptr);
+		uint _count = 0;
+		uint _popped = m_popped;
+		Chunk* _chunk = m_readChunk;
 
-		++out;
-
-		m_mutex.Lock();
-
-		if (_wait)
+		for (uint _pushed = m_pushed; _popped != _pushed || _popped != (_pushed = m_pushed);)
 		{
-			while (_GetSize() == 0) // wait
+			if (_priority && !_priority->IsEmpty())
+				_count += _priority->Execute();
+
+			Command* _cmd = reinterpret_cast<Command*>(_chunk->data + m_readPos);
+			if (m_readPos + HEADER_SIZE > _chunk->size || !_cmd->func)
 			{
-				m_mutex.Unlock();
-				s_onPush.Wait();
-				m_mutex.Lock();
+				// end of chunk, previous chunk can be reused by producer
+				_chunk = _chunk->next;
+				m_readChunk = _chunk;
+				m_readPos = 0;
+				continue;
 			}
-		}
-		else if (_GetSize() == 0)
-		{
-			m_mutex.Unlock();
-			return false;
-		}
 
-		Command _cmd;
-		_Read(&_cmd, sizeof(Command));
-		if (_cmd.size > 0)
-			_Read(_data, _cmd.size);
-		_func = _cmd.func;
+			_cmd->func(reinterpret_cast<uint8*>(_cmd) + HEADER_SIZE);
 
-		m_mutex.Unlock();
-		return true;
-	}
-	//----------------------------------------------------------------------------//
-	uint GLCommandQueue::GetSize(void)
-	{
-		SCOPE_LOCK(m_mutex);
-		return (uint)_GetSize();
+			m_readPos += _cmd->size;
+			++_popped;
+			++_count;
+		}
+
+		m_popped = _popped;
+		return _count;
 	}
 	//----------------------------------------------------------------------------//
 	void GLCommandQueue::Wait(uint _timeout)
 	{
 		s_onPush.Wait(_timeout);
+		s_waiting = false;
 	}
 	//----------------------------------------------------------------------------//
-	void GLCommandQueue::_Wait(size_t _size)
+	GLCommandQueue::Command* GLCommandQueue::_Alloc(uint _size)
 	{
-		bool _overflow = false;
-		while (SIZE - _GetSize() < _size)
-		{
-			_overflow = true;
-			m_mutex.Unlock();
-			Thread::Pause(0);
-			m_mutex.Lock();
-		}
+		_size = (HEADER_SIZE + _size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
 
-		if (_overflow)
-		{
-			LOG_MSG(LL_Warning, "Command queue overflow");
-		}
-	}
-	//----------------------------------------------------------------------------//
-	void GLCommandQueue::_Write(const void* _data, size_t _size)
-	{
-#if 0
-		if (_highPriority) // write to position of read
-		{
-			if (m_writePos >= m_readPos) // |---R===W---|
-			{
-				size_t _ls = m_readPos - m_data;
-				if (_ls >= _size)
-				{
-					m_readPos -= _size;
-					memcpy(m_readPos, _data, _size);
-					ASSERT(m_readPos >= m_data);
-				}
-				else
-				{
-					size_t _rs = _size - _ls;
-					memcpy(m_data, ((uint8*)_data) + _rs, _ls);
-					m_readPos = m_end - _rs;
-					memcpy(m_readPos, _data, _rs);
-					ASSERT(m_readPos >= m_writePos);
-				}
-			}
-			else // |===W---R===|
-			{
-				m_readPos -= _size;
-				memcpy(m_readPos, _data, _size);
-				ASSERT(m_readPos >= m_writePos);
-			}
-		}
-		else
-#endif
+		if (m_writePos + _size > m_writeChunk->size)
 		{
-			if (m_writePos >= m_readPos)	// |---R===W---|
-			{
-				size_t _rs = m_end - m_writePos;
-				if (_rs >= _size)
-				{
-					memcpy(m_writePos, _data, _size);
-					m_writePos += _size;
-					ASSERT(m_writePos <= m_end);
-				}
-				else
-				{
-					size_t _ls = _size - _rs;
-					memcpy(m_writePos, _data, _rs);
-					memcpy(m_data, ((const uint8*)_data) + _rs, _ls);
-					m_writePos = m_data + _ls;
-					ASSERT(m_writePos <= m_readPos);
-				}
-			}
-			else // |===W---R===|
+			if (m_writePos + HEADER_SIZE <= m_writeChunk->size)
+				reinterpret_cast<Command*>(m_writeChunk->data + m_writePos)->func = nullptr; // end of chunk
+
+			Chunk* _next = m_writeChunk->next;
+			while (_next != m_readChunk && _next->size > CHUNK_SIZE) // executed oversized command
 			{
-				memcpy(m_writePos, _data, _size);
-				m_writePos += _size;
-				ASSERT(m_writePos <= m_readPos);
+				m_writeChunk->next = _next->next;
+				delete[] _next->data;
+				delete _next;
+				--m_numChunks;
+				_next = m_writeChunk->next;
 			}
-		}
-	}
-	//----------------------------------------------------------------------------//
-	void GLCommandQueue::_Read(void* _data, size_t _size)
-	{
-		if (m_writePos >= m_readPos)	// |---R===W---|
-		{
-			memcpy(_data, m_readPos, _size);
-			m_readPos += _size;
-			ASSERT(m_readPos <= m_writePos);
-		}
-		else // |===W---R===|
-		{
-			size_t _rs = m_end - m_readPos;
-			if (_rs >= _size)
+
+			if (_size > CHUNK_SIZE)
 			{
-				memcpy(_data, m_readPos, _size);
-				m_readPos += _size;
-				ASSERT(m_readPos <= m_end);
+				LOG_MSG(LL_Warning, "Command of %u KB doesn't fit to chunk of command queue", _size / 1024);
+				_next = _InsertChunk(_size);
 			}
-			else
+			else if (_next == m_readChunk) // all chunks are used
 			{
-				size_t _ls = _size - _rs;
-				memcpy(_data, m_readPos, _rs);
-				memcpy(((uint8*)_data) + _rs, m_data, _ls);
-				m_readPos = m_data + _ls;
-				ASSERT(m_readPos <= m_writePos);
+				if (m_numChunks >= MAX_CHUNKS)
+					return nullptr; // wait for consumer
+
+				_next = _InsertChunk(CHUNK_SIZE);
+				LOG_MSG(LL_Warning, "Command queue was expanded to %u KB", m_numChunks * CHUNK_SIZE / 1024);
 			}
+
+			m_writeChunk = _next;
+			m_writePos = 0;
 		}
+
+		Command* _cmd = reinterpret_cast<Command*>(m_writeChunk->data + m_writePos);
+		_cmd->size = _size;
+		m_writePos += _size;
+		return _cmd;
 	}
 	//----------------------------------------------------------------------------//
-	size_t GLCommandQueue::_GetSize(void)
+	GLCommandQueue::Chunk* GLCommandQueue::_InsertChunk(uint _size)
 	{
-		uint8* _r = m_readPos;
-		uint8* _w = m_writePos;
-		return _w >= _r ? (_w - _r) : (SIZE - (_r - _w));
+		Chunk* _chunk = new Chunk;
+		_chunk->data = new uint8[_size];
+		_chunk->size = _size;
+		_chunk->next = m_writeChunk->next;
+		m_writeChunk->next = _chunk;
+		++m_numChunks;
+		return _chunk;
 	}
 	//----------------------------------------------------------------------------//
 	
@@ -246,15 +246,38 @@ namespace Engine
 
 	typedef void(*GLCommandFunc)(void*);
 
-	class GLCommandQueue final : public NonCopyable // FIFO  
+	///\brief FIFO of commands for driver thread.
+	/// Commands are stored in chunks which are linked in a ring. If producer reaches the chunk which is being read, new chunk is inserted to the ring.
+	/// Consumer executes commands in place and is lock-free. Producers are serialized by spin lock, which is not contended with one producer.
+	class GLCommandQueue final : public NonCopyable
 	{
 	public:
-		enum : size_t { SIZE = 1024 * 1024 }; // 1MB
+		enum : uint
+		{
+			CHUNK_SIZE = 256 * 1024,
+			NUM_CHUNKS = 4, // 1MB
+			MAX_CHUNKS = 64, // producer waits for consumer if all chunks are used
+			ALIGNMENT = 16,
+			CACHE_LINE = 64,
+		};
 
+		/// Header of command. Data of command follows it.
 		struct Command
 		{
-			GLCommandFunc func;
-			size_t size;
+			GLCommandFunc func; //!< nullptr is end of chunk
+			uint size; //!< Size of command with header and padding
+		};
+
+		enum : uint
+		{
+			HEADER_SIZE = (sizeof(Command) + ALIGNMENT - 1) & ~(ALIGNMENT - 1),
+		};
+
+		struct Chunk
+		{
+			Chunk* next;
+			uint8* data;
+			uint size; //!< CHUNK_SIZE or size of single command which doesn't fit to regular chunk
 		};
 
 		template <class T> static void Exec(void* _cmd)
@@ -265,33 +288,51 @@ namespace Engine
 		static GLCommandQueue RQ;
 		static GLCommandQueue DQ;
 
-		void PushRaw(const void* _data, size_t _size);
+		GLCommandQueue(void);
+		~GLCommandQueue(void);
+
 		void Push(GLCommandFunc _func, const void* _data, uint _size);
 		template <class T> void Push(const T* _cmd) { Push(&Exec<T>, _cmd, sizeof(T)); }
 		template <class T> void Push(void(*_func)(T*), const T* _cmd) { Push(reinterpret_cast<GLCommandFunc>(_func), _cmd, sizeof(T)); }
-		bool Pop(GLCommandFunc& _func, void* _data, bool _wait);
-		uint GetSize(void);
+		/// Execute all pushed commands in place. Commands of _priority queue are executed before each command of this queue.
+		///\return number of executed commands. \note Only for consumer thread.
+		uint Execute(GLCommandQueue* _priority = nullptr);
+		/// Get number of pending commands.
+		uint GetSize(void) { return m_pushed - m_popped; }
+		bool IsEmpty(void) { return m_pushed == m_popped; }
+		/// Get number of allocated chunks.
+		uint GetNumChunks(void) { return m_numChunks; }
+
+		/// Announce that consumer is going to wait. Queues must be checked after this, then Wait or CancelWait must be called.
+		static void PrepareWait(void) { s_waiting = true; }
+		/// Wait for push to any queue.
 		static void Wait(uint _timeout);
-
-		AtomicInt in, out; // for debug
+		static void CancelWait(void) { s_waiting = false; }
 
 	protected:
 
-		GLCommandQueue(void);
-		~GLCommandQueue(void);
-
-		void _Wait(size_t _size);
-		void _Write(const void* _data, size_t _size);
-		void _Read(void* _data, size_t _size);
-		size_t _GetSize(void);
+		/// Get memory for command. Switches to next chunk or inserts new chunk if needed. Command larger than CHUNK_SIZE gets dedicated
+		/// chunk, which is released when producer reaches it again. \note Only for producer.
+		///\return nullptr if all MAX_CHUNKS are used by consumer.
+		Command* _Alloc(uint _size);
+		/// Insert new chunk after write chunk.
+		Chunk* _InsertChunk(uint _size);
 
+		// producer
 		SpinLock m_mutex;
-		uint8 m_data[SIZE];
-		uint8* m_readPos;
-		uint8* m_writePos;
-		uint8* m_end;
+		Chunk* m_writeChunk;
+		uint m_writePos;
+		uint m_numChunks;
+		Atomic<uint> m_pushed;
+		uint8 m_pad[CACHE_LINE];
+
+		// consumer
+		Atomic<Chunk*> m_readChunk;
+		uint m_readPos;
+		Atomic<uint> m_popped;
 
 		static Condition s_onPush;
+		static Atomic<bool> s_waiting;
 	};
 
 	//----------------------------------------------------------------------------//
@@ -1,9 +1,16 @@
 #include "Math.hpp"
+#ifdef _MSC_VER
+#	include <intrin.h>
+#	define TARGET_AVX
+#else
+#	include <immintrin.h>
+#	include <cpuid.h>
+#	define TARGET_AVX __attribute__((target("avx")))
+#endif
 
 namespace Engine
 {
 	TODO_EX("MathLib", "  ");
-	TODO_EX("MathLib", " Dbvt");
 
 	//----------------------------------------------------------------------------//
 	// Quat
@@ -619,6 +626,1040 @@ namespace Engine
 	}
 	//----------------------------------------------------------------------------//
 
+	//----------------------------------------------------------------------------//
+	// Frustum culling
+	//----------------------------------------------------------------------------//
+
+	namespace
+	{
+		enum : uint
+		{
+			CPU_SSE = 0x1,
+			CPU_AVX = 0x2,
+		};
+
+		uint _GetCpuFeatures(void)
+		{
+			uint _features = 0;
+			int _info[4] = { 0 };
+#ifdef _MSC_VER
+			__cpuid(_info, 1);
+#else
+			__cpuid(1, _info[0], _info[1], _info[2], _info[3]);
+#endif
+			if (_info[3] & (1 << 25))
+				_features |= CPU_SSE;
+
+			if ((_info[2] & (1 << 27)) && (_info[2] & (1 << 28))) // OSXSAVE, AVX
+			{
+#ifdef _MSC_VER
+				uint64 _xcr0 = _xgetbv(0);
+#else
+				uint32 _eax, _edx;
+				__asm__ __volatile__("xgetbv" : "=a"(_eax), "=d"(_edx) : "c"(0));
+				uint64 _xcr0 = ((uint64)_edx << 32) | _eax;
+#endif
+				if ((_xcr0 & 0x6) == 0x6) // xmm and ymm state are enabled by OS
+					_features |= CPU_AVX;
+			}
+			return _features;
+		}
+
+		/// Positive vertex of boxes for plane. Sign of normal is constant for plane, so vertex is selected by pointers.
+		struct CullPlane
+		{
+			float nx, ny, nz, d;
+			const float* x;
+			const float* y;
+			const float* z;
+		};
+
+		void _GetCullPlanes(const Plane* _planes, const AlignedBoxSoA& _boxes, CullPlane* _cp)
+		{
+			for (uint i = 0; i < 6; ++i)
+			{
+				const Plane& _p = _planes[i];
+				_cp[i].nx = _p.normal.x;
+				_cp[i].ny = _p.normal.y;
+				_cp[i].nz = _p.normal.z;
+				_cp[i].d = _p.dist;
+				_cp[i].x = _p.normal.x >= 0 ? _boxes.mxx : _boxes.mnx;
+				_cp[i].y = _p.normal.y >= 0 ? _boxes.mxy : _boxes.mny;
+				_cp[i].z = _p.normal.z >= 0 ? _boxes.mxz : _boxes.mnz;
+			}
+		}
+
+		void _CullBoxesScalar(const CullPlane* _cp, uint _start, uint _end, uint32* _visibility)
+		{
+			for (uint i = _start; i < _end; ++i)
+			{
+				bool _visible = true;
+				for (uint p = 0; p < 6; ++p)
+				{
+					const CullPlane& _p = _cp[p];
+					float _d = ((_p.nx * _p.x[i] + _p.ny * _p.y[i]) + _p.nz * _p.z[i]) + _p.d;
+					if (!(_d >= 0)) // NaN is culled, as in _mm_cmpge_ps
+						_visible = false;
+				}
+				if (_visible)
+					_visibility[i >> 5] |= 1u << (i & 31);
+			}
+		}
+
+		uint _CullBoxesSSE(const CullPlane* _cp, uint _count, uint32* _visibility)
+		{
+			__m128 _zero = _mm_setzero_ps();
+			uint i = 0;
+			for (; i + 4 <= _count; i += 4)
+			{
+				__m128 _mask = _mm_cmpeq_ps(_zero, _zero);
+				for (uint p = 0; p < 6; ++p)
+				{
+					const CullPlane& _p = _cp[p];
+					__m128 _d = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(_p.nx), _mm_loadu_ps(_p.x + i)), _mm_mul_ps(_mm_set1_ps(_p.ny), _mm_loadu_ps(_p.y + i)));
+					_d = _mm_add_ps(_d, _mm_mul_ps(_mm_set1_ps(_p.nz), _mm_loadu_ps(_p.z + i)));
+					_d = _mm_add_ps(_d, _mm_set1_ps(_p.d));
+					_mask = _mm_and_ps(_mask, _mm_cmpge_ps(_d, _zero));
+				}
+				_visibility[i >> 5] |= (uint32)_mm_movemask_ps(_mask) << (i & 31);
+			}
+			return i;
+		}
+
+		TARGET_AVX uint _CullBoxesAVX(const CullPlane* _cp, uint _count, uint32* _visibility)
+		{
+			__m256 _zero = _mm256_setzero_ps();
+			uint i = 0;
+			for (; i + 8 <= _count; i += 8)
+			{
+				__m256 _mask = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+				for (uint p = 0; p < 6; ++p)
+				{
+					const CullPlane& _p = _cp[p];
+					__m256 _d = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(_p.nx), _mm256_loadu_ps(_p.x + i)), _mm256_mul_ps(_mm256_set1_ps(_p.ny), _mm256_loadu_ps(_p.y + i)));
+					_d = _mm256_add_ps(_d, _mm256_mul_ps(_mm256_set1_ps(_p.nz), _mm256_loadu_ps(_p.z + i)));
+					_d = _mm256_add_ps(_d, _mm256_set1_ps(_p.d));
+					_mask = _mm256_and_ps(_mask, _mm256_cmp_ps(_d, _zero, _CMP_GE_OQ));
+				}
+				_visibility[i >> 5] |= (uint32)_mm256_movemask_ps(_mask) << (i & 31);
+			}
+			_mm256_zeroupper();
+			return i;
+		}
+
+		const uint s_cpuFeatures = _GetCpuFeatures();
+		uint s_simdFeatures = s_cpuFeatures; //!< features allowed by SetMaxSimdLevel
+	}
+
+	//----------------------------------------------------------------------------//
+	void SetMaxSimdLevel(SimdLevel _level)
+	{
+		const uint _masks[] = { 0, CPU_SSE, CPU_SSE | CPU_AVX }; // SL_Scalar, SL_SSE, SL_AVX
+		s_simdFeatures = s_cpuFeatures & _masks[_level];
+	}
+	//----------------------------------------------------------------------------//
+	SimdLevel GetSimdLevel(void)
+	{
+		return (s_simdFeatures & CPU_AVX) ? SL_AVX : ((s_simdFeatures & CPU_SSE) ? SL_SSE : SL_Scalar);
+	}
+
+	//----------------------------------------------------------------------------//
+	void Frustum::CullBoxes(const AlignedBoxSoA& _boxes, uint32* _visibility, bool _simd) const
+	{
+		memset(_visibility, 0, ((_boxes.count + 31) >> 5) * sizeof(uint32));
+
+		CullPlane _cp[6];
+		_GetCullPlanes(planes, _boxes, _cp);
+
+		uint _start = 0;
+		if (_simd && (s_simdFeatures & CPU_AVX))
+			_start = _CullBoxesAVX(_cp, _boxes.count, _visibility);
+		else if (_simd && (s_simdFeatures & CPU_SSE))
+			_start = _CullBoxesSSE(_cp, _boxes.count, _visibility);
+
+		_CullBoxesScalar(_cp, _start, _boxes.count, _visibility);
+	}
+	//----------------------------------------------------------------------------//
+
+	//----------------------------------------------------------------------------//
+	// Batch operations
+	//----------------------------------------------------------------------------//
+
+	namespace
+	{
+		/// Load 4 points and convert them to structure of arrays.
+		inline void _LoadVec3x4(const float* _src, __m128& _x, __m128& _y, __m128& _z)
+		{
+			__m128 _m03 = _mm_loadu_ps(_src), _m14 = _mm_loadu_ps(_src + 4), _m25 = _mm_loadu_ps(_src + 8);
+			__m128 _xy = _mm_shuffle_ps(_m14, _m25, _MM_SHUFFLE(2, 1, 3, 2));
+			__m128 _yz = _mm_shuffle_ps(_m03, _m14, _MM_SHUFFLE(1, 0, 2, 1));
+			_x = _mm_shuffle_ps(_m03, _xy, _MM_SHUFFLE(2, 0, 3, 0));
+			_y = _mm_shuffle_ps(_yz, _xy, _MM_SHUFFLE(3, 1, 2, 0));
+			_z = _mm_shuffle_ps(_yz, _m25, _MM_SHUFFLE(3, 0, 3, 1));
+		}
+
+		/// Convert structure of arrays to 4 points and store them.
+		inline void _StoreVec3x4(float* _dst, __m128 _x, __m128 _y, __m128 _z)
+		{
+			__m128 _xy = _mm_shuffle_ps(_x, _y, _MM_SHUFFLE(2, 0, 2, 0));
+			__m128 _yz = _mm_shuffle_ps(_y, _z, _MM_SHUFFLE(3, 1, 3, 1));
+			__m128 _zx = _mm_shuffle_ps(_z, _x, _MM_SHUFFLE(3, 1, 2, 0));
+			_mm_storeu_ps(_dst, _mm_shuffle_ps(_xy, _zx, _MM_SHUFFLE(2, 0, 2, 0)));
+			_mm_storeu_ps(_dst + 4, _mm_shuffle_ps(_yz, _xy, _MM_SHUFFLE(3, 1, 2, 0)));
+			_mm_storeu_ps(_dst + 8, _mm_shuffle_ps(_zx, _yz, _MM_SHUFFLE(3, 1, 3, 1)));
+		}
+
+		/// (_r[0] * _x + _r[1] * _y) + _r[2] * _z
+		inline __m128 _Dot3SSE(const __m128* _r, __m128 _x, __m128 _y, __m128 _z)
+		{
+			return _mm_add_ps(_mm_add_ps(_mm_mul_ps(_r[0], _x), _mm_mul_ps(_r[1], _y)), _mm_mul_ps(_r[2], _z));
+		}
+
+		/// ((_r[0] * _x + _r[1] * _y) + _r[2] * _z) + _r[3]
+		inline __m128 _Dot4SSE(const __m128* _r, __m128 _x, __m128 _y, __m128 _z)
+		{
+			return _mm_add_ps(_Dot3SSE(_r, _x, _y, _z), _r[3]);
+		}
+
+		/// Load 8 points and convert them to structure of arrays. Each 128-bit lane holds 4 points as in _LoadVec3x4.
+		TARGET_AVX inline void _LoadVec3x8(const float* _src, __m256& _x, __m256& _y, __m256& _z)
+		{
+			__m256 _m03 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(_src)), _mm_loadu_ps(_src + 12), 1);
+			__m256 _m14 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(_src + 4)), _mm_loadu_ps(_src + 16), 1);
+			__m256 _m25 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(_src + 8)), _mm_loadu_ps(_src + 20), 1);
+			__m256 _xy = _mm256_shuffle_ps(_m14, _m25, _MM_SHUFFLE(2, 1, 3, 2));
+			__m256 _yz = _mm256_shuffle_ps(_m03, _m14, _MM_SHUFFLE(1, 0, 2, 1));
+			_x = _mm256_shuffle_ps(_m03, _xy, _MM_SHUFFLE(2, 0, 3, 0));
+			_y = _mm256_shuffle_ps(_yz, _xy, _MM_SHUFFLE(3, 1, 2, 0));
+			_z = _mm256_shuffle_ps(_yz, _m25, _MM_SHUFFLE(3, 0, 3, 1));
+		}
+
+		/// Convert structure of arrays to 8 points and store them.
+		TARGET_AVX inline void _StoreVec3x8(float* _dst, __m256 _x, __m256 _y, __m256 _z)
+		{
+			__m256 _xy = _mm256_shuffle_ps(_x, _y, _MM_SHUFFLE(2, 0, 2, 0));
+			__m256 _yz = _mm256_shuffle_ps(_y, _z, _MM_SHUFFLE(3, 1, 3, 1));
+			__m256 _zx = _mm256_shuffle_ps(_z, _x, _MM_SHUFFLE(3, 1, 2, 0));
+			__m256 _r03 = _mm256_shuffle_ps(_xy, _zx, _MM_SHUFFLE(2, 0, 2, 0));
+			__m256 _r14 = _mm256_shuffle_ps(_yz, _xy, _MM_SHUFFLE(3, 1, 2, 0));
+			__m256 _r25 = _mm256_shuffle_ps(_zx, _yz, _MM_SHUFFLE(3, 1, 3, 1));
+			_mm_storeu_ps(_dst, _mm256_castps256_ps128(_r03));
+			_mm_storeu_ps(_dst + 4, _mm256_castps256_ps128(_r14));
+			_mm_storeu_ps(_dst + 8, _mm256_castps256_ps128(_r25));
+			_mm_storeu_ps(_dst + 12, _mm256_extractf128_ps(_r03, 1));
+			_mm_storeu_ps(_dst + 16, _mm256_extractf128_ps(_r14, 1));
+			_mm_storeu_ps(_dst + 20, _mm256_extractf128_ps(_r25, 1));
+		}
+
+		/// Transpose 4x4 matrix in each 128-bit lane.
+		TARGET_AVX inline void _Transpose4x4x2(__m256& _r0, __m256& _r1, __m256& _r2, __m256& _r3)
+		{
+			__m256 _t0 = _mm256_unpacklo_ps(_r0, _r1), _t1 = _mm256_unpacklo_ps(_r2, _r3);
+			__m256 _t2 = _mm256_unpackhi_ps(_r0, _r1), _t3 = _mm256_unpackhi_ps(_r2, _r3);
+			_r0 = _mm256_shuffle_ps(_t0, _t1, _MM_SHUFFLE(1, 0, 1, 0));
+			_r1 = _mm256_shuffle_ps(_t0, _t1, _MM_SHUFFLE(3, 2, 3, 2));
+			_r2 = _mm256_shuffle_ps(_t2, _t3, _MM_SHUFFLE(1, 0, 1, 0));
+			_r3 = _mm256_shuffle_ps(_t2, _t3, _MM_SHUFFLE(3, 2, 3, 2));
+		}
+
+		/// Load two 128-bit values into lanes of 256-bit value.
+		TARGET_AVX inline __m256 _Load4x2(const float* _lo, const float* _hi)
+		{
+			return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(_lo)), _mm_loadu_ps(_hi), 1);
+		}
+
+		/// Store lanes of 256-bit value to two addresses.
+		TARGET_AVX inline void _Store4x2(float* _lo, float* _hi, __m256 _v)
+		{
+			_mm_storeu_ps(_lo, _mm256_castps256_ps128(_v));
+			_mm_storeu_ps(_hi, _mm256_extractf128_ps(_v, 1));
+		}
+
+		TARGET_AVX inline __m256 _Dot3AVX(const __m256* _r, __m256 _x, __m256 _y, __m256 _z)
+		{
+			return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_r[0], _x), _mm256_mul_ps(_r[1], _y)), _mm256_mul_ps(_r[2], _z));
+		}
+
+		TARGET_AVX inline __m256 _Dot4AVX(const __m256* _r, __m256 _x, __m256 _y, __m256 _z)
+		{
+			return _mm256_add_ps(_Dot3AVX(_r, _x, _y, _z), _r[3]);
+		}
+
+		// TransformPoints
+
+		uint _TransformPointsSSE(const Mat34& _m, const Vec3* _src, Vec3* _dst, uint _count)
+		{
+			__m128 _r[12];
+			for (uint k = 0; k < 12; ++k)
+				_r[k] = _mm_set1_ps(_m.v[k]);
+
+			uint i = 0;
+			for (; i + 4 <= _count; i += 4)
+			{
+				__m128 _x, _y, _z;
+				_LoadVec3x4(*_src[i], _x, _y, _z);
+				_StoreVec3x4(*_dst[i], _Dot4SSE(_r, _x, _y, _z), _Dot4SSE(_r + 4, _x, _y, _z), _Dot4SSE(_r + 8, _x, _y, _z));
+			}
+			return i;
+		}
+
+		TARGET_AVX uint _TransformPointsAVX(const Mat34& _m, const Vec3* _src, Vec3* _dst, uint _count)
+		{
+			__m256 _r[12];
+			for (uint k = 0; k < 12; ++k)
+				_r[k] = _mm256_set1_ps(_m.v[k]);
+
+			uint i = 0;
+			for (; i + 8 <= _count; i += 8)
+			{
+				__m256 _x, _y, _z;
+				_LoadVec3x8(*_src[i], _x, _y, _z);
+				_StoreVec3x8(*_dst[i], _Dot4AVX(_r, _x, _y, _z), _Dot4AVX(_r + 4, _x, _y, _z), _Dot4AVX(_r + 8, _x, _y, _z));
+			}
+			_mm256_zeroupper();
+			return i;
+		}
+
+		uint _TransformPointsSSE(const Mat44& _m, const Vec3* _src, Vec3* _dst, uint _count)
+		{
+			__m128 _r[16], _one = _mm_set1_ps(1);
+			for (uint k = 0; k < 16; ++k)
+				_r[k] = _mm_set1_ps(_m.v[k]);
+
+			uint i = 0;
+			for (; i + 4 <= _count; i += 4)
+			{
+				__m128 _x, _y, _z;
+				_LoadVec3x4(*_src[i], _x, _y, _z);
+				__m128 _iw = _mm_div_ps(_one, _Dot4SSE(_r + 12, _x, _y, _z));
+				_StoreVec3x4(*_dst[i], _mm_mul_ps(_Dot4SSE(_r, _x, _y, _z), _iw), _mm_mul_ps(_Dot4SSE(_r + 4, _x, _y, _z), _iw), _mm_mul_ps(_Dot4SSE(_r + 8, _x, _y, _z), _iw));
+			}
+			return i;
+		}
+
+		TARGET_AVX uint _TransformPointsAVX(const Mat44& _m, const Vec3* _src, Vec3* _dst, uint _count)
+		{
+			__m256 _r[16], _one = _mm256_set1_ps(1);
+			for (uint k = 0; k < 16; ++k)
+				_r[k] = _mm256_set1_ps(_m.v[k]);
+
+			uint i = 0;
+			for (; i + 8 <= _count; i += 8)
+			{
+				__m256 _x, _y, _z;
+				_LoadVec3x8(*_src[i], _x, _y, _z);
+				__m256 _iw = _mm256_div_ps(_one, _Dot4AVX(_r + 12, _x, _y, _z));
+				_StoreVec3x8(*_dst[i], _mm256_mul_ps(_Dot4AVX(_r, _x, _y, _z), _iw), _mm256_mul_ps(_Dot4AVX(_r + 4, _x, _y, _z), _iw), _mm256_mul_ps(_Dot4AVX(_r + 8, _x, _y, _z), _iw));
+			}
+			_mm256_zeroupper();
+			return i;
+		}
+
+		// MultiplyMat34Array
+
+		/// Row of product: (a0 * b0 + a1 * b1) + a2 * b2 + (-0, -0, -0, a3). Adding of -0 keeps x, y, z unchanged (including sign of zero).
+		inline __m128 _MultiplyRowSSE(__m128 _a, __m128 _b0, __m128 _b1, __m128 _b2, __m128 _wMask, __m128 _negZero)
+		{
+			__m128 _r = _mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(_a, _a, _MM_SHUFFLE(0, 0, 0, 0)), _b0), _mm_mul_ps(_mm_shuffle_ps(_a, _a, _MM_SHUFFLE(1, 1, 1, 1)), _b1));
+			_r = _mm_add_ps(_r, _mm_mul_ps(_mm_shuffle_ps(_a, _a, _MM_SHUFFLE(2, 2, 2, 2)), _b2));
+			return _mm_add_ps(_r, _mm_or_ps(_mm_and_ps(_a, _wMask), _negZero));
+		}
+
+		uint _MultiplyMat34ArraySSE(const Mat34* _a, const Mat34* _b, Mat34* _dst, uint _count)
+		{
+			__m128 _wMask = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+			__m128 _negZero = _mm_set_ps(0, -0.0f, -0.0f, -0.0f);
+			for (uint i = 0; i < _count; ++i)
+			{
+				__m128 _b0 = _mm_loadu_ps(_b[i].m[0]), _b1 = _mm_loadu_ps(_b[i].m[1]), _b2 = _mm_loadu_ps(_b[i].m[2]);
+				__m128 _a0 = _mm_loadu_ps(_a[i].m[0]), _a1 = _mm_loadu_ps(_a[i].m[1]), _a2 = _mm_loadu_ps(_a[i].m[2]);
+				_mm_storeu_ps(_dst[i].m[0], _MultiplyRowSSE(_a0, _b0, _b1, _b2, _wMask, _negZero));
+				_mm_storeu_ps(_dst[i].m[1], _MultiplyRowSSE(_a1, _b0, _b1, _b2, _wMask, _negZero));
+				_mm_storeu_ps(_dst[i].m[2], _MultiplyRowSSE(_a2, _b0, _b1, _b2, _wMask, _negZero));
+			}
+			return _count;
+		}
+
+		TARGET_AVX inline __m256 _MultiplyRowAVX(__m256 _a, __m256 _b0, __m256 _b1, __m256 _b2, __m256 _wMask, __m256 _negZero)
+		{
+			__m256 _r = _mm256_add_ps(_mm256_mul_ps(_mm256_permute_ps(_a, _MM_SHUFFLE(0, 0, 0, 0)), _b0), _mm256_mul_ps(_mm256_permute_ps(_a, _MM_SHUFFLE(1, 1, 1, 1)), _b1));
+			_r = _mm256_add_ps(_r, _mm256_mul_ps(_mm256_permute_ps(_a, _MM_SHUFFLE(2, 2, 2, 2)), _b2));
+			return _mm256_add_ps(_r, _mm256_or_ps(_mm256_and_ps(_a, _wMask), _negZero));
+		}
+
+		/// Two matrices per iteration, one in each 128-bit lane.
+		TARGET_AVX uint _MultiplyMat34ArrayAVX(const Mat34* _a, const Mat34* _b, Mat34* _dst, uint _count)
+		{
+			__m256 _wMask = _mm256_castsi256_ps(_mm256_set_epi32(-1, 0, 0, 0, -1, 0, 0, 0));
+			__m256 _negZero = _mm256_set_ps(0, -0.0f, -0.0f, -0.0f, 0, -0.0f, -0.0f, -0.0f);
+			uint i = 0;
+			for (; i + 2 <= _count; i += 2)
+			{
+				__m256 _b0 = _Load4x2(_b[i].m[0], _b[i + 1].m[0]), _b1 = _Load4x2(_b[i].m[1], _b[i + 1].m[1]), _b2 = _Load4x2(_b[i].m[2], _b[i + 1].m[2]);
+				__m256 _a0 = _Load4x2(_a[i].m[0], _a[i + 1].m[0]), _a1 = _Load4x2(_a[i].m[1], _a[i + 1].m[1]), _a2 = _Load4x2(_a[i].m[2], _a[i + 1].m[2]);
+				_Store4x2(_dst[i].m[0], _dst[i + 1].m[0], _MultiplyRowAVX(_a0, _b0, _b1, _b2, _wMask, _negZero));
+				_Store4x2(_dst[i].m[1], _dst[i + 1].m[1], _MultiplyRowAVX(_a1, _b0, _b1, _b2, _wMask, _negZero));
+				_Store4x2(_dst[i].m[2], _dst[i + 1].m[2], _MultiplyRowAVX(_a2, _b0, _b1, _b2, _wMask, _negZero));
+			}
+			_mm256_zeroupper();
+			return i;
+		}
+
+		// QuatToMat34Array
+
+		uint _QuatToMat34ArraySSE(const Quat* _src, Mat34* _dst, uint _count)
+		{
+			__m128 _one = _mm_set1_ps(1), _zero = _mm_setzero_ps();
+			uint i = 0;
+			for (; i + 4 <= _count; i += 4)
+			{
+				__m128 _x = _mm_loadu_ps(_src[i].v), _y = _mm_loadu_ps(_src[i + 1].v), _z = _mm_loadu_ps(_src[i + 2].v), _w = _mm_loadu_ps(_src[i + 3].v);
+				_MM_TRANSPOSE4_PS(_x, _y, _z, _w);
+
+				// see Quat::ToMatrixRows
+				__m128 _x2 = _mm_add_ps(_x, _x), _y2 = _mm_add_ps(_y, _y), _z2 = _mm_add_ps(_z, _z);
+				__m128 _wx = _mm_mul_ps(_x2, _w), _wy = _mm_mul_ps(_y2, _w), _wz = _mm_mul_ps(_z2, _w);
+				__m128 _xx = _mm_mul_ps(_x2, _x), _xy = _mm_mul_ps(_y2, _x), _xz = _mm_mul_ps(_z2, _x);
+				__m128 _yy = _mm_mul_ps(_y2, _y), _yz = _mm_mul_ps(_z2, _y), _zz = _mm_mul_ps(_z2, _z);
+
+				__m128 _r00 = _mm_sub_ps(_one, _mm_add_ps(_yy, _zz)), _r01 = _mm_add_ps(_xy, _wz), _r02 = _mm_sub_ps(_xz, _wy), _r03 = _zero;
+				__m128 _r10 = _mm_sub_ps(_xy, _wz), _r11 = _mm_sub_ps(_one, _mm_add_ps(_xx, _zz)), _r12 = _mm_add_ps(_yz, _wx), _r13 = _zero;
+				__m128 _r20 = _mm_add_ps(_xz, _wy), _r21 = _mm_sub_ps(_yz, _wx), _r22 = _mm_sub_ps(_one, _mm_add_ps(_xx, _yy)), _r23 = _zero;
+				_MM_TRANSPOSE4_PS(_r00, _r01, _r02, _r03);
+				_MM_TRANSPOSE4_PS(_r10, _r11, _r12, _r13);
+				_MM_TRANSPOSE4_PS(_r20, _r21, _r22, _r23);
+
+				Mat34* _m = _dst + i;
+				_mm_storeu_ps(_m[0].m[0], _r00), _mm_storeu_ps(_m[0].m[1], _r10), _mm_storeu_ps(_m[0].m[2], _r20);
+				_mm_storeu_ps(_m[1].m[0], _r01), _mm_storeu_ps(_m[1].m[1], _r11), _mm_storeu_ps(_m[1].m[2], _r21);
+				_mm_storeu_ps(_m[2].m[0], _r02), _mm_storeu_ps(_m[2].m[1], _r12), _mm_storeu_ps(_m[2].m[2], _r22);
+				_mm_storeu_ps(_m[3].m[0], _r03), _mm_storeu_ps(_m[3].m[1], _r13), _mm_storeu_ps(_m[3].m[2], _r23);
+			}
+			return i;
+		}
+
+		/// Quaternions i..i+3 are in low lanes and i+4..i+7 are in high lanes.
+		TARGET_AVX uint _QuatToMat34ArrayAVX(const Quat* _src, Mat34* _dst, uint _count)
+		{
+			__m256 _one = _mm256_set1_ps(1), _zero = _mm256_setzero_ps();
+			uint i = 0;
+			for (; i + 8 <= _count; i += 8)
+			{
+				const Quat* _q = _src + i;
+				__m256 _x = _Load4x2(_q[0].v, _q[4].v), _y = _Load4x2(_q[1].v, _q[5].v), _z = _Load4x2(_q[2].v, _q[6].v), _w = _Load4x2(_q[3].v, _q[7].v);
+				_Transpose4x4x2(_x, _y, _z, _w);
+
+				__m256 _x2 = _mm256_add_ps(_x, _x), _y2 = _mm256_add_ps(_y, _y), _z2 = _mm256_add_ps(_z, _z);
+				__m256 _wx = _mm256_mul_ps(_x2, _w), _wy = _mm256_mul_ps(_y2, _w), _wz = _mm256_mul_ps(_z2, _w);
+				__m256 _xx = _mm256_mul_ps(_x2, _x), _xy = _mm256_mul_ps(_y2, _x), _xz = _mm256_mul_ps(_z2, _x);
+				__m256 _yy = _mm256_mul_ps(_y2, _y), _yz = _mm256_mul_ps(_z2, _y), _zz = _mm256_mul_ps(_z2, _z);
+
+				__m256 _r00 = _mm256_sub_ps(_one, _mm256_add_ps(_yy, _zz)), _r01 = _mm256_add_ps(_xy, _wz), _r02 = _mm256_sub_ps(_xz, _wy), _r03 = _zero;
+				__m256 _r10 = _mm256_sub_ps(_xy, _wz), _r11 = _mm256_sub_ps(_one, _mm256_add_ps(_xx, _zz)), _r12 = _mm256_add_ps(_yz, _wx), _r13 = _zero;
+				__m256 _r20 = _mm256_add_ps(_xz, _wy), _r21 = _mm256_sub_ps(_yz, _wx), _r22 = _mm256_sub_ps(_one, _mm256_add_ps(_xx, _yy)), _r23 = _zero;
+				_Transpose4x4x2(_r00, _r01, _r02, _r03);
+				_Transpose4x4x2(_r10, _r11, _r12, _r13);
+				_Transpose4x4x2(_r20, _r21, _r22, _r23);
+
+				Mat34* _m = _dst + i;
+				_Store4x2(_m[0].m[0], _m[4].m[0], _r00), _Store4x2(_m[0].m[1], _m[4].m[1], _r10), _Store4x2(_m[0].m[2], _m[4].m[2], _r20);
+				_Store4x2(_m[1].m[0], _m[5].m[0], _r01), _Store4x2(_m[1].m[1], _m[5].m[1], _r11), _Store4x2(_m[1].m[2], _m[5].m[2], _r21);
+				_Store4x2(_m[2].m[0], _m[6].m[0], _r02), _Store4x2(_m[2].m[1], _m[6].m[1], _r12), _Store4x2(_m[2].m[2], _m[6].m[2], _r22);
+				_Store4x2(_m[3].m[0], _m[7].m[0], _r03), _Store4x2(_m[3].m[1], _m[7].m[1], _r13), _Store4x2(_m[3].m[2], _m[7].m[2], _r23);
+			}
+			_mm256_zeroupper();
+			return i;
+		}
+
+		// NormalizeQuatArray
+
+		uint _NormalizeQuatArraySSE(const Quat* _src, Quat* _dst, uint _count)
+		{
+			__m128 _one = _mm_set1_ps(1), _eps = _mm_set1_ps(EPSILON2);
+			uint i = 0;
+			for (; i + 4 <= _count; i += 4)
+			{
+				__m128 _x = _mm_loadu_ps(_src[i].v), _y = _mm_loadu_ps(_src[i + 1].v), _z = _mm_loadu_ps(_src[i + 2].v), _w = _mm_loadu_ps(_src[i + 3].v);
+				_MM_TRANSPOSE4_PS(_x, _y, _z, _w);
+				__m128 _l = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_x, _x), _mm_mul_ps(_y, _y)), _mm_mul_ps(_z, _z)), _mm_mul_ps(_w, _w));
+				__m128 _mask = _mm_cmpgt_ps(_l, _eps);
+				__m128 _s = _mm_div_ps(_one, _mm_sqrt_ps(_l));
+				_s = _mm_or_ps(_mm_and_ps(_mask, _s), _mm_andnot_ps(_mask, _one)); // 1 for too short quaternions
+				_x = _mm_mul_ps(_x, _s), _y = _mm_mul_ps(_y, _s), _z = _mm_mul_ps(_z, _s), _w = _mm_mul_ps(_w, _s);
+				_MM_TRANSPOSE4_PS(_x, _y, _z, _w);
+				_mm_storeu_ps(_dst[i].v, _x), _mm_storeu_ps(_dst[i + 1].v, _y), _mm_storeu_ps(_dst[i + 2].v, _z), _mm_storeu_ps(_dst[i + 3].v, _w);
+			}
+			return i;
+		}
+
+		TARGET_AVX uint _NormalizeQuatArrayAVX(const Quat* _src, Quat* _dst, uint _count)
+		{
+			__m256 _one = _mm256_set1_ps(1), _eps = _mm256_set1_ps(EPSILON2);
+			uint i = 0;
+			for (; i + 8 <= _count; i += 8)
+			{
+				const Quat* _q = _src + i;
+				__m256 _x = _Load4x2(_q[0].v, _q[4].v), _y = _Load4x2(_q[1].v, _q[5].v), _z = _Load4x2(_q[2].v, _q[6].v), _w = _Load4x2(_q[3].v, _q[7].v);
+				_Transpose4x4x2(_x, _y, _z, _w);
+				__m256 _l = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_x, _x), _mm256_mul_ps(_y, _y)), _mm256_mul_ps(_z, _z)), _mm256_mul_ps(_w, _w));
+				__m256 _s = _mm256_blendv_ps(_one, _mm256_div_ps(_one, _mm256_sqrt_ps(_l)), _mm256_cmp_ps(_l, _eps, _CMP_GT_OQ));
+				_x = _mm256_mul_ps(_x, _s), _y = _mm256_mul_ps(_y, _s), _z = _mm256_mul_ps(_z, _s), _w = _mm256_mul_ps(_w, _s);
+				_Transpose4x4x2(_x, _y, _z, _w);
+				Quat* _r = _dst + i;
+				_Store4x2(_r[0].v, _r[4].v, _x), _Store4x2(_r[1].v, _r[5].v, _y), _Store4x2(_r[2].v, _r[6].v, _z), _Store4x2(_r[3].v, _r[7].v, _w);
+			}
+			_mm256_zeroupper();
+			return i;
+		}
+
+		// TransformAlignedBoxes
+
+		uint _TransformAlignedBoxesSSE(const Mat34& _m, const AlignedBox* _src, AlignedBox* _dst, uint _count)
+		{
+			__m128 _r[12], _a[9], _half = _mm_set1_ps(0.5f);
+			for (uint k = 0; k < 12; ++k)
+				_r[k] = _mm_set1_ps(_m.v[k]);
+			for (uint k = 0; k < 9; ++k)
+				_a[k] = _mm_set1_ps(Abs(_m.m[k / 3][k % 3]));
+
+			uint i = 0;
+			for (; i + 4 <= _count; i += 4)
+			{
+				// two loads of mn0, mx0, mn1, mx1 and mn2, mx2, mn3, mx3
+				__m128 _x0, _y0, _z0, _x1, _y1, _z1;
+				_LoadVec3x4(*_src[i].mn, _x0, _y0, _z0);
+				_LoadVec3x4(*_src[i + 2].mn, _x1, _y1, _z1);
+				__m128 _mnx = _mm_shuffle_ps(_x0, _x1, _MM_SHUFFLE(2, 0, 2, 0)), _mxx = _mm_shuffle_ps(_x0, _x1, _MM_SHUFFLE(3, 1, 3, 1));
+				__m128 _mny = _mm_shuffle_ps(_y0, _y1, _MM_SHUFFLE(2, 0, 2, 0)), _mxy = _mm_shuffle_ps(_y0, _y1, _MM_SHUFFLE(3, 1, 3, 1));
+				__m128 _mnz = _mm_shuffle_ps(_z0, _z1, _MM_SHUFFLE(2, 0, 2, 0)), _mxz = _mm_shuffle_ps(_z0, _z1, _MM_SHUFFLE(3, 1, 3, 1));
+
+				__m128 _cx = _mm_mul_ps(_mm_add_ps(_mxx, _mnx), _half), _cy = _mm_mul_ps(_mm_add_ps(_mxy, _mny), _half), _cz = _mm_mul_ps(_mm_add_ps(_mxz, _mnz), _half);
+				__m128 _ex = _mm_mul_ps(_mm_sub_ps(_mxx, _mnx), _half), _ey = _mm_mul_ps(_mm_sub_ps(_mxy, _mny), _half), _ez = _mm_mul_ps(_mm_sub_ps(_mxz, _mnz), _half);
+				__m128 _tx = _Dot4SSE(_r, _cx, _cy, _cz), _ty = _Dot4SSE(_r + 4, _cx, _cy, _cz), _tz = _Dot4SSE(_r + 8, _cx, _cy, _cz);
+				__m128 _sx = _Dot3SSE(_a, _ex, _ey, _ez), _sy = _Dot3SSE(_a + 3, _ex, _ey, _ez), _sz = _Dot3SSE(_a + 6, _ex, _ey, _ez);
+
+				_mnx = _mm_sub_ps(_tx, _sx), _mny = _mm_sub_ps(_ty, _sy), _mnz = _mm_sub_ps(_tz, _sz);
+				_mxx = _mm_add_ps(_tx, _sx), _mxy = _mm_add_ps(_ty, _sy), _mxz = _mm_add_ps(_tz, _sz);
+				_StoreVec3x4(*_dst[i].mn, _mm_unpacklo_ps(_mnx, _mxx), _mm_unpacklo_ps(_mny, _mxy), _mm_unpacklo_ps(_mnz, _mxz));
+				_StoreVec3x4(*_dst[i + 2].mn, _mm_unpackhi_ps(_mnx, _mxx), _mm_unpackhi_ps(_mny, _mxy), _mm_unpackhi_ps(_mnz, _mxz));
+			}
+			return i;
+		}
+
+		/// Same as _TransformAlignedBoxesSSE in each 128-bit lane. Low lanes hold boxes i..i+1, i+4..i+5, high lanes hold i+2..i+3, i+6..i+7.
+		TARGET_AVX uint _TransformAlignedBoxesAVX(const Mat34& _m, const AlignedBox* _src, AlignedBox* _dst, uint _count)
+		{
+			__m256 _r[12], _a[9], _half = _mm256_set1_ps(0.5f);
+			for (uint k = 0; k < 12; ++k)
+				_r[k] = _mm256_set1_ps(_m.v[k]);
+			for (uint k = 0; k < 9; ++k)
+				_a[k] = _mm256_set1_ps(Abs(_m.m[k / 3][k % 3]));
+
+			uint i = 0;
+			for (; i + 8 <= _count; i += 8)
+			{
+				__m256 _x0, _y0, _z0, _x1, _y1, _z1;
+				_LoadVec3x8(*_src[i].mn, _x0, _y0, _z0);
+				_LoadVec3x8(*_src[i + 4].mn, _x1, _y1, _z1);
+				__m256 _mnx = _mm256_shuffle_ps(_x0, _x1, _MM_SHUFFLE(2, 0, 2, 0)), _mxx = _mm256_shuffle_ps(_x0, _x1, _MM_SHUFFLE(3, 1, 3, 1));
+				__m256 _mny = _mm256_shuffle_ps(_y0, _y1, _MM_SHUFFLE(2, 0, 2, 0)), _mxy = _mm256_shuffle_ps(_y0, _y1, _MM_SHUFFLE(3, 1, 3, 1));
+				__m256 _mnz = _mm256_shuffle_ps(_z0, _z1, _MM_SHUFFLE(2, 0, 2, 0)), _mxz = _mm256_shuffle_ps(_z0, _z1, _MM_SHUFFLE(3, 1, 3, 1));
+
+				__m256 _cx = _mm256_mul_ps(_mm256_add_ps(_mxx, _mnx), _half), _cy = _mm256_mul_ps(_mm256_add_ps(_mxy, _mny), _half), _cz = _mm256_mul_ps(_mm256_add_ps(_mxz, _mnz), _half);
+				__m256 _ex = _mm256_mul_ps(_mm256_sub_ps(_mxx, _mnx), _half), _ey = _mm256_mul_ps(_mm256_sub_ps(_mxy, _mny), _half), _ez = _mm256_mul_ps(_mm256_sub_ps(_mxz, _mnz), _half);
+				__m256 _tx = _Dot4AVX(_r, _cx, _cy, _cz), _ty = _Dot4AVX(_r + 4, _cx, _cy, _cz), _tz = _Dot4AVX(_r + 8, _cx, _cy, _cz);
+				__m256 _sx = _Dot3AVX(_a, _ex, _ey, _ez), _sy = _Dot3AVX(_a + 3, _ex, _ey, _ez), _sz = _Dot3AVX(_a + 6, _ex, _ey, _ez);
+
+				_mnx = _mm256_sub_ps(_tx, _sx), _mny = _mm256_sub_ps(_ty, _sy), _mnz = _mm256_sub_ps(_tz, _sz);
+				_mxx = _mm256_add_ps(_tx, _sx), _mxy = _mm256_add_ps(_ty, _sy), _mxz = _mm256_add_ps(_tz, _sz);
+				_StoreVec3x8(*_dst[i].mn, _mm256_unpacklo_ps(_mnx, _mxx), _mm256_unpacklo_ps(_mny, _mxy), _mm256_unpacklo_ps(_mnz, _mxz));
+				_StoreVec3x8(*_dst[i + 4].mn, _mm256_unpackhi_ps(_mnx, _mxx), _mm256_unpackhi_ps(_mny, _mxy), _mm256_unpackhi_ps(_mnz, _mxz));
+			}
+			_mm256_zeroupper();
+			return i;
+		}
+	}
+
+	//----------------------------------------------------------------------------//
+	void TransformPoints(const Mat34& _m, const Vec3* _src, Vec3* _dst, uint _count, bool _simd)
+	{
+		uint i = 0;
+		if (_simd && (s_simdFeatures & CPU_AVX))
+			i = _TransformPointsAVX(_m, _src, _dst, _count);
+		else if (_simd && (s_simdFeatures & CPU_SSE))
+			i = _TransformPointsSSE(_m, _src, _dst, _count);
+
+		for (; i < _count; ++i)
+			_dst[i] = _m.Transform(_src[i]);
+	}
+	//----------------------------------------------------------------------------//
+	void TransformPoints(const Mat44& _m, const Vec3* _src, Vec3* _dst, uint _count, bool _simd)
+	{
+		uint i = 0;
+		if (_simd && (s_simdFeatures & CPU_AVX))
+			i = _TransformPointsAVX(_m, _src, _dst, _count);
+		else if (_simd && (s_simdFeatures & CPU_SSE))
+			i = _TransformPointsSSE(_m, _src, _dst, _count);
+
+		for (; i < _count; ++i)
+			_dst[i] = _m.Transform(_src[i]);
+	}
+	//----------------------------------------------------------------------------//
+	void MultiplyMat34Array(const Mat34* _a, const Mat34* _b, Mat34* _dst, uint _count, bool _simd)
+	{
+		uint i = 0;
+		if (_simd && (s_simdFeatures & CPU_AVX))
+			i = _MultiplyMat34ArrayAVX(_a, _b, _dst, _count);
+		else if (_simd && (s_simdFeatures & CPU_SSE))
+			i = _MultiplyMat34ArraySSE(_a, _b, _dst, _count);
+
+		for (; i < _count; ++i)
+			_dst[i] = _a[i] * _b[i];
+	}
+	//----------------------------------------------------------------------------//
+	void QuatToMat34Array(const Quat* _src, Mat34* _dst, uint _count, bool _simd)
+	{
+		uint i = 0;
+		if (_simd && (s_simdFeatures & CPU_AVX))
+			i = _QuatToMat34ArrayAVX(_src, _dst, _count);
+		else if (_simd && (s_simdFeatures & CPU_SSE))
+			i = _QuatToMat34ArraySSE(_src, _dst, _count);
+
+		for (; i < _count; ++i)
+			_dst[i].CreateRotation(_src[i]);
+	}
+	//----------------------------------------------------------------------------//
+	void NormalizeQuatArray(const Quat* _src, Quat* _dst, uint _count, bool _simd)
+	{
+		uint i = 0;
+		if (_simd && (s_simdFeatures & CPU_AVX))
+			i = _NormalizeQuatArrayAVX(_src, _dst, _count);
+		else if (_simd && (s_simdFeatures & CPU_SSE))
+			i = _NormalizeQuatArraySSE(_src, _dst, _count);
+
+		for (; i < _count; ++i)
+			_dst[i] = _src[i].Copy().Normalize();
+	}
+	//----------------------------------------------------------------------------//
+	void TransformAlignedBoxes(const Mat34& _m, const AlignedBox* _src, AlignedBox* _dst, uint _count, bool _simd)
+	{
+		uint i = 0;
+		if (_simd && (s_simdFeatures & CPU_AVX))
+			i = _TransformAlignedBoxesAVX(_m, _src, _dst, _count);
+		else if (_simd && (s_simdFeatures & CPU_SSE))
+			i = _TransformAlignedBoxesSSE(_m, _src, _dst, _count);
+
+		for (; i < _count; ++i)
+			_dst[i] = _src[i] * _m;
+	}
+	//----------------------------------------------------------------------------//
+
+	//----------------------------------------------------------------------------//
+	// Dbvt
+	//----------------------------------------------------------------------------//
+
+	namespace
+	{
+		inline float _SurfaceArea(const AlignedBox& _box)
+		{
+			Vec3 _s = _box.Size();
+			return 2 * (_s.x * _s.y + _s.y * _s.z + _s.z * _s.x);
+		}
+
+		inline bool _Intersects(const Sphere& _sphere, const AlignedBox& _box, bool* _contains)
+		{
+			float _dist = 0, _maxDist = 0;
+			for (uint i = 0; i < 3; ++i)
+			{
+				float _c = _sphere.center[i], _mn = _box.mn[i], _mx = _box.mx[i];
+				if (_c < _mn)
+					_dist += Sqr(_mn - _c);
+				else if (_c > _mx)
+					_dist += Sqr(_c - _mx);
+				_maxDist += Sqr(Max(_c - _mn, _mx - _c));
+			}
+			float _r = Sqr(_sphere.radius);
+			if (_dist > _r)
+				return false;
+			*_contains = _maxDist <= _r;
+			return true;
+		}
+
+		inline void _UpdateNode(Dbvt::Node* _node)
+		{
+			Dbvt::Node* _a = _node->childs[0];
+			Dbvt::Node* _b = _node->childs[1];
+			_node->height = 1 + Max(_a->height, _b->height);
+			_node->box = _a->fatBox + _b->fatBox;
+			_node->fatBox = _node->box;
+		}
+	}
+
+	//----------------------------------------------------------------------------//
+	Dbvt::Node* Dbvt::Add(void* _object, const AlignedBox& _bv)
+	{
+		ASSERT(_bv.IsFinite());
+		Node* _leaf = new Node;
+		_leaf->object = _object;
+		_leaf->box = _bv;
+		_leaf->fatBox.Set(_bv.mn - m_margin, _bv.mx + m_margin);
+		_Insert(_leaf);
+		++m_numLeafs;
+		return _leaf;
+	}
+	//----------------------------------------------------------------------------//
+	void Dbvt::Remove(Node* _node)
+	{
+		ASSERT(_node != nullptr && _node->IsLeaf());
+		_Remove(_node);
+		delete _node;
+		--m_numLeafs;
+	}
+	//----------------------------------------------------------------------------//
+	void Dbvt::Update(Node* _node)
+	{
+		ASSERT(_node != nullptr && _node->IsLeaf());
+		ASSERT(_node->box.IsFinite());
+
+		if (_node->fatBox.Contains(_node->box))
+			return;
+
+		_Remove(_node);
+		_node->fatBox.Set(_node->box.mn - m_margin, _node->box.mx + m_margin);
+		_Insert(_node);
+	}
+	//----------------------------------------------------------------------------//
+	void Dbvt::Clear(void)
+	{
+		Node* _stack[MAX_DEPTH];
+		uint _top = 0;
+		if (m_root)
+			_stack[_top++] = m_root;
+
+		while (_top)
+		{
+			Node* _node = _stack[--_top];
+			if (_node->IsNode())
+			{
+				ASSERT(_top + 2 <= MAX_DEPTH);
+				_stack[_top++] = _node->childs[0];
+				_stack[_top++] = _node->childs[1];
+			}
+			delete _node;
+		}
+
+		m_root = nullptr;
+		m_numLeafs = 0;
+	}
+	//----------------------------------------------------------------------------//
+	void Dbvt::EnumObjects(const Frustum& _bv, Callback& _callback)
+	{
+		Node* _stack[MAX_DEPTH];
+		uint _top = 0;
+		if (m_root)
+			_stack[_top++] = m_root;
+
+		while (_top)
+		{
+			Node* _node = _stack[--_top];
+			if (_node->IsLeaf())
+			{
+				if (_bv.Intersects(_node->box))
+					_callback.AddResult(_node->object);
+			}
+			else
+			{
+				bool _contains = false;
+				if (_bv.Intersects(_node->box, &_contains))
+				{
+					if (_contains)
+					{
+						_EnumAll(_node, _callback);
+					}
+					else
+					{
+						ASSERT(_top + 2 <= MAX_DEPTH);
+						_stack[_top++] = _node->childs[0];
+						_stack[_top++] = _node->childs[1];
+					}
+				}
+			}
+		}
+	}
+	//----------------------------------------------------------------------------//
+	void Dbvt::EnumObjects(const Frustum& _bv, const Frustum& _bv2, Callback& _callback)
+	{
+		Node* _stack[MAX_DEPTH];
+		uint8 _tests[MAX_DEPTH]; // 0x1 - test _bv, 0x2 - test _bv2
+		uint _top = 0;
+		if (m_root)
+			_stack[_top] = m_root, _tests[_top++] = 0x3;
+
+		while (_top)
+		{
+			Node* _node = _stack[--_top];
+			uint8 _test = _tests[_top];
+			if (_node->IsLeaf())
+			{
+				if ((!(_test & 0x1) || _bv.Intersects(_node->box)) && (!(_test & 0x2) || _bv2.Intersects(_node->box)))
+					_callback.AddResult(_node->object);
+			}
+			else
+			{
+				bool _contains = false;
+				if (_test & 0x1)
+				{
+					if (!_bv.Intersects(_node->box, &_contains))
+						continue;
+					if (_contains)
+						_test &= ~0x1;
+				}
+				if (_test & 0x2)
+				{
+					if (!_bv2.Intersects(_node->box, &_contains))
+						continue;
+					if (_contains)
+						_test &= ~0x2;
+				}
+
+				if (!_test)
+				{
+					_EnumAll(_node, _callback);
+				}
+				else
+				{
+					ASSERT(_top + 2 <= MAX_DEPTH);
+					_stack[_top] = _node->childs[0], _tests[_top++] = _test;
+					_stack[_top] = _node->childs[1], _tests[_top++] = _test;
+				}
+			}
+		}
+	}
+	//----------------------------------------------------------------------------//
+	void Dbvt::EnumObjects(const AlignedBox& _bv, Callback& _callback)
+	{
+		Node* _stack[MAX_DEPTH];
+		uint _top = 0;
+		if (m_root)
+			_stack[_top++] = m_root;
+
+		while (_top)
+		{
+			Node* _node = _stack[--_top];
+			if (_node->IsLeaf())
+			{
+				if (_bv.Intersects(_node->box))
+					_callback.AddResult(_node->object);
+			}
+			else
+			{
+				bool _contains = false;
+				if (_bv.Intersects(_node->box, &_contains))
+				{
+					if (_contains)
+					{
+						_EnumAll(_node, _callback);
+					}
+					else
+					{
+						ASSERT(_top + 2 <= MAX_DEPTH);
+						_stack[_top++] = _node->childs[0];
+						_stack[_top++] = _node->childs[1];
+					}
+				}
+			}
+		}
+	}
+	//----------------------------------------------------------------------------//
+	void Dbvt::EnumObjects(const Sphere& _bv, Callback& _callback)
+	{
+		Node* _stack[MAX_DEPTH];
+		uint _top = 0;
+		if (m_root)
+			_stack[_top++] = m_root;
+
+		while (_top)
+		{
+			Node* _node = _stack[--_top];
+			if (_node->IsLeaf())
+			{
+				if (_bv.Intersects(_node->box))
+					_callback.AddResult(_node->object);
+			}
+			else
+			{
+				bool _contains = false;
+				if (_Intersects(_bv, _node->box, &_contains))
+				{
+					if (_contains)
+					{
+						_EnumAll(_node, _callback);
+					}
+					else
+					{
+						ASSERT(_top + 2 <= MAX_DEPTH);
+						_stack[_top++] = _node->childs[0];
+						_stack[_top++] = _node->childs[1];
+					}
+				}
+			}
+		}
+	}
+	//----------------------------------------------------------------------------//
+	void Dbvt::_Insert(Node* _leaf)
+	{
+		if (!m_root)
+		{
+			m_root = _leaf;
+			_leaf->parent = nullptr;
+			return;
+		}
+
+		// find the best sibling (surface area heuristic)
+		const AlignedBox& _box = _leaf->fatBox;
+		Node* _sibling = m_root;
+		while (_sibling->IsNode())
+		{
+			float _area = _SurfaceArea(_sibling->fatBox);
+			float _combinedArea = _SurfaceArea(_sibling->fatBox + _box);
+			float _cost = 2 * _combinedArea; // cost of new parent for this node and the leaf
+			float _inheritanceCost = 2 * (_combinedArea - _area); // minimum cost of pushing the leaf down
+
+			float _childCost[2];
+			for (uint i = 0; i < 2; ++i)
+			{
+				Node* _child = _sibling->childs[i];
+				_childCost[i] = _SurfaceArea(_child->fatBox + _box) + _inheritanceCost;
+				if (_child->IsNode())
+					_childCost[i] -= _SurfaceArea(_child->fatBox);
+			}
+
+			if (_cost < _childCost[0] && _cost < _childCost[1])
+				break;
+
+			_sibling = _sibling->childs[_childCost[0] < _childCost[1] ? 0 : 1];
+		}
+
+		// create new parent
+		Node* _oldParent = _sibling->parent;
+		Node* _newParent = new Node;
+		_newParent->parent = _oldParent;
+		_newParent->childs[0] = _sibling;
+		_newParent->childs[1] = _leaf;
+		_sibling->parent = _newParent;
+		_leaf->parent = _newParent;
+
+		if (_oldParent)
+			_oldParent->childs[_oldParent->childs[0] == _sibling ? 0 : 1] = _newParent;
+		else
+			m_root = _newParent;
+
+		_Refit(_newParent);
+	}
+	//----------------------------------------------------------------------------//
+	void Dbvt::_Remove(Node* _leaf)
+	{
+		if (_leaf == m_root)
+		{
+			m_root = nullptr;
+			return;
+		}
+
+		Node* _parent = _leaf->parent;
+		Node* _grandParent = _parent->parent;
+		Node* _sibling = _parent->childs[_parent->childs[0] == _leaf ? 1 : 0];
+
+		_sibling->parent = _grandParent;
+		if (_grandParent)
+		{
+			_grandParent->childs[_grandParent->childs[0] == _parent ? 0 : 1] = _sibling;
+			_Refit(_grandParent);
+		}
+		else
+		{
+			m_root = _sibling;
+		}
+
+		delete _parent;
+		_leaf->parent = nullptr;
+	}
+	//----------------------------------------------------------------------------//
+	void Dbvt::_Refit(Node* _node)
+	{
+		while (_node)
+		{
+			_node = _Balance(_node);
+			_UpdateNode(_node);
+			_node = _node->parent;
+		}
+	}
+	//----------------------------------------------------------------------------//
+	Dbvt::Node* Dbvt::_Balance(Node* _a)
+	{
+		if (_a->IsLeaf() || _a->height < 2)
+			return _a;
+
+		int _balance = _a->childs[1]->height - _a->childs[0]->height;
+		if (_balance >= -1 && _balance <= 1)
+			return _a;
+
+		// rotate higher child up
+		uint _side = _balance > 1 ? 1 : 0;
+		Node* _x = _a->childs[_side];
+		Node* _f = _x->childs[0];
+		Node* _g = _x->childs[1];
+
+		_x->childs[0] = _a;
+		_x->parent = _a->parent;
+		_a->parent = _x;
+
+		if (_x->parent)
+			_x->parent->childs[_x->parent->childs[0] == _a ? 0 : 1] = _x;
+		else
+			m_root = _x;
+
+		// keep higher grandchild in _x, move lower one to _a
+		if (_f->height > _g->height)
+		{
+			_x->childs[1] = _f;
+			_a->childs[_side] = _g;
+			_g->parent = _a;
+		}
+		else
+		{
+			_x->childs[1] = _g;
+			_a->childs[_side] = _f;
+			_f->parent = _a;
+		}
+
+		_UpdateNode(_a);
+		_UpdateNode(_x);
+		return _x;
+	}
+	//----------------------------------------------------------------------------//
+	void Dbvt::_EnumAll(Node* _node, Callback& _callback)
+	{
+		Node* _stack[MAX_DEPTH];
+		uint _top = 0;
+		_stack[_top++] = _node;
+
+		while (_top)
+		{
+			_node = _stack[--_top];
+			if (_node->IsLeaf())
+			{
+				_callback.AddResult(_node->object);
+			}
+			else
+			{
+				ASSERT(_top + 2 <= MAX_DEPTH);
+				_stack[_top++] = _node->childs[0];
+				_stack[_top++] = _node->childs[1];
+			}
+		}
+	}
+	//----------------------------------------------------------------------------//
+
 	//----------------------------------------------------------------------------//
 	//
 	//----------------------------------------------------------------------------//
@@ -430,8 +430,8 @@ namespace Engine
 		Quat& operator += (const Quat& _rhs) { x += _rhs.x, y += _rhs.y, z += _rhs.z, w += _rhs.w; return *this; }
 		Quat& operator -= (const Quat& _rhs) { x -= _rhs.x, y -= _rhs.y, z -= _rhs.z, w -= _rhs.w; return *this; }
 		Quat& operator *= (const Quat& _rhs) { return Multiply(_rhs); }
-		Quat& operator *= (float _rhs) { x += _rhs, y += _rhs, z += _rhs, w += _rhs; return *this; }
-		Quat& operator /= (float _rhs) { x += _rhs, y += _rhs, z += _rhs, w += _rhs; return *this; }
+		Quat& operator *= (float _rhs) { x *= _rhs, y *= _rhs, z *= _rhs, w *= _rhs; return *this; }
+		Quat& operator /= (float _rhs) { x /= _rhs, y /= _rhs, z /= _rhs, w /= _rhs; return *this; }
 		friend Quat operator * (float _lhs, const Quat& _rhs) { return Quat(_lhs * _rhs.x, _lhs * _rhs.y, _lhs * _rhs.z, _lhs * _rhs.w); }
 		friend Vec3 operator * (const Vec3& _lhs, const Quat& _rhs)
 		{
@@ -506,7 +506,7 @@ namespace Engine
 		Mat34& Set(const Mat34& _m) { return *this = _m; }
 		Mat34& FromPtr(const void* _ptr) { memcpy(v, _ptr, 12 * sizeof(float));  return *this; }
 
-		Mat34& Add(const Mat34& _rhs) { for (int i = 0; i < 12; ++i) v[i] += v[i]; return *this; }
+		Mat34& Add(const Mat34& _rhs) { for (int i = 0; i < 12; ++i) v[i] += _rhs.v[i]; return *this; }
 		Mat34& Multiply(float _rhs) { for (int i = 0; i < 12; ++i) v[i] *= _rhs; return *this; }
 		Mat34& Multiply(const Mat34& _rhs);
 		float Determinant(void) const { return m00 * m11 * m22 + m01 * m12 * m20 + m02 * m10 * m21 - m02 * m11 * m20 - m00 * m12 * m21 - m01 * m10 * m22; }
@@ -588,7 +588,7 @@ namespace Engine
 		Mat44& FromPtr(const void* _ptr) { memcpy(v, _ptr, 16 * sizeof(float)); return *this; }
 
 		Mat44& Add(const Mat44& _rhs) { for (int i = 0; i < 16; ++i) v[i] += _rhs.v[i]; return *this; }
-		Mat44& Multiply(float _rhs) { for (int i = 0; i < 16; ++i) v[i] += _rhs; return *this; }
+		Mat44& Multiply(float _rhs) { for (int i = 0; i < 16; ++i) v[i] *= _rhs; return *this; }
 		Mat44& Multiply(const Mat44& _rhs);
 		Mat44& Multiply(const Mat34& _rhs);
 		Mat44& Inverse(void);
@@ -795,6 +795,24 @@ namespace Engine
 		static const uint16_t Triangles[36];
 	};
 
+	//----------------------------------------------------------------------------//
+	// AlignedBoxSoA
+	//----------------------------------------------------------------------------//
+
+	/// Boxes as structure of arrays for batch operations. Arrays are not owned.
+	struct AlignedBoxSoA
+	{
+		AlignedBoxSoA(void) : mnx(nullptr), mny(nullptr), mnz(nullptr), mxx(nullptr), mxy(nullptr), mxz(nullptr), count(0) { }
+
+		const float* mnx;
+		const float* mny;
+		const float* mnz;
+		const float* mxx;
+		const float* mxy;
+		const float* mxz;
+		uint count;
+	};
+
 	//----------------------------------------------------------------------------//
 	// Frustum
 	//----------------------------------------------------------------------------//
@@ -819,6 +837,10 @@ namespace Engine
 		bool Intersects(const Vec3& _center, float _radius) const;
 		bool Intersects(const AlignedBox& _box, bool* _contains = nullptr) const;
 		bool Intersects(const Frustum& _frustum, bool* _contains = nullptr) const;
+		/// Test boxes against planes of frustum in batch. Bit i of _visibility is set if box i is not completely outside.
+		///\param[out] _visibility must have (_boxes.count + 31) / 32 elements.
+		///\param[in] _simd enables SSE/AVX path (if supported by CPU). Result does not depend on this.
+		void CullBoxes(const AlignedBoxSoA& _boxes, uint32* _visibility, bool _simd = true) const;
 
 		float Distance(const Vec3& _point) const { return origin.Distance(_point); }
 		float Distance(const Vec3& _center, float _radius) const { float _d = origin.Distance(_center); return _d < _radius ? 0 : _d - _radius; }
@@ -833,19 +855,60 @@ namespace Engine
 		AlignedBox box;
 	};
 
+	//----------------------------------------------------------------------------//
+	// Batch operations
+	//----------------------------------------------------------------------------//
+
+	/// Maximal difference (in ulps) between results of batch operations and per-element operators.
+	/// SIMD paths do the same operations in the same order as scalar code and don't use FMA, so results are equal.
+	static const uint BATCH_MAX_ULP = 0;
+
+	/// Instruction sets of SIMD paths.
+	enum SimdLevel : uint8
+	{
+		SL_Scalar,
+		SL_SSE,
+		SL_AVX,
+	};
+
+	/// Limit instruction set of batch operations and Frustum::CullBoxes, to test all paths on one CPU. \note Not thread-safe.
+	void SetMaxSimdLevel(SimdLevel _level);
+	/// Get instruction set used by batch operations and Frustum::CullBoxes.
+	SimdLevel GetSimdLevel(void);
+
+	// Batch operations on arrays. SSE or AVX path is selected at runtime by CPU features, _simd = false forces scalar path.
+	// Destination may be the same array as source (in-place), but must not overlap it partially.
+
+	/// _dst[i] = _m.Transform(_src[i])
+	void TransformPoints(const Mat34& _m, const Vec3* _src, Vec3* _dst, uint _count, bool _simd = true);
+	/// _dst[i] = _m.Transform(_src[i]), with perspective division.
+	void TransformPoints(const Mat44& _m, const Vec3* _src, Vec3* _dst, uint _count, bool _simd = true);
+	/// _dst[i] = _a[i] * _b[i]
+	void MultiplyMat34Array(const Mat34* _a, const Mat34* _b, Mat34* _dst, uint _count, bool _simd = true);
+	/// _dst[i].CreateRotation(_src[i])
+	void QuatToMat34Array(const Quat* _src, Mat34* _dst, uint _count, bool _simd = true);
+	/// _dst[i] = _src[i].Copy().Normalize()
+	void NormalizeQuatArray(const Quat* _src, Quat* _dst, uint _count, bool _simd = true);
+	/// _dst[i] = _src[i] * _m
+	void TransformAlignedBoxes(const Mat34& _m, const AlignedBox* _src, AlignedBox* _dst, uint _count, bool _simd = true);
+
 	//----------------------------------------------------------------------------//
 	// Dbvt
 	//----------------------------------------------------------------------------//
 
-	///\warning It is very simple implementation (linear search O(n))
+	///\brief Dynamic bounding volume tree.
+	///\note Leafs are inserted by surface area heuristic and tree is balanced by rotations.
+	///\note Box of leaf is extended by margin, small moves of object does not change the tree.
 	class Dbvt
 	{
 	public:
 
-		struct Node	// 36 bytes (x86), 48 bytes (x64)
+		struct Node	// 64 bytes (x86), 80 bytes (x64)
 		{
-			AlignedBox box = AlignedBox::Inf;
+			AlignedBox box = AlignedBox::Inf; ///< box of object for leaf, box of childs for node
+			AlignedBox fatBox = AlignedBox::Inf; ///< extended box of object for leaf, copy of box for node
 			Node* parent = nullptr;
+			int height = 0; ///< 0 for leaf
 			union
 			{
 				Node* childs[2] = { nullptr };
@@ -862,77 +925,47 @@ namespace Engine
 			virtual void AddResult(void* _object) = 0;
 		};
 
-		Node* Add(void* _object, const AlignedBox& _bv)
-		{
-			ASSERT(_bv.IsFinite());
-			Node* _nn = new Node;
-			_nn->object = _object;
-			_nn->box = _bv;
-			m_nodes.PushBack(_nn);
-			return _nn;
-		}
-		void Remove(Node* _node)
-		{
-			ASSERT(_node != nullptr);
-			m_nodes.Remove(_node);
-			delete _node;
-		}
-		void Update(Node* _node)
+		enum : uint
 		{
-			ASSERT(_node != nullptr);
-			ASSERT(_node->box.IsFinite());
-		}
-		void EnumObjects(const Frustum& _bv, Callback& _callback)
-		{
-			for (uint i = 0; i < m_nodes.Size(); ++i)
-			{
-				Node* _n = m_nodes[i];
-				if (_bv.Intersects(_n->box))
-				{
-					_callback.AddResult(_n->object);
-				}
-			}
-		}
-		void EnumObjects(const Frustum& _bv, const Frustum& _bv2, Callback& _callback)
-		{
-			for (uint i = 0; i < m_nodes.Size(); ++i)
-			{
-				Node* _n = m_nodes[i];
-				if (_bv.Intersects(_n->box) && _bv2.Intersects(_n->box))
-				{
-					_callback.AddResult(_n->object);
-				}
-			}
-		}
-		void EnumObjects(const AlignedBox& _bv, Callback& _callback)
-		{
-			for (uint i = 0; i < m_nodes.Size(); ++i)
-			{
-				Node* _n = m_nodes[i];
-				if (_bv.Intersects(_n->box))
-				{
-					_callback.AddResult(_n->object);
-				}
-			}
-		}
-		void EnumObjects(const Sphere& _bv, Callback& _callback)
-		{
-			for (uint i = 0; i < m_nodes.Size(); ++i)
-			{
-				Node* _n = m_nodes[i];
-				if (_bv.Intersects(_n->box))
-				{
-					_callback.AddResult(_n->object);
-				}
-			}
-		}
-
-	//protected:
-
-		//void _Insert(Node*);
+			MAX_DEPTH = 128, ///< size of stack for traversal
+		};
 
-		//Node* m_root;
-		SArray<Node*, uint> m_nodes; // temp
+		Dbvt(void) : m_root(nullptr), m_numLeafs(0), m_margin(0.1f) { }
+		~Dbvt(void) { Clear(); }
+
+		/// Set margin of leafs. Larger margin means fewer reinsertions but more false candidates in queries.
+		void SetMargin(float _margin) { m_margin = _margin; }
+		float GetMargin(void) const { return m_margin; }
+		uint GetNumLeafs(void) const { return m_numLeafs; }
+		int GetHeight(void) const { return m_root ? m_root->height : 0; }
+
+		Node* Add(void* _object, const AlignedBox& _bv);
+		void Remove(Node* _node);
+		/// Update position of node after changing of Node::box.
+		void Update(Node* _node);
+		void Update(Node* _node, const AlignedBox& _bv) { _node->box = _bv; Update(_node); }
+		/// Remove all nodes.
+		void Clear(void);
+
+		void EnumObjects(const Frustum& _bv, Callback& _callback);
+		void EnumObjects(const Frustum& _bv, const Frustum& _bv2, Callback& _callback);
+		void EnumObjects(const AlignedBox& _bv, Callback& _callback);
+		void EnumObjects(const Sphere& _bv, Callback& _callback);
+
+	protected:
+
+		void _Insert(Node* _leaf);
+		void _Remove(Node* _leaf);
+		/// Update boxes and heights from _node to root with balancing.
+		void _Refit(Node* _node);
+		/// Balance subtree by rotation. \return new root of subtree.
+		Node* _Balance(Node* _node);
+		/// Report all leafs in subtree without testing.
+		void _EnumAll(Node* _node, Callback& _callback);
+
+		Node* m_root;
+		uint m_numLeafs;
+		float m_margin;
 	};
 
 	typedef Dbvt::Node DbvtNode;
@@ -1,4 +1,5 @@
 #include "Resource.hpp"
+#include "Timer.hpp"
 
 namespace Engine
 {
@@ -6,15 +7,17 @@ namespace Engine
 	// Resource
 	//----------------------------------------------------------------------------//
 
-	SpinLock Resource::s_queueLock;
-	List<ResourcePtr> Resource::s_queue;
-	Condition Resource::s_queueEvent;
-
 	//----------------------------------------------------------------------------//
 	Resource::Resource(void) :
 		m_rState(RS_Unloaded),
-		m_rInQueue(false),
-		m_id(0)
+		m_failedLoad(false),
+		m_id(0),
+		m_type(nullptr),
+		m_touchFrame(0),
+		m_priority(0),
+		m_rQueueIndex(-1),
+		m_rQueueTime(0),
+		m_residentSize(0)
 	{
 
 	}
@@ -33,23 +36,19 @@ namespace Engine
 	{
 		if (_async)
 		{
-			if (m_rState.CompareExchange(RS_Unloaded, RS_Loading)) // queue
-			{
-				SCOPE_LOCK(s_queueLock);
-				if (m_rInQueue.CompareExchange(false, true))
-				{
-					s_queue.push_front(this);
-					s_queueEvent.Signal();
-				}
-			}
+			Request(m_priority);
 		}
 		else
 		{
+			_Touch();
 			if (m_rState.CompareExchange(RS_Unloaded, RS_Loading) || m_rState == RS_Loading)
 			{
 				SCOPE_LOCK(*this); // only one thread can load this resource once
 				if (m_rState != RS_Loaded)
 				{
+					double _st = m_rQueueTime > 0 ? m_rQueueTime : Timer::Ms();
+					gResourceCache->m_queue.Remove(this); // was requested asynchronously
+
 					if (m_sourceFile.IsEmpty())
 						m_sourceFile = gResourceCache->SearchFile(ClassId(), m_name);
 
@@ -63,31 +62,191 @@ namespace Engine
 						LOG_MSG(LL_Error, "%s '%s' is not found", *ClassName(), *m_name);
 						m_failedLoad = true;
 					}
+
+					m_residentSize = m_failedLoad ? 0 : _GetResidentSize();
+					m_rQueueTime = 0;
 					m_rState = RS_Loaded;
+					gResourceCache->_OnLoad(this, Timer::Ms() - _st);
 				}
 			}
 		}
 	}
 	//----------------------------------------------------------------------------//
-	void Resource::Unload(void)
+	void Resource::Request(float _priority)
+	{
+		_Touch();
+		if (m_rState.CompareExchange(RS_Unloaded, RS_Loading)) // queue
+		{
+			m_rQueueTime = Timer::Ms();
+			gResourceCache->m_queue.Push(this, _priority);
+			gResourceCache->m_queueEvent.Signal();
+		}
+		else if (m_rState == RS_Loading) // change priority
+		{
+			gResourceCache->m_queue.Update(this, _priority);
+		}
+	}
+	//----------------------------------------------------------------------------//
+	bool Resource::Unload(void)
 	{
 		SCOPE_LOCK(*this);
 		if (m_rState == RS_Loaded && _Unload())
 		{
 			m_rState = RS_Unloaded;
+			gResourceCache->_OnUnload(this);
+			m_residentSize = 0;
+			return true;
+		}
+		return false;
+	}
+	//----------------------------------------------------------------------------//
+	void Resource::_Touch(void)
+	{
+		if (gResourceCache)
+			m_touchFrame = gResourceCache->GetFrame();
+	}
+	//----------------------------------------------------------------------------//
+
+	//----------------------------------------------------------------------------//
+	// ResourceQueue
+	//----------------------------------------------------------------------------//
+
+	//----------------------------------------------------------------------------//
+	void ResourceQueue::Push(Resource* _r, float _priority)
+	{
+		ASSERT(_r != nullptr);
+
+		_r->AddRef();
+
+		SCOPE_LOCK(m_lock);
+		ASSERT(_r->m_rQueueIndex < 0, "Resource is already queued");
+		_r->m_priority = _priority;
+		m_heap.push_back(_r);
+		_Set((uint)m_heap.size() - 1, _r);
+		_Up(_r->m_rQueueIndex);
+		m_size = (uint)m_heap.size();
+	}
+	//----------------------------------------------------------------------------//
+	bool ResourceQueue::Update(Resource* _r, float _priority)
+	{
+		ASSERT(_r != nullptr);
+
+		SCOPE_LOCK(m_lock);
+		float _prev = _r->m_priority;
+		_r->m_priority = _priority;
+		if (_r->m_rQueueIndex < 0)
+			return false;
+		if (_priority > _prev)
+			_Up(_r->m_rQueueIndex);
+		else if (_priority < _prev)
+			_Down(_r->m_rQueueIndex);
+		return true;
+	}
+	//----------------------------------------------------------------------------//
+	bool ResourceQueue::Remove(Resource* _r)
+	{
+		ASSERT(_r != nullptr);
+		{
+			SCOPE_LOCK(m_lock);
+			if (_r->m_rQueueIndex < 0)
+				return false;
+			_Remove(_r->m_rQueueIndex);
 		}
+		_r->Release(); // reference of queue
+		return true;
 	}
 	//----------------------------------------------------------------------------//
-	ResourcePtr Resource::_Unqueue(void)
+	ResourcePtr ResourceQueue::Pop(void)
 	{
 		ResourcePtr _r;
-		SCOPE_LOCK(s_queueLock);
-		if (!s_queue.empty())
 		{
-			_r = s_queue.back();
-			s_queue.pop_back();
-			_r->m_rInQueue = false;
+			SCOPE_LOCK(m_lock);
+			if (m_heap.empty())
+				return _r;
+			_r = _Remove(0);
+		}
+		_r->Release(); // reference of queue
+		return _r;
+	}
+	//----------------------------------------------------------------------------//
+	void ResourceQueue::Clear(ResourceType* _type)
+	{
+		Array<Resource*> _removed;
+		{
+			SCOPE_LOCK(m_lock);
+			Array<Resource*> _heap;
+			_heap.swap(m_heap);
+			for (Resource* _r : _heap)
+			{
+				if (!_type || _r->m_type == _type)
+				{
+					_r->m_rQueueIndex = -1;
+					_removed.push_back(_r);
+				}
+				else
+				{
+					m_heap.push_back(_r);
+					_Set((uint)m_heap.size() - 1, _r);
+					_Up(_r->m_rQueueIndex);
+				}
+			}
+			m_size = (uint)m_heap.size();
+		}
+
+		for (Resource* _r : _removed)
+		{
+			_r->m_rState.CompareExchange(RS_Loading, RS_Unloaded);
+			_r->m_rQueueTime = 0;
+			_r->Release();
+		}
+	}
+	//----------------------------------------------------------------------------//
+	void ResourceQueue::_Up(uint _index)
+	{
+		Resource* _r = m_heap[_index];
+		while (_index > 0)
+		{
+			uint _parent = (_index - 1) >> 1;
+			if (m_heap[_parent]->m_priority >= _r->m_priority)
+				break;
+			_Set(_index, m_heap[_parent]);
+			_index = _parent;
+		}
+		_Set(_index, _r);
+	}
+	//----------------------------------------------------------------------------//
+	void ResourceQueue::_Down(uint _index)
+	{
+		Resource* _r = m_heap[_index];
+		uint _size = (uint)m_heap.size();
+		for (;;)
+		{
+			uint _child = (_index << 1) + 1;
+			if (_child >= _size)
+				break;
+			if (_child + 1 < _size && m_heap[_child + 1]->m_priority > m_heap[_child]->m_priority)
+				++_child;
+			if (_r->m_priority >= m_heap[_child]->m_priority)
+				break;
+			_Set(_index, m_heap[_child]);
+			_index = _child;
+		}
+		_Set(_index, _r);
+	}
+	//----------------------------------------------------------------------------//
+	Resource* ResourceQueue::_Remove(uint _index)
+	{
+		Resource* _r = m_heap[_index];
+		Resource* _last = m_heap.back();
+		m_heap.pop_back();
+		if (_r != _last)
+		{
+			_Set(_index, _last);
+			_Up(_index);
+			_Down(_last->m_rQueueIndex);
 		}
+		_r->m_rQueueIndex = -1;
+		m_size = (uint)m_heap.size();
 		return _r;
 	}
 	//----------------------------------------------------------------------------//
@@ -100,7 +259,9 @@ namespace Engine
 	ResourceType::ResourceType(const String& _name, ResourceFactoryPfn _factory) :
 		m_name(_name),
 		m_typeid(_name.Hashi()),
-		m_factory(_factory)
+		m_factory(_factory),
+		m_budget(0),
+		m_residentSize(0)
 	{
 		ASSERT(_name.NonEmpty());
 		ASSERT(_factory != nullptr);
@@ -157,16 +318,21 @@ namespace Engine
 			Config* _val = _cfg.Search("rc_numBackgroundThreads");
 			if (_val)
 				numThreads = *_val;
+			_val = _cfg.Search("rc_memoryBudget");
+			if (_val)
+				memoryBudget = *_val;
 		}
 		else
 		{
 			_cfg("rc_numBackgroundThreads") = numThreads;
+			_cfg("rc_memoryBudget") = memoryBudget;
 		}
 	}
 	//----------------------------------------------------------------------------//
 	void ResourceCache::StartupParams::SetDefaults(void)
 	{
 		numThreads = MAX_THREADS;
+		memoryBudget = 0;
 	}
 	//----------------------------------------------------------------------------//
 	void ResourceCache::StartupParams::Validate(void)
@@ -189,17 +355,27 @@ namespace Engine
 		if (s_instance)
 		{
 			s_startupParams.numThreads = s_instance->m_numThreads;
+			s_startupParams.memoryBudget = (uint)(s_instance->m_budget >> 20);
 		}
 		return s_startupParams;
 	}
 	//----------------------------------------------------------------------------//
 	ResourceCache::ResourceCache(void) :
 		m_numThreads(0),
-		m_numStartedThreads(0)
+		m_numStartedThreads(0),
+		m_frame(0),
+		m_budget(0),
+		m_residentSize(0),
+		m_numResident(0),
+		m_numLoaded(0),
+		m_evictedSize(0),
+		m_numEvicted(0),
+		m_numLatencySamples(0)
 	{
 		ASSERT(Thread::IsMain());
 
 		s_startupParams.Validate();
+		m_budget = (size_t)s_startupParams.memoryBudget << 20;
 
 		while (m_numThreads < s_startupParams.numThreads)
 		{
@@ -216,7 +392,7 @@ namespace Engine
 		ASSERT(Thread::IsMain());
 
 		// unqueue all resources
-		while (Resource::_Unqueue());
+		m_queue.Clear();
 									  
 		// cleanup
 		{
@@ -232,11 +408,8 @@ namespace Engine
 			m_threads[m_numThreads].Wait();
 		}
 
-		{
-			SCOPE_LOCK(Resource::s_queueLock);
-			if (Resource::s_queue.size() > 0)
-				LOG_MSG(LL_Warning, "Resources load queue is not empty (size = %u)", (uint)Resource::s_queue.size());
-		}
+		if (m_queue.Size() > 0)
+			LOG_MSG(LL_Warning, "Resources load queue is not empty (size = %u)", m_queue.Size());
 		{
 			SCOPE_LOCK(m_cacheLock);
 			if (m_cache.size() > 0)
@@ -306,6 +479,7 @@ namespace Engine
 			_r = _rt->m_factory();
 			_r->m_name = _name;
 			_r->m_id = _id;
+			_r->m_type = _rt;
 			m_cache[_id] = _r;
 		}
 
@@ -325,14 +499,149 @@ namespace Engine
 		return _r;
 	}
 	//----------------------------------------------------------------------------//
+	Resource* ResourceCache::RequestResource(const NameHash& _type, const String& _name, float _priority)
+	{
+		ResourcePtr _r = AddResource(_type, _name);
+		if (_r)
+			_r->Request(_priority);
+		return _r;
+	}
+	//----------------------------------------------------------------------------//
 	void ResourceCache::UnqueueAllResources(void)
 	{
-		while (Resource::_Unqueue());
+		m_queue.Clear();
 	}
 	//----------------------------------------------------------------------------//
 	void ResourceCache::UnqueueAllResources(const NameHash& _type)
 	{
-		NOT_IMPLEMENTED_YET();
+		ResourceType* _rt = GetType(_type);
+		if (_rt)
+			m_queue.Clear(_rt);
+	}
+	//----------------------------------------------------------------------------//
+	void ResourceCache::SetBudget(const NameHash& _type, size_t _bytes)
+	{
+		ResourceType* _rt = GetType(_type);
+		if (_rt)
+			_rt->m_budget = _bytes;
+	}
+	//----------------------------------------------------------------------------//
+	void ResourceCache::Update(void)
+	{
+		ASSERT(Thread::IsMain());
+
+		++m_frame;
+		_Evict();
+	}
+	//----------------------------------------------------------------------------//
+	ResourceCache::Stats ResourceCache::GetStats(void)
+	{
+		Stats _stats;
+		_stats.residentBytes = m_residentSize;
+		_stats.evictedBytes = m_evictedSize;
+		_stats.numResident = m_numResident;
+		_stats.numQueued = m_queue.Size();
+		_stats.numLoaded = m_numLoaded;
+		_stats.numEvicted = m_numEvicted;
+
+		float _samples[LATENCY_SAMPLES];
+		uint _num;
+		{
+			SCOPE_LOCK(m_latencyLock);
+			_num = m_numLatencySamples < LATENCY_SAMPLES ? m_numLatencySamples : LATENCY_SAMPLES;
+			memcpy(_samples, m_latency, _num * sizeof(float));
+		}
+		if (_num > 0)
+		{
+			std::sort(_samples, _samples + _num);
+			_stats.latency50 = _samples[_num * 50 / 100];
+			_stats.latency90 = _samples[_num * 90 / 100];
+			_stats.latency99 = _samples[_num * 99 / 100];
+			_stats.latencyMax = _samples[_num - 1];
+		}
+
+		return _stats;
+	}
+	//----------------------------------------------------------------------------//
+	void ResourceCache::_Evict(void)
+	{
+		bool _overBudget = m_budget && m_residentSize > m_budget;
+		for (auto& i : m_types)
+		{
+			ResourceType* _rt = i.second;
+			if (_rt->m_budget && _rt->m_residentSize > _rt->m_budget)
+				_overBudget = true;
+		}
+		if (!_overBudget)
+			return;
+
+		struct Candidate
+		{
+			Resource* resource;
+			bool referenced;
+			uint age;
+
+			bool operator < (const Candidate& _rhs) const { return referenced != _rhs.referenced ? !referenced : age > _rhs.age; }
+		};
+
+		// resources which were touched in current or previous frame are not evicted
+		uint _frame = m_frame;
+		Array<Candidate> _candidates;
+		{
+			SCOPE_LOCK(m_cacheLock);
+			for (auto& i : m_cache)
+			{
+				Resource* _r = i.second;
+				uint _age = _frame - _r->m_touchFrame;
+				if (_r->m_rState == RS_Loaded && _r->m_residentSize > 0 && _age > 1)
+					_candidates.push_back({ _r, _r->GetRefCount() > 1, _age }); // the cache holds one reference
+			}
+		}
+
+		// unreferenced first, then least recently touched
+		std::sort(_candidates.begin(), _candidates.end());
+
+		for (const Candidate& _c : _candidates)
+		{
+			ResourceType* _rt = _c.resource->m_type;
+			bool _overGlobal = m_budget && m_residentSize > m_budget;
+			bool _overType = _rt->m_budget && _rt->m_residentSize > _rt->m_budget;
+			if (!_overGlobal && !_overType)
+				continue;
+
+			size_t _size = _c.resource->m_residentSize;
+			if (_c.resource->Unload())
+			{
+				m_evictedSize += _size;
+				++m_numEvicted;
+			}
+		}
+	}
+	//----------------------------------------------------------------------------//
+	void ResourceCache::_OnLoad(Resource* _r, double _latency)
+	{
+		if (_r->m_residentSize)
+		{
+			m_residentSize += _r->m_residentSize;
+			if (_r->m_type)
+				_r->m_type->m_residentSize += _r->m_residentSize;
+		}
+		++m_numResident;
+		++m_numLoaded;
+
+		SCOPE_LOCK(m_latencyLock);
+		m_latency[m_numLatencySamples++ % LATENCY_SAMPLES] = (float)_latency;
+	}
+	//----------------------------------------------------------------------------//
+	void ResourceCache::_OnUnload(Resource* _r)
+	{
+		if (_r->m_residentSize)
+		{
+			m_residentSize -= _r->m_residentSize;
+			if (_r->m_type)
+				_r->m_type->m_residentSize -= _r->m_residentSize;
+		}
+		--m_numResident;
 	}
 	//----------------------------------------------------------------------------//
 	void ResourceCache::_LoadingThread(uint _index)
@@ -342,15 +651,17 @@ namespace Engine
 		m_numStartedThreads++;
 		while (m_runThreads[_index])
 		{
-			ResourcePtr _r = Resource::_Unqueue();
+			ResourcePtr _r = m_queue.Pop();
 
 			if (_r)
 			{
 				if (_r->GetRefCount() > 1) // it is not lost resource
 					_r->Load(false); // load synchronously
+				else
+					_r->m_rState.CompareExchange(RS_Loading, RS_Unloaded);
 			}
 			else
-				Resource::s_queueEvent.Wait(20); // wait next resource
+				m_queueEvent.Wait(20); // wait next resource
 		}
 		m_numStartedThreads--;
 	}
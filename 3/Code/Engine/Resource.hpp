@@ -15,6 +15,8 @@ namespace Engine
 	typedef Ptr<class Resource> ResourcePtr;
 	typedef ResourcePtr(*ResourceFactoryPfn)(void);
 
+	class ResourceType;
+
 	//----------------------------------------------------------------------------//
 	// Resource
 	//----------------------------------------------------------------------------//
@@ -41,28 +43,79 @@ namespace Engine
 		bool IsLoadFail(void) { return m_failedLoad; }
 		void Touch(bool _wait = true) { Load(!_wait); }
 		void Load(bool _async = false);
-		void Unload(void);
+		/// Queue asynchronous loading or change priority of queued resource. Resources with larger priority are loaded first.
+		void Request(float _priority);
+		/// Unload resource. \return false if resource was not loaded or cannot be unloaded.
+		bool Unload(void);
+
+		/// Get priority of loading.
+		float GetPriority(void) { return m_priority; }
+		/// Get number of bytes used by loaded resource.
+		size_t GetResidentSize(void) { return m_residentSize; }
+		/// Get frame of last usage (see ResourceCache::Update).
+		uint GetTouchFrame(void) { return m_touchFrame; }
 
 		static uint CreateId(const NameHash& _type, const String& _name) { return (_type + "@") + _name; }
+		/// Make priority of loading from distance to viewer, size on screen (0..1) and explicit bias.
+		static float MakePriority(float _distance, float _screenSize = 1, float _bias = 0) { return _bias + _screenSize / (1 + (_distance > 0 ? _distance : 0)); }
 
 	protected:
 		friend class ResourceCache;
+		friend class ResourceQueue;
 
 		virtual bool _Unload(void) { return false; }
 		virtual bool _Load(DataStream& _src) { return true; }
+		/// Get number of bytes used by this resource in memory. Called after loading.
+		virtual size_t _GetResidentSize(void) { return 0; }
 
-		static ResourcePtr _Unqueue(void);
+		void _Touch(void);
 
 		Atomic<ResourceState> m_rState;
-		Atomic<bool> m_rInQueue;
 		bool m_failedLoad;
 		String m_sourceFile;
 		String m_name;
 		uint m_id;
+		ResourceType* m_type;
+		Atomic<uint> m_touchFrame;
+		float m_priority;
+		int m_rQueueIndex; //!< Index in the load queue. -1 if resource is not queued.
+		double m_rQueueTime; //!< Time of queuing (ms). Zero if resource is not queued.
+		size_t m_residentSize;
+	};
+
+	//----------------------------------------------------------------------------//
+	// ResourceQueue
+	//----------------------------------------------------------------------------//
 
-		static SpinLock s_queueLock;
-		static List<ResourcePtr> s_queue;
-		static Condition s_queueEvent;
+	/// Load queue. Binary heap of resources ordered by priority.
+	/// Each queued resource knows own index in the heap, so its priority can be changed in place.
+	class ResourceQueue : public NonCopyable
+	{
+	public:
+		~ResourceQueue(void) { Clear(); }
+
+		/// Add resource to queue. Resource must not be queued.
+		void Push(Resource* _r, float _priority);
+		/// Change priority of resource. \return false if resource is not queued.
+		bool Update(Resource* _r, float _priority);
+		/// Remove resource from queue and release reference of queue. \return false if resource is not queued.
+		bool Remove(Resource* _r);
+		/// Remove resource with max priority from queue.
+		ResourcePtr Pop(void);
+		/// Remove all resources of given type (or all resources if _type is null) from queue. Removed resources become unloaded.
+		void Clear(ResourceType* _type = nullptr);
+		/// Get number of queued resources.
+		uint Size(void) { return m_size; }
+
+	protected:
+		void _Set(uint _index, Resource* _r) { m_heap[_index] = _r; _r->m_rQueueIndex = (int)_index; }
+		void _Up(uint _index);
+		void _Down(uint _index);
+		Resource* _Remove(uint _index);
+
+		SpinLock m_lock;
+		Array<Resource*> m_heap;
+		Atomic<uint> m_size;
 	};
 
 	//----------------------------------------------------------------------------//
@@ -74,11 +127,18 @@ namespace Engine
 	public:
 		ResourceType(const String& _name, ResourceFactoryPfn _factory);
 		~ResourceType(void);
-		
+
 		void AddPaths(const String& _paths);
 		void AddFileExts(const String& _exts);
 
+		const String& GetName(void) { return m_name; }
+		/// Get number of bytes used by loaded resources of this type.
+		size_t GetResidentSize(void) { return m_residentSize; }
+		/// Get memory budget of this type. Zero is unlimited.
+		size_t GetBudget(void) { return m_budget; }
+
 	protected:
+		friend class Resource;
 		friend class ResourceCache;
 		String m_name;
 		uint m_typeid;
@@ -88,6 +148,8 @@ namespace Engine
 		CriticalSection m_lock;
 		HashSet<uint> m_items;
 		HashMap<uint, uint> m_files;
+		size_t m_budget;
+		Atomic<size_t> m_residentSize;
 	};
 
 	//----------------------------------------------------------------------------//
@@ -101,11 +163,13 @@ namespace Engine
 		enum : uint
 		{
 			MAX_THREADS = 4,
+			LATENCY_SAMPLES = 256, //!< Number of last loads used for latency percentiles.
 		};
 
 		struct StartupParams
 		{
 			uint numThreads = MAX_THREADS; // rc_numBackgroundThreads
+			uint memoryBudget = 0; // rc_memoryBudget, in megabytes. Zero is unlimited.
 
 			void Serialize(Config& _cfg, bool _loading);
 			void SetDefaults(void);
@@ -114,6 +178,20 @@ namespace Engine
 		static StartupParams& GetStartupParams(void) { return s_startupParams; }
 		static StartupParams& GetCurrentStartupParams(void);
 
+		struct Stats
+		{
+			size_t residentBytes = 0;
+			size_t evictedBytes = 0; //!< Total number of bytes freed by eviction.
+			uint numResident = 0;
+			uint numQueued = 0;
+			uint numLoaded = 0; //!< Total number of loads.
+			uint numEvicted = 0; //!< Total number of evicted resources.
+			float latency50 = 0; //!< Median time (ms) between request and end of loading.
+			float latency90 = 0;
+			float latency99 = 0;
+			float latencyMax = 0;
+		};
+
 		// []
 
 		bool RegisterType(const String& _name, ResourceFactoryPfn _factory, const String& _paths = String::Empty, const String& _exts = String::Empty);
@@ -124,31 +202,60 @@ namespace Engine
 		Resource* GetResource(const NameHash& _type, const String& _name) { return GetResource(Resource::CreateId(_type,_name)); }
 		Resource* AddResource(const NameHash& _type, const String& _name);
 		Resource* LoadResource(const NameHash& _type, const String& _name, bool _async);
+		Resource* RequestResource(const NameHash& _type, const String& _name, float _priority);
 
 		//template <class T> T* Get(const String& _name) { return static_cast<T*>(GetResource(T::ClassIdStatic(), _name)); }
 		template <class T> T* Add(const String& _name) { return static_cast<T*>(AddResource(T::ClassIdStatic(), _name)); }
 		template <class T> T* Load(const String& _name, bool _async) { return static_cast<T*>(LoadResource(T::ClassIdStatic(), _name, _async)); }
-
-		//TODO: resource lifetime management
+		template <class T> T* Request(const String& _name, float _priority) { return static_cast<T*>(RequestResource(T::ClassIdStatic(), _name, _priority)); }
 
 		void UnqueueAllResources(void);
 		void UnqueueAllResources(const NameHash& _type);
 
+		/// Set memory budget for all resources. Zero is unlimited.
+		void SetBudget(size_t _bytes) { m_budget = _bytes; }
+		/// Set memory budget for resources of given type. Zero is unlimited.
+		void SetBudget(const NameHash& _type, size_t _bytes);
+		size_t GetBudget(void) { return m_budget; }
+
+		/// Begin new frame and evict least recently touched resources if memory budget is exceeded. Call it once per frame in main thread.
+		void Update(void);
+		/// Get current frame.
+		uint GetFrame(void) { return m_frame; }
+		Stats GetStats(void);
+
 	protected:
 		friend class System;
+		friend class Resource;
 
 		ResourceCache(void);
 		~ResourceCache(void);
 		void _LoadingThread(uint _index);
+		void _Evict(void);
+		void _OnLoad(Resource* _r, double _latency);
+		void _OnUnload(Resource* _r);
 
 		HashMap<uint, ResourceType*> m_types;
 		CriticalSection m_cacheLock;
 		HashMap<uint, ResourcePtr> m_cache;
+		ResourceQueue m_queue;
+		Condition m_queueEvent;
 		volatile bool m_runThreads[MAX_THREADS];
 		Thread m_threads[MAX_THREADS];
 		uint m_numThreads;
 		Atomic<uint> m_numStartedThreads;
 
+		Atomic<uint> m_frame;
+		size_t m_budget;
+		Atomic<size_t> m_residentSize;
+		Atomic<uint> m_numResident;
+		Atomic<uint> m_numLoaded;
+		size_t m_evictedSize;
+		uint m_numEvicted;
+		SpinLock m_latencyLock;
+		float m_latency[LATENCY_SAMPLES];
+		uint m_numLatencySamples;
+
 		static int s_moduleRefCount;
 		static StartupParams s_startupParams;
 	};
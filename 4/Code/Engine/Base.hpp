@@ -500,15 +500,8 @@ namespace Rx
 
 	extern RX_API const uint32 Crc32Table[256];
 
-	inline uint32 Crc32(uint32 _crc, const void* _buf, uint _size)
-	{
-		ASSERT(_buf || !_size);
-		const uint8* p = (const uint8*)_buf;
-		_crc = _crc ^ ~0u;
-		while (_size--)
-			_crc = Crc32Table[(_crc ^ *p++) & 0xff] ^ (_crc >> 8);
-		return _crc ^ ~0u;
-	}
+	/// CRC-32 (IEEE 802.3). Large buffers are folded with PCLMULQDQ if it is supported by CPU, others are processed by slice-by-8.
+	RX_API uint32 Crc32(uint32 _crc, const void* _buf, uint _size);
 	inline uint32 Crc32(const void* _buf, uint _size) { return Crc32(0, _buf, _size); }
 	inline uint32 Crc32(const char* _str, int _length = -1, uint32 _crc = 0) { return _str ? Crc32(_crc, _str, _length < 0 ? (uint)strlen(_str) : _length) : _crc; }
 	inline uint32 Crc32(const String& _str, uint32 _crc = 0) { return Crc32(_crc, _str, _str.Length()); }
@@ -599,9 +592,16 @@ namespace Rx
 	 // RefCounter 
 	 //----------------------------------------------------------------------------//
 
+	 //! Control block for weak references. Blocks are allocated from slabs and cached per thread, freed blocks are reused.
 	 class RX_API RefCounter : public NonCopyable
 	 {
 	 public:
+		 enum : uint
+		 {
+			 SLAB_SIZE = 4096, //!< Number of blocks allocated at once. Slabs are never freed.
+			 CACHE_BATCH = 256, //!< Number of blocks moved between cache of thread and global free list at once.
+		 };
+
 		 //! Increments the counter of weak references
 		 void AddRef(void);
 		 //! Decrements the counter of weak references and destroy this when he equals zero.
@@ -610,7 +610,7 @@ namespace Rx
 		 //! Get the number of strong references.
 		 int GetNumReferences(void) const { return m_refs; }
 		 //! Get the number of weak references.
-		 int GetNumWeakReferences(void) const { return m_refs; }
+		 int GetNumWeakReferences(void) const { return m_weakRefs; }
 		 //! \return true if no object. 
 		 bool Expired(void) const;
 		 //! Get the object. \warning Returned object can be destroyed at any moment asynchronously. Use Rx::RefCounter::_Lock instead for access to the object.
@@ -618,8 +618,10 @@ namespace Rx
 		 //! Lock the object. Increments the counter of references of object. \warning You must release the returned object (if he is not null).
 		 class RefCounted* _Lock(void);
 
-		 //! Get the number of all instances.
+		 //! Get the number of all instances. Counted only in debug build.
 		 static int GetNumInstances(void);
+		 //! Move cached blocks of current thread to global free list. Called at end of thread.
+		 static void _ReleaseCache(void);
 
 	 private:
 		 friend class RefCounted;
@@ -629,6 +631,11 @@ namespace Rx
 		 //! Destroy.
 		 ~RefCounter(void);
 
+		 //! Allocate block from cache of current thread.
+		 static void* operator new (size_t _size);
+		 //! Return block to cache of current thread.
+		 static void operator delete (void* _ptr);
+
 		 //! The object.
 		 volatile RefCounted* m_object;
 		 //! The counter of strong references.
@@ -644,11 +651,18 @@ namespace Rx
 	 // RefCounted 
 	 //----------------------------------------------------------------------------//
 
+	 enum _LazyRef
+	 {
+		 LazyRef
+	 };
+
 	 class RX_API RefCounted : public NonCopyable
 	 {
 	 public:
 		 //! Contruct.
 		 RefCounted(void);
+		 //! Contruct without RefCounter. The counter of references is stored in the object until first call of GetRef (first weak reference).
+		 RefCounted(_LazyRef);
 		 //! Destroy.
 		 virtual ~RefCounted(void);
 
@@ -657,20 +671,22 @@ namespace Rx
 		 //! Decrements the counter of references and destroy this when he equals zero.
 		 void Release(void);
 
-		 //! Get the counter of references.
-		 RefCounter* GetRef(void) const { return m_refCounter; }
+		 //! Get the counter of references. Allocates it for object constructed with LazyRef.
+		 RefCounter* GetRef(void) const;
 		 //! Get the number of strong references.
-		 int GetNumReferences(void) const { return m_refCounter->m_refs; }
+		 int GetNumReferences(void) const;
 
-		 //! Get the number of all instances.
+		 //! Get the number of all instances. Counted only in debug build.
 		 static int GetNumInstances(void);
 
 	 protected:
 		 //! Delete this. You can override this method for customized algorithm of deletion. 
 		 virtual void _DeleteThis(void) { delete this; }
 
-		 //! The counter of references.
-		 RefCounter* m_refCounter;
+		 typedef AtomicType<sizeof(void*)>::Type RefsType;
+
+		 //! Pointer to RefCounter or (number of references * 2 + 1) if object has no RefCounter.
+		 mutable RefsType m_refs;
 
 		 //! The number of all instances.
 		 static int s_numInstances;
@@ -804,7 +820,7 @@ namespace Rx
  namespace Rx
  {
 	//----------------------------------------------------------------------------//
-	// Config 
+	// ConfigType 
 	//----------------------------------------------------------------------------//
 
 	enum ConfigType : uint8
@@ -817,25 +833,73 @@ namespace Rx
 		CT_Object,
 	};
 
+	//----------------------------------------------------------------------------//
+	// ConfigArena 
+	//----------------------------------------------------------------------------//
+
+	/// Monotonic allocator for Config. Nodes, children, indices and keys of config which was created with arena are placed in blocks of arena and released together.
+	class RX_API ConfigArena : public NonCopyable
+	{
+	public:
+		ConfigArena(uint _blockSize = 64 * 1024) : m_blocks(nullptr), m_blockSize(_blockSize), m_size(0) { }
+		~ConfigArena(void);
+
+		/// Allocate memory aligned by 8 bytes.
+		void* Alloc(uint _size);
+		/// Get interned copy of string. All equal strings share one buffer.
+		const String& Intern(const String& _str);
+		/// Get size of all blocks.
+		uint GetMemoryUse(void) const { return m_size; }
+
+	protected:
+
+		struct Block
+		{
+			Block* next;
+			uint size;
+			uint used;
+		};
+
+		Block* m_blocks;
+		uint m_blockSize;
+		uint m_size;
+		HashSet<String> m_strings;
+	};
+
+	//----------------------------------------------------------------------------//
+	// Config 
+	//----------------------------------------------------------------------------//
+
 	class RX_API Config
 	{
 	public:
 
+		struct Key
+		{
+			String name;
+			String type;
+		};
+
 		struct Node
 		{
-			Node(void) { }
-			Node(const Node& _other) : childs(_other.childs), names(_other.names), indices(_other.indices) { }
-			Node(Node&& _temp) : childs(std::move(_temp.childs)), names(std::move(_temp.names)), indices(std::move(_temp.indices)) { }
-			Node& operator = (const Node& _other) { childs = _other.childs; names = _other.names; indices = _other.indices; return *this; }
-			Node& operator = (Node&& _temp) { childs = std::move(_temp.childs); names = std::move(_temp.names); indices = std::move(_temp.indices); return *this; }
-
-			Array<Config> childs;
-			HashMap<uint, std::pair<String, String>> names; // for simple and associative arrays <index in childs, pair<name,type>>
-			HashMap<String, uint> indices; // for associative arrays  <name, index in childs>
+			ConfigArena* arena; //!< Owner of memory. nullptr for heap.
+			Config* childs;
+			Key* keys;
+			uint* table; //!< Open addressing table of object (index of child + 1). Used only for large objects.
+			uint size;
+			uint capacity;
+			uint tableSize;
+		};
+
+		enum : uint
+		{
+			MIN_TABLE_SIZE = 8, //!< Objects with fewer children are searched linearly.
 		};
 
 		Config(void) : m_type(CT_Null), m_raw(0) { }
-		~Config(void);
+		/// Create null config which allocates children in arena. Config must not outlive the arena.
+		explicit Config(ConfigArena* _arena) : m_type(CT_Null), m_raw(0) { m_arena = _arena; }
+		~Config(void) { _Destroy(); }
 		Config(const Config& _other);
 		Config(Config&& _temp);
 		Config(bool _value) : m_type(CT_Bool), m_num((double)_value) { }
@@ -843,8 +907,8 @@ namespace Rx
 		Config(uint _value) : m_type(CT_Number), m_num((double)_value) { }
 		Config(float _value) : m_type(CT_Number), m_num((double)_value) { }
 		Config(double _value) : m_type(CT_Number), m_num((double)_value) { }
-		Config(const char* _str) : m_type(CT_String), m_str(new String(_str)) { }
-		Config(const String& _str) : m_type(CT_String), m_str(new String(_str)) { }
+		Config(const char* _str) : m_type(CT_String) { new(&m_raw) String(_str); }
+		Config(const String& _str) : m_type(CT_String) { new(&m_raw) String(_str); }
 
 		Config& operator = (const Config& _other);
 		Config& operator = (Config&& _temp);
@@ -882,7 +946,7 @@ namespace Rx
 		///	Get value as number. Returns zero if this is not a number or a boolean.
 		double AsNumber(void) const { return (m_type == CT_Bool || m_type == CT_Number) ? m_num : 0.0; }
 		///	Get value as string. Returns empty string if this is not string.
-		const String& AsString(void) const { return m_type == CT_String ? *m_str : String::Empty; }
+		const String& AsString(void) const { return m_type == CT_String ? _Str() : String::Empty; }
 
 		/// Get existent child with name.
 		Config* Search(const String& _name, uint* _index = nullptr) const;
@@ -897,14 +961,16 @@ namespace Rx
 		///	Get type of child.
 		const String& Type(uint _index) const;
 		///	Get size of an object or an array. Returns zero otherwise.
-		uint Size(void) const { return (m_type >= CT_Array) ? (uint)m_node->childs.size() : 0; }
+		uint Size(void) const { return (m_type >= CT_Array) ? m_node->size : 0; }
+		/// Get arena of this config. Returns nullptr if config uses heap.
+		ConfigArena* Arena(void) const { return m_type >= CT_Array ? m_node->arena : (m_type == CT_Null ? m_arena : nullptr); }
 
 		/// Get or add child. Becomes an object if was not an object or an array before.
 		Config& Add(const String& _name, const String& _type = String::Empty);
 		/// Add new child to an array. Becomes an array if was not before.
 		Config& Append(const String& _name = String::Empty, const String& _type = String::Empty);
 
-		/// Change type to null.
+		/// Change type to null. Arena is kept.
 		Config& SetNull(void);
 		///	Set default value without changing type.
 		Config& Clear(void);
@@ -919,17 +985,158 @@ namespace Rx
 
 	protected:
 
+		String& _Str(void) { return *reinterpret_cast<String*>(&m_raw); }
+		const String& _Str(void) const { return *reinterpret_cast<const String*>(&m_raw); }
+		void _Destroy(void);
+
+		/// Add child with key to end of node. Updates hash table if _isObject is true.
+		static Config& _Push(Node* _node, const String& _name, const String& _type, bool _isObject);
+		static void _Reserve(Node* _node, uint _capacity);
+		static void _Rehash(Node* _node);
+		/// Get index of child with name. Returns -1 if not found.
+		static int _Find(const Node* _node, const String& _name);
+		static Node* _NewNode(ConfigArena* _arena);
+		static void _DeleteNode(Node* _node);
+		static void _CopyNode(Node* _dst, const Node* _src, bool _isObject);
+		static void* _Alloc(ConfigArena* _arena, uint _size);
+		static void _Free(ConfigArena* _arena, void* _ptr);
+
 		union
 		{
 			void* m_ptr;
 			uint64 m_raw;
 			double m_num;
-			String* m_str;
 			Node* m_node;
+			ConfigArena* m_arena; //!< Only for null
 		};
 		ConfigType m_type;
 	};
 
+	//----------------------------------------------------------------------------//
+	// BinaryConfig 
+	//----------------------------------------------------------------------------//
+
+	/// Read-only compiled Config. Used directly from memory (e.g. mapped file) without allocations.
+	///\note Layout: Header, Node[numNodes] (children of each node are contiguous), IndexItem[numIndices] (children of each object sorted by hash of name), strings.
+	class RX_API BinaryConfig
+	{
+	public:
+
+		enum : uint32
+		{
+			MAGIC = 0x42435852, // "RXCB"
+			VERSION = 2,
+		};
+
+		struct Header
+		{
+			uint32 magic;
+			uint32 version;
+			uint32 size; //!< Size of whole data
+			uint32 numNodes;
+			uint32 numIndices;
+			uint32 stringsSize;
+			uint32 sourceSize; //!< Length of source text. Zero if it was compiled from Config.
+			uint32 sourceCrc; //!< Crc32 of source text. Zero if it was compiled from Config.
+		};
+
+		struct Node
+		{
+			uint32 type; //!< Rx::ConfigType
+			uint32 name; //!< Offset of name in strings
+			uint32 typeName; //!< Offset of type in strings
+			uint32 size; //!< Number of children
+			union
+			{
+				double num;
+				uint32 str; //!< Offset of value in strings
+				struct
+				{
+					uint32 first; //!< Index of first child in nodes
+					uint32 index; //!< Index of first item in indices (for objects)
+				} childs;
+			};
+		};
+
+		struct IndexItem
+		{
+			uint32 hash; //!< Hash of name
+			uint32 child; //!< Index of child in parent
+		};
+
+		/// Reference to node of BinaryConfig.
+		class RX_API Value
+		{
+		public:
+			Value(void) : m_config(nullptr), m_node(&s_null) { }
+			Value(const BinaryConfig* _config, const Node* _node) : m_config(_config), m_node(_node) { }
+
+			Value operator [] (const char* _name) const { return Child(_name); }
+			Value operator [] (int _index) const { return Child((uint)_index); }
+
+			operator bool(void) const { return AsBool(); }
+			operator int(void) const { return (int)AsNumber(); }
+			operator uint(void) const { return (uint)AsNumber(); }
+			operator float(void) const { return (float)AsNumber(); }
+			operator double(void) const { return AsNumber(); }
+			operator const char*(void) const { return AsString(); }
+
+			ConfigType Type(void) const { return (ConfigType)m_node->type; }
+			bool IsNull(void) const { return m_node->type == CT_Null; }
+			bool IsBool(void) const { return m_node->type == CT_Bool; }
+			bool IsNumber(void) const { return m_node->type == CT_Number; }
+			bool IsString(void) const { return m_node->type == CT_String; }
+			bool IsArray(void) const { return m_node->type == CT_Array; }
+			bool IsObject(void) const { return m_node->type == CT_Object; }
+			bool IsNode(void) const { return m_node->type >= CT_Array; }
+
+			bool AsBool(void) const { return (m_node->type == CT_Bool || m_node->type == CT_Number) ? m_node->num != 0 : false; }
+			double AsNumber(void) const { return (m_node->type == CT_Bool || m_node->type == CT_Number) ? m_node->num : 0.0; }
+			const char* AsString(void) const { return m_node->type == CT_String ? m_config->_String(m_node->str) : ""; }
+
+			/// Get child with name. For objects is used binary search by hash.
+			Value Child(const char* _name) const;
+			Value Child(uint _index) const;
+			const char* Name(uint _index) const { return _index < Size() ? m_config->_String(m_config->m_nodes[m_node->childs.first + _index].name) : ""; }
+			const char* Type(uint _index) const { return _index < Size() ? m_config->_String(m_config->m_nodes[m_node->childs.first + _index].typeName) : ""; }
+			uint Size(void) const { return m_node->type >= CT_Array ? m_node->size : 0; }
+
+			/// Convert to Config.
+			void Decompile(Config& _dst) const;
+
+		protected:
+			const BinaryConfig* m_config;
+			const Node* m_node;
+
+			static const Node s_null;
+		};
+
+		BinaryConfig(void) : m_header(nullptr), m_nodes(nullptr), m_indices(nullptr), m_strings(nullptr) { }
+
+		/// Use compiled data. Data is not copied and must be valid while this is used. \return false if data is not valid.
+		bool Open(const void* _data, uint _size);
+		void Close(void) { m_header = nullptr; m_nodes = nullptr; m_indices = nullptr; m_strings = nullptr; }
+		bool IsOpened(void) const { return m_header != nullptr; }
+		Value Root(void) const { return m_header ? Value(this, m_nodes) : Value(); }
+		/// Check that opened data was compiled from this text.
+		bool IsCompiledFrom(const String& _src) const { return m_header && m_header->sourceSize == _src.Length() && m_header->sourceCrc == Crc32(_src); }
+
+		/// Compile Config to binary form.
+		static void Compile(const Config& _src, Array<uint8>& _dst);
+		/// Parse text and compile it to binary form.
+		static bool Compile(const String& _src, Array<uint8>& _dst, String* _errorString = nullptr, int* _errorLine = nullptr);
+		/// Decompile to text.
+		String Print(void) const;
+
+	protected:
+		const char* _String(uint32 _offset) const { return m_strings + _offset; }
+
+		const Header* m_header;
+		const Node* m_nodes;
+		const IndexItem* m_indices;
+		const char* m_strings;
+	};
+
 	//----------------------------------------------------------------------------//
 	// 
 	//----------------------------------------------------------------------------//
@@ -1,6 +1,6 @@
 #pragma once
 
-#include "Base.hpp"
+#include "Thread.hpp"
 
 namespace Rx
 {
@@ -25,22 +25,78 @@ namespace Rx
 		String msg;
 	};
 
+	//----------------------------------------------------------------------------//
+	// LogBuffer
+	//----------------------------------------------------------------------------//
+
+	/// Single producer / single consumer queue of messages of one thread.
+	struct LogBuffer
+	{
+		enum : uint
+		{
+			SIZE = 1024, //!< Must be power of two.
+			MASK = SIZE - 1,
+		};
+
+		LogMessage items[SIZE];
+		Atomic<uint> read; //!< Changed only by the writer
+		Atomic<uint> write; //!< Changed only by the owner thread
+		Atomic<uint> lost; //!< Number of messages which were dropped because the buffer was full
+		uint reported; //!< Number of lost messages which were reported by the writer
+		uint threadId; //!< Owner thread
+		Atomic<bool> orphan; //!< Owner thread was finished. Buffer can be reused by another thread after draining.
+		LogBuffer* next;
+	};
+
 	//----------------------------------------------------------------------------//
 	// LogSystem
 	//----------------------------------------------------------------------------//
 
-	class LogSystem final : public NonCopyable
+	///\brief Asynchronous logger.
+	/// Each thread writes messages to own LogBuffer without locks, background thread writes them to console and file.
+	/// Order of messages is kept within one thread only.
+	/// Fatal errors and assertions are written synchronously after flushing of all buffers.
+	class RX_API LogSystem final : public NonCopyable
 	{
 	public:
 		static LogSystem* Get(void) { return &s_instance; }
 
 		void SetWriteInfo(bool _enabled = true) { m_writeInfo = _enabled; }
+		/// Enable or disable background writing. If disabled, each message is written in calling thread.
+		void SetAsync(bool _enabled = true);
+		/// Set file for duplication of messages. Empty path closes file.
+		bool SetFile(const String& _path);
 		void Message(int _level, const char* _func, const char* _file, int _line, const char* _msg);
+		/// Write all pending messages.
+		void Flush(void);
+		/// Write all pending messages and stop background thread. Messages after this are written synchronously.
+		void Shutdown(void);
+		/// Get number of messages which were dropped because of overflow of buffers.
+		uint GetNumLost(void) { return m_lost; }
 
 	private:
 		LogSystem(void);
+		~LogSystem(void);
+
+		LogBuffer* _GetBuffer(void);
+		bool _Push(LogBuffer* _buffer, int _level, const char* _func, const char* _file, int _line, const char* _msg);
+		/// Write messages of all buffers. Must be called under m_writeMutex. \return number of written messages.
+		uint _Drain(void);
+		void _Write(const LogMessage& _msg);
+		void _WriterThread(void);
 
 		bool m_writeInfo;
+		bool m_async;
+		Atomic<bool> m_started;
+		Atomic<bool> m_stop;
+		Atomic<bool> m_shutdown;
+		Atomic<uint> m_lost;
+		Atomic<LogBuffer*> m_buffers;
+		Mutex m_buffersMutex;
+		Mutex m_writeMutex;
+		Condition m_wakeup;
+		Thread m_thread;
+		FILE* m_file;
 		static LogSystem s_instance;
 	};
 
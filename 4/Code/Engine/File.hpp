@@ -64,11 +64,18 @@ namespace Rx
 		SO_End = SEEK_END,
 	};
 
+	enum OpenFileFlags : uint
+	{
+		OF_Buffered = 0x1, //!< Read file through buffered stream instead of mapping it into memory.
+	};
+
 	class FileHandle : public NonCopyable
 	{
 	public:
 		virtual ~FileHandle(void) { }
 		virtual bool IsInMemory(void) { return false; }
+		/// Get whole content of file. Pointer is valid while handle exists. Returns nullptr if file is not in memory.
+		virtual const uint8* Data(void) { return nullptr; }
 		virtual AccessMode Access(void) = 0;
 		virtual uint Size(void) = 0;
 		virtual uint Tell(void) = 0;
@@ -97,6 +104,9 @@ namespace Rx
 		AccessMode GetAccess(void) { return m_handle ? m_handle->Access() : AM_None; }
 		const String& GetName(void) { return m_name; }
 		FileHandle* GetHandle(void) { return m_handle; }
+		bool IsInMemory(void) { return m_handle && m_handle->IsInMemory(); }
+		/// Get whole content of file without copying. Returns nullptr if file is not in memory.
+		const uint8* GetData(void) { return m_handle ? m_handle->Data() : nullptr; }
 		uint GetSize(void);
 		void SetPos(int _pos, SeekOrigin _origin = SO_Set);
 		uint GetPos(void);
@@ -114,6 +124,28 @@ namespace Rx
 		bool m_readOnly;
 	};
 
+	//----------------------------------------------------------------------------//
+	// ConfigFile
+	//----------------------------------------------------------------------------//
+
+	/// Compiled config loaded from file.
+	class ConfigFile : public NonCopyable
+	{
+	public:
+
+		/// Load text config. Compiled copy (path + ".bin") is mapped if it was compiled from same text, otherwise it is rebuilt from text and saved.
+		bool Load(const String& _path);
+		void Close(void);
+
+		const BinaryConfig& Get(void) const { return m_config; }
+		BinaryConfig::Value Root(void) const { return m_config.Root(); }
+
+	protected:
+		File m_file;
+		Array<uint8> m_buffer;
+		BinaryConfig m_config;
+	};
+
 	//----------------------------------------------------------------------------//
 	// VirtualFileSystem
 	//----------------------------------------------------------------------------//
@@ -167,7 +199,7 @@ namespace Rx
 		void AddSearchPath(const String& _path, int _priority = 0);
 
 		bool FileExists(const String& _path);
-		File OpenFile(const String& _path, AccessMode _access = AM_Read);
+		File OpenFile(const String& _path, AccessMode _access = AM_Read, uint _flags = 0);
 
 		bool GetPhysFileInfo(FileInfo& _fi, const String& _path);
 		bool EnumPhysFiles(FileInfoList& _dst, const String& _dir, uint _attribMask = FA_All, const String& _nameMask = String::Empty);
@@ -2,6 +2,14 @@
 
 #include <atomic>
 #include "../Thread.hpp"
+#ifdef _MSC_VER
+#	include <intrin.h>
+#	define TARGET_PCLMUL
+#else
+#	include <immintrin.h>
+#	include <cpuid.h>
+#	define TARGET_PCLMUL __attribute__((target("sse4.1,pclmul")))
+#endif
 
 namespace Rx
 {
@@ -16,6 +24,38 @@ namespace Rx
 	TODO_EX("Config", "   ");
 	TODO_EX("Config", "");
 
+	//----------------------------------------------------------------------------//
+	// Defs
+	//----------------------------------------------------------------------------//
+
+	namespace
+	{
+		enum : uint
+		{
+			CPU_SSE41 = 0x1,
+			CPU_PCLMUL = 0x2,
+		};
+
+		uint _GetCpuFeatures(void)
+		{
+			uint _features = 0;
+			int _info[4] = { 0 };
+#ifdef _MSC_VER
+			__cpuid(_info, 1);
+#else
+			__cpuid(1, _info[0], _info[1], _info[2], _info[3]);
+#endif
+			if (_info[2] & (1 << 19))
+				_features |= CPU_SSE41;
+			if (_info[2] & (1 << 1))
+				_features |= CPU_PCLMUL;
+			return _features;
+		}
+
+		/// Zero until dynamic initialization of this file, so checksums in static initializers of other files use portable code.
+		const uint s_cpuFeatures = _GetCpuFeatures();
+	}
+
 	//----------------------------------------------------------------------------//
 	// Atomic
 	//----------------------------------------------------------------------------//
@@ -906,10 +946,206 @@ namespace Rx
 		0x54de5729, 0x23d967bf, 0xb3667a2e, 0xc4614ab8, 0x5d681b02, 0x2a6f2b94,
 		0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d
 	};
+
+	namespace
+	{
+		/// Tables for slice-by-8. Crc32Tables::t[0] is Crc32Table, t[n] is CRC of byte followed by n zeros.
+		struct Crc32Tables
+		{
+			Crc32Tables(void)
+			{
+				for (uint i = 0; i < 256; ++i)
+				{
+					t[0][i] = Crc32Table[i];
+					for (uint j = 1; j < 8; ++j)
+						t[j][i] = (t[j - 1][i] >> 8) ^ Crc32Table[t[j - 1][i] & 0xff];
+				}
+			}
+
+			uint32 t[8][256];
+		};
+
+		const Crc32Tables& _GetCrc32Tables(void)
+		{
+			static const Crc32Tables _tables;
+			return _tables;
+		}
+
+		uint32 _Crc32Slice8(uint32 _crc, const uint8* _p, size_t _size)
+		{
+			const uint32(*t)[256] = _GetCrc32Tables().t;
+			for (; _size >= 8; _size -= 8, _p += 8)
+			{
+				uint32 _a, _b;
+				memcpy(&_a, _p, 4);
+				memcpy(&_b, _p + 4, 4);
+				_a ^= _crc;
+				_crc =
+					t[7][_a & 0xff] ^ t[6][(_a >> 8) & 0xff] ^ t[5][(_a >> 16) & 0xff] ^ t[4][_a >> 24] ^
+					t[3][_b & 0xff] ^ t[2][(_b >> 8) & 0xff] ^ t[1][(_b >> 16) & 0xff] ^ t[0][_b >> 24];
+			}
+			while (_size--)
+				_crc = t[0][(_crc ^ *_p++) & 0xff] ^ (_crc >> 8);
+			return _crc;
+		}
+
+		/// Folding with carry-less multiplication. See "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction" (Intel, 2009).
+		/// _size must be multiple of 16 and at least 64. _crc is inverted.
+		TARGET_PCLMUL uint32 _Crc32Clmul(uint32 _crc, const uint8* _p, size_t _size)
+		{
+			// constants for the reflected polynomial 0xedb88320
+			alignas(16) static const uint64 _k1k2[] = { 0x0154442bd4ull, 0x01c6e41596ull };
+			alignas(16) static const uint64 _k3k4[] = { 0x01751997d0ull, 0x00ccaa009eull };
+			alignas(16) static const uint64 _k5k0[] = { 0x0163cd6124ull, 0x0000000000ull };
+			alignas(16) static const uint64 _poly[] = { 0x01db710641ull, 0x01f7011641ull };
+
+			__m128i _x0, _x1, _x2, _x3, _x4, _x5, _x6, _x7, _x8;
+
+			_x1 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(_p + 0x00)), _mm_cvtsi32_si128(_crc));
+			_x2 = _mm_loadu_si128((const __m128i*)(_p + 0x10));
+			_x3 = _mm_loadu_si128((const __m128i*)(_p + 0x20));
+			_x4 = _mm_loadu_si128((const __m128i*)(_p + 0x30));
+			_p += 64;
+			_size -= 64;
+
+			// fold 4 x 128 bits in parallel
+			_x0 = _mm_load_si128((const __m128i*)_k1k2);
+			for (; _size >= 64; _size -= 64, _p += 64)
+			{
+				_x5 = _mm_clmulepi64_si128(_x1, _x0, 0x00);
+				_x6 = _mm_clmulepi64_si128(_x2, _x0, 0x00);
+				_x7 = _mm_clmulepi64_si128(_x3, _x0, 0x00);
+				_x8 = _mm_clmulepi64_si128(_x4, _x0, 0x00);
+				_x1 = _mm_clmulepi64_si128(_x1, _x0, 0x11);
+				_x2 = _mm_clmulepi64_si128(_x2, _x0, 0x11);
+				_x3 = _mm_clmulepi64_si128(_x3, _x0, 0x11);
+				_x4 = _mm_clmulepi64_si128(_x4, _x0, 0x11);
+				_x1 = _mm_xor_si128(_mm_xor_si128(_x1, _x5), _mm_loadu_si128((const __m128i*)(_p + 0x00)));
+				_x2 = _mm_xor_si128(_mm_xor_si128(_x2, _x6), _mm_loadu_si128((const __m128i*)(_p + 0x10)));
+				_x3 = _mm_xor_si128(_mm_xor_si128(_x3, _x7), _mm_loadu_si128((const __m128i*)(_p + 0x20)));
+				_x4 = _mm_xor_si128(_mm_xor_si128(_x4, _x8), _mm_loadu_si128((const __m128i*)(_p + 0x30)));
+			}
+
+			// fold into 128 bits
+			_x0 = _mm_load_si128((const __m128i*)_k3k4);
+			_x5 = _mm_clmulepi64_si128(_x1, _x0, 0x00);
+			_x1 = _mm_clmulepi64_si128(_x1, _x0, 0x11);
+			_x1 = _mm_xor_si128(_mm_xor_si128(_x1, _x2), _x5);
+			_x5 = _mm_clmulepi64_si128(_x1, _x0, 0x00);
+			_x1 = _mm_clmulepi64_si128(_x1, _x0, 0x11);
+			_x1 = _mm_xor_si128(_mm_xor_si128(_x1, _x3), _x5);
+			_x5 = _mm_clmulepi64_si128(_x1, _x0, 0x00);
+			_x1 = _mm_clmulepi64_si128(_x1, _x0, 0x11);
+			_x1 = _mm_xor_si128(_mm_xor_si128(_x1, _x4), _x5);
+
+			for (; _size >= 16; _size -= 16, _p += 16)
+			{
+				_x5 = _mm_clmulepi64_si128(_x1, _x0, 0x00);
+				_x1 = _mm_clmulepi64_si128(_x1, _x0, 0x11);
+				_x1 = _mm_xor_si128(_mm_xor_si128(_x1, _mm_loadu_si128((const __m128i*)_p)), _x5);
+			}
+
+			// fold 128 bits to 64 bits
+			_x2 = _mm_clmulepi64_si128(_x1, _x0, 0x10);
+			_x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+			_x1 = _mm_xor_si128(_mm_srli_si128(_x1, 8), _x2);
+			_x0 = _mm_loadl_epi64((const __m128i*)_k5k0);
+			_x2 = _mm_srli_si128(_x1, 4);
+			_x1 = _mm_clmulepi64_si128(_mm_and_si128(_x1, _x3), _x0, 0x00);
+			_x1 = _mm_xor_si128(_x1, _x2);
+
+			// Barrett reduction to 32 bits
+			_x0 = _mm_load_si128((const __m128i*)_poly);
+			_x2 = _mm_clmulepi64_si128(_mm_and_si128(_x1, _x3), _x0, 0x10);
+			_x2 = _mm_clmulepi64_si128(_mm_and_si128(_x2, _x3), _x0, 0x00);
+			_x1 = _mm_xor_si128(_x1, _x2);
+
+			return (uint32)_mm_extract_epi32(_x1, 1);
+		}
+	}
+
+	//----------------------------------------------------------------------------//
+	uint32 Crc32(uint32 _crc, const void* _buf, uint _size)
+	{
+		ASSERT(_buf || !_size);
+		const uint8* p = (const uint8*)_buf;
+		_crc = _crc ^ ~0u;
+		if (_size >= 256 && (s_cpuFeatures & (CPU_PCLMUL | CPU_SSE41)) == (CPU_PCLMUL | CPU_SSE41))
+		{
+			uint _blocks = _size & ~15u;
+			_crc = _Crc32Clmul(_crc, p, _blocks);
+			p += _blocks;
+			_size -= _blocks;
+		}
+		_crc = _Crc32Slice8(_crc, p, _size);
+		return _crc ^ ~0u;
+	}
+	//----------------------------------------------------------------------------//
+
 	//----------------------------------------------------------------------------//
 	// RefCounter
 	//----------------------------------------------------------------------------//
 
+	namespace
+	{
+		/// Free block of RefCounter.
+		struct RefCounterBlock
+		{
+			RefCounterBlock* next;
+			RefCounterBlock* nextBatch; //!< Next list in s_refCounterBatches. Valid for first block of list.
+		};
+
+		int s_refCounterLock = 0;
+		RefCounterBlock* s_refCounterBatches = nullptr; //!< Lists of free blocks returned by threads or allocated in new slab.
+		static THREAD_LOCAL RefCounterBlock* s_refCounterCache = nullptr;
+		static THREAD_LOCAL uint s_refCounterCacheSize = 0;
+
+		void _PushRefCounterBatch(RefCounterBlock* _batch)
+		{
+			AtomicLock(s_refCounterLock);
+			_batch->nextBatch = s_refCounterBatches;
+			s_refCounterBatches = _batch;
+			AtomicUnlock(s_refCounterLock);
+		}
+
+		RefCounterBlock* _PopRefCounterBatch(void)
+		{
+			AtomicLock(s_refCounterLock);
+			RefCounterBlock* _batch = s_refCounterBatches;
+			if (_batch)
+				s_refCounterBatches = _batch->nextBatch;
+			AtomicUnlock(s_refCounterLock);
+
+			if (!_batch)
+			{
+				// new slab. first batch is returned, others are pushed to global list
+				const uint _blockSize = sizeof(RefCounter);
+				uint8* _slab = reinterpret_cast<uint8*>(malloc(RefCounter::SLAB_SIZE * _blockSize));
+				for (uint i = 0; i < RefCounter::SLAB_SIZE; ++i)
+				{
+					RefCounterBlock* _block = reinterpret_cast<RefCounterBlock*>(_slab + i * _blockSize);
+					_block->next = (i + 1) % RefCounter::CACHE_BATCH ? reinterpret_cast<RefCounterBlock*>(_slab + (i + 1) * _blockSize) : nullptr;
+				}
+
+				AtomicLock(s_refCounterLock);
+				for (uint i = RefCounter::CACHE_BATCH; i < RefCounter::SLAB_SIZE; i += RefCounter::CACHE_BATCH)
+				{
+					RefCounterBlock* _block = reinterpret_cast<RefCounterBlock*>(_slab + i * _blockSize);
+					_block->nextBatch = s_refCounterBatches;
+					s_refCounterBatches = _block;
+				}
+				AtomicUnlock(s_refCounterLock);
+
+				_batch = reinterpret_cast<RefCounterBlock*>(_slab);
+			}
+
+			return _batch;
+		}
+	}
+
+	static_assert(sizeof(RefCounter) >= sizeof(RefCounterBlock), "RefCounter is too small for free list");
+	static_assert(RefCounter::SLAB_SIZE % RefCounter::CACHE_BATCH == 0, "Slab must consist of whole batches");
+
 	int RefCounter::s_numInstances = 0;
 
 	//----------------------------------------------------------------------------//
@@ -918,12 +1154,65 @@ namespace Rx
 		m_refs(0),
 		m_weakRefs(1)
 	{
+#ifdef _DEBUG
 		AtomicAdd(s_numInstances, 1);
+#endif
 	}
 	//----------------------------------------------------------------------------//
 	RefCounter::~RefCounter(void)
 	{
+#ifdef _DEBUG
 		AtomicAdd(s_numInstances, -1);
+#endif
+	}
+	//----------------------------------------------------------------------------//
+	void* RefCounter::operator new (size_t _size)
+	{
+		ASSERT(_size == sizeof(RefCounter));
+
+		RefCounterBlock* _block = s_refCounterCache;
+		if (!_block)
+		{
+			// batches returned by _ReleaseCache can be incomplete
+			_block = _PopRefCounterBatch();
+			s_refCounterCacheSize = 0;
+			for (RefCounterBlock* i = _block; i; i = i->next)
+				++s_refCounterCacheSize;
+		}
+
+		s_refCounterCache = _block->next;
+		--s_refCounterCacheSize;
+		return _block;
+	}
+	//----------------------------------------------------------------------------//
+	void RefCounter::operator delete (void* _ptr)
+	{
+		if (!_ptr)
+			return;
+
+		RefCounterBlock* _block = reinterpret_cast<RefCounterBlock*>(_ptr);
+		_block->next = s_refCounterCache;
+		s_refCounterCache = _block;
+
+		if (++s_refCounterCacheSize >= CACHE_BATCH * 2)
+		{
+			// return one batch to global list, keep another for next allocations
+			RefCounterBlock* _last = _block;
+			for (uint i = 1; i < CACHE_BATCH; ++i)
+				_last = _last->next;
+			s_refCounterCache = _last->next;
+			s_refCounterCacheSize -= CACHE_BATCH;
+			_last->next = nullptr;
+			_PushRefCounterBatch(_block);
+		}
+	}
+	//----------------------------------------------------------------------------//
+	void RefCounter::_ReleaseCache(void)
+	{
+		if (s_refCounterCache)
+			_PushRefCounterBatch(s_refCounterCache);
+		s_refCounterCache = nullptr;
+		s_refCounterCacheSize = 0;
 	}
 	//----------------------------------------------------------------------------//
 	void RefCounter::AddRef(void)
@@ -939,19 +1228,23 @@ namespace Rx
 	//----------------------------------------------------------------------------//
 	bool RefCounter::Expired(void) const
 	{
-		return !AtomicGet(m_refs) || !m_object;
+		return AtomicGet(m_refs) <= 0;
 	}
 	//----------------------------------------------------------------------------//
 	RefCounted* RefCounter::_Lock(void)
 	{
 		ASSERT(AtomicGet(m_weakRefs) > 0);
 
-		int _cnt = AtomicAdd(m_refs, 1); // grab object.
-		RefCounted* _object = const_cast<RefCounted*>(m_object);
-		if (_cnt > 0 && _object)
-			return _object;
-		AtomicAdd(m_refs, -1); // no object. restore the counter.
-		return nullptr;
+		// counter never grows from zero, so object is alive if it was incremented from non-zero value
+		int _refs = AtomicGet(m_refs);
+		do
+		{
+			if (_refs <= 0)
+				return nullptr;
+
+		} while (!AtomicCompareExchange(m_refs, _refs, _refs + 1));
+
+		return const_cast<RefCounted*>(m_object);
 	}
 	//----------------------------------------------------------------------------//
 	int RefCounter::GetNumInstances(void)
@@ -969,34 +1262,90 @@ namespace Rx
 	//----------------------------------------------------------------------------//
 	RefCounted::RefCounted(void)
 	{
+#ifdef _DEBUG
 		AtomicAdd(s_numInstances, 1);
-		m_refCounter = new RefCounter(this);
+#endif
+		m_refs = reinterpret_cast<RefsType>(new RefCounter(this));
+	}
+	//----------------------------------------------------------------------------//
+	RefCounted::RefCounted(_LazyRef) :
+		m_refs(1)
+	{
+#ifdef _DEBUG
+		AtomicAdd(s_numInstances, 1);
+#endif
 	}
 	//----------------------------------------------------------------------------//
 	RefCounted::~RefCounted(void)
 	{
-		ASSERT(m_refCounter == nullptr, "object is destroyed incorrectly");
+		ASSERT((m_refs & 1) != 0, "object is destroyed incorrectly");
+#ifdef _DEBUG
 		AtomicAdd(s_numInstances, -1);
+#endif
 	}
 	//----------------------------------------------------------------------------//
 	void RefCounted::AddRef(void)
 	{
-		ASSERT(m_refCounter != nullptr, "object already was destroyed");
-		AtomicAdd(m_refCounter->m_refs, 1);
+		RefsType _refs = AtomicGet(m_refs);
+		while (_refs & 1)
+		{
+			if (AtomicCompareExchange(m_refs, _refs, _refs + 2))
+				return;
+		}
+		AtomicAdd(reinterpret_cast<RefCounter*>(_refs)->m_refs, 1);
 	}
 	//----------------------------------------------------------------------------//
 	void RefCounted::Release(void)
 	{
-		ASSERT(m_refCounter != nullptr, "object already was destroyed");
-		if (AtomicAdd(m_refCounter->m_refs, -1) == 1)
+		RefsType _refs = AtomicGet(m_refs);
+		while (_refs & 1)
+		{
+			ASSERT(_refs > 1, "object already was destroyed");
+			if (AtomicCompareExchange(m_refs, _refs, _refs - 2))
+			{
+				if (_refs == 3)
+					_DeleteThis();
+				return;
+			}
+		}
+
+		RefCounter* _refCounter = reinterpret_cast<RefCounter*>(_refs);
+		if (AtomicAdd(_refCounter->m_refs, -1) == 1)
 		{
-			m_refCounter->m_object = nullptr;
-			m_refCounter->Release();
-			m_refCounter = nullptr;
+			_refCounter->m_object = nullptr;
+			_refCounter->Release();
+			m_refs = 1;
 			_DeleteThis();
 		}
 	}
 	//----------------------------------------------------------------------------//
+	RefCounter* RefCounted::GetRef(void) const
+	{
+		RefsType _refs = AtomicGet(m_refs);
+		RefCounter* _refCounter = nullptr;
+		for (;;)
+		{
+			if (!(_refs & 1))
+			{
+				delete _refCounter; // was created by another thread
+				return reinterpret_cast<RefCounter*>(_refs);
+			}
+
+			// move counter of references from object to RefCounter
+			if (!_refCounter)
+				_refCounter = new RefCounter(const_cast<RefCounted*>(this));
+			_refCounter->m_refs = static_cast<int>(_refs >> 1);
+			if (AtomicCompareExchange(m_refs, _refs, reinterpret_cast<RefsType>(_refCounter)))
+				return _refCounter;
+		}
+	}
+	//----------------------------------------------------------------------------//
+	int RefCounted::GetNumReferences(void) const
+	{
+		RefsType _refs = AtomicGet(m_refs);
+		return (_refs & 1) ? static_cast<int>(_refs >> 1) : AtomicGet(reinterpret_cast<RefCounter*>(_refs)->m_refs);
+	}
+	//----------------------------------------------------------------------------//
 	int RefCounted::GetNumInstances(void)
 	{
 		return AtomicGet(s_numInstances);
@@ -1324,31 +1673,21 @@ namespace Rx
 			return true;
 		}
 
-		bool ParseExpr(String& _name, String& _type, Config& _value, char _end)
-		{
-			if (ParseLhs(_name, _type) == R_Error)
-				return false;
-
-			return ParseRhs(_value, _end);
-		}
-
 		bool ParseBody(Config& _node, char _end)
 		{
-			Config _child;
 			String _name, _type;
 			for (SkipSpace(); *s && *s != _end; SkipSpace())
 			{
-				_child.SetNull();
 				_name.Clear();
 				_type.Clear();
 
-				if (!ParseExpr(_name, _type, _child, _end))
+				if (ParseLhs(_name, _type) == R_Error)
 					return false;
 
-				if (_end == ']')
-					_node.Append(_name, _type) = Move(_child);
-				else
-					_node.Add(_name, _type) = Move(_child);
+				// parse value in place, so child uses memory of node
+				Config& _child = (_end == ']') ? _node.Append(_name, _type) : _node.Add(_name, _type).SetNull();
+				if (!ParseRhs(_child, _end))
+					return false;
 			}
 			return true;
 		}
@@ -1535,29 +1874,83 @@ namespace Rx
 	};
 
 	//----------------------------------------------------------------------------//
-	// Config
+	// ConfigArena
 	//----------------------------------------------------------------------------//
 
-	const Config Config::Null;
-	const String Config::Unnamed = "__unnamed";
+	static const uint ConfigArenaBlockHeader = (sizeof(void*) + sizeof(uint) * 2 + 7) & ~7;
 
 	//----------------------------------------------------------------------------//
-	Config::~Config(void)
+	ConfigArena::~ConfigArena(void)
 	{
-		if (m_type == CT_String)
-			delete m_str;
-		else if (m_type >= CT_Array)
-			delete m_node;
+		m_strings.clear();
+		while (m_blocks)
+		{
+			Block* _next = m_blocks->next;
+			delete[] reinterpret_cast<uint8*>(m_blocks);
+			m_blocks = _next;
+		}
+	}
+	//----------------------------------------------------------------------------//
+	void* ConfigArena::Alloc(uint _size)
+	{
+		_size = (_size + 7) & ~7;
+
+		if (!m_blocks || m_blocks->used + _size > m_blocks->size)
+		{
+			uint _blockSize = _size > m_blockSize / 4 ? _size : m_blockSize;
+			Block* _block = reinterpret_cast<Block*>(new uint8[ConfigArenaBlockHeader + _blockSize]);
+			_block->size = _blockSize;
+			_block->used = 0;
+			m_size += _blockSize;
+
+			if (m_blocks && _blockSize != m_blockSize)
+			{
+				// large allocation does not replace current block
+				_block->next = m_blocks->next;
+				m_blocks->next = _block;
+				_block->used = _size;
+				return reinterpret_cast<uint8*>(_block) + ConfigArenaBlockHeader;
+			}
+
+			_block->next = m_blocks;
+			m_blocks = _block;
+		}
+
+		uint8* _ptr = reinterpret_cast<uint8*>(m_blocks) + ConfigArenaBlockHeader + m_blocks->used;
+		m_blocks->used += _size;
+		return _ptr;
+	}
+	//----------------------------------------------------------------------------//
+	const String& ConfigArena::Intern(const String& _str)
+	{
+		if (_str.IsEmpty())
+			return String::Empty;
+		return *m_strings.insert(_str).first;
 	}
+
+	//----------------------------------------------------------------------------//
+	// Config
+	//----------------------------------------------------------------------------//
+
+	static_assert(sizeof(String) <= sizeof(uint64), "String must fit into Config");
+
+	const Config Config::Null;
+	const String Config::Unnamed = "__unnamed";
+
 	//----------------------------------------------------------------------------//
 	Config::Config(const Config& _other) :
 		m_type(_other.m_type),
 		m_raw(_other.m_raw)
 	{
 		if (m_type == CT_String)
-			m_str = new String(*_other.m_str);
+			new(&m_raw) String(_other._Str());
 		else if (m_type >= CT_Array)
-			m_node = new Node(*_other.m_node);
+		{
+			m_node = _NewNode(nullptr);
+			_CopyNode(m_node, _other.m_node, m_type == CT_Object);
+		}
+		else if (m_type == CT_Null)
+			m_raw = 0;
 	}
 	//----------------------------------------------------------------------------//
 	Config::Config(Config&& _temp) :
@@ -1570,31 +1963,44 @@ namespace Rx
 	//----------------------------------------------------------------------------//
 	Config& Config::operator = (const Config& _other)
 	{
-		if (m_type != _other.m_type)
-		{
-			if (m_type == CT_String)
-				delete m_str;
-			else if (m_type >= CT_Array)
-				delete m_node;
+		if (this == &_other)
+			return *this;
 
-			m_type = _other.m_type;
+		ConfigArena* _arena = Arena();
+		ConfigType _type = _other.m_type;
 
+		// copy before destroying, _other can be a child of this
+		if (_type >= CT_Array)
+		{
+			Node* _node = _NewNode(_arena);
+			_CopyNode(_node, _other.m_node, _type == CT_Object);
+			_Destroy();
+			m_node = _node;
+		}
+		else if (_type == CT_String)
+		{
 			if (m_type == CT_String)
-				m_str = new String(*_other.m_str);
-			else if (m_type >= CT_Array)
-				m_node = new Node(*_other.m_node);
+				_Str() = _other._Str();
 			else
-				m_raw = _other.m_raw;
+			{
+				String _str = _other._Str();
+				_Destroy();
+				new(&m_raw) String(Move(_str));
+			}
+		}
+		else if (_type == CT_Null)
+		{
+			_Destroy();
+			m_arena = _arena;
 		}
 		else
 		{
-			if (m_type == CT_String)
-				*m_str = *_other.m_str;
-			else if (m_type >= CT_Array)
-				*m_node = *_other.m_node;
-			else
-				m_raw = _other.m_raw;
+			uint64 _raw = _other.m_raw;
+			_Destroy();
+			m_raw = _raw;
 		}
+
+		m_type = _type;
 		return *this;
 	}
 	//----------------------------------------------------------------------------//
@@ -1607,29 +2013,18 @@ namespace Rx
 	//----------------------------------------------------------------------------//
 	Config* Config::Search(const String& _name, uint* _index) const
 	{
+		int _idx = -1;
 		if (m_type == CT_Object)
-		{
-			auto _it = m_node->indices.find(_name.IsEmpty() ? Unnamed : _name);
-			if (_it != m_node->indices.end())
-			{
-				if (_index)
-					*_index = _it->second;
-				return &m_node->childs[_it->second];
-			}
-		}
+			_idx = _Find(m_node, _name.IsEmpty() ? Unnamed : _name);
 		else if (m_type == CT_Array && _name.NonEmpty())
-		{
-			for (auto i = m_node->names.begin(), e = m_node->names.end(); i != e; ++i)
-			{
-				if (i->second.first == _name)
-				{
-					if (_index)
-						*_index = i->first;
-					return &m_node->childs[i->first];
-				}
-			}
-		}
-		return nullptr;
+			_idx = _Find(m_node, _name);
+
+		if (_idx < 0)
+			return nullptr;
+
+		if (_index)
+			*_index = (uint)_idx;
+		return m_node->childs + _idx;
 	}
 	//----------------------------------------------------------------------------//
 	const Config& Config::Child(const String& _name) const
@@ -1640,15 +2035,15 @@ namespace Rx
 	//----------------------------------------------------------------------------//
 	const Config& Config::Child(uint _index) const
 	{
-		if (m_type >= CT_Array && _index < (uint)m_node->childs.size())
+		if (m_type >= CT_Array && _index < m_node->size)
 			return m_node->childs[_index];
 		return Null;
 	}
 	//----------------------------------------------------------------------------//
 	const String& Config::Name(uint _index) const
 	{
-		if (m_type >= CT_Array && _index < (uint)m_node->childs.size())
-			return m_node->names[_index].first;
+		if (m_type >= CT_Array && _index < m_node->size)
+			return m_node->keys[_index].name;
 		return String::Empty;
 	}
 	//----------------------------------------------------------------------------//
@@ -1656,84 +2051,63 @@ namespace Rx
 	{
 		uint _index;
 		Config* _child = Search(_name, &_index);
-		return _child ? m_node->names[_index].second : String::Empty;
+		return _child ? m_node->keys[_index].type : String::Empty;
 	}
 	//----------------------------------------------------------------------------//
 	const String& Config::Type(uint _index) const
 	{
-		if (m_type >= CT_Array && _index < (uint)m_node->childs.size())
-			return m_node->names[_index].second;
+		if (m_type >= CT_Array && _index < m_node->size)
+			return m_node->keys[_index].type;
 		return String::Empty;
 	}
 	//----------------------------------------------------------------------------//
 	Config& Config::Add(const String& _name, const String& _type)
 	{
-		uint _index = 0;
-
 		if (m_type == CT_Array)
 		{
 			// search existent object with name
 			if (_name.NonEmpty())
 			{
-				Config* _exists = Search(_name, &_index);
-				if (_exists)
+				int _index = _Find(m_node, _name);
+				if (_index >= 0)
 				{
 					// set new type
-					String& _ctype = m_node->names[_index].second;
+					String& _ctype = m_node->keys[_index].type;
 					if (_ctype.IsEmpty())
-						_ctype = _type;
+						_ctype = m_node->arena ? m_node->arena->Intern(_type) : _type;
 
-					return *_exists;
+					return m_node->childs[_index];
 				}
 			}
 
 			// add new child to an array
-			_index = (uint)m_node->childs.size();
-			if (_name.NonEmpty() || _type.NonEmpty())
-				m_node->names[_index] = std::pair<String, String>(_name, _type);
-			m_node->childs.push_back(Config());
-
-			return m_node->childs.back();
+			return _Push(m_node, _name, _type, false);
 		}
 
 		// convert this to object
 		if (m_type != CT_Object)
 		{
-			if (m_type == CT_String)
-				delete m_str;
-
+			ConfigArena* _arena = Arena();
+			_Destroy();
 			m_type = CT_Object;
-			m_node = new Node;
-
+			m_node = _NewNode(_arena);
 		}
 
 		// search existent child with name
-		Config* _exists = Search(_name.IsEmpty() ? Unnamed : _name, &_index);
-		if (_exists)
+		const String& _key = _name.IsEmpty() ? Unnamed : _name;
+		int _index = _Find(m_node, _key);
+		if (_index >= 0)
 		{
 			// set new type
-			String& _ctype = m_node->names[_index].second;
+			String& _ctype = m_node->keys[_index].type;
 			if (_ctype.IsEmpty())
-				_ctype = _type;
+				_ctype = m_node->arena ? m_node->arena->Intern(_type) : _type;
 
-			return *_exists;
+			return m_node->childs[_index];
 		}
 
 		// add new child at index
-		_index = (uint)m_node->childs.size();
-		if (_name.IsEmpty())
-		{
-			m_node->names[_index] = std::pair<String, String>(Unnamed, _type);
-			m_node->indices[Unnamed] = _index;
-		}
-		else
-		{
-			m_node->names[_index] = std::pair<String, String>(_name, _type);
-			m_node->indices[_name] = _index;
-		}
-		m_node->childs.push_back(Config());
-
-		return m_node->childs.back();
+		return _Push(m_node, _key, _type, true);
 	}
 	//----------------------------------------------------------------------------//
 	Config& Config::Append(const String& _name, const String& _type)
@@ -1741,51 +2115,213 @@ namespace Rx
 		if (m_type != CT_Array)
 		{
 			if (m_type == CT_Object)
-				m_node->indices.clear();
+			{
+				// names of children are kept, but search is linear now
+				_Free(m_node->arena, m_node->table);
+				m_node->table = nullptr;
+				m_node->tableSize = 0;
+			}
 			else
 			{
-				if (m_type == CT_String)
-					delete m_str;
-				m_node = new Node;
+				ConfigArena* _arena = Arena();
+				_Destroy();
+				m_node = _NewNode(_arena);
 			}
 
 			m_type = CT_Array;
 		}
 
-		if (_name.NonEmpty() || _type.NonEmpty())
-			m_node->names[(uint)m_node->childs.size()] = std::pair<String, String>(_name, _type);
-		m_node->childs.push_back(Config());
-
-		return m_node->childs.back();
+		return _Push(m_node, _name, _type, false);
 	}
 	//----------------------------------------------------------------------------//
 	Config& Config::SetNull(void)
 	{
-		if (m_type == CT_String)
-			delete m_str;
-		else if (m_type >= CT_Array)
-			delete m_node;
+		ConfigArena* _arena = Arena();
+		_Destroy();
 		m_type = CT_Null;
 		m_raw = 0;
+		m_arena = _arena;
 		return *this;
 	}
 	//----------------------------------------------------------------------------//
 	Config& Config::Clear(void)
 	{
 		if (m_type == CT_String)
-			m_str->Clear();
+			_Str().Clear();
 		else if (m_type >= CT_Array)
 		{
-			m_node->childs.clear();
-			m_node->names.clear();
-			if (m_type == CT_Object)
-				m_node->indices.clear();
+			for (uint i = 0; i < m_node->size; ++i)
+			{
+				m_node->childs[i].~Config();
+				m_node->keys[i].~Key();
+			}
+			m_node->size = 0;
+			if (m_node->table)
+				memset(m_node->table, 0, m_node->tableSize * sizeof(uint));
 		}
-		else
+		else if (m_type != CT_Null)
 			m_raw = 0;
 		return *this;
 	}
 	//----------------------------------------------------------------------------//
+	void Config::_Destroy(void)
+	{
+		if (m_type == CT_String)
+			_Str().~String();
+		else if (m_type >= CT_Array)
+			_DeleteNode(m_node);
+	}
+	//----------------------------------------------------------------------------//
+	Config& Config::_Push(Node* _node, const String& _name, const String& _type, bool _isObject)
+	{
+		if (_node->size == _node->capacity)
+			_Reserve(_node, _node->capacity ? _node->capacity * 2 : 4);
+
+		uint _index = _node->size++;
+		Key* _key = new(_node->keys + _index) Key;
+		if (_node->arena)
+		{
+			// all equal keys share one buffer of string
+			_key->name = _node->arena->Intern(_name);
+			_key->type = _node->arena->Intern(_type);
+		}
+		else
+		{
+			_key->name = _name;
+			_key->type = _type;
+		}
+
+		if (_isObject)
+		{
+			if (_node->size * 2 > _node->tableSize)
+			{
+				if (_node->size > MIN_TABLE_SIZE)
+					_Rehash(_node);
+			}
+			else
+			{
+				uint _mask = _node->tableSize - 1;
+				uint _pos = _key->name.Hash() & _mask;
+				while (_node->table[_pos])
+					_pos = (_pos + 1) & _mask;
+				_node->table[_pos] = _index + 1;
+			}
+		}
+
+		return *new(_node->childs + _index) Config(_node->arena);
+	}
+	//----------------------------------------------------------------------------//
+	void Config::_Reserve(Node* _node, uint _capacity)
+	{
+		if (_capacity <= _node->capacity)
+			return;
+
+		Config* _childs = reinterpret_cast<Config*>(_Alloc(_node->arena, _capacity * sizeof(Config)));
+		Key* _keys = reinterpret_cast<Key*>(_Alloc(_node->arena, _capacity * sizeof(Key)));
+
+		for (uint i = 0; i < _node->size; ++i)
+		{
+			new(_childs + i) Config(Move(_node->childs[i]));
+			new(_keys + i) Key(Move(_node->keys[i]));
+			_node->childs[i].~Config();
+			_node->keys[i].~Key();
+		}
+
+		_Free(_node->arena, _node->childs);
+		_Free(_node->arena, _node->keys);
+		_node->childs = _childs;
+		_node->keys = _keys;
+		_node->capacity = _capacity;
+	}
+	//----------------------------------------------------------------------------//
+	void Config::_Rehash(Node* _node)
+	{
+		uint _size = MIN_TABLE_SIZE * 2;
+		while (_size < _node->size * 2)
+			_size <<= 1;
+
+		if (_size != _node->tableSize)
+		{
+			_Free(_node->arena, _node->table);
+			_node->table = reinterpret_cast<uint*>(_Alloc(_node->arena, _size * sizeof(uint)));
+			_node->tableSize = _size;
+		}
+		memset(_node->table, 0, _size * sizeof(uint));
+
+		uint _mask = _size - 1;
+		for (uint i = 0; i < _node->size; ++i)
+		{
+			uint _pos = _node->keys[i].name.Hash() & _mask;
+			while (_node->table[_pos])
+				_pos = (_pos + 1) & _mask;
+			_node->table[_pos] = i + 1;
+		}
+	}
+	//----------------------------------------------------------------------------//
+	int Config::_Find(const Node* _node, const String& _name)
+	{
+		if (_node->table)
+		{
+			uint _mask = _node->tableSize - 1;
+			for (uint _pos = _name.Hash() & _mask; _node->table[_pos]; _pos = (_pos + 1) & _mask)
+			{
+				uint _index = _node->table[_pos] - 1;
+				if (_node->keys[_index].name == _name)
+					return (int)_index;
+			}
+		}
+		else
+		{
+			for (uint i = 0; i < _node->size; ++i)
+			{
+				if (_node->keys[i].name == _name)
+					return (int)i;
+			}
+		}
+		return -1;
+	}
+	//----------------------------------------------------------------------------//
+	Config::Node* Config::_NewNode(ConfigArena* _arena)
+	{
+		Node* _node = reinterpret_cast<Node*>(_Alloc(_arena, sizeof(Node)));
+		memset(_node, 0, sizeof(Node));
+		_node->arena = _arena;
+		return _node;
+	}
+	//----------------------------------------------------------------------------//
+	void Config::_DeleteNode(Node* _node)
+	{
+		for (uint i = 0; i < _node->size; ++i)
+		{
+			_node->childs[i].~Config();
+			_node->keys[i].~Key();
+		}
+
+		ConfigArena* _arena = _node->arena;
+		_Free(_arena, _node->childs);
+		_Free(_arena, _node->keys);
+		_Free(_arena, _node->table);
+		_Free(_arena, _node);
+	}
+	//----------------------------------------------------------------------------//
+	void Config::_CopyNode(Node* _dst, const Node* _src, bool _isObject)
+	{
+		_Reserve(_dst, _src->size);
+		for (uint i = 0; i < _src->size; ++i)
+			_Push(_dst, _src->keys[i].name, _src->keys[i].type, _isObject) = _src->childs[i];
+	}
+	//----------------------------------------------------------------------------//
+	void* Config::_Alloc(ConfigArena* _arena, uint _size)
+	{
+		return _arena ? _arena->Alloc(_size) : new uint8[_size];
+	}
+	//----------------------------------------------------------------------------//
+	void Config::_Free(ConfigArena* _arena, void* _ptr)
+	{
+		if (!_arena)
+			delete[] reinterpret_cast<uint8*>(_ptr);
+	}
+	//----------------------------------------------------------------------------//
 	bool Config::Parse(const String& _str, String* _errorString, int* _errorLine)
 	{
 		ConfigParser _parser;
@@ -1800,6 +2336,271 @@ namespace Rx
 	}
 	//----------------------------------------------------------------------------//
 
+	//----------------------------------------------------------------------------//
+	// BinaryConfigCompiler
+	//----------------------------------------------------------------------------//
+
+	struct BinaryConfigCompiler
+	{
+		typedef BinaryConfig::Node Node;
+		typedef BinaryConfig::IndexItem IndexItem;
+
+		Array<Node> nodes;
+		Array<IndexItem> indices;
+		Array<char> strings;
+		HashMap<String, uint32> stringTable;
+
+		uint32 AddString(const String& _str)
+		{
+			if (_str.IsEmpty())
+				return 0;
+
+			auto _it = stringTable.find(_str);
+			if (_it != stringTable.end())
+				return _it->second;
+
+			uint32 _offset = (uint32)strings.size();
+			strings.insert(strings.end(), _str.Ptr(), _str.Ptr() + _str.Length() + 1);
+			stringTable[_str] = _offset;
+			return _offset;
+		}
+
+		void Compile(const Config& _src, Array<uint8>& _dst)
+		{
+			strings.push_back(0); // empty string
+
+			// breadth-first, so children of each node are contiguous
+			Array<const Config*> _queue;
+			_queue.push_back(&_src);
+			nodes.push_back(Node());
+			memset(&nodes.back(), 0, sizeof(Node));
+
+			for (uint i = 0; i < _queue.size(); ++i)
+			{
+				const Config& _cfg = *_queue[i];
+				uint _size = _cfg.Size();
+				Node _node = nodes[i];
+				_node.type = _cfg.Type();
+
+				if (_cfg.IsBool() || _cfg.IsNumber())
+				{
+					_node.num = _cfg.AsNumber();
+				}
+				else if (_cfg.IsString())
+				{
+					_node.str = AddString(_cfg.AsString());
+				}
+				else if (_cfg.IsNode())
+				{
+					_node.size = _size;
+					_node.childs.first = (uint32)nodes.size();
+					_node.childs.index = 0;
+
+					for (uint c = 0; c < _size; ++c)
+					{
+						Node _child;
+						memset(&_child, 0, sizeof(_child));
+						_child.name = AddString(_cfg.Name(c));
+						_child.typeName = AddString(_cfg.Type(c));
+						nodes.push_back(_child);
+						_queue.push_back(&_cfg[c]);
+					}
+
+					if (_cfg.IsObject())
+					{
+						_node.childs.index = (uint32)indices.size();
+						for (uint c = 0; c < _size; ++c)
+							indices.push_back({ String::Hash(_cfg.Name(c)), c });
+						std::sort(indices.begin() + _node.childs.index, indices.end(), [](const IndexItem& _a, const IndexItem& _b)
+						{
+							return _a.hash < _b.hash || (_a.hash == _b.hash && _a.child < _b.child);
+						});
+					}
+				}
+
+				nodes[i] = _node;
+			}
+
+			BinaryConfig::Header _header;
+			_header.magic = BinaryConfig::MAGIC;
+			_header.version = BinaryConfig::VERSION;
+			_header.numNodes = (uint32)nodes.size();
+			_header.numIndices = (uint32)indices.size();
+			_header.stringsSize = (uint32)strings.size();
+			_header.sourceSize = 0;
+			_header.sourceCrc = 0;
+			_header.size = (uint32)(sizeof(_header) + nodes.size() * sizeof(Node) + indices.size() * sizeof(IndexItem) + strings.size());
+
+			_dst.resize(_header.size);
+			uint8* _ptr = &_dst[0];
+			memcpy(_ptr, &_header, sizeof(_header));
+			_ptr += sizeof(_header);
+			memcpy(_ptr, &nodes[0], nodes.size() * sizeof(Node));
+			_ptr += nodes.size() * sizeof(Node);
+			if (indices.size())
+				memcpy(_ptr, &indices[0], indices.size() * sizeof(IndexItem));
+			_ptr += indices.size() * sizeof(IndexItem);
+			memcpy(_ptr, &strings[0], strings.size());
+		}
+	};
+
+	//----------------------------------------------------------------------------//
+	// BinaryConfig
+	//----------------------------------------------------------------------------//
+
+	static_assert(sizeof(BinaryConfig::Header) == 32 && sizeof(BinaryConfig::Node) == 24, "Header and Node must be 8-byte aligned");
+
+	const BinaryConfig::Node BinaryConfig::Value::s_null = {};
+
+	//----------------------------------------------------------------------------//
+	BinaryConfig::Value BinaryConfig::Value::Child(const char* _name) const
+	{
+		if (m_node->type == CT_Object)
+		{
+			if (!_name || !*_name)
+				_name = Config::Unnamed;
+
+			uint32 _hash = String::Hash(_name);
+			const Node* _childs = m_config->m_nodes + m_node->childs.first;
+			const IndexItem* _end = m_config->m_indices + m_node->childs.index + m_node->size;
+			const IndexItem* _it = std::lower_bound(m_config->m_indices + m_node->childs.index, _end, _hash, [](const IndexItem& _item, uint32 _hash)
+			{
+				return _item.hash < _hash;
+			});
+
+			for (; _it != _end && _it->hash == _hash; ++_it)
+			{
+				if (!strcmp(m_config->_String(_childs[_it->child].name), _name))
+					return Value(m_config, _childs + _it->child);
+			}
+		}
+		else if (m_node->type == CT_Array && _name && *_name)
+		{
+			const Node* _childs = m_config->m_nodes + m_node->childs.first;
+			for (uint i = 0; i < m_node->size; ++i)
+			{
+				if (!strcmp(m_config->_String(_childs[i].name), _name))
+					return Value(m_config, _childs + i);
+			}
+		}
+		return Value();
+	}
+	//----------------------------------------------------------------------------//
+	BinaryConfig::Value BinaryConfig::Value::Child(uint _index) const
+	{
+		return _index < Size() ? Value(m_config, m_config->m_nodes + m_node->childs.first + _index) : Value();
+	}
+	//----------------------------------------------------------------------------//
+	void BinaryConfig::Value::Decompile(Config& _dst) const
+	{
+		switch (Type())
+		{
+		case CT_Bool:
+			_dst = AsBool();
+			break;
+
+		case CT_Number:
+			_dst = AsNumber();
+			break;
+
+		case CT_String:
+			_dst = AsString();
+			break;
+
+		case CT_Array:
+		case CT_Object:
+			_dst.SetNull();
+			for (uint i = 0, s = Size(); i < s; ++i)
+				Child(i).Decompile(IsArray() ? _dst.Append(Name(i), Type(i)) : _dst.Add(Name(i), Type(i)));
+			if (!Size()) // empty node
+			{
+				IsArray() ? _dst.Append() : _dst.Add(Config::Unnamed);
+				_dst.Clear();
+			}
+			break;
+
+		default:
+			_dst.SetNull();
+		}
+	}
+	//----------------------------------------------------------------------------//
+	bool BinaryConfig::Open(const void* _data, uint _size)
+	{
+		Close();
+
+		const Header* _header = reinterpret_cast<const Header*>(_data);
+		if (!_data || _size < sizeof(Header) || _header->magic != MAGIC || _header->version != VERSION || _header->size != _size)
+			return false;
+
+		uint64 _expectedSize = sizeof(Header) + (uint64)_header->numNodes * sizeof(Node) + (uint64)_header->numIndices * sizeof(IndexItem) + _header->stringsSize;
+		if (_expectedSize != _size || !_header->numNodes || !_header->stringsSize)
+			return false;
+
+		const Node* _nodes = reinterpret_cast<const Node*>(_header + 1);
+		const IndexItem* _indices = reinterpret_cast<const IndexItem*>(_nodes + _header->numNodes);
+		const char* _strings = reinterpret_cast<const char*>(_indices + _header->numIndices);
+		if (_strings[_header->stringsSize - 1])
+			return false;
+
+		// validate offsets, so access is safe without checks
+		for (uint i = 0; i < _header->numNodes; ++i)
+		{
+			const Node& _node = _nodes[i];
+			if (_node.type > CT_Object || _node.name >= _header->stringsSize || _node.typeName >= _header->stringsSize)
+				return false;
+			if (_node.type == CT_String && _node.str >= _header->stringsSize)
+				return false;
+			if (_node.type >= CT_Array)
+			{
+				if (_node.childs.first <= i || (uint64)_node.childs.first + _node.size > _header->numNodes)
+					return false;
+				if (_node.type == CT_Object)
+				{
+					if ((uint64)_node.childs.index + _node.size > _header->numIndices)
+						return false;
+					for (uint c = 0; c < _node.size; ++c)
+					{
+						if (_indices[_node.childs.index + c].child >= _node.size)
+							return false;
+					}
+				}
+			}
+		}
+
+		m_header = _header;
+		m_nodes = _nodes;
+		m_indices = _indices;
+		m_strings = _strings;
+		return true;
+	}
+	//----------------------------------------------------------------------------//
+	void BinaryConfig::Compile(const Config& _src, Array<uint8>& _dst)
+	{
+		BinaryConfigCompiler _compiler;
+		_compiler.Compile(_src, _dst);
+	}
+	//----------------------------------------------------------------------------//
+	bool BinaryConfig::Compile(const String& _src, Array<uint8>& _dst, String* _errorString, int* _errorLine)
+	{
+		Config _cfg;
+		if (!_cfg.Parse(_src, _errorString, _errorLine))
+			return false;
+		Compile(_cfg, _dst);
+
+		Header* _header = reinterpret_cast<Header*>(&_dst[0]);
+		_header->sourceSize = _src.Length();
+		_header->sourceCrc = Crc32(_src);
+		return true;
+	}
+	//----------------------------------------------------------------------------//
+	String BinaryConfig::Print(void) const
+	{
+		Config _cfg;
+		Root().Decompile(_cfg);
+		return _cfg.Print();
+	}
+	//----------------------------------------------------------------------------//
+
 	//----------------------------------------------------------------------------//
 	//
 	//----------------------------------------------------------------------------//
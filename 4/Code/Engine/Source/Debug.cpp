@@ -10,8 +10,6 @@ namespace Rx
 	// Utils
 	//----------------------------------------------------------------------------//
 
-	TODO_EX("Logger", "  ");
-
 	namespace
 	{
 		//----------------------------------------------------------------------------//
@@ -33,7 +31,27 @@ namespace Rx
 		}
 		//----------------------------------------------------------------------------//
 
-		Mutex g_logMutex;
+		enum : uint
+		{
+			LOG_WRITE_INTERVAL = 10, //!< Max delay of writing in milliseconds
+		};
+
+		/// Buffer of current thread. It becomes orphan at end of any thread, including threads which were not created by Rx::Thread.
+		struct LogBufferHolder
+		{
+			LogBuffer* buffer = nullptr;
+
+			~LogBufferHolder(void)
+			{
+				if (buffer)
+				{
+					buffer->orphan = true;
+					buffer = nullptr;
+				}
+			}
+		};
+
+		static thread_local LogBufferHolder s_logBuffer; // THREAD_LOCAL does not support destructors
 	}
 
 	void LogMsg(int _level, const char* _func, const char* _file, int _line, const char* _msg)
@@ -49,12 +67,65 @@ namespace Rx
 	LogSystem LogSystem::s_instance;
 
 	//----------------------------------------------------------------------------//
-	LogSystem::LogSystem(void)
+	LogSystem::LogSystem(void) :
+		m_writeInfo(false),
+		m_async(true),
+		m_file(nullptr)
+	{
+	}
+	//----------------------------------------------------------------------------//
+	LogSystem::~LogSystem(void)
+	{
+		Shutdown();
+
+		for (LogBuffer *i = m_buffers, *_next; i; i = _next)
+		{
+			_next = i->next;
+			delete i;
+		}
+
+		if (m_file)
+			fclose(m_file);
+	}
+	//----------------------------------------------------------------------------//
+	void LogSystem::SetAsync(bool _enabled)
 	{
+		if (!_enabled)
+			Flush();
+		m_async = _enabled;
+	}
+	//----------------------------------------------------------------------------//
+	bool LogSystem::SetFile(const String& _path)
+	{
+		SCOPE_LOCK(m_writeMutex);
+		_Drain();
+
+		if (m_file)
+			fclose(m_file);
+		m_file = _path.NonEmpty() ? fopen(_path, "w") : nullptr;
+
+		return m_file || _path.IsEmpty();
 	}
 	//----------------------------------------------------------------------------//
 	void LogSystem::Message(int _level, const char* _func, const char* _file, int _line, const char* _msg)
 	{
+		bool _sync = !m_async || m_shutdown || _level <= LL_Fatal;
+#	ifdef _WIN32
+		if (_level < LL_Warning && IsDebuggerPresent())
+			_sync = true; // break on caller
+#	endif
+
+		if (!_sync)
+		{
+			LogBuffer* _buffer = _GetBuffer();
+			if (_Push(_buffer, _level, _func, _file, _line, _msg))
+			{
+				if (!m_started && !m_started.Exchange(true))
+					m_thread = Thread(this, &LogSystem::_WriterThread);
+				return;
+			}
+		}
+
 		LogMessage _lm;
 		time(&_lm.time);
 		_lm.threadId = Thread::GetCurrentId();
@@ -64,10 +135,169 @@ namespace Rx
 		_lm.line = _line;
 		_lm.msg = _msg;
 
-		// ...
-		//TODO: do store message
-		// ...
+		{
+			SCOPE_LOCK(m_writeMutex);
+			_Drain(); // keep order of messages of this thread
+			_Write(_lm);
+			if (m_file)
+				fflush(m_file);
+		}
+
+#	ifdef _WIN32
+		if (IsDebuggerPresent())
+		{
+			if (_lm.level < LL_Warning)
+				DebugBreak();
+		}
+		else if (_lm.level == LL_Fatal || _lm.level == LL_Assert)
+		{
+			String _str = _msg;
+			_str += "\n";
+
+			if (_lm.file.NonEmpty())
+			{
+				_str += "File: " + _lm.file;
+				_str += String::Format("\nLine: %d\n", _lm.line);
+			}
+
+			if (_lm.func.NonEmpty())
+				_str += "Function: " + _lm.func + "\n";
+
+			_str += String::Format("Thread: %d (%s)\n", _lm.threadId, Thread::GetName(_lm.threadId));
+			_str += "\n See log for more details.";
+
+			MessageBoxA(0, _str, _lm.level == LL_Fatal ? "Fatal error" : "Assertion failed", MB_OK | MB_ICONERROR | MB_APPLMODAL | MB_SETFOREGROUND | MB_TOPMOST | MB_DEFAULT_DESKTOP_ONLY);
+		}
+#	endif
+
+		if (_lm.level == LL_Assert)
+		{
+			exit(-1);
+		}
+	}
+	//----------------------------------------------------------------------------//
+	void LogSystem::Flush(void)
+	{
+		SCOPE_LOCK(m_writeMutex);
+		if (_Drain() && m_file)
+			fflush(m_file);
+	}
+	//----------------------------------------------------------------------------//
+	void LogSystem::Shutdown(void)
+	{
+		if (m_shutdown.Exchange(true))
+			return;
+
+		if (m_started)
+		{
+			m_stop = true;
+			m_wakeup.Signal();
+			m_thread.Wait();
+		}
+
+		Flush();
+	}
+	//----------------------------------------------------------------------------//
+	LogBuffer* LogSystem::_GetBuffer(void)
+	{
+		if (s_logBuffer.buffer)
+			return s_logBuffer.buffer;
+
+		SCOPE_LOCK(m_buffersMutex);
+
+		// reuse buffer of finished thread
+		for (LogBuffer* i = m_buffers; i; i = i->next)
+		{
+			if (i->orphan && i->read == i->write)
+			{
+				i->orphan = false;
+				i->threadId = Thread::GetCurrentId();
+				s_logBuffer.buffer = i;
+				return i;
+			}
+		}
+
+		LogBuffer* _buffer = new LogBuffer;
+		_buffer->reported = 0;
+		_buffer->threadId = Thread::GetCurrentId();
+		_buffer->next = m_buffers;
+		m_buffers = _buffer;
+		s_logBuffer.buffer = _buffer;
+		return _buffer;
+	}
+	//----------------------------------------------------------------------------//
+	bool LogSystem::_Push(LogBuffer* _buffer, int _level, const char* _func, const char* _file, int _line, const char* _msg)
+	{
+		uint _write = _buffer->write;
+		uint _used = _write - _buffer->read;
+		if (_used >= LogBuffer::SIZE)
+		{
+			m_wakeup.Signal();
+
+			// warnings and errors are not dropped, wait for the writer
+			if (_level <= LL_Warning)
+			{
+				while (!m_stop && (_used = _write - _buffer->read) >= LogBuffer::SIZE)
+					Thread::Pause(0);
+			}
+
+			if (_used >= LogBuffer::SIZE)
+			{
+				++_buffer->lost;
+				++m_lost;
+				return true;
+			}
+		}
+
+		// strings of item keep their buffers, so there are no allocations for short messages
+		LogMessage& _lm = _buffer->items[_write & LogBuffer::MASK];
+		time(&_lm.time);
+		_lm.threadId = Thread::GetCurrentId();
+		_lm.level = _level;
+		_lm.func.Clear().Append(_func);
+		_lm.file.Clear().Append(_file);
+		_lm.line = _line;
+		_lm.msg.Clear().Append(_msg);
+
+		_buffer->write = _write + 1;
+
+		if (_used == LogBuffer::SIZE / 2)
+			m_wakeup.Signal();
+
+		return true;
+	}
+	//----------------------------------------------------------------------------//
+	uint LogSystem::_Drain(void)
+	{
+		uint _count = 0;
+		for (LogBuffer* i = m_buffers; i; i = i->next)
+		{
+			uint _write = i->write;
+			for (uint _read = i->read; _read != _write; ++_count)
+			{
+				_Write(i->items[_read & LogBuffer::MASK]);
+				i->read = ++_read;
+			}
 
+			uint _lost = i->lost;
+			if (_lost != i->reported)
+			{
+				LogMessage _lm;
+				time(&_lm.time);
+				_lm.threadId = i->threadId;
+				_lm.level = LL_Warning;
+				_lm.line = 0;
+				_lm.msg = String::Format("%u messages were lost because of overflow of log buffer", _lost - i->reported);
+				i->reported = _lost;
+				_Write(_lm);
+				++_count;
+			}
+		}
+		return _count;
+	}
+	//----------------------------------------------------------------------------//
+	void LogSystem::_Write(const LogMessage& _lm)
+	{
 		//[time] thread> file(line): func:
 		//    level: msg
 
@@ -99,7 +329,7 @@ namespace Rx
 
 		_info += "\n\t";
 
-		switch (_level)
+		switch (_lm.level)
 		{
 		case LL_Assert:
 			_str += "Assertion failed: ";
@@ -124,16 +354,15 @@ namespace Rx
 			break;
 		}
 
-		_str += _msg;
+		_str += _lm.msg;
 		_str += "\n";
 
 		// print message
 		{
 			struct tm _tm = *localtime(&_lm.time);
 			uint8 _cc = 0;
-			SCOPE_LOCK(g_logMutex);
 
-			switch (_level)
+			switch (_lm.level)
 			{
 			case LL_Error:
 			case LL_Fatal:
@@ -157,39 +386,33 @@ namespace Rx
 
 			if (_cc)
 				_SetCColors(_cc);
+
+			if (m_file)
+				fprintf(m_file, "[%02d:%02d:%02d] %s%s", _tm.tm_hour, _tm.tm_min, _tm.tm_sec, *_info, *_str);
 		}
 
 #	ifdef _WIN32
 		if (IsDebuggerPresent())
-		{
 			OutputDebugStringA(_info + _str);
-			if (_lm.level < LL_Warning)
-				DebugBreak();
-		}
-		else if (_lm.level == LL_Fatal || _lm.level == LL_Assert)
-		{
-			_str = _msg;
-			_str += "\n";
+#	endif
+	}
+	//----------------------------------------------------------------------------//
+	void LogSystem::_WriterThread(void)
+	{
+		Thread::SetName(Thread::GetCurrentId(), "Log");
 
-			if (_lm.file.NonEmpty())
+		while (!m_stop)
+		{
+			uint _count;
 			{
-				_str += "File: " + _lm.file;
-				_str += String::Format("\nLine: %d\n", _lm.line);
+				SCOPE_LOCK(m_writeMutex);
+				_count = _Drain();
+				if (_count && m_file)
+					fflush(m_file);
 			}
 
-			if (_lm.func.NonEmpty())
-				_str += "Function: " + _lm.func + "\n";
-
-			_str += String::Format("Thread: %d (%s)\n", _lm.threadId, Thread::GetName(_lm.threadId));
-			_str += "\n See log for more details.";
-
-			MessageBoxA(0, _str, _lm.level == LL_Fatal ? "Fatal error" : "Assertion failed", MB_OK | MB_ICONERROR | MB_APPLMODAL | MB_SETFOREGROUND | MB_TOPMOST | MB_DEFAULT_DESKTOP_ONLY);
-		}
-#	endif
-
-		if (_lm.level == LL_Assert)
-		{
-			exit(-1);
+			if (!_count)
+				m_wakeup.Wait(LOG_WRITE_INTERVAL);
 		}
 	}
 	//----------------------------------------------------------------------------//
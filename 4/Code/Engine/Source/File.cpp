@@ -1,6 +1,7 @@
 #include "../File.hpp"
 #include <io.h>
 #include <sys/stat.h>
+#include <zlib.h>
 #ifdef _MSC_VER
 #	include <direct.h>
 #else
@@ -8,6 +9,10 @@
 #endif
 #ifdef _WIN32
 #	include <Windows.h>
+#else
+#	include <sys/mman.h>
+#	include <fcntl.h>
+#	include <unistd.h>
 #endif
 
 namespace Rx
@@ -345,6 +350,83 @@ namespace Rx
 	}
 	//----------------------------------------------------------------------------//
 
+	//----------------------------------------------------------------------------//
+	// ConfigFile
+	//----------------------------------------------------------------------------//
+
+	//----------------------------------------------------------------------------//
+	bool ConfigFile::Load(const String& _path)
+	{
+		Close();
+
+		String _textPath = FullPath(_path, gFileSystem->RootDir());
+		String _binPath = _textPath + ".bin";
+
+		struct stat _textSt, _binSt;
+		bool _hasText = !stat(_textPath, &_textSt) && (_textSt.st_mode & S_IFREG);
+		bool _hasBin = !stat(_binPath, &_binSt) && (_binSt.st_mode & S_IFREG);
+
+		// text is read anyway to check that compiled copy is actual. modification time has resolution of one second and can be changed by copying
+		String _text;
+		if (_hasText)
+		{
+			File _file = gFileSystem->OpenFile(_textPath);
+			_hasText = _file;
+			if (_hasText)
+				_text = _file.ReadString();
+		}
+
+		// compiled
+		if (_hasBin)
+		{
+			m_file = gFileSystem->OpenFile(_binPath);
+			if (m_file.IsInMemory())
+			{
+				m_config.Open(m_file.GetData(), m_file.GetSize());
+			}
+			else if (m_file)
+			{
+				m_buffer.resize(m_file.GetSize());
+				if (m_buffer.size() && m_config.Open(&m_buffer[0], m_file.Read(&m_buffer[0], (uint)m_buffer.size())))
+					m_file = File();
+			}
+
+			if (!m_config.IsOpened())
+				LOG_WARNING("Compiled config '%s' is invalid", *_binPath);
+			else if (!_hasText || m_config.IsCompiledFrom(_text))
+				return true;
+			Close();
+		}
+
+		// text
+		if (!_hasText)
+			return false;
+
+		String _errorString;
+		int _errorLine = 0;
+		if (!BinaryConfig::Compile(_text, m_buffer, &_errorString, &_errorLine))
+		{
+			LOG_ERROR("Couldn't parse config:\n> %s(%d) : %s", *_textPath, _errorLine, *_errorString);
+			return false;
+		}
+
+		File _bin = gFileSystem->OpenFile(_binPath, AM_Write);
+		if (!_bin || _bin.Write(&m_buffer[0], (uint)m_buffer.size()) != m_buffer.size())
+		{
+			LOG_WARNING("Couldn't save compiled config '%s'", *_binPath);
+		}
+
+		return m_config.Open(&m_buffer[0], (uint)m_buffer.size());
+	}
+	//----------------------------------------------------------------------------//
+	void ConfigFile::Close(void)
+	{
+		m_config.Close();
+		m_file = File();
+		m_buffer.clear();
+	}
+	//----------------------------------------------------------------------------//
+
 	//----------------------------------------------------------------------------//
 	// PhysFile
 	//----------------------------------------------------------------------------//
@@ -421,6 +503,164 @@ namespace Rx
 		AccessMode m_access;
 	};
 
+	//----------------------------------------------------------------------------//
+	// MemoryFile
+	//----------------------------------------------------------------------------//
+
+	/// Read-only view of memory. Memory isn't owned by this.
+	class MemoryFile : public FileHandle
+	{
+	public:
+
+		MemoryFile(const void* _data, uint _size) :
+			m_data(reinterpret_cast<const uint8*>(_data)),
+			m_size(_size),
+			m_pos(0)
+		{
+		}
+
+		bool IsInMemory(void) override
+		{
+			return true;
+		}
+		const uint8* Data(void) override
+		{
+			return m_data;
+		}
+		AccessMode Access(void) override
+		{
+			return AM_Read;
+		}
+		uint Size(void) override
+		{
+			return m_size;
+		}
+		uint Tell(void)	override
+		{
+			return m_pos;
+		}
+		void Seek(int _pos, int _origin = SO_Set) override
+		{
+			int64 _npos = _pos;
+			if (_origin == SO_Current)
+				_npos += m_pos;
+			else if (_origin == SO_End)
+				_npos += m_size;
+			m_pos = _npos < 0 ? 0 : (_npos > m_size ? m_size : (uint)_npos);
+		}
+		bool Eof(void) override
+		{
+			return m_pos >= m_size;
+		}
+		uint Read(void* _dst, uint _size) override
+		{
+			ASSERT(_dst || !_size);
+			if (_size > m_size - m_pos)
+				_size = m_size - m_pos;
+			memcpy(_dst, m_data + m_pos, _size);
+			m_pos += _size;
+			return _size;
+		}
+		uint Write(const void* _src, uint _size) override
+		{
+			return 0;
+		}
+		void Flush(void) override
+		{
+		}
+
+	protected:
+		const uint8* m_data;
+		uint m_size;
+		uint m_pos;
+	};
+
+	//----------------------------------------------------------------------------//
+	// MappedFile
+	//----------------------------------------------------------------------------//
+
+	/// Read-only file mapped into memory. Content is shared with the page cache and isn't copied until Read.
+	class MappedFile : public MemoryFile
+	{
+	public:
+
+		///\return nullptr if file is not regular, empty or couldn't be mapped.
+		static MappedFile* Open(const char* _path)
+		{
+#ifdef _WIN32
+			HANDLE _file = CreateFileA(_path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (_file == INVALID_HANDLE_VALUE)
+				return nullptr;
+
+			LARGE_INTEGER _size;
+			if (GetFileType(_file) != FILE_TYPE_DISK || !GetFileSizeEx(_file, &_size) || _size.QuadPart <= 0 || _size.QuadPart > 0x7fffffff)
+			{
+				CloseHandle(_file);
+				return nullptr;
+			}
+
+			HANDLE _mapping = CreateFileMappingA(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			CloseHandle(_file); // mapping holds the file
+			if (!_mapping)
+				return nullptr;
+
+			void* _data = MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+			CloseHandle(_mapping); // view holds the mapping
+			if (!_data)
+				return nullptr;
+
+			return new MappedFile(_data, (uint)_size.QuadPart);
+#else
+			int _fd = open(_path, O_RDONLY);
+			if (_fd < 0)
+				return nullptr;
+
+			struct stat _st;
+			if (fstat(_fd, &_st) || !S_ISREG(_st.st_mode) || _st.st_size <= 0 || _st.st_size > 0x7fffffff)
+			{
+				close(_fd);
+				return nullptr;
+			}
+
+			void* _data = mmap(nullptr, (size_t)_st.st_size, PROT_READ, MAP_PRIVATE, _fd, 0);
+			close(_fd); // mapping holds the file
+			if (_data == MAP_FAILED)
+				return nullptr;
+
+			return new MappedFile(_data, (uint)_st.st_size);
+#endif
+		}
+
+		~MappedFile(void)
+		{
+#ifdef _WIN32
+			UnmapViewOfFile(m_data);
+#else
+			munmap(const_cast<uint8*>(m_data), m_size);
+#endif
+		}
+
+	protected:
+
+		MappedFile(void* _data, uint _size) : MemoryFile(_data, _size)
+		{
+		}
+	};
+
+	/// Open file for reading. Regular files are mapped into memory unless Rx::OF_Buffered is set.
+	FileHandle* OpenFileForRead(const char* _path, uint _flags)
+	{
+		if (!(_flags & OF_Buffered))
+		{
+			FileHandle* _mf = MappedFile::Open(_path);
+			if (_mf)
+				return _mf;
+		}
+
+		FILE* _f = fopen(_path, "rb");
+		return _f ? new PhysFile(_f, AM_Read) : nullptr;
+	}
+
 	//----------------------------------------------------------------------------//
 	// PhysFileSystem
 	//----------------------------------------------------------------------------//
@@ -474,8 +714,7 @@ namespace Rx
 			if (_name.IsEmpty())
 				return nullptr;
 
-			FILE* _f = fopen(m_path + _name, "rb");
-			return _f ? new PhysFile(_f, AM_Read) : nullptr;
+			return OpenFileForRead(m_path + _name, _flags);
 		}
 
 	protected:
@@ -485,12 +724,322 @@ namespace Rx
 	// ZipFileSystem
 	//----------------------------------------------------------------------------//
 
+	/// Content of archive. Shared between ZipFileSystem and opened files, so files remain valid after closing of archive.
+	class ZipArchive : public RefCounted
+	{
+	public:
+
+		ZipArchive(FileHandle* _file) :
+			m_file(_file),
+			m_data(nullptr),
+			m_size(_file->Size())
+		{
+			if (_file->IsInMemory())
+			{
+				m_data = _file->Data();
+			}
+			else if (m_size) // couldn't be mapped, read whole archive
+			{
+				m_buffer.resize(m_size);
+				m_size = _file->Read(&m_buffer[0], m_size);
+				m_data = &m_buffer[0];
+			}
+		}
+		~ZipArchive(void)
+		{
+			delete m_file;
+		}
+
+		const uint8* Data(void) { return m_data; }
+		uint Size(void) { return m_size; }
+
+	protected:
+		FileHandle* m_file;
+		Array<uint8> m_buffer;
+		const uint8* m_data;
+		uint m_size;
+	};
+
+	/// Stored entry of archive. Data isn't copied.
+	class ZipStoredFile : public MemoryFile
+	{
+	public:
+
+		ZipStoredFile(ZipArchive* _archive, const uint8* _data, uint _size) : MemoryFile(_data, _size), m_archive(_archive)
+		{
+		}
+
+	protected:
+		SharedPtr<ZipArchive> m_archive;
+	};
+
+	/// Deflated entry of archive. Data is inflated directly into destination buffer of Read.
+	class ZipDeflatedFile : public FileHandle
+	{
+	public:
+
+		ZipDeflatedFile(ZipArchive* _archive, const uint8* _src, uint _srcSize, uint _size) :
+			m_archive(_archive),
+			m_src(_src),
+			m_srcSize(_srcSize),
+			m_size(_size),
+			m_pos(0)
+		{
+			memset(&m_stream, 0, sizeof(m_stream));
+			int _r = inflateInit2(&m_stream, -MAX_WBITS); // raw deflate without zlib header
+			ASSERT(_r == Z_OK);
+			_Reset();
+		}
+		~ZipDeflatedFile(void)
+		{
+			inflateEnd(&m_stream);
+		}
+
+		AccessMode Access(void) override
+		{
+			return AM_Read;
+		}
+		uint Size(void) override
+		{
+			return m_size;
+		}
+		uint Tell(void)	override
+		{
+			return m_pos;
+		}
+		void Seek(int _pos, int _origin = SO_Set) override
+		{
+			int64 _npos = _pos;
+			if (_origin == SO_Current)
+				_npos += m_pos;
+			else if (_origin == SO_End)
+				_npos += m_size;
+			uint _target = _npos < 0 ? 0 : (_npos > m_size ? m_size : (uint)_npos);
+
+			if (_target < m_pos)
+				_Reset();
+
+			uint8 _buf[4096];
+			while (m_pos < _target)
+			{
+				uint _size = _target - m_pos;
+				if (!Read(_buf, _size < sizeof(_buf) ? _size : sizeof(_buf)))
+					break;
+			}
+		}
+		bool Eof(void) override
+		{
+			return m_pos >= m_size;
+		}
+		uint Read(void* _dst, uint _size) override
+		{
+			ASSERT(_dst || !_size);
+			if (_size > m_size - m_pos)
+				_size = m_size - m_pos;
+
+			m_stream.next_out = reinterpret_cast<Bytef*>(_dst);
+			m_stream.avail_out = _size;
+			while (m_stream.avail_out)
+			{
+				if (inflate(&m_stream, Z_SYNC_FLUSH) != Z_OK)
+					break; // end of stream or corrupted data
+			}
+
+			uint _readed = _size - m_stream.avail_out;
+			m_pos += _readed;
+			return _readed;
+		}
+		uint Write(const void* _src, uint _size) override
+		{
+			return 0;
+		}
+		void Flush(void) override
+		{
+		}
+
+	protected:
+
+		void _Reset(void)
+		{
+			inflateReset(&m_stream);
+			m_stream.next_in = const_cast<Bytef*>(m_src);
+			m_stream.avail_in = m_srcSize;
+			m_pos = 0;
+		}
+
+		SharedPtr<ZipArchive> m_archive;
+		z_stream m_stream;
+		const uint8* m_src;
+		uint m_srcSize;
+		uint m_size;
+		uint m_pos;
+	};
+
+	/// Read-only zip archive. Central directory is read once into hash index. Opened files are independent and can be used from different threads.
+	///\note Zip64, encryption and compression methods other than store and deflate are not supported.
 	class ZipFileSystem : public VirtualFileSystem
 	{
 	public:
 		//CLASSNAME(ZipFileSystem);
 
-		// ...
+		ZipFileSystem(void)
+		{
+		}
+		~ZipFileSystem(void)
+		{
+		}
+
+		bool Open(const String& _path) override
+		{
+			String _fpath = FullPath(_path, gFileSystem->RootDir());
+			if (m_path.Equals(_fpath, true))
+				return m_opened; // no changes
+
+			Close();
+
+			m_path = _fpath;
+
+			FileHandle* _file = OpenFileForRead(_fpath, 0);
+			if (!_file)
+			{
+				LOG_ERROR("Couldn't open ZipFileSystem '%s' : No file", *m_path);
+				return false;
+			}
+
+			m_archive = new ZipArchive(_file);
+			if (!_ReadCentralDirectory())
+			{
+				LOG_ERROR("Couldn't open ZipFileSystem '%s' : Invalid or unsupported archive", *m_path);
+				Close();
+				return false;
+			}
+
+			m_opened = true;
+			return true;
+		}
+		void Close(void) override
+		{
+			m_entries.clear();
+			m_archive = nullptr;
+			m_opened = false;
+		}
+
+		bool FileExists(const String& _name) override
+		{
+			return m_entries.find(_Key(_name)) != m_entries.end();
+		}
+		FileHandle* OpenFile(const String& _name, uint _flags) override
+		{
+			auto _it = m_entries.find(_Key(_name));
+			if (_it == m_entries.end())
+				return nullptr;
+
+			const Entry& _e = _it->second;
+			const uint8* _data = m_archive->Data();
+			const uint8* _header = _data + _e.offset;
+			if ((uint64)_e.offset + 30 > m_archive->Size() || _Read32(_header) != 0x04034b50)
+			{
+				LOG_ERROR("Couldn't open file '%s' in ZipFileSystem '%s' : Invalid local header", *_name, *m_path);
+				return nullptr;
+			}
+
+			uint64 _start = (uint64)_e.offset + 30 + _Read16(_header + 26) + _Read16(_header + 28);
+			if (_start + _e.packedSize > m_archive->Size())
+			{
+				LOG_ERROR("Couldn't open file '%s' in ZipFileSystem '%s' : Unexpected end of archive", *_name, *m_path);
+				return nullptr;
+			}
+
+			if (_e.method == 0)
+				return new ZipStoredFile(m_archive, _data + _start, _e.size);
+			return new ZipDeflatedFile(m_archive, _data + _start, _e.packedSize, _e.size);
+		}
+
+	protected:
+
+		struct Entry
+		{
+			uint offset; // of local header
+			uint packedSize;
+			uint size;
+			uint method;
+		};
+
+		static uint _Read16(const uint8* _src) { return _src[0] | (_src[1] << 8); }
+		static uint _Read32(const uint8* _src) { return _src[0] | (_src[1] << 8) | (_src[2] << 16) | ((uint)_src[3] << 24); }
+		static String _Key(const String& _name) { return FS_IGNORE_CASE ? _name.ToLower() : _name; }
+
+		bool _ReadCentralDirectory(void)
+		{
+			const uint8* _data = m_archive->Data();
+			uint _size = m_archive->Size();
+			if (_size < 22)
+				return false;
+
+			// end of central directory record, it can be followed by comment up to 64k
+			const uint8* _eocd = nullptr;
+			uint _min = _size > 22 + 0xffff ? _size - 22 - 0xffff : 0;
+			for (uint i = _size - 22 + 1; i-- > _min;)
+			{
+				if (_Read32(_data + i) == 0x06054b50)
+				{
+					_eocd = _data + i;
+					break;
+				}
+			}
+			if (!_eocd)
+				return false;
+
+			uint _numEntries = _Read16(_eocd + 10);
+			uint _dirSize = _Read32(_eocd + 12);
+			uint _dirOffset = _Read32(_eocd + 16);
+			if (_numEntries == 0xffff || _dirOffset == 0xffffffff || (uint64)_dirOffset + _dirSize > _size)
+				return false; // zip64
+
+			m_entries.reserve(_numEntries);
+
+			const uint8* p = _data + _dirOffset;
+			const uint8* _end = p + _dirSize;
+			for (uint i = 0; i < _numEntries; ++i)
+			{
+				if (_end - p < 46 || _Read32(p) != 0x02014b50)
+					return false;
+
+				uint _recordSize = 46 + _Read16(p + 28) + _Read16(p + 30) + _Read16(p + 32);
+				if ((uint)(_end - p) < _recordSize)
+					return false;
+
+				uint _flags = _Read16(p + 8);
+				const char* _name = reinterpret_cast<const char*>(p + 46);
+				uint _nameLength = _Read16(p + 28);
+				Entry _e;
+				_e.method = _Read16(p + 10);
+				_e.packedSize = _Read32(p + 20);
+				_e.size = _Read32(p + 24);
+				_e.offset = _Read32(p + 42);
+
+				p += _recordSize;
+
+				if (!_nameLength || strchr("/\\", _name[_nameLength - 1]))
+					continue; // directory
+				if (_flags & 0x1)
+					continue; // encrypted
+				if (_e.method != 0 && _e.method != 8)
+					continue; // unsupported compression
+				if ((uint64)_e.offset + 30 + _e.packedSize > _dirOffset || (_e.method == 0 && _e.packedSize != _e.size))
+				{
+					LOG_WARNING("Invalid entry '%s' in ZipFileSystem '%s'", *String(_name, _nameLength), *m_path);
+					continue; // local header and data must be before central directory
+				}
+
+				m_entries[_Key(FullPath(String(_name, _nameLength)))] = _e;
+			}
+
+			return true;
+		}
+
+		SharedPtr<ZipArchive> m_archive;
+		HashMap<String, Entry> m_entries;
 	};
 
 	//----------------------------------------------------------------------------//
@@ -738,7 +1287,7 @@ namespace Rx
 		return false;
 	}
 	//----------------------------------------------------------------------------//
-	File FileSystem::OpenFile(const String& _path, AccessMode _access)
+	File FileSystem::OpenFile(const String& _path, AccessMode _access, uint _flags)
 	{
 		if (_path.IsEmpty() || _access == AM_None)
 			return File(_path, nullptr);
@@ -747,33 +1296,35 @@ namespace Rx
 
 		if (IsFullPath(_npath))
 		{
-			FILE* _f;
+			FileHandle* _fh = nullptr;
 			if (_access & AM_Write)
 			{
 				TODO("create directory");
 
-				_f = fopen(_path, (_access & AM_Read) ? "w+b" : "wb");
-				if (!_f)
+				FILE* _f = fopen(_path, (_access & AM_Read) ? "w+b" : "wb");
+				if (_f)
+					_fh = new PhysFile(_f, _access);
+				else
 				{
 					LOG_ERROR("Couldn't create file '%s'", *_path);
 				}
 			}
 			else
 			{
-				_f = fopen(_path, "rb");
-				if (!_f)
+				_fh = OpenFileForRead(_path, _flags);
+				if (!_fh)
 				{
 					LOG_ERROR("Couldn't open file '%s': File not was found", *_path);
 				}
 			}
 
-			return File(_path, _f ? new PhysFile(_f, _access) : nullptr);
+			return File(_path, _fh);
 		}
 
 		FileHandle* _fh = nullptr;
 		for (auto& _vfs : m_vfss)
 		{
-			_fh = _vfs.fs->OpenFile(_npath);
+			_fh = _vfs.fs->OpenFile(_npath, _flags);
 			if (_fh)
 				break;
 		}
@@ -827,7 +1378,7 @@ namespace Rx
 				continue;
 			if (_isHidden && !_enumHidden)
 				continue;
-			if (strcmp(_fd.name, ".") && strcmp(_fd.name, ".."))
+			if (!strcmp(_fd.name, ".") || !strcmp(_fd.name, ".."))
 				continue;
 			if (_nameMask.NonEmpty() && !_nameMask.Match(_fd.name))
 				continue;
@@ -838,6 +1389,7 @@ namespace Rx
 			_fi.time = _fd.time_write;
 			_fi.path = _fpath + _fi.name;
 			_fi.size = (uint)_fd.size;
+			_dst.push_back(_fi);
 		}
 
 		_findclose(_fh);
@@ -868,19 +1420,17 @@ namespace Rx
 
 		if (_st.st_mode & _S_IFDIR)
 		{
-			/*if (!_vfs.fs || !_vfs.fs->IsClass<PhysFileSystem>())
+			if (!_vfs.fs || !_vfs.fs.DynamicCast<PhysFileSystem>())
 			{
 				_vfs.fs = new PhysFileSystem();
-			} */
+			}
 		}
 		else
 		{
-			if (!_vfs.fs)
+			if (!_vfs.fs || !_vfs.fs.DynamicCast<ZipFileSystem>())
 			{
-				_vfs.fs = new PhysFileSystem();
+				_vfs.fs = new ZipFileSystem();
 			}
-			//TODO: classify type of archive
-			ASSERT(false, "ToDo");
 		}
 
 		_vfs.fs->Open(_fpath);
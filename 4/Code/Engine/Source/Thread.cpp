@@ -1,4 +1,5 @@
 #include "../Thread.hpp"
+#include "../Debug.hpp"
 #include <SDL.h>
 #include <atomic>
 #ifdef _WIN32
@@ -296,6 +297,7 @@ namespace Rx
 		}
 		delete _entry;
 		LOG_MSG(LL_Event, "End thread %d", GetCurrentId());
+		RefCounter::_ReleaseCache();
 		return 0;
 	}
 	//----------------------------------------------------------------------------//
@@ -225,7 +225,7 @@ namespace Rx
 		{
 			ASSERT(_func != nullptr);
 			ASSERT(_self != nullptr);
-			m_handle = _NewThread(new TEntryNoArgs<R(C::*)(A), T>(_self, _func));
+			m_handle = _NewThread(new TEntryNoArgs<R(C::*)(void)>(_self, _func));
 		}
 
 		Thread(void);
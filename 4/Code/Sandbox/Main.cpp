@@ -3,6 +3,7 @@
 #include "Sandbox.hpp"
 #include <SDL2\include\SDL.h>
 #include <Windows.h>
+#include <Psapi.h>
 #include <io.h>
 #include <sys/stat.h>
 #ifdef _MSC_VER
@@ -469,6 +470,341 @@ _SpinLock TestRC::s_lock;
 
 template <MemoryOrder Order = MO_Default> int8 _AtomicGet(int8& _atom) { return ((std::atomic<int8>*)&_atom)->load(static_cast<std::memory_order>(Order)); }
 
+//----------------------------------------------------------------------------//
+// 
+//----------------------------------------------------------------------------//
+
+#include <chrono>
+
+void _EnumFilesRecursive(FileInfoList& _dst, const String& _dir)
+{
+	FileInfoList _items;
+	gFileSystem->EnumPhysFiles(_items, _dir);
+	for (const FileInfo& _fi : _items)
+	{
+		if (_fi.attribs & FA_Directory)
+			_EnumFilesRecursive(_dst, _fi.path);
+		else
+			_dst.push_back(_fi);
+	}
+}
+
+/// Remove cached pages of file from the system cache. Opening a file without buffering makes Windows purge its
+/// cached data, provided no other handle or view of it is still open.
+void _EvictFileCache(const String& _path)
+{
+	HANDLE _file = CreateFileA(_path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_NO_BUFFERING, nullptr);
+	if (_file != INVALID_HANDLE_VALUE)
+		CloseHandle(_file);
+}
+
+/// Load all files of directory through buffered and mapped paths.
+/// Files are evicted from the system cache before the first pass of each path, so both cold passes read from disk.
+void _TestFileMapping(const char* _dir)
+{
+	FileInfoList _files;
+	_EnumFilesRecursive(_files, _dir);
+
+	uint64 _totalSize = 0;
+	for (const FileInfo& _fi : _files)
+		_totalSize += _fi.size;
+	printf("%d files, %.2f MB\n", (int)_files.size(), _totalSize / (1024.0 * 1024.0));
+
+	const char* _pass[] = { "buffered (cold)", "buffered (warm)", "mapped (cold)", "mapped (warm)" };
+	Array<uint8> _buffer;
+	for (uint p = 0; p < 4; ++p)
+	{
+		uint _flags = p < 2 ? OF_Buffered : 0;
+		if (!(p & 1))
+		{
+			for (const FileInfo& _fi : _files)
+				_EvictFileCache(_fi.path);
+		}
+
+		uint _sum = 0, _numMapped = 0;
+		auto _start = std::chrono::high_resolution_clock::now();
+		for (const FileInfo& _fi : _files)
+		{
+			File _f = gFileSystem->OpenFile(_fi.path, AM_Read, _flags);
+			if (!_f)
+				continue;
+
+			const uint8* _data = _f.GetData();
+			uint _size = _f.GetSize();
+			if (_data)
+			{
+				++_numMapped;
+			}
+			else // copy to heap
+			{
+				_buffer.resize(_size + 1);
+				_size = _f.Read(&_buffer[0], _size);
+				_data = &_buffer[0];
+			}
+
+			for (uint i = 0; i < _size; i += 64) // touch each cache line as parser would
+				_sum += _data[i];
+		}
+		double _ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - _start).count();
+		printf("%-16s: %8.2f ms, %8.2f MB/s, %d mapped, checksum %08x\n", _pass[p], _ms, _totalSize / (1024.0 * 1024.0) / (_ms * 0.001), _numMapped, _sum);
+	}
+}
+
+void _WriteLE(Array<uint8>& _dst, uint _val, uint _size)
+{
+	for (uint i = 0; i < _size; ++i)
+		_dst.push_back((uint8)(_val >> (i * 8)));
+}
+
+/// Append entry to zip archive. Local header and data are written to _zip, record of central directory to _dir.
+void _AddZipEntry(Array<uint8>& _zip, Array<uint8>& _dir, const String& _name, const Array<uint8>& _src, bool _deflate)
+{
+	Array<uint8> _packed = _src;
+	if (_deflate)
+	{
+		z_stream _stream;
+		memset(&_stream, 0, sizeof(_stream));
+		deflateInit2(&_stream, Z_BEST_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY); // raw deflate
+		_packed.resize(deflateBound(&_stream, (uLong)_src.size()));
+		_stream.next_in = const_cast<Bytef*>(&_src[0]);
+		_stream.avail_in = (uInt)_src.size();
+		_stream.next_out = &_packed[0];
+		_stream.avail_out = (uInt)_packed.size();
+		deflate(&_stream, Z_FINISH);
+		_packed.resize(_stream.total_out);
+		deflateEnd(&_stream);
+	}
+
+	uint _crc = crc32(0, &_src[0], (uInt)_src.size());
+	uint _offset = (uint)_zip.size();
+	for (uint i = 0; i < 2; ++i)
+	{
+		Array<uint8>& _dst = i ? _dir : _zip;
+		_WriteLE(_dst, i ? 0x02014b50 : 0x04034b50, 4);
+		if (i)
+			_WriteLE(_dst, 20, 2); // version made by
+		_WriteLE(_dst, 20, 2); // version needed to extract
+		_WriteLE(_dst, 0, 2); // flags
+		_WriteLE(_dst, _deflate ? 8 : 0, 2);
+		_WriteLE(_dst, 0, 4); // time and date
+		_WriteLE(_dst, _crc, 4);
+		_WriteLE(_dst, (uint)_packed.size(), 4);
+		_WriteLE(_dst, (uint)_src.size(), 4);
+		_WriteLE(_dst, _name.Length(), 2);
+		_WriteLE(_dst, 0, 2); // extra field
+		if (i)
+		{
+			_WriteLE(_dst, 0, 2); // comment
+			_WriteLE(_dst, 0, 4); // disk, internal attributes
+			_WriteLE(_dst, 0, 4); // external attributes
+			_WriteLE(_dst, _offset, 4);
+		}
+		_dst.insert(_dst.end(), _name.CStr(), _name.CStr() + _name.Length());
+	}
+	_zip.insert(_zip.end(), _packed.begin(), _packed.end());
+}
+
+/// Write archive _name.zip with stored and deflated entries. If _dataSize isn't zero, data of entries is cut to this size. _cut bytes are removed from end of archive.
+void _WriteTestZip(const String& _name, const Array<uint8>& _text, uint _dataSize = 0, uint _cut = 0)
+{
+	Array<uint8> _zip, _dir;
+	_AddZipEntry(_zip, _dir, _name + "/stored.txt", _text, false);
+	_AddZipEntry(_zip, _dir, _name + "/deflated.txt", _text, true);
+	if (_dataSize)
+		_zip.resize(_dataSize);
+
+	uint _offset = (uint)_zip.size();
+	_zip.insert(_zip.end(), _dir.begin(), _dir.end());
+	_WriteLE(_zip, 0x06054b50, 4);
+	_WriteLE(_zip, 0, 4); // disks
+	_WriteLE(_zip, 2, 2);
+	_WriteLE(_zip, 2, 2);
+	_WriteLE(_zip, (uint)_dir.size(), 4);
+	_WriteLE(_zip, _offset, 4);
+	_WriteLE(_zip, 0, 2); // comment
+
+	File _f = gFileSystem->OpenFile(_name + ".zip", AM_Write);
+	_f.Write(&_zip[0], (uint)_zip.size() - _cut);
+}
+
+/// Read stored and deflated entries of archive, open truncated and corrupted archives.
+void _TestZipFileSystem(void)
+{
+	Array<uint8> _text(100000);
+	for (uint i = 0; i < _text.size(); ++i)
+		_text[i] = "abcdefgh \n"[rand() % 10];
+
+	_WriteTestZip("ZipTest", _text);
+	gFileSystem->AddSearchPath("ZipTest.zip");
+	const char* _names[] = { "ZipTest/stored.txt", "ZipTest/deflated.txt" };
+	for (uint i = 0; i < 2; ++i)
+	{
+		File _f = gFileSystem->OpenFile(_names[i]);
+		Array<uint8> _data(_text.size() + 1);
+		_data.resize(_f ? _f.Read(&_data[0], (uint)_data.size()) : 0);
+		printf("%s: %s\n", _names[i], _data == _text ? "ok" : "FAILED");
+	}
+
+	// end of central directory is cut off
+	_WriteTestZip("ZipTestTruncated", _text, 0, 10);
+	gFileSystem->AddSearchPath("ZipTestTruncated.zip");
+	printf("truncated archive: %s\n", gFileSystem->FileExists("ZipTestTruncated/stored.txt") ? "FAILED" : "ok");
+
+	// central directory is valid, but data of entries is cut off
+	_WriteTestZip("ZipTestCorrupted", _text, 1000);
+	gFileSystem->AddSearchPath("ZipTestCorrupted.zip");
+	bool _opened = gFileSystem->OpenFile("ZipTestCorrupted/stored.txt") || gFileSystem->OpenFile("ZipTestCorrupted/deflated.txt");
+	printf("corrupted archive: %s\n", _opened ? "FAILED" : "ok");
+}
+
+/// Compare parsing of text config with opening of compiled config.
+void _TestBinaryConfig(uint _numEntries = 20000)
+{
+	String _text = "Entities = [\n";
+	for (uint i = 0; i < _numEntries; ++i)
+		_text += String::Format("\tEntity%u : Actor = { Name = \"Actor %u\" Position = [ %d, %d, %d ] Visible = true Mass = %f }\n", i, i, rand() % 1000, rand() % 100, rand() % 1000, rand() * 0.01f);
+	_text += "]\n";
+
+	auto _start = std::chrono::high_resolution_clock::now();
+	Config _cfg;
+	_cfg.Parse(_text);
+	double _parseTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - _start).count();
+
+	Array<uint8> _data;
+	BinaryConfig::Compile(_cfg, _data);
+
+	_start = std::chrono::high_resolution_clock::now();
+	BinaryConfig _bin;
+	_bin.Open(&_data[0], (uint)_data.size());
+	double _openTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - _start).count();
+
+	double _sum = 0, _binSum = 0;
+	_start = std::chrono::high_resolution_clock::now();
+	for (uint i = 0; i < _numEntries; ++i)
+		_sum += (double)_cfg["Entities"][i]["Position"][1] + (float)_cfg["Entities"][i]["Mass"];
+	double _lookupTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - _start).count();
+
+	_start = std::chrono::high_resolution_clock::now();
+	for (uint i = 0; i < _numEntries; ++i)
+		_binSum += (double)_bin.Root()["Entities"][i]["Position"][1] + (float)_bin.Root()["Entities"][i]["Mass"];
+	double _binLookupTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - _start).count();
+
+	printf("%u entries, text %u bytes, compiled %u bytes\n", _numEntries, _text.Length(), (uint)_data.size());
+	printf("parse %.3f ms, open compiled %.3f ms\n", _parseTime, _openTime);
+	printf("lookup %.3f ms, compiled %.3f ms, %s\n", _lookupTime, _binLookupTime, _sum == _binSum ? "results are equal" : "RESULTS ARE DIFFERENT");
+	printf("round-trip: %s\n", _bin.Print() == _cfg.Print() ? "ok" : "FAILED");
+
+	// compiled copy must be rejected after any change of text, even of the same length
+	Array<uint8> _srcData;
+	BinaryConfig _src;
+	String _changed = String(_text, _text.Length() - 1) + " ";
+	bool _checked = BinaryConfig::Compile(_text, _srcData) && _src.Open(&_srcData[0], (uint)_srcData.size());
+	printf("source check: %s\n", _checked && _src.IsCompiledFrom(_text) && !_src.IsCompiledFrom(_changed) && !_bin.IsCompiledFrom(_text) ? "ok" : "FAILED");
+}
+
+/// Compare parsing of config to arena and to heap.
+/// Memory is the growth of peak working set over the trimmed working set at start of pass. The peak can't be reset, so arena
+/// runs first; if a pass stays below the peak of previous one, its memory can't be measured.
+void _TestConfigArena(uint _numEntries = 20000)
+{
+	String _text = "Entities = [\n";
+	for (uint i = 0; i < _numEntries; ++i)
+		_text += String::Format("\tEntity%u : Actor = { Name = \"Actor %u\" Position = [ %d, %d, %d ] Visible = true Mass = %f }\n", i, i, rand() % 1000, rand() % 100, rand() % 1000, rand() * 0.01f);
+	_text += "]\n";
+
+	String _result[2];
+	for (uint p = 0; p < 2; ++p)
+	{
+		SetProcessWorkingSetSize(GetCurrentProcess(), (SIZE_T)-1, (SIZE_T)-1); // trim
+		PROCESS_MEMORY_COUNTERS _mem;
+		GetProcessMemoryInfo(GetCurrentProcess(), &_mem, sizeof(_mem));
+		size_t _startMem = _mem.WorkingSetSize;
+		size_t _prevPeak = _mem.PeakWorkingSetSize;
+
+		ConfigArena* _arena = p ? nullptr : new ConfigArena;
+		auto _start = std::chrono::high_resolution_clock::now();
+		{
+			Config _cfg(_arena);
+			_cfg.Parse(_text);
+			double _parseTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - _start).count();
+
+			GetProcessMemoryInfo(GetCurrentProcess(), &_mem, sizeof(_mem));
+			if (_mem.PeakWorkingSetSize > _prevPeak)
+				printf("%-5s: parse %.3f ms, peak memory %.2f MB\n", p ? "heap" : "arena", _parseTime, (_mem.PeakWorkingSetSize - _startMem) / (1024.0 * 1024.0));
+			else
+				printf("%-5s: parse %.3f ms, peak memory below previous pass\n", p ? "heap" : "arena", _parseTime);
+
+			_result[p] = _cfg.Print();
+		}
+		delete _arena;
+	}
+	printf("result: %s\n", _result[0] == _result[1] ? "ok" : "FAILED");
+}
+
+/// Log from 8 threads concurrently with synchronous and asynchronous writing.
+void _TestLogger(uint _numMessages = 20000)
+{
+	gLogSystem->SetFile("log.txt");
+	for (uint p = 0; p < 2; ++p)
+	{
+		gLogSystem->SetAsync(p == 1);
+		uint _lost = gLogSystem->GetNumLost();
+
+		auto _start = std::chrono::high_resolution_clock::now();
+		std::thread _threads[8];
+		for (uint i = 0; i < 8; ++i)
+		{
+			_threads[i] = std::thread([=]
+			{
+				for (uint j = 0; j < _numMessages; ++j)
+					LOG_INFO("thread %u, message %u", i, j);
+			});
+		}
+		for (uint i = 0; i < 8; ++i)
+			_threads[i].join();
+		double _logTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - _start).count();
+
+		gLogSystem->Flush();
+		double _totalTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - _start).count();
+
+		fprintf(stderr, "%-5s: logging %.2f ms, with flush %.2f ms, %u messages were lost\n", p ? "async" : "sync", _logTime, _totalTime, gLogSystem->GetNumLost() - _lost);
+	}
+	gLogSystem->SetFile("");
+}
+
+class TestRefCountedObject : public RefCounted
+{
+public:
+	TestRefCountedObject(void) { }
+	TestRefCountedObject(_LazyRef) : RefCounted(LazyRef) { }
+	uint value = 1;
+};
+
+/// Create and destroy objects with RefCounter allocated in constructor and with LazyRef, with and without weak reference.
+void _TestRefCounted(uint _numObjects = 10000000)
+{
+	for (uint p = 0; p < 4; ++p)
+	{
+		bool _lazy = (p & 1) != 0, _weak = (p & 2) != 0;
+		uint _check = 0;
+
+		auto _start = std::chrono::high_resolution_clock::now();
+		for (uint i = 0; i < _numObjects; ++i)
+		{
+			SharedPtr<TestRefCountedObject> _obj = _lazy ? new TestRefCountedObject(LazyRef) : new TestRefCountedObject;
+			if (_weak)
+			{
+				WeakRef<TestRefCountedObject> _ref = _obj;
+				_check += _ref.Lock()->value;
+			}
+			else
+				_check += _obj->value;
+		}
+		double _time = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - _start).count();
+
+		printf("%-5s %-8s: %.2f ms (%.1f ns/object), %s\n", _lazy ? "lazy" : "eager", _weak ? "weak ref" : "", _time, _time * 1e6 / _numObjects, _check == _numObjects ? "ok" : "FAILED");
+	}
+}
 
 int main(void)
 {
@@ -492,6 +828,13 @@ int main(void)
 		_t1.join();
 		_t2.join();*/
 
+		//_TestFileMapping("Data");
+		//_TestZipFileSystem();
+		//_TestBinaryConfig();
+		//_TestConfigArena();
+		//_TestLogger();
+		//_TestRefCounted();
+
 		RefCounted* _rc = new RefCounted;
 		_rc->AddRef();
 
@@ -94,8 +94,8 @@ namespace Engine
 		const char* CStr(void) const { return m_buffer->str; }
 		const char* Ptr(void) const { return m_buffer->str; }
 		const char* Ptr(uint _offset) const { ASSERT(_offset <= m_buffer->length); return m_buffer->str + _offset; }
-		uint32 Hash(uint32 _hash = 0) const { return Hash(m_buffer->str, _hash); }
-		uint32 Hashi(uint32 _hash = 0) const { return Hashi(m_buffer->str, _hash); }
+		uint32 Hash(uint32 _hash = 0) const { return Hash(m_buffer->str, m_buffer->length, _hash); }
+		uint32 Hashi(uint32 _hash = 0) const { return Hashi(m_buffer->str, m_buffer->length, _hash); }
 		String Trim(const char* _cset, bool _left = true, bool _right = true) const;
 		StringArray Split(const char* _delimiters) const { StringArray _dst; Split(m_buffer->str, _delimiters, _dst); return Move(_dst); }
 		int Compare(const char* _rhs, bool _ignoreCase = false) const { return Compare(*this, _rhs, _ignoreCase); }
@@ -106,8 +106,12 @@ namespace Engine
 
 		static String Format(const char* _fmt, ...);
 		static String FormatV(const char* _fmt, va_list _args);
-		static uint32 Hash(const char* _str, uint32 _hash = 0);
-		static uint32 Hashi(const char* _str, uint32 _hash = 0);
+		static uint32 Hash(const char* _str, uint32 _hash = 0) { return _str ? Hash(_str, (uint)strlen(_str), _hash) : _hash; }
+		static uint32 Hashi(const char* _str, uint32 _hash = 0) { return _str ? Hashi(_str, (uint)strlen(_str), _hash) : _hash; }
+		/// sdbm hash of _length chars (_hash * 65599 + c). Eight chars are processed per step.
+		static uint32 Hash(const char* _str, uint _length, uint32 _hash);
+		/// Case-insensitive sdbm hash of _length chars. Same as Hash for ToLower of each char.
+		static uint32 Hashi(const char* _str, uint _length, uint32 _hash);
 		static int Compare(const char* _a, const char* _b, bool _ignoreCase = false);
 		static bool Equals(const char* _a, const char* _b, bool _ignoreCase = false) { return Compare(_a, _b, _ignoreCase) == 0; }
 		static bool Match(const char* _str, const char* _pattern, bool _ignoreCase = true);
@@ -129,6 +133,7 @@ namespace Engine
 		static const String Empty;
 
 	protected:
+		friend class NameTable; // places buffers of names in own memory
 
 		struct Buffer
 		{
@@ -158,11 +163,11 @@ namespace Engine
 	{
 		NameHash(void) : hash(0) { }
 		NameHash(uint _value) : hash(_value) { }
-		NameHash(const String& _str, uint _hash = 0) : hash(String::Hashi(_str, _hash)) { }
+		NameHash(const String& _str, uint _hash = 0) : hash(_str.Hashi(_hash)) { }
 		NameHash(const char* _str, uint _hash = 0) : hash(String::Hashi(_str, _hash)) { }
 
 		NameHash& operator += (const char* _str) { hash = String::Hashi(_str, hash); return *this; }
-		NameHash& operator += (const String& _str) { hash = String::Hashi(_str, hash); return *this; }
+		NameHash& operator += (const String& _str) { hash = _str.Hashi(hash); return *this; }
 		NameHash operator + (const char* _rhs) const { return NameHash(_rhs, hash); }
 		NameHash operator + (const String& _rhs) const { return NameHash(_rhs, hash); }
 
@@ -180,20 +185,24 @@ namespace Engine
 	// Name
 	//----------------------------------------------------------------------------//
 
+	/// Interned case-insensitive string. Names are compared by pointer.
+	/// Items of names are never deleted, so pointers to them are stable and can be used from any thread.
 	class Name
 	{
 	public:
 		struct Item
 		{
-			Item(const String& _name) : name(_name), hash(_name) { }
-			NameHash hash;
-			String name;
+			Item(const String& _name) : hash(_name), name(_name) { }
+			NameHash hash; //!< Case-insensitive hash, computed once.
+			String name; //!< Spelling of first added name.
 		};
 
 		Name(void) : m_item(&s_empty) { }
-		Name(const String& _str) : m_item(_AddItem(_str)) { }
-		Name& operator = (const String& _str) { m_item = _AddItem(_str); return *this; }
-		bool operator == (const Name& _rhs) const { return m_item == _rhs.m_item || m_item->hash == _rhs.m_item->hash; }
+		Name(const String& _str) : m_item(_AddItem(_str, _str.Length())) { }
+		Name(const char* _str, int _length = -1) : m_item(_AddItem(_str, _length)) { }
+		Name& operator = (const String& _str) { m_item = _AddItem(_str, _str.Length()); return *this; }
+		Name& operator = (const char* _str) { m_item = _AddItem(_str, -1); return *this; }
+		bool operator == (const Name& _rhs) const { return m_item == _rhs.m_item; }
 		bool operator != (const Name& _rhs) const { return !(*this == _rhs); }
 		bool operator == (const NameHash& _rhs) const { return m_item->hash == _rhs; }
 		bool operator != (const NameHash& _rhs) const { return !(*this == _rhs); }
@@ -204,14 +213,17 @@ namespace Engine
 		operator const NameHash& (void) const { return m_item->hash; }
 		operator uint (void) const { return m_item->hash; }
 
+		/// Get number of interned names.
+		static uint GetCount(void);
+		/// Get number of bytes used by interned names, including the table.
+		static size_t GetMemoryUse(void);
+
 	protected:
-		static const Item* _AddItem(const String& _name);
+		static const Item* _AddItem(const char* _str, int _length);
 
 		const Item* m_item;
 
 		static const Item s_empty;
-		static HashMap<uint, const Item*> s_names; // <StrHash, Item>
-		static int s_mutex;
 	};
 
 	//----------------------------------------------------------------------------//
@@ -243,20 +255,17 @@ namespace Engine
 
 	extern const uint32 Crc32Table[256];
 
-	inline uint32 Crc32(uint32 _crc, const void* _buf, uint _size)
-	{
-		ASSERT(_buf || !_size);
-		const uint8* p = (const uint8*)_buf;
-		_crc = _crc ^ ~0u;
-		while (_size--)
-			_crc = Crc32Table[(_crc ^ *p++) & 0xff] ^ (_crc >> 8);
-		return _crc ^ ~0u;
-	}
+	/// CRC-32 (IEEE 802.3). Large buffers are folded with PCLMULQDQ if it is supported by CPU, others are processed by slice-by-8.
+	uint32 Crc32(uint32 _crc, const void* _buf, uint _size);
 	inline uint32 Crc32(const void* _buf, uint _size) { return Crc32(0, _buf, _size); }
 	inline uint32 Crc32(const char* _str, int _length = -1, uint32 _crc = 0) { return _str ? Crc32(_crc, _str, _length < 0 ? (uint)strlen(_str) : _length) : _crc; }
 	inline uint32 Crc32(const String& _str, uint32 _crc = 0) { return Crc32(_crc, _str, _str.Length()); }
 	template <typename T> uint32 Crc32(const T& _obj, uint32 _crc = 0) { return Crc32(_crc, &_obj, sizeof(_obj)); }
 
+	/// 64-bit hash of binary data (MurmurHash64A). Faster than Crc32 for large blobs.
+	uint64 Hash64(const void* _data, size_t _size, uint64 _seed = 0);
+	inline uint64 Hash64(const String& _str, uint64 _seed = 0) { return Hash64(_str.CStr(), _str.Length(), _seed); }
+
 	//----------------------------------------------------------------------------//
 	// 
 	//----------------------------------------------------------------------------//
@@ -9,6 +9,8 @@
 #include "Object.hpp"
 #include "Device.hpp"
 #include "Graphics.hpp"
+#include "TextureCompression.hpp"
+#include "MipMaps.hpp"
 
 #pragma comment(lib, "SDL2.lib")
 #pragma comment(lib, "Bullet.lib")
@@ -129,6 +129,7 @@ namespace Engine
 	enum RenderSystemType
 	{
 		RST_Unknown,
+		RST_Null, //!< Headless backend without output, only for tests and benchmarks.
 		RST_D3D11,
 		//RST_GL,
 		//RST_D3D12,
@@ -175,6 +176,13 @@ namespace Engine
 		uint shaderVersion = 0; // HLSL(4.1 = 41, 5.0 = 50), GL(330, 430)
 	};
 
+	struct RenderFrameStats
+	{
+		uint numDraws = 0;
+		uint numCommands = 0; // state changes and draws
+		uint32 commandsHash = 0; // checksum of commands with arguments in order of execution, only RST_Null computes it
+	};
+
 	//----------------------------------------------------------------------------//
 	// HardwareBuffer
 	//----------------------------------------------------------------------------//
@@ -524,6 +532,76 @@ namespace Engine
 		bool m_deferred;
 	};
 
+	//----------------------------------------------------------------------------//
+	// DeferredRenderContext
+	//----------------------------------------------------------------------------//
+
+	///\brief CPU-side deferred context. Records commands into a linear buffer, which can be executed later on any render context.
+	///\note Each context can be used only from one thread at the same time, but different contexts can be recorded in parallel.
+	///\warning Commands don't hold references to buffers and vertex formats. They must be valid until commands are executed.
+	class DeferredRenderContext final : public RenderContext
+	{
+	public:
+		DeferredRenderContext(void);
+		~DeferredRenderContext(void);
+
+		/// Clear previous commands and reset state.
+		void BeginCommands(void) override;
+		void EndCommands(void) override;
+
+		void SetVertexFormat(VertexFormat* _format) override;
+		void SetVertexBuffer(uint _slot, HardwareBuffer* _buffer, uint _offset, uint _stride) override;
+		void SetIndexBuffer(HardwareBuffer* _buffer, IndexFormat _format, uint _offset) override;
+		void SetPrimitiveType(PrimitiveType _type) override;
+
+		void Draw(uint _numVertices, uint _numInstances, uint _firstVertex, uint _baseInstance = 0) override;
+		void DrawIndexed(uint _numIndices, uint _numInstances, uint _firstIndex, int _baseVertex, uint _baseInstance = 0) override;
+		void DrawIndirect(HardwareBuffer* _buffer, uint _offset = 0) override;
+		void DrawIndexedIndirect(HardwareBuffer* _buffer, uint _offset = 0) override;
+
+		/// Replay recorded commands on other context. Commands are not removed and can be executed several times.
+		void Execute(RenderContext* _dst);
+
+		bool IsEmpty(void) { return m_size == 0; }
+		/// Get size of recorded commands in bytes.
+		uint GetSize(void) { return m_size; }
+		uint GetNumCommands(void) { return m_numCommands; }
+
+	protected:
+
+		enum StateFlags : uint
+		{
+			SF_VertexFormat = 0x1,
+			SF_IndexBuffer = 0x2,
+			SF_PrimitiveType = 0x4,
+			SF_VertexBuffer = 0x8, //!< first of MAX_VERTEX_STREAMS flags
+		};
+
+		struct VertexStream
+		{
+			HardwareBuffer* buffer;
+			uint offset;
+			uint stride;
+		};
+
+		template <class T> T* _Add(uint _type);
+		void _Grow(uint _size);
+
+		uint8* m_data;
+		uint m_size;
+		uint m_capacity;
+		uint m_numCommands;
+
+		// current state for skipping of redundant commands. Is unknown at begin of commands, because destination context can have any state.
+		uint m_validState;
+		VertexFormat* m_vertexFormat;
+		PrimitiveType m_primitiveType;
+		HardwareBuffer* m_indexBuffer;
+		IndexFormat m_indexFormat;
+		uint m_indexOffset;
+		VertexStream m_vertexStreams[MAX_VERTEX_STREAMS];
+	};
+
 	//----------------------------------------------------------------------------//
 	// RenderSystem
 	//----------------------------------------------------------------------------//
@@ -532,12 +610,14 @@ namespace Engine
 	{
 	public:
 
-		static bool Create(void);
+		static bool Create(RenderSystemType _type = RST_D3D11);
 		static void Destroy(void);
 
 
 		SDL_Window* GetSDLWindow(void) { return m_window; }
 		const RenderSystemFeatures& GetFeatures(void) { return m_features; }
+		/// Get statistics of last finished frame.
+		const RenderFrameStats& GetFrameStats(void) { return m_frameStats; }
 
 		virtual void BeginFrame(void);
 		virtual void EndFrame(void);
@@ -549,6 +629,12 @@ namespace Engine
 		///\param[in] _elementSize specify size of each element in buffer. It's obligatory when _type is Engine::HBU_Uniform, use as hint otherwise. 
 		virtual HardwareBufferPtr CreateBuffer(HardwareBufferType _type, HardwareBufferUsage _usage, uint _size, uint _elementSize, const void* _data = nullptr) = 0;
 
+		/// Queue recorded commands for execution in FlushCommands. Submitted lists are executed in ascending order of _order independent of order of submission.
+		///\note Can be used from any thread. The list must not be changed until it is executed.
+		void Submit(DeferredRenderContext* _commands, uint _order);
+		/// Execute all submitted commands on this context. It's called in EndFrame.
+		void FlushCommands(void);
+
 
 	protected:
 		RenderSystem(void);
@@ -561,6 +647,19 @@ namespace Engine
 
 		SDL_Window* m_window;
 		RenderSystemFeatures m_features;
+		RenderFrameStats m_frameStats;
+
+		struct SubmittedCommands
+		{
+			uint order;
+			DeferredRenderContext* commands;
+
+			bool operator < (const SubmittedCommands& _rhs) const { return order < _rhs.order; }
+		};
+
+		SpinLock m_submitLock;
+		Array<SubmittedCommands> m_submitted;
+		Array<SubmittedCommands> m_executing;
 	};
 
 	//----------------------------------------------------------------------------//
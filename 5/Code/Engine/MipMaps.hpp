@@ -0,0 +1,51 @@
+#pragma once
+
+#include "TextureCompression.hpp"
+
+namespace Engine
+{
+	//----------------------------------------------------------------------------//
+	// MipMaps
+	//----------------------------------------------------------------------------//
+
+	enum MipFilter
+	{
+		MF_Box, //!< average of covered pixels (2x2 for even sizes).
+		MF_Kaiser, //!< Kaiser-windowed sinc. Sharper than box, keeps more details in small levels.
+	};
+
+	struct MipMapParams
+	{
+		MipFilter filter = MF_Box;
+		bool srgb = false; //!< color channels of PF_R8 and PF_RGBA8 are in sRGB and filtered in linear space. Alpha is always linear.
+		bool wrap = false; //!< filter wraps around edges of tiled texture, otherwise edge pixels are repeated.
+		float alphaRef = 0; //!< if positive, alpha of each level is scaled to keep coverage of alpha test (alpha > alphaRef) as in level 0.
+		float kaiserWidth = 3; //!< radius of Kaiser filter in pixels of destination level.
+		float kaiserAlpha = 4;
+		float kaiserStretch = 1;
+		uint numLevels = 0; //!< zero is full chain.
+		uint numThreads = 0; //!< zero is number of cores.
+	};
+
+	struct MipLevel
+	{
+		uint width;
+		uint height;
+		Array<uint8> data; //!< pixels in format of source image, rows are tightly packed.
+	};
+
+	/// Get number of levels in full mip chain.
+	uint GetNumMipLevels(uint _width, uint _height);
+
+	///\brief Generate mip chain of PF_R8, PF_RGBA8 or PF_RGBA16F image. Level 0 is copy of source image.
+	///\note Each level is filtered from the previous one in floating point, rows are distributed between threads.
+	///\return false if format is not supported.
+	bool GenerateMipMaps(PixelFormat _format, const void* _src, uint _width, uint _height, uint _srcPitch, Array<MipLevel>& _levels, const MipMapParams& _params = MipMapParams());
+	///\brief Compress all levels of PF_R8 or PF_RGBA8 mip chain. Levels are stored one after another. PF_R8 is compressed as (r, r, r, 255).
+	///\return false if format is not supported.
+	bool CompressMipMaps(PixelFormat _format, const Array<MipLevel>& _levels, PixelFormat _dstFormat, Array<uint8>& _dst, BlockCompressionQuality _quality = BCQ_Fast, uint _numThreads = 0);
+
+	//----------------------------------------------------------------------------//
+	//
+	//----------------------------------------------------------------------------//
+}
@@ -1,7 +1,50 @@
 #include "../Base.hpp"
+#include "../Thread.hpp"
+#ifdef _MSC_VER
+#	include <intrin.h>
+#	define TARGET_SSE41
+#	define TARGET_PCLMUL
+#else
+#	include <immintrin.h>
+#	include <cpuid.h>
+#	define TARGET_SSE41 __attribute__((target("sse4.1")))
+#	define TARGET_PCLMUL __attribute__((target("sse4.1,pclmul")))
+#endif
 
 namespace Engine
 {
+	//----------------------------------------------------------------------------//
+	// Defs
+	//----------------------------------------------------------------------------//
+
+	namespace
+	{
+		enum : uint
+		{
+			CPU_SSE41 = 0x1,
+			CPU_PCLMUL = 0x2,
+		};
+
+		uint _GetCpuFeatures(void)
+		{
+			uint _features = 0;
+			int _info[4] = { 0 };
+#ifdef _MSC_VER
+			__cpuid(_info, 1);
+#else
+			__cpuid(1, _info[0], _info[1], _info[2], _info[3]);
+#endif
+			if (_info[2] & (1 << 19))
+				_features |= CPU_SSE41;
+			if (_info[2] & (1 << 1))
+				_features |= CPU_PCLMUL;
+			return _features;
+		}
+
+		/// Zero until dynamic initialization of this file, so hashing in static initializers of other files uses portable code.
+		const uint s_cpuFeatures = _GetCpuFeatures();
+	}
+
 	//----------------------------------------------------------------------------//
 	// Atomic
 	//----------------------------------------------------------------------------//
@@ -317,16 +360,121 @@ namespace Engine
 #endif
 	}
 	//----------------------------------------------------------------------------//
-	uint32 String::Hash(const char* _str, uint32 _hash)
+	namespace
+	{
+		// Powers of multiplier of sdbm hash: _hash = c + (_hash << 6) + (_hash << 16) - _hash = _hash * 65599 + c.
+		// Block of chars is added as _hash * M^n + c0 * M^(n-1) + ... + c(n-1), so the result is same as per-char loop.
+		enum : uint32
+		{
+			HASH_M0 = 0x00000001,
+			HASH_M1 = 0x0001003f,
+			HASH_M2 = 0x007e0f81,
+			HASH_M3 = 0x2e86d0bf,
+			HASH_M4 = 0x43ec5f01,
+			HASH_M5 = 0x162c613f,
+			HASH_M6 = 0xd62aee81,
+			HASH_M7 = 0xa311b1bf,
+			HASH_M8 = 0xd319be01,
+			HASH_M9 = 0xb156c23f,
+			HASH_M10 = 0x6698cd81,
+			HASH_M11 = 0x0d1b92bf,
+			HASH_M12 = 0xcc881d01,
+			HASH_M13 = 0x7280233f,
+			HASH_M14 = 0x50c7ac81,
+			HASH_M15 = 0x8da473bf,
+			HASH_M16 = 0x4f377c01,
+		};
+
+		inline uint32 _HashBlock8(uint32 _hash, const char* _s)
+		{
+			return _hash * HASH_M8 +
+				_s[0] * HASH_M7 + _s[1] * HASH_M6 + _s[2] * HASH_M5 + _s[3] * HASH_M4 +
+				_s[4] * HASH_M3 + _s[5] * HASH_M2 + _s[6] * HASH_M1 + _s[7];
+		}
+
+		/// Same as ToLower for eight chars.
+		inline uint64 _ToLower8(uint64 _x)
+		{
+			const uint64 _ones = 0x0101010101010101ull;
+			const uint64 _low = _x & (_ones * 0x7f);
+			uint64 _upper = ((_ones * (127 + 'Z' + 1)) - _low) & ~_x & (_low + _ones * (127 - 'A' + 1)); // 'A'..'Z'
+			uint64 _high = _x << 1; // 0xc0..0xff
+			return _x | (((_upper | (_x & _high)) & (_ones * 0x80)) >> 2);
+		}
+
+		/// Hash of 16-char blocks. Sums of four lanes are multiplied by M^16 for each block and added at the end.
+		template <bool LOWER> TARGET_SSE41 uint32 _HashBlocks16(uint32 _hash, const char* _str, uint _blocks)
+		{
+			alignas(16) static const uint32 _pow[16] =
+			{
+				HASH_M15, HASH_M14, HASH_M13, HASH_M12, HASH_M11, HASH_M10, HASH_M9, HASH_M8,
+				HASH_M7, HASH_M6, HASH_M5, HASH_M4, HASH_M3, HASH_M2, HASH_M1, HASH_M0,
+			};
+			const __m128i _p0 = _mm_load_si128((const __m128i*)(_pow + 0));
+			const __m128i _p1 = _mm_load_si128((const __m128i*)(_pow + 4));
+			const __m128i _p2 = _mm_load_si128((const __m128i*)(_pow + 8));
+			const __m128i _p3 = _mm_load_si128((const __m128i*)(_pow + 12));
+			const __m128i _m16 = _mm_set1_epi32((int)HASH_M16);
+			__m128i _acc = _mm_setzero_si128();
+			for (uint i = 0; i < _blocks; ++i, _str += 16)
+			{
+				__m128i _x = _mm_loadu_si128((const __m128i*)_str);
+				if (LOWER)
+				{
+					__m128i _upper = _mm_and_si128(_mm_cmpgt_epi8(_x, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(_x, _mm_set1_epi8('Z' + 1)));
+					__m128i _high = _mm_andnot_si128(_mm_cmplt_epi8(_x, _mm_set1_epi8(-64)), _mm_cmplt_epi8(_x, _mm_setzero_si128())); // 0xc0..0xff
+					_x = _mm_or_si128(_x, _mm_and_si128(_mm_or_si128(_upper, _high), _mm_set1_epi8(0x20)));
+				}
+				__m128i _s0 = _mm_mullo_epi32(_mm_cvtepi8_epi32(_x), _p0);
+				__m128i _s1 = _mm_mullo_epi32(_mm_cvtepi8_epi32(_mm_srli_si128(_x, 4)), _p1);
+				__m128i _s2 = _mm_mullo_epi32(_mm_cvtepi8_epi32(_mm_srli_si128(_x, 8)), _p2);
+				__m128i _s3 = _mm_mullo_epi32(_mm_cvtepi8_epi32(_mm_srli_si128(_x, 12)), _p3);
+				_acc = _mm_add_epi32(_mm_mullo_epi32(_acc, _m16), _mm_add_epi32(_mm_add_epi32(_s0, _s1), _mm_add_epi32(_s2, _s3)));
+				_hash *= HASH_M16;
+			}
+			_acc = _mm_add_epi32(_acc, _mm_shuffle_epi32(_acc, 0x4e));
+			_acc = _mm_add_epi32(_acc, _mm_shuffle_epi32(_acc, 0xb1));
+			return _hash + (uint32)_mm_cvtsi128_si32(_acc);
+		}
+	}
+	//----------------------------------------------------------------------------//
+	uint32 String::Hash(const char* _str, uint _length, uint32 _hash)
 	{
-		if (_str) while (*_str)
+		if (_length >= 32 && (s_cpuFeatures & CPU_SSE41))
+		{
+			_hash = _HashBlocks16<false>(_hash, _str, _length >> 4);
+			_str += _length & ~15u;
+			_length &= 15;
+		}
+
+		const char* _end = _str + (_length & ~7u);
+		for (; _str < _end; _str += 8)
+			_hash = _HashBlock8(_hash, _str);
+		for (_end += _length & 7; _str < _end;)
 			_hash = *_str++ + (_hash << 6) + (_hash << 16) - _hash;
 		return _hash;
 	}
 	//----------------------------------------------------------------------------//
-	uint32 String::Hashi(const char* _str, uint32 _hash)
+	uint32 String::Hashi(const char* _str, uint _length, uint32 _hash)
 	{
-		if (_str) while (*_str)
+		if (_length >= 32 && (s_cpuFeatures & CPU_SSE41))
+		{
+			_hash = _HashBlocks16<true>(_hash, _str, _length >> 4);
+			_str += _length & ~15u;
+			_length &= 15;
+		}
+
+		const char* _end = _str + (_length & ~7u);
+		for (; _str < _end; _str += 8)
+		{
+			uint64 _x;
+			char _s[8];
+			memcpy(&_x, _str, 8);
+			_x = _ToLower8(_x);
+			memcpy(_s, &_x, 8);
+			_hash = _HashBlock8(_hash, _s);
+		}
+		for (_end += _length & 7; _str < _end;)
 			_hash = ToLower(*_str++) + (_hash << 6) + (_hash << 16) - _hash;
 		return _hash;
 	}
@@ -337,8 +485,9 @@ namespace Engine
 		_b = _b ? _b : "";
 		if (_ignoreCase)
 		{
-			while (*_a && ToLower(*_a++) == ToLower(*_b++));
-			return *_a - *_b;
+			while (*_a && ToLower(*_a) == ToLower(*_b))
+				++_a, ++_b;
+			return ToLower(*_a) - ToLower(*_b);
 		}
 		return strcmp(_a, _b);
 	}
@@ -666,39 +815,243 @@ namespace Engine
 	//----------------------------------------------------------------------------//
 
 	//----------------------------------------------------------------------------//
-	// Name
+	// NameTable
 	//----------------------------------------------------------------------------//
 
-	const Name::Item Name::s_empty("");
-	HashMap<uint, const Name::Item*> Name::s_names = { { 0, &s_empty } };
-	int Name::s_mutex;
+	/// Table of interned names. Names are distributed between shards by hash.
+	/// Shard is an open-addressed array of pointers to items. Search is lock-free, insertion locks only one shard.
+	/// Items and their strings are placed in append-only pages of shard and are never deleted.
+	class NameTable : public NonCopyable
+	{
+	public:
+		typedef Name::Item Item;
+
+		enum : uint
+		{
+			SHARD_BITS = 5,
+			NUM_SHARDS = 1 << SHARD_BITS,
+			MIN_SLOTS = 16, //!< Initial number of slots in shard. Must be power of two.
+			MIN_PAGE_SIZE = 512, //!< Size of first page of shard. Size of each next page is doubled.
+			MAX_PAGE_SIZE = 16 * 1024,
+		};
+
+		static NameTable& Get(void)
+		{
+			static NameTable _table; // created on first use, so names can be used in static initializers
+			return _table;
+		}
+
+		const Item* Add(const char* _str, uint _length, uint32 _hash);
+		uint GetCount(void);
+		size_t GetMemoryUse(void);
+
+	protected:
+		struct Slots
+		{
+			uint mask; //!< Number of slots minus one.
+			Slots* prev; //!< Replaced array. It can be still used by readers, so it is never deleted.
+			Atomic<const Item*> items[1];
+		};
+
+		struct Shard
+		{
+			SpinLock lock; //!< Only for writers.
+			Atomic<Slots*> slots;
+			uint count = 0;
+			uint8* page = nullptr;
+			uint pageSize = 0;
+			uint pageUsed = 0;
+			size_t memory = 0; //!< Number of allocated bytes.
+		};
+
+		/// Mix bits of hash for uniform distribution between shards and slots.
+		static uint32 _Mix(uint32 _hash)
+		{
+			_hash = (_hash ^ (_hash >> 16)) * 0x85ebca6b;
+			_hash = (_hash ^ (_hash >> 13)) * 0xc2b2ae35;
+			return _hash ^ (_hash >> 16);
+		}
+		static const Item* _Find(Slots* _slots, const char* _str, uint _length, uint32 _hash);
+		static Slots* _Grow(Shard& _shard);
+		static const Item* _NewItem(Shard& _shard, const char* _str, uint _length, uint32 _hash);
+
+		Shard m_shards[NUM_SHARDS];
+	};
 
 	//----------------------------------------------------------------------------//
-	const Name::Item* Name::_AddItem(const String& _name)
+	const Name::Item* NameTable::Add(const char* _str, uint _length, uint32 _hash)
 	{
-		if (_name.IsEmpty())
-			return nullptr;
+		Shard& _shard = m_shards[_Mix(_hash) & (NUM_SHARDS - 1)];
+
+		Slots* _slots = _shard.slots;
+		const Item* _item = _slots ? _Find(_slots, _str, _length, _hash) : nullptr;
+		if (_item)
+			return _item;
 
-		uint _hash = _name.Hash(_name);
+		SCOPE_LOCK(_shard.lock);
 
-		AtomicLock(s_mutex);
+		// the name can be added by other thread
+		_slots = _shard.slots;
+		_item = _slots ? _Find(_slots, _str, _length, _hash) : nullptr;
+		if (_item)
+			return _item;
 
-		auto _it = s_names.find(_hash);
-		if (_it != s_names.end())
+		if (!_slots || (_shard.count + 1) * 2 > _slots->mask + 1) // load factor is 0.5 at most
+			_slots = _Grow(_shard);
+
+		_item = _NewItem(_shard, _str, _length, _hash);
+		uint _index = _Mix(_hash) >> SHARD_BITS;
+		while (_slots->items[_index & _slots->mask])
+			++_index;
+		_slots->items[_index & _slots->mask] = _item; // publish constructed item
+		++_shard.count;
+
+		return _item;
+	}
+	//----------------------------------------------------------------------------//
+	uint NameTable::GetCount(void)
+	{
+		uint _count = 0;
+		for (uint i = 0; i < NUM_SHARDS; ++i)
+		{
+			SCOPE_LOCK(m_shards[i].lock);
+			_count += m_shards[i].count;
+		}
+		return _count;
+	}
+	//----------------------------------------------------------------------------//
+	size_t NameTable::GetMemoryUse(void)
+	{
+		size_t _memory = sizeof(*this);
+		for (uint i = 0; i < NUM_SHARDS; ++i)
 		{
-			AtomicUnlock(s_mutex);
-			return _it->second;
+			SCOPE_LOCK(m_shards[i].lock);
+			_memory += m_shards[i].memory;
 		}
+		return _memory;
+	}
+	//----------------------------------------------------------------------------//
+	const Name::Item* NameTable::_Find(Slots* _slots, const char* _str, uint _length, uint32 _hash)
+	{
+		for (uint _index = _Mix(_hash) >> SHARD_BITS;; ++_index)
+		{
+			const Item* _item = _slots->items[_index & _slots->mask];
+			if (!_item)
+				return nullptr;
 
-		Item* _item = new Item(_name);
-		s_names[_hash] = _item;
+			if (_item->hash.hash == _hash && _item->name.Length() == _length)
+			{
+				const char* _name = _item->name;
+				if (!memcmp(_name, _str, _length)) // same spelling is most common case
+					return _item;
+
+				uint i = 0;
+				while (i < _length && String::ToLower(_name[i]) == String::ToLower(_str[i]))
+					++i;
+				if (i == _length)
+					return _item;
+			}
+		}
+	}
+	//----------------------------------------------------------------------------//
+	NameTable::Slots* NameTable::_Grow(Shard& _shard)
+	{
+		Slots* _old = _shard.slots;
+		uint _size = _old ? (_old->mask + 1) << 1 : MIN_SLOTS;
+		size_t _bytes = sizeof(Slots) + (_size - 1) * sizeof(Atomic<const Item*>);
+
+		Slots* _slots = reinterpret_cast<Slots*>(new uint8[_bytes]);
+		_slots->mask = _size - 1;
+		_slots->prev = _old;
+		for (uint i = 0; i < _size; ++i)
+			new(_slots->items + i) Atomic<const Item*>(nullptr);
+
+		if (_old)
+		{
+			for (uint i = 0; i <= _old->mask; ++i)
+			{
+				const Item* _item = _old->items[i];
+				if (_item)
+				{
+					uint _index = _Mix(_item->hash) >> SHARD_BITS;
+					while (_slots->items[_index & _slots->mask])
+						++_index;
+					_slots->items[_index & _slots->mask] = _item;
+				}
+			}
+		}
+
+		_shard.memory += _bytes;
+		_shard.slots = _slots;
+
+		return _slots;
+	}
+	//----------------------------------------------------------------------------//
+	const Name::Item* NameTable::_NewItem(Shard& _shard, const char* _str, uint _length, uint32 _hash)
+	{
+		// item and buffer of string are placed together
+		uint _size = (uint)(sizeof(Item) + sizeof(String::Buffer) + _length + sizeof(void*) - 1) & ~(uint)(sizeof(void*) - 1);
+
+		uint8* _mem;
+		if (_size > MAX_PAGE_SIZE / 4)
+		{
+			_mem = new uint8[_size];
+			_shard.memory += _size;
+		}
+		else
+		{
+			if (_shard.pageUsed + _size > _shard.pageSize)
+			{
+				_shard.pageSize = _shard.pageSize ? _shard.pageSize << 1 : MIN_PAGE_SIZE;
+				if (_shard.pageSize > MAX_PAGE_SIZE)
+					_shard.pageSize = MAX_PAGE_SIZE;
+				_shard.page = new uint8[_shard.pageSize];
+				_shard.pageUsed = 0;
+				_shard.memory += _shard.pageSize;
+			}
+			_mem = _shard.page + _shard.pageUsed;
+			_shard.pageUsed += _size;
+		}
+
+		String::Buffer* _buffer = new(_mem + sizeof(Item)) String::Buffer(_length, _length);
+		memcpy(_buffer->str, _str, _length);
 
-		AtomicUnlock(s_mutex);
+		Item* _item = new(_mem) Item(String::Empty);
+		String::_Release(_item->name.m_buffer);
+		_item->name.m_buffer = _buffer; // the item owns one reference forever, so the buffer is never deleted
+		_item->hash = _hash;
 
 		return _item;
 	}
 	//----------------------------------------------------------------------------//
 
+	//----------------------------------------------------------------------------//
+	// Name
+	//----------------------------------------------------------------------------//
+
+	const Name::Item Name::s_empty("");
+
+	//----------------------------------------------------------------------------//
+	const Name::Item* Name::_AddItem(const char* _str, int _length)
+	{
+		uint _len = _str ? (_length < 0 ? (uint)strlen(_str) : (uint)_length) : 0;
+		if (!_len)
+			return &s_empty;
+
+		return NameTable::Get().Add(_str, _len, String::Hashi(_str, _len, 0));
+	}
+	//----------------------------------------------------------------------------//
+	uint Name::GetCount(void)
+	{
+		return NameTable::Get().GetCount();
+	}
+	//----------------------------------------------------------------------------//
+	size_t Name::GetMemoryUse(void)
+	{
+		return NameTable::Get().GetMemoryUse();
+	}
+	//----------------------------------------------------------------------------//
+
 	//----------------------------------------------------------------------------//
 	// CharStream
 	//----------------------------------------------------------------------------//
@@ -788,6 +1141,180 @@ namespace Engine
 		0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d
 	};
 
+	namespace
+	{
+		/// Tables for slice-by-8. Crc32Tables::t[0] is Crc32Table, t[n] is CRC of byte followed by n zeros.
+		struct Crc32Tables
+		{
+			Crc32Tables(void)
+			{
+				for (uint i = 0; i < 256; ++i)
+				{
+					t[0][i] = Crc32Table[i];
+					for (uint j = 1; j < 8; ++j)
+						t[j][i] = (t[j - 1][i] >> 8) ^ Crc32Table[t[j - 1][i] & 0xff];
+				}
+			}
+
+			uint32 t[8][256];
+		};
+
+		const Crc32Tables& _GetCrc32Tables(void)
+		{
+			static const Crc32Tables _tables;
+			return _tables;
+		}
+
+		uint32 _Crc32Slice8(uint32 _crc, const uint8* _p, size_t _size)
+		{
+			const uint32(*t)[256] = _GetCrc32Tables().t;
+			for (; _size >= 8; _size -= 8, _p += 8)
+			{
+				uint32 _a, _b;
+				memcpy(&_a, _p, 4);
+				memcpy(&_b, _p + 4, 4);
+				_a ^= _crc;
+				_crc =
+					t[7][_a & 0xff] ^ t[6][(_a >> 8) & 0xff] ^ t[5][(_a >> 16) & 0xff] ^ t[4][_a >> 24] ^
+					t[3][_b & 0xff] ^ t[2][(_b >> 8) & 0xff] ^ t[1][(_b >> 16) & 0xff] ^ t[0][_b >> 24];
+			}
+			while (_size--)
+				_crc = t[0][(_crc ^ *_p++) & 0xff] ^ (_crc >> 8);
+			return _crc;
+		}
+
+		/// Folding with carry-less multiplication. See "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction" (Intel, 2009).
+		/// _size must be multiple of 16 and at least 64. _crc is inverted.
+		TARGET_PCLMUL uint32 _Crc32Clmul(uint32 _crc, const uint8* _p, size_t _size)
+		{
+			// constants for the reflected polynomial 0xedb88320
+			alignas(16) static const uint64 _k1k2[] = { 0x0154442bd4ull, 0x01c6e41596ull };
+			alignas(16) static const uint64 _k3k4[] = { 0x01751997d0ull, 0x00ccaa009eull };
+			alignas(16) static const uint64 _k5k0[] = { 0x0163cd6124ull, 0x0000000000ull };
+			alignas(16) static const uint64 _poly[] = { 0x01db710641ull, 0x01f7011641ull };
+
+			__m128i _x0, _x1, _x2, _x3, _x4, _x5, _x6, _x7, _x8;
+
+			_x1 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(_p + 0x00)), _mm_cvtsi32_si128(_crc));
+			_x2 = _mm_loadu_si128((const __m128i*)(_p + 0x10));
+			_x3 = _mm_loadu_si128((const __m128i*)(_p + 0x20));
+			_x4 = _mm_loadu_si128((const __m128i*)(_p + 0x30));
+			_p += 64;
+			_size -= 64;
+
+			// fold 4 x 128 bits in parallel
+			_x0 = _mm_load_si128((const __m128i*)_k1k2);
+			for (; _size >= 64; _size -= 64, _p += 64)
+			{
+				_x5 = _mm_clmulepi64_si128(_x1, _x0, 0x00);
+				_x6 = _mm_clmulepi64_si128(_x2, _x0, 0x00);
+				_x7 = _mm_clmulepi64_si128(_x3, _x0, 0x00);
+				_x8 = _mm_clmulepi64_si128(_x4, _x0, 0x00);
+				_x1 = _mm_clmulepi64_si128(_x1, _x0, 0x11);
+				_x2 = _mm_clmulepi64_si128(_x2, _x0, 0x11);
+				_x3 = _mm_clmulepi64_si128(_x3, _x0, 0x11);
+				_x4 = _mm_clmulepi64_si128(_x4, _x0, 0x11);
+				_x1 = _mm_xor_si128(_mm_xor_si128(_x1, _x5), _mm_loadu_si128((const __m128i*)(_p + 0x00)));
+				_x2 = _mm_xor_si128(_mm_xor_si128(_x2, _x6), _mm_loadu_si128((const __m128i*)(_p + 0x10)));
+				_x3 = _mm_xor_si128(_mm_xor_si128(_x3, _x7), _mm_loadu_si128((const __m128i*)(_p + 0x20)));
+				_x4 = _mm_xor_si128(_mm_xor_si128(_x4, _x8), _mm_loadu_si128((const __m128i*)(_p + 0x30)));
+			}
+
+			// fold into 128 bits
+			_x0 = _mm_load_si128((const __m128i*)_k3k4);
+			_x5 = _mm_clmulepi64_si128(_x1, _x0, 0x00);
+			_x1 = _mm_clmulepi64_si128(_x1, _x0, 0x11);
+			_x1 = _mm_xor_si128(_mm_xor_si128(_x1, _x2), _x5);
+			_x5 = _mm_clmulepi64_si128(_x1, _x0, 0x00);
+			_x1 = _mm_clmulepi64_si128(_x1, _x0, 0x11);
+			_x1 = _mm_xor_si128(_mm_xor_si128(_x1, _x3), _x5);
+			_x5 = _mm_clmulepi64_si128(_x1, _x0, 0x00);
+			_x1 = _mm_clmulepi64_si128(_x1, _x0, 0x11);
+			_x1 = _mm_xor_si128(_mm_xor_si128(_x1, _x4), _x5);
+
+			for (; _size >= 16; _size -= 16, _p += 16)
+			{
+				_x5 = _mm_clmulepi64_si128(_x1, _x0, 0x00);
+				_x1 = _mm_clmulepi64_si128(_x1, _x0, 0x11);
+				_x1 = _mm_xor_si128(_mm_xor_si128(_x1, _mm_loadu_si128((const __m128i*)_p)), _x5);
+			}
+
+			// fold 128 bits to 64 bits
+			_x2 = _mm_clmulepi64_si128(_x1, _x0, 0x10);
+			_x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+			_x1 = _mm_xor_si128(_mm_srli_si128(_x1, 8), _x2);
+			_x0 = _mm_loadl_epi64((const __m128i*)_k5k0);
+			_x2 = _mm_srli_si128(_x1, 4);
+			_x1 = _mm_clmulepi64_si128(_mm_and_si128(_x1, _x3), _x0, 0x00);
+			_x1 = _mm_xor_si128(_x1, _x2);
+
+			// Barrett reduction to 32 bits
+			_x0 = _mm_load_si128((const __m128i*)_poly);
+			_x2 = _mm_clmulepi64_si128(_mm_and_si128(_x1, _x3), _x0, 0x10);
+			_x2 = _mm_clmulepi64_si128(_mm_and_si128(_x2, _x3), _x0, 0x00);
+			_x1 = _mm_xor_si128(_x1, _x2);
+
+			return (uint32)_mm_extract_epi32(_x1, 1);
+		}
+	}
+
+	//----------------------------------------------------------------------------//
+	uint32 Crc32(uint32 _crc, const void* _buf, uint _size)
+	{
+		ASSERT((_buf && _size) || !_size);
+		const uint8* p = (const uint8*)_buf;
+		_crc = _crc ^ ~0u;
+		if (_size >= 256 && (s_cpuFeatures & (CPU_PCLMUL | CPU_SSE41)) == (CPU_PCLMUL | CPU_SSE41))
+		{
+			uint _blocks = _size & ~15u;
+			_crc = _Crc32Clmul(_crc, p, _blocks);
+			p += _blocks;
+			_size -= _blocks;
+		}
+		_crc = _Crc32Slice8(_crc, p, _size);
+		return _crc ^ ~0u;
+	}
+	//----------------------------------------------------------------------------//
+	uint64 Hash64(const void* _data, size_t _size, uint64 _seed)
+	{
+		// MurmurHash64A by Austin Appleby (public domain)
+		const uint64 _m = 0xc6a4a7935bd1e995ull;
+		const int _r = 47;
+
+		const uint8* p = (const uint8*)_data;
+		const uint8* _end = p + (_size & ~(size_t)7);
+		uint64 _h = _seed ^ (_size * _m);
+
+		for (; p < _end; p += 8)
+		{
+			uint64 _k;
+			memcpy(&_k, p, 8);
+			_k *= _m;
+			_k ^= _k >> _r;
+			_k *= _m;
+			_h ^= _k;
+			_h *= _m;
+		}
+
+		switch (_size & 7)
+		{
+		case 7: _h ^= (uint64)p[6] << 48;
+		case 6: _h ^= (uint64)p[5] << 40;
+		case 5: _h ^= (uint64)p[4] << 32;
+		case 4: _h ^= (uint64)p[3] << 24;
+		case 3: _h ^= (uint64)p[2] << 16;
+		case 2: _h ^= (uint64)p[1] << 8;
+		case 1: _h ^= (uint64)p[0];
+			_h *= _m;
+		};
+
+		_h ^= _h >> _r;
+		_h *= _m;
+		_h ^= _h >> _r;
+		return _h;
+	}
+	//----------------------------------------------------------------------------//
+
 	//----------------------------------------------------------------------------//
 	// ConfigParser
 	//----------------------------------------------------------------------------//
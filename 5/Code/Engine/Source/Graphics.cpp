@@ -57,21 +57,311 @@ namespace Engine
 	}
 	//----------------------------------------------------------------------------//
 
+	//----------------------------------------------------------------------------//
+	// DeferredRenderContext
+	//----------------------------------------------------------------------------//
+
+	enum RenderCommandType : uint16
+	{
+		RCT_SetVertexFormat,
+		RCT_SetVertexBuffer,
+		RCT_SetIndexBuffer,
+		RCT_SetPrimitiveType,
+		RCT_Draw,
+		RCT_DrawIndexed,
+		RCT_DrawIndirect,
+		RCT_DrawIndexedIndirect,
+	};
+
+	struct RenderCommand
+	{
+		uint16 type;
+		uint16 size; //!< aligned size of command with header
+	};
+
+	struct RC_SetVertexFormat : RenderCommand
+	{
+		VertexFormat* format;
+	};
+
+	struct RC_SetVertexBuffer : RenderCommand
+	{
+		uint slot;
+		HardwareBuffer* buffer;
+		uint offset;
+		uint stride;
+	};
+
+	struct RC_SetIndexBuffer : RenderCommand
+	{
+		IndexFormat format;
+		HardwareBuffer* buffer;
+		uint offset;
+	};
+
+	struct RC_SetPrimitiveType : RenderCommand
+	{
+		PrimitiveType primitiveType;
+	};
+
+	struct RC_Draw : RenderCommand
+	{
+		uint numVertices;
+		uint numInstances;
+		uint firstVertex;
+		uint baseInstance;
+	};
+
+	struct RC_DrawIndexed : RenderCommand
+	{
+		uint numIndices;
+		uint numInstances;
+		uint firstIndex;
+		int baseVertex;
+		uint baseInstance;
+	};
+
+	struct RC_DrawIndirect : RenderCommand
+	{
+		uint offset;
+		HardwareBuffer* buffer;
+	};
+
+	//----------------------------------------------------------------------------//
+	DeferredRenderContext::DeferredRenderContext(void) :
+		RenderContext(true),
+		m_data(nullptr),
+		m_size(0),
+		m_capacity(0),
+		m_numCommands(0),
+		m_validState(0)
+	{
+	}
+	//----------------------------------------------------------------------------//
+	DeferredRenderContext::~DeferredRenderContext(void)
+	{
+		free(m_data);
+	}
+	//----------------------------------------------------------------------------//
+	template <class T> T* DeferredRenderContext::_Add(uint _type)
+	{
+		const uint _size = (sizeof(T) + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+		if (m_size + _size > m_capacity)
+			_Grow(_size);
+
+		T* _cmd = reinterpret_cast<T*>(m_data + m_size);
+		_cmd->type = (uint16)_type;
+		_cmd->size = (uint16)_size;
+		m_size += _size;
+		++m_numCommands;
+		return _cmd;
+	}
+	//----------------------------------------------------------------------------//
+	void DeferredRenderContext::_Grow(uint _size)
+	{
+		uint _newCapacity = m_capacity ? m_capacity << 1 : 64 * 1024;
+		while (_newCapacity < m_size + _size)
+			_newCapacity <<= 1;
+
+		m_data = (uint8*)realloc(m_data, _newCapacity);
+		m_capacity = _newCapacity;
+	}
+	//----------------------------------------------------------------------------//
+	void DeferredRenderContext::BeginCommands(void)
+	{
+		m_size = 0;
+		m_numCommands = 0;
+		m_validState = 0;
+	}
+	//----------------------------------------------------------------------------//
+	void DeferredRenderContext::EndCommands(void)
+	{
+	}
+	//----------------------------------------------------------------------------//
+	void DeferredRenderContext::SetVertexFormat(VertexFormat* _format)
+	{
+		if ((m_validState & SF_VertexFormat) && m_vertexFormat == _format)
+			return;
+
+		m_validState |= SF_VertexFormat;
+		m_vertexFormat = _format;
+		_Add<RC_SetVertexFormat>(RCT_SetVertexFormat)->format = _format;
+	}
+	//----------------------------------------------------------------------------//
+	void DeferredRenderContext::SetVertexBuffer(uint _slot, HardwareBuffer* _buffer, uint _offset, uint _stride)
+	{
+		ASSERT(_slot < MAX_VERTEX_STREAMS);
+
+		uint _flag = SF_VertexBuffer << _slot;
+		VertexStream& _stream = m_vertexStreams[_slot];
+		if ((m_validState & _flag) && _stream.buffer == _buffer && _stream.offset == _offset && _stream.stride == _stride)
+			return;
+
+		m_validState |= _flag;
+		_stream.buffer = _buffer;
+		_stream.offset = _offset;
+		_stream.stride = _stride;
+
+		RC_SetVertexBuffer* _cmd = _Add<RC_SetVertexBuffer>(RCT_SetVertexBuffer);
+		_cmd->slot = _slot;
+		_cmd->buffer = _buffer;
+		_cmd->offset = _offset;
+		_cmd->stride = _stride;
+	}
+	//----------------------------------------------------------------------------//
+	void DeferredRenderContext::SetIndexBuffer(HardwareBuffer* _buffer, IndexFormat _format, uint _offset)
+	{
+		if ((m_validState & SF_IndexBuffer) && m_indexBuffer == _buffer && m_indexFormat == _format && m_indexOffset == _offset)
+			return;
+
+		m_validState |= SF_IndexBuffer;
+		m_indexBuffer = _buffer;
+		m_indexFormat = _format;
+		m_indexOffset = _offset;
+
+		RC_SetIndexBuffer* _cmd = _Add<RC_SetIndexBuffer>(RCT_SetIndexBuffer);
+		_cmd->format = _format;
+		_cmd->buffer = _buffer;
+		_cmd->offset = _offset;
+	}
+	//----------------------------------------------------------------------------//
+	void DeferredRenderContext::SetPrimitiveType(PrimitiveType _type)
+	{
+		if ((m_validState & SF_PrimitiveType) && m_primitiveType == _type)
+			return;
+
+		m_validState |= SF_PrimitiveType;
+		m_primitiveType = _type;
+		_Add<RC_SetPrimitiveType>(RCT_SetPrimitiveType)->primitiveType = _type;
+	}
+	//----------------------------------------------------------------------------//
+	void DeferredRenderContext::Draw(uint _numVertices, uint _numInstances, uint _firstVertex, uint _baseInstance)
+	{
+		RC_Draw* _cmd = _Add<RC_Draw>(RCT_Draw);
+		_cmd->numVertices = _numVertices;
+		_cmd->numInstances = _numInstances;
+		_cmd->firstVertex = _firstVertex;
+		_cmd->baseInstance = _baseInstance;
+	}
+	//----------------------------------------------------------------------------//
+	void DeferredRenderContext::DrawIndexed(uint _numIndices, uint _numInstances, uint _firstIndex, int _baseVertex, uint _baseInstance)
+	{
+		RC_DrawIndexed* _cmd = _Add<RC_DrawIndexed>(RCT_DrawIndexed);
+		_cmd->numIndices = _numIndices;
+		_cmd->numInstances = _numInstances;
+		_cmd->firstIndex = _firstIndex;
+		_cmd->baseVertex = _baseVertex;
+		_cmd->baseInstance = _baseInstance;
+	}
+	//----------------------------------------------------------------------------//
+	void DeferredRenderContext::DrawIndirect(HardwareBuffer* _buffer, uint _offset)
+	{
+		RC_DrawIndirect* _cmd = _Add<RC_DrawIndirect>(RCT_DrawIndirect);
+		_cmd->buffer = _buffer;
+		_cmd->offset = _offset;
+	}
+	//----------------------------------------------------------------------------//
+	void DeferredRenderContext::DrawIndexedIndirect(HardwareBuffer* _buffer, uint _offset)
+	{
+		RC_DrawIndirect* _cmd = _Add<RC_DrawIndirect>(RCT_DrawIndexedIndirect);
+		_cmd->buffer = _buffer;
+		_cmd->offset = _offset;
+	}
+	//----------------------------------------------------------------------------//
+	void DeferredRenderContext::Execute(RenderContext* _dst)
+	{
+		ASSERT(_dst != nullptr);
+		ASSERT(_dst != this);
+
+		for (const uint8 *_ptr = m_data, *_end = m_data + m_size; _ptr < _end;)
+		{
+			const RenderCommand* _cmd = reinterpret_cast<const RenderCommand*>(_ptr);
+			_ptr += _cmd->size;
+
+			switch (_cmd->type)
+			{
+			case RCT_SetVertexFormat:
+			{
+				const RC_SetVertexFormat* _c = static_cast<const RC_SetVertexFormat*>(_cmd);
+				_dst->SetVertexFormat(_c->format);
+			} break;
+
+			case RCT_SetVertexBuffer:
+			{
+				const RC_SetVertexBuffer* _c = static_cast<const RC_SetVertexBuffer*>(_cmd);
+				_dst->SetVertexBuffer(_c->slot, _c->buffer, _c->offset, _c->stride);
+			} break;
+
+			case RCT_SetIndexBuffer:
+			{
+				const RC_SetIndexBuffer* _c = static_cast<const RC_SetIndexBuffer*>(_cmd);
+				_dst->SetIndexBuffer(_c->buffer, _c->format, _c->offset);
+			} break;
+
+			case RCT_SetPrimitiveType:
+			{
+				const RC_SetPrimitiveType* _c = static_cast<const RC_SetPrimitiveType*>(_cmd);
+				_dst->SetPrimitiveType(_c->primitiveType);
+			} break;
+
+			case RCT_Draw:
+			{
+				const RC_Draw* _c = static_cast<const RC_Draw*>(_cmd);
+				_dst->Draw(_c->numVertices, _c->numInstances, _c->firstVertex, _c->baseInstance);
+			} break;
+
+			case RCT_DrawIndexed:
+			{
+				const RC_DrawIndexed* _c = static_cast<const RC_DrawIndexed*>(_cmd);
+				_dst->DrawIndexed(_c->numIndices, _c->numInstances, _c->firstIndex, _c->baseVertex, _c->baseInstance);
+			} break;
+
+			case RCT_DrawIndirect:
+			{
+				const RC_DrawIndirect* _c = static_cast<const RC_DrawIndirect*>(_cmd);
+				_dst->DrawIndirect(_c->buffer, _c->offset);
+			} break;
+
+			case RCT_DrawIndexedIndirect:
+			{
+				const RC_DrawIndirect* _c = static_cast<const RC_DrawIndirect*>(_cmd);
+				_dst->DrawIndexedIndirect(_c->buffer, _c->offset);
+			} break;
+
+			default:
+				ASSERT(false, "Unknown render command");
+				return;
+			}
+		}
+	}
+	//----------------------------------------------------------------------------//
+
 	//----------------------------------------------------------------------------//
 	// RenderSystem
 	//----------------------------------------------------------------------------//
 
+	void _CreateNullRenderSystem(void); // in GraphicsNull.cpp
 	void _CreateD3D11RenderSystem(void); // in D3D11RenderSystem.cpp
 
 	//----------------------------------------------------------------------------//
-	bool RenderSystem::Create(void)
+	bool RenderSystem::Create(RenderSystemType _type)
 	{
 		if (s_instance)
 			return true;
 
 		LOG_EVENT("Create RenderSystem");
 
-		_CreateD3D11RenderSystem();
+		switch (_type)
+		{
+		case RST_Null:
+			_CreateNullRenderSystem();
+			break;
+
+		default:
+			_CreateD3D11RenderSystem();
+			break;
+		}
+
 		if (s_instance->_Init())
 			return true;
 
@@ -103,7 +393,7 @@ namespace Engine
 	//----------------------------------------------------------------------------//
 	bool RenderSystem::_Init(void)
 	{
-		if (SDL_Init(SDL_INIT_VIDEO))
+		if (m_features.type != RST_Null && SDL_Init(SDL_INIT_VIDEO))
 		{
 			LOG_ERROR("Couldn't initialize SDL video : %s", SDL_GetError());
 			return false;
@@ -135,7 +425,34 @@ namespace Engine
 	//----------------------------------------------------------------------------//
 	void RenderSystem::EndFrame(void)
 	{
+		FlushCommands();
+	}
+	//----------------------------------------------------------------------------//
+	void RenderSystem::Submit(DeferredRenderContext* _commands, uint _order)
+	{
+		ASSERT(_commands != nullptr);
+
+		SCOPE_LOCK(m_submitLock);
+		m_submitted.push_back({ _order, _commands });
+	}
+	//----------------------------------------------------------------------------//
+	void RenderSystem::FlushCommands(void)
+	{
+		{
+			SCOPE_LOCK(m_submitLock);
+			m_executing.swap(m_submitted);
+		}
+
+		// threads submit lists in random order, sorting makes result independent of it
+		std::sort(m_executing.begin(), m_executing.end());
+
+		for (size_t i = 0; i < m_executing.size(); ++i)
+		{
+			ASSERT(i == 0 || m_executing[i - 1].order != m_executing[i].order, "Order of submitted commands should be unique");
+			m_executing[i].commands->Execute(this);
+		}
 
+		m_executing.clear();
 	}
 	//----------------------------------------------------------------------------//
 
@@ -0,0 +1,196 @@
+#include "../Graphics.hpp"
+
+namespace Engine
+{
+	//----------------------------------------------------------------------------//
+	// NullBuffer
+	//----------------------------------------------------------------------------//
+
+	class NullBuffer final : public HardwareBuffer
+	{
+	public:
+		NullBuffer(HardwareBufferType _type, HardwareBufferUsage _usage, uint _size, uint _elementSize, const void* _data) :
+			HardwareBuffer(_type, _usage, _size, _elementSize),
+			m_data(_size),
+			m_mapMode(MM_None)
+		{
+			if (_data && _size)
+				memcpy(&m_data[0], _data, _size);
+		}
+
+		uint8* Map(MappingMode _mode, uint _offset, uint _size) override
+		{
+			if (_mode == MM_None || m_mapMode != MM_None)
+				return nullptr;
+
+			if (_size == 0 || _offset + _size > m_size)
+				return nullptr;
+
+			m_mapMode = _mode;
+			return &m_data[_offset];
+		}
+
+		void Unmap(void) override
+		{
+			m_mapMode = MM_None;
+		}
+
+	protected:
+		Array<uint8> m_data;
+		MappingMode m_mapMode;
+	};
+
+	//----------------------------------------------------------------------------//
+	// NullVertexFormat
+	//----------------------------------------------------------------------------//
+
+	class NullVertexFormat final : public VertexFormat
+	{
+	public:
+		NullVertexFormat(const VertexFormatDesc& _desc) : VertexFormat(_desc) { }
+		~NullVertexFormat(void) { }
+	};
+
+	//----------------------------------------------------------------------------//
+	// NullRenderSystem
+	//----------------------------------------------------------------------------//
+
+	///\brief Render system without device. Commands are accepted and ignored, only their checksum is computed (see RenderFrameStats).
+	class NullRenderSystem final : public RenderSystem
+	{
+	public:
+		NullRenderSystem(void) :
+			m_vertexFormat(nullptr),
+			m_primitiveType(PT_Points)
+		{
+			m_features.type = RST_Null;
+			m_features.adapterName = "Null";
+		}
+
+		~NullRenderSystem(void)
+		{
+		}
+
+		VertexFormat* AddVertexFormat(const VertexFormatDesc& _desc) override
+		{
+			uint _hash = Crc32(_desc);
+
+			SCOPE_LOCK(m_mutex);
+
+			auto _exists = m_vertexFormats.find(_hash);
+			if (_exists != m_vertexFormats.end())
+				return _exists->second;
+
+			NullVertexFormat* _newFormat = new NullVertexFormat(_desc);
+			m_vertexFormats[_hash] = _newFormat;
+			return _newFormat;
+		}
+
+		HardwareBufferPtr CreateBuffer(HardwareBufferType _type, HardwareBufferUsage _usage, uint _size, uint _elementSize, const void* _data = nullptr) override
+		{
+			if (_type == HBT_Texture)
+				return nullptr;
+
+			return new NullBuffer(_type, _usage, _size, _elementSize, _data);
+		}
+
+		void BeginCommands(void) override { }
+		void EndCommands(void) override { }
+
+		void SetVertexFormat(VertexFormat* _format) override
+		{
+			m_vertexFormat = _format;
+			const size_t _args[] = { 1, (size_t)_format };
+			_AddCommand(_args);
+		}
+		void SetVertexBuffer(uint _slot, HardwareBuffer* _buffer, uint _offset, uint _stride) override
+		{
+			ASSERT(_slot < MAX_VERTEX_STREAMS);
+			const size_t _args[] = { 2, _slot, (size_t)_buffer, _offset, _stride };
+			_AddCommand(_args);
+		}
+		void SetIndexBuffer(HardwareBuffer* _buffer, IndexFormat _format, uint _offset) override
+		{
+			const size_t _args[] = { 3, (size_t)_buffer, (size_t)_format, _offset };
+			_AddCommand(_args);
+		}
+		void SetPrimitiveType(PrimitiveType _type) override
+		{
+			m_primitiveType = _type;
+			const size_t _args[] = { 4, (size_t)_type };
+			_AddCommand(_args);
+		}
+
+		void Draw(uint _numVertices, uint _numInstances, uint _firstVertex, uint _baseInstance) override
+		{
+			const size_t _args[] = { 5, _numVertices, _numInstances, _firstVertex, _baseInstance };
+			_AddCommand(_args, true);
+		}
+		void DrawIndexed(uint _numIndices, uint _numInstances, uint _firstIndex, int _baseVertex, uint _baseInstance) override
+		{
+			const size_t _args[] = { 6, _numIndices, _numInstances, _firstIndex, (size_t)_baseVertex, _baseInstance };
+			_AddCommand(_args, true);
+		}
+		void DrawIndirect(HardwareBuffer* _buffer, uint _offset) override
+		{
+			const size_t _args[] = { 7, (size_t)_buffer, _offset };
+			_AddCommand(_args, true);
+		}
+		void DrawIndexedIndirect(HardwareBuffer* _buffer, uint _offset) override
+		{
+			const size_t _args[] = { 8, (size_t)_buffer, _offset };
+			_AddCommand(_args, true);
+		}
+
+		void EndFrame(void) override
+		{
+			RenderSystem::EndFrame();
+			m_frameStats = m_stats;
+			m_stats = RenderFrameStats();
+		}
+
+	protected:
+
+		template <uint N> void _AddCommand(const size_t (&_args)[N], bool _draw = false)
+		{
+			// FNV-1a over words, cheap enough to not hide cost of replay
+			uint32 _hash = m_stats.commandsHash;
+			for (uint i = 0; i < N; ++i)
+				_hash = (_hash ^ (uint32)_args[i] ^ (uint32)((uint64)_args[i] >> 32)) * 16777619u;
+			m_stats.commandsHash = _hash;
+			m_stats.numCommands++;
+			if (_draw)
+				m_stats.numDraws++;
+		}
+
+		bool _InitDriver(void) override
+		{
+			LOG_EVENT("Initialize NullRenderSystem");
+			return true;
+		}
+
+		void _DestroyDriver(void) override
+		{
+			for (auto& _format : m_vertexFormats)
+				delete _format.second;
+			m_vertexFormats.clear();
+		}
+
+		Mutex m_mutex;
+		HashMap<uint, NullVertexFormat*> m_vertexFormats;
+		VertexFormat* m_vertexFormat;
+		PrimitiveType m_primitiveType;
+		RenderFrameStats m_stats; //!< Statistics of current frame.
+	};
+
+	//----------------------------------------------------------------------------//
+	void _CreateNullRenderSystem(void)
+	{
+		new NullRenderSystem;
+	}
+	//----------------------------------------------------------------------------//
+
+	//----------------------------------------------------------------------------//
+	//
+	//----------------------------------------------------------------------------//
+}
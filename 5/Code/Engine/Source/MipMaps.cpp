@@ -0,0 +1,583 @@
+#include "../MipMaps.hpp"
+#include "../Thread.hpp"
+#include <math.h>
+#include <emmintrin.h>
+
+namespace Engine
+{
+	//----------------------------------------------------------------------------//
+	// Defs
+	//----------------------------------------------------------------------------//
+
+	namespace
+	{
+		enum : uint
+		{
+			ROWS_PER_TASK = 8,
+			COVERAGE_ITERATIONS = 16,
+		};
+
+		//----------------------------------------------------------------------------//
+		// Conversion
+		//----------------------------------------------------------------------------//
+
+		struct SrgbTables
+		{
+			SrgbTables(void)
+			{
+				for (uint i = 0; i < 256; ++i)
+					toLinear[i] = _ToLinear(i / 255.f);
+				for (uint i = 0; i < 255; ++i)
+					thresholds[i] = _ToLinear((i + 0.5f) / 255.f);
+			}
+
+			static float _ToLinear(float _c) { return _c <= 0.04045f ? _c / 12.92f : powf((_c + 0.055f) / 1.055f, 2.4f); }
+
+			float toLinear[256];
+			float thresholds[255]; //!< linear value between sRGB codes i and i + 1
+		};
+
+		const SrgbTables& _GetSrgbTables(void)
+		{
+			static const SrgbTables _tables;
+			return _tables;
+		}
+
+		/// Get nearest sRGB code of linear value.
+		uint8 _ToSrgb(float _c, const float* _thresholds)
+		{
+			uint _code = 0;
+			for (uint _step = 128; _step; _step >>= 1)
+			{
+				if (_code + _step <= 255 && _c >= _thresholds[_code + _step - 1])
+					_code += _step;
+			}
+			return (uint8)_code;
+		}
+
+		inline uint8 _ToUnorm8(float _c)
+		{
+			return (uint8)(Clamp(_c, 0.f, 1.f) * 255 + 0.5f);
+		}
+
+		/// Exact conversion of half to float, including zero and denormals. See "half_to_float_fast5" by F. Giesen.
+		float _HalfToFloat(uint16 _value)
+		{
+			union { uint32 u; float f; } _magic = { 113 << 23 }, _out;
+			const uint32 _exp = 0x7c00 << 13;
+			_out.u = (_value & 0x7fff) << 13;
+			uint32 _e = _out.u & _exp;
+			_out.u += (127 - 15) << 23;
+			if (_e == _exp)
+				_out.u += (128 - 16) << 23; // inf or nan
+			else if (_e == 0)
+			{
+				_out.u += 1 << 23; // zero or denormal
+				_out.f -= _magic.f;
+			}
+			_out.u |= (_value & 0x8000) << 16;
+			return _out.f;
+		}
+
+		///\brief Conversion of float to half with rounding to nearest even. See "float_to_half_fast3_rtne" by F. Giesen.
+		///\note FloatToHalf truncates mantissa, so repeated filtering would make image darker.
+		uint16 _FloatToHalf(float _value)
+		{
+			union { uint32 u; float f; } _in = { 0 }, _denormMagic = { ((127 - 15) + (23 - 10) + 1) << 23 };
+			_in.f = _value;
+			uint32 _sign = _in.u & 0x80000000u;
+			_in.u ^= _sign;
+
+			uint16 _out;
+			if (_in.u >= (127 + 16) << 23)
+				_out = _in.u > (255u << 23) ? 0x7e00 : 0x7c00; // nan or inf
+			else if (_in.u < (113 << 23))
+			{
+				_in.f += _denormMagic.f; // denormal or zero
+				_out = (uint16)(_in.u - _denormMagic.u);
+			}
+			else
+			{
+				uint32 _odd = (_in.u >> 13) & 1;
+				_in.u += ((uint32)(15 - 127) << 23) + 0xfff + _odd;
+				_out = (uint16)(_in.u >> 13);
+			}
+			return (uint16)(_out | (_sign >> 16));
+		}
+
+		/// Convert row of source image to linear floats.
+		void _ReadRow(PixelFormat _format, const uint8* _src, uint _width, const float* _toLinear, float* _dst)
+		{
+			if (_format == PF_RGBA16F)
+			{
+				const uint16* _half = reinterpret_cast<const uint16*>(_src);
+				for (uint i = 0; i < _width * 4; ++i)
+					_dst[i] = _HalfToFloat(_half[i]);
+			}
+			else if (_format == PF_R8)
+			{
+				for (uint i = 0; i < _width; ++i)
+					_dst[i] = _toLinear ? _toLinear[_src[i]] : _src[i] * (1 / 255.f);
+			}
+			else
+			{
+				for (uint i = 0; i < _width * 4; i += 4)
+				{
+					for (uint c = 0; c < 3; ++c)
+						_dst[i + c] = _toLinear ? _toLinear[_src[i + c]] : _src[i + c] * (1 / 255.f);
+					_dst[i + 3] = _src[i + 3] * (1 / 255.f);
+				}
+			}
+		}
+
+		//----------------------------------------------------------------------------//
+		// Filter
+		//----------------------------------------------------------------------------//
+
+		float _BesselI0(float _x)
+		{
+			float _sum = 1, _term = 1, _q = _x * _x * 0.25f;
+			for (uint k = 1; k < 32 && _term > _sum * 1e-8f; ++k)
+			{
+				_term *= _q / (k * k);
+				_sum += _term;
+			}
+			return _sum;
+		}
+
+		float _Sinc(float _x)
+		{
+			if (fabsf(_x) < 1e-4f)
+				return 1;
+			_x *= PI;
+			return sinf(_x) / _x;
+		}
+
+		/// Weights of source pixels for each destination pixel along one axis.
+		struct Kernel
+		{
+			uint taps;
+			Array<uint> indices; //!< source pixel of each tap
+			Array<float> weights;
+		};
+
+		///\brief Make polyphase kernel, so sizes don't have to be even.
+		/// Box takes area of source pixels covered by destination pixel, Kaiser is sampled in centers of source pixels.
+		void _MakeKernel(Kernel& _kernel, uint _srcSize, uint _dstSize, const MipMapParams& _params)
+		{
+			if (_srcSize == _dstSize)
+			{
+				_kernel.taps = 1;
+				_kernel.indices.resize(_dstSize);
+				_kernel.weights.assign(_dstSize, 1.f);
+				for (uint i = 0; i < _dstSize; ++i)
+					_kernel.indices[i] = i;
+				return;
+			}
+
+			float _scale = (float)_srcSize / _dstSize;
+			float _radius = _params.filter == MF_Box ? _scale * 0.5f : _params.kaiserWidth * _scale;
+			float _i0 = _BesselI0(_params.kaiserAlpha);
+
+			_kernel.taps = 0;
+			for (uint i = 0; i < _dstSize; ++i)
+			{
+				float _center = (i + 0.5f) * _scale;
+				int _first = (int)floorf(_center - _radius), _end = (int)ceilf(_center + _radius);
+				_kernel.taps = Max(_kernel.taps, (uint)(_end - _first));
+			}
+
+			_kernel.indices.resize(_dstSize * _kernel.taps);
+			_kernel.weights.resize(_dstSize * _kernel.taps);
+			for (uint i = 0; i < _dstSize; ++i)
+			{
+				float _center = (i + 0.5f) * _scale;
+				int _first = (int)floorf(_center - _radius);
+				uint* _indices = &_kernel.indices[i * _kernel.taps];
+				float* _weights = &_kernel.weights[i * _kernel.taps];
+
+				float _sum = 0;
+				for (uint t = 0; t < _kernel.taps; ++t)
+				{
+					int _p = _first + (int)t;
+					float _w;
+					if (_params.filter == MF_Box)
+					{
+						_w = Max(Min(_p + 1.f, _center + _radius) - Max((float)_p, _center - _radius), 0.f);
+					}
+					else
+					{
+						float _x = (_p + 0.5f - _center) / _scale; // in destination pixels
+						float _r = _x / _params.kaiserWidth;
+						_w = fabsf(_r) < 1 ? _Sinc(_x * _params.kaiserStretch) * _BesselI0(_params.kaiserAlpha * sqrtf(1 - _r * _r)) / _i0 : 0;
+					}
+					_weights[t] = _w;
+					_sum += _w;
+
+					if (_params.wrap)
+						_indices[t] = (uint)((_p % (int)_srcSize + (int)_srcSize) % (int)_srcSize);
+					else
+						_indices[t] = (uint)Clamp(_p, 0, (int)_srcSize - 1);
+				}
+				for (uint t = 0; t < _kernel.taps; ++t)
+					_weights[t] /= _sum;
+			}
+		}
+
+		//----------------------------------------------------------------------------//
+		// Tasks
+		//----------------------------------------------------------------------------//
+
+		/// Rows processed in parallel. Each thread takes ROWS_PER_TASK rows at once until all rows are taken.
+		struct RowTask
+		{
+			virtual void Run(uint _first, uint _end) = 0;
+
+			uint numRows;
+			Atomic<uint> nextRow;
+		};
+
+		void _RunRows(RowTask* _task)
+		{
+			for (uint _first; (_first = (_task->nextRow += ROWS_PER_TASK) - ROWS_PER_TASK) < _task->numRows;)
+				_task->Run(_first, Min(_first + ROWS_PER_TASK, _task->numRows));
+		}
+
+		void _ParallelRows(RowTask& _task, uint _numRows, uint _numThreads)
+		{
+			_task.numRows = _numRows;
+			_task.nextRow = 0;
+			_numThreads = Min(_numThreads, (_numRows + ROWS_PER_TASK - 1) / ROWS_PER_TASK);
+
+			Array<Thread> _threads(_numThreads > 1 ? _numThreads - 1 : 0);
+			for (Thread& _thread : _threads)
+				_thread = Thread(&_RunRows, &_task);
+			_RunRows(&_task);
+			for (Thread& _thread : _threads)
+				_thread.Wait();
+		}
+
+		/// Filter rows of source image horizontally. Source is either previous level in floats or pixels of source image.
+		struct HorizontalPass : RowTask
+		{
+			void Run(uint _first, uint _end) override
+			{
+				Array<float> _row(src ? 0 : srcWidth * channels);
+				for (uint _y = _first; _y < _end; ++_y)
+				{
+					const float* _src = _row.data();
+					if (src)
+						_src = src + (size_t)_y * srcWidth * channels;
+					else
+						_ReadRow(format, pixels + (size_t)_y * pitch, srcWidth, toLinear, _row.data());
+
+					float* _dst = dst + (size_t)_y * dstWidth * channels;
+					const uint _taps = kernel->taps;
+					const uint* _indices = kernel->indices.data();
+					const float* _weights = kernel->weights.data();
+					if (channels == 4)
+					{
+						for (uint x = 0; x < dstWidth; ++x, _indices += _taps, _weights += _taps)
+						{
+							__m128 _acc = _mm_setzero_ps();
+							for (uint t = 0; t < _taps; ++t)
+								_acc = _mm_add_ps(_acc, _mm_mul_ps(_mm_loadu_ps(_src + _indices[t] * 4), _mm_set1_ps(_weights[t])));
+							_mm_storeu_ps(_dst + x * 4, _acc);
+						}
+					}
+					else
+					{
+						for (uint x = 0; x < dstWidth; ++x, _indices += _taps, _weights += _taps)
+						{
+							float _acc = 0;
+							for (uint t = 0; t < _taps; ++t)
+								_acc += _src[_indices[t]] * _weights[t];
+							_dst[x] = _acc;
+						}
+					}
+				}
+			}
+
+			const Kernel* kernel;
+			const float* src;
+			const uint8* pixels;
+			uint pitch;
+			PixelFormat format;
+			const float* toLinear;
+			uint srcWidth;
+			uint dstWidth;
+			uint channels;
+			float* dst;
+		};
+
+		/// Filter columns of horizontally filtered rows.
+		struct VerticalPass : RowTask
+		{
+			void Run(uint _first, uint _end) override
+			{
+				const uint _taps = kernel->taps;
+				for (uint _y = _first; _y < _end; ++_y)
+				{
+					const uint* _indices = &kernel->indices[_y * _taps];
+					const float* _weights = &kernel->weights[_y * _taps];
+					float* _dst = dst + (size_t)_y * rowSize;
+
+					uint x = 0;
+					for (; x + 4 <= rowSize; x += 4)
+					{
+						__m128 _acc = _mm_setzero_ps();
+						for (uint t = 0; t < _taps; ++t)
+							_acc = _mm_add_ps(_acc, _mm_mul_ps(_mm_loadu_ps(src + (size_t)_indices[t] * rowSize + x), _mm_set1_ps(_weights[t])));
+						_mm_storeu_ps(_dst + x, _acc);
+					}
+					for (; x < rowSize; ++x)
+					{
+						float _acc = 0;
+						for (uint t = 0; t < _taps; ++t)
+							_acc += src[(size_t)_indices[t] * rowSize + x] * _weights[t];
+						_dst[x] = _acc;
+					}
+				}
+			}
+
+			const Kernel* kernel;
+			const float* src;
+			uint rowSize; //!< number of floats in row
+			float* dst;
+		};
+
+		/// Convert filtered level to pixels.
+		struct OutputPass : RowTask
+		{
+			void Run(uint _first, uint _end) override
+			{
+				for (uint _y = _first; _y < _end; ++_y)
+				{
+					const float* _src = src + (size_t)_y * width * channels;
+					if (format == PF_RGBA16F)
+					{
+						uint16* _dst = reinterpret_cast<uint16*>(dst) + (size_t)_y * width * 4;
+						for (uint i = 0; i < width * 4; i += 4)
+						{
+							_dst[i + 0] = _FloatToHalf(_src[i + 0]);
+							_dst[i + 1] = _FloatToHalf(_src[i + 1]);
+							_dst[i + 2] = _FloatToHalf(_src[i + 2]);
+							_dst[i + 3] = _FloatToHalf(alphaScale != 1 ? Min(_src[i + 3] * alphaScale, 1.f) : _src[i + 3]);
+						}
+					}
+					else if (format == PF_R8)
+					{
+						uint8* _dst = dst + (size_t)_y * width;
+						for (uint i = 0; i < width; ++i)
+							_dst[i] = thresholds ? _ToSrgb(_src[i], thresholds) : _ToUnorm8(_src[i]);
+					}
+					else
+					{
+						uint8* _dst = dst + (size_t)_y * width * 4;
+						for (uint i = 0; i < width * 4; i += 4)
+						{
+							for (uint c = 0; c < 3; ++c)
+								_dst[i + c] = thresholds ? _ToSrgb(_src[i + c], thresholds) : _ToUnorm8(_src[i + c]);
+							_dst[i + 3] = _ToUnorm8(_src[i + 3] * alphaScale);
+						}
+					}
+				}
+			}
+
+			const float* src;
+			uint width;
+			uint channels;
+			PixelFormat format;
+			const float* thresholds;
+			float alphaScale;
+			uint8* dst;
+		};
+
+		//----------------------------------------------------------------------------//
+		// Alpha coverage
+		//----------------------------------------------------------------------------//
+
+		/// Get fraction of pixels with alpha greater than reference.
+		float _AlphaCoverage(const float* _rgba, size_t _numPixels, float _ref)
+		{
+			size_t _count = 0;
+			for (size_t i = 0; i < _numPixels; ++i)
+				_count += _rgba[i * 4 + 3] > _ref;
+			return (float)_count / _numPixels;
+		}
+
+		///\brief Find scale of alpha to get given coverage of alpha test. Coverage grows with scale, so bisection of reference is used.
+		///\see "Computing Alpha Mipmaps" by I. Castano.
+		float _FindAlphaScale(const float* _rgba, size_t _numPixels, float _ref, float _coverage)
+		{
+			float _lo = 0, _hi = 1, _mid = _ref;
+			for (uint i = 0; i < COVERAGE_ITERATIONS; ++i)
+			{
+				float _current = _AlphaCoverage(_rgba, _numPixels, _mid);
+				if (_current > _coverage)
+					_lo = _mid;
+				else if (_current < _coverage)
+					_hi = _mid;
+				else
+					break;
+				_mid = (_lo + _hi) * 0.5f;
+			}
+			return _ref / Max(_mid, 1e-4f);
+		}
+	}
+
+	//----------------------------------------------------------------------------//
+	// MipMaps
+	//----------------------------------------------------------------------------//
+
+	//----------------------------------------------------------------------------//
+	uint GetNumMipLevels(uint _width, uint _height)
+	{
+		uint _levels = 1;
+		for (uint _size = Max(_width, _height); _size > 1; _size >>= 1)
+			++_levels;
+		return _levels;
+	}
+	//----------------------------------------------------------------------------//
+	bool GenerateMipMaps(PixelFormat _format, const void* _src, uint _width, uint _height, uint _srcPitch, Array<MipLevel>& _levels, const MipMapParams& _params)
+	{
+		uint _channels, _pixelSize;
+		switch (_format)
+		{
+		case PF_R8:
+			_channels = 1, _pixelSize = 1;
+			break;
+		case PF_RGBA8:
+			_channels = 4, _pixelSize = 4;
+			break;
+		case PF_RGBA16F:
+			_channels = 4, _pixelSize = 8;
+			break;
+		default:
+			return false;
+		}
+
+		if (!_width || !_height)
+		{
+			_levels.clear();
+			return true;
+		}
+
+		uint _numLevels = GetNumMipLevels(_width, _height);
+		if (_params.numLevels)
+			_numLevels = Min(_numLevels, _params.numLevels);
+		uint _numThreads = _params.numThreads ? _params.numThreads : Thread::GetNumCores();
+		bool _srgb = _params.srgb && _format != PF_RGBA16F;
+		bool _coverage = _params.alphaRef > 0 && _channels == 4;
+		const SrgbTables& _tables = _GetSrgbTables();
+
+		// level 0
+		const uint8* _pixels = reinterpret_cast<const uint8*>(_src);
+		_levels.resize(_numLevels);
+		_levels[0].width = _width;
+		_levels[0].height = _height;
+		_levels[0].data.resize((size_t)_width * _height * _pixelSize);
+		for (uint _y = 0; _y < _height; ++_y)
+			memcpy(&_levels[0].data[(size_t)_y * _width * _pixelSize], _pixels + (size_t)_y * _srcPitch, _width * _pixelSize);
+
+		float _refCoverage = 0;
+		if (_coverage)
+		{
+			Array<float> _row(_width * 4);
+			size_t _count = 0;
+			for (uint _y = 0; _y < _height; ++_y)
+			{
+				_ReadRow(_format, _pixels + (size_t)_y * _srcPitch, _width, nullptr, _row.data());
+				for (uint x = 0; x < _width; ++x)
+					_count += _row[x * 4 + 3] > _params.alphaRef;
+			}
+			_refCoverage = (float)_count / ((size_t)_width * _height);
+		}
+
+		Kernel _kernelX, _kernelY;
+		Array<float> _prev, _temp, _next;
+		for (uint _level = 1; _level < _numLevels; ++_level)
+		{
+			uint _srcWidth = _levels[_level - 1].width, _srcHeight = _levels[_level - 1].height;
+			uint _dstWidth = Max(_srcWidth >> 1, 1u), _dstHeight = Max(_srcHeight >> 1, 1u);
+			_MakeKernel(_kernelX, _srcWidth, _dstWidth, _params);
+			_MakeKernel(_kernelY, _srcHeight, _dstHeight, _params);
+
+			// first level is filtered from source pixels, others from previous level in floats
+			HorizontalPass _horizontal;
+			_horizontal.kernel = &_kernelX;
+			_horizontal.src = _level > 1 ? _prev.data() : nullptr;
+			_horizontal.pixels = _pixels;
+			_horizontal.pitch = _srcPitch;
+			_horizontal.format = _format;
+			_horizontal.toLinear = _srgb ? _tables.toLinear : nullptr;
+			_horizontal.srcWidth = _srcWidth;
+			_horizontal.dstWidth = _dstWidth;
+			_horizontal.channels = _channels;
+			_temp.resize((size_t)_dstWidth * _srcHeight * _channels);
+			_horizontal.dst = _temp.data();
+			_ParallelRows(_horizontal, _srcHeight, _numThreads);
+
+			VerticalPass _vertical;
+			_vertical.kernel = &_kernelY;
+			_vertical.src = _temp.data();
+			_vertical.rowSize = _dstWidth * _channels;
+			_next.resize((size_t)_dstWidth * _dstHeight * _channels);
+			_vertical.dst = _next.data();
+			_ParallelRows(_vertical, _dstHeight, _numThreads);
+
+			MipLevel& _dst = _levels[_level];
+			_dst.width = _dstWidth;
+			_dst.height = _dstHeight;
+			_dst.data.resize((size_t)_dstWidth * _dstHeight * _pixelSize);
+
+			OutputPass _output;
+			_output.src = _next.data();
+			_output.width = _dstWidth;
+			_output.channels = _channels;
+			_output.format = _format;
+			_output.thresholds = _srgb ? _tables.thresholds : nullptr;
+			_output.alphaScale = _coverage ? _FindAlphaScale(_next.data(), (size_t)_dstWidth * _dstHeight, _params.alphaRef, _refCoverage) : 1;
+			_output.dst = _dst.data.data();
+			_ParallelRows(_output, _dstHeight, _numThreads);
+
+			Swap(_prev, _next);
+		}
+
+		return true;
+	}
+	//----------------------------------------------------------------------------//
+	bool CompressMipMaps(PixelFormat _format, const Array<MipLevel>& _levels, PixelFormat _dstFormat, Array<uint8>& _dst, BlockCompressionQuality _quality, uint _numThreads)
+	{
+		if ((_format != PF_R8 && _format != PF_RGBA8) || !IsCompressedFormat(_dstFormat))
+			return false;
+
+		size_t _size = 0;
+		for (const MipLevel& _level : _levels)
+			_size += GetCompressedImageSize(_dstFormat, _level.width, _level.height);
+		_dst.resize(_size);
+
+		Array<uint8> _rgba;
+		uint8* _blocks = _dst.data();
+		for (const MipLevel& _level : _levels)
+		{
+			const uint8* _src = _level.data.data();
+			if (_format == PF_R8)
+			{
+				_rgba.resize(_level.data.size() * 4);
+				for (size_t i = 0; i < _level.data.size(); ++i)
+				{
+					_rgba[i * 4 + 0] = _rgba[i * 4 + 1] = _rgba[i * 4 + 2] = _src[i];
+					_rgba[i * 4 + 3] = 255;
+				}
+				_src = _rgba.data();
+			}
+
+			CompressImage(_dstFormat, _src, _level.width, _level.height, _level.width * 4, _blocks, _quality, _numThreads);
+			_blocks += GetCompressedImageSize(_dstFormat, _level.width, _level.height);
+		}
+
+		return true;
+	}
+	//----------------------------------------------------------------------------//
+}
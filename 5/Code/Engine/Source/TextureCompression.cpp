@@ -0,0 +1,849 @@
+#include "../TextureCompression.hpp"
+#include "../Thread.hpp"
+#include <math.h>
+#include <float.h>
+#include <emmintrin.h>
+
+namespace Engine
+{
+	//----------------------------------------------------------------------------//
+	// Defs
+	//----------------------------------------------------------------------------//
+
+	namespace
+	{
+		enum : uint
+		{
+			CLUSTER_FIT_ITERATIONS = 8,
+			ALPHA_REFINE_ITERATIONS = 4,
+		};
+
+		inline int _Expand5(int _c) { return (_c << 3) | (_c >> 2); }
+		inline int _Expand6(int _c) { return (_c << 2) | (_c >> 4); }
+		inline int _Quantize5(float _c) { return (int)(_c * (31.f / 255.f) + 0.5f); }
+		inline int _Quantize6(float _c) { return (int)(_c * (63.f / 255.f) + 0.5f); }
+		/// Value at 1/3 between _a and _b.
+		inline int _Lerp13(int _a, int _b) { return (2 * _a + _b + 1) / 3; }
+		/// Value at 1/2 between _a and _b.
+		inline int _Lerp12(int _a, int _b) { return (_a + _b + 1) >> 1; }
+		inline float _Clamp255(float _c) { return _c < 0 ? 0 : (_c > 255 ? 255 : _c); }
+
+		//----------------------------------------------------------------------------//
+		// Color block
+		//----------------------------------------------------------------------------//
+
+		/// Best endpoints for solid color blocks. Value at 1/3 between endpoints is the nearest to each 8-bit value.
+		struct SingleColorTables
+		{
+			SingleColorTables(void)
+			{
+				_Init(match5, 32, &_Expand5);
+				_Init(match6, 64, &_Expand6);
+			}
+
+			static void _Init(uint8(*_table)[2], int _size, int(*_expand)(int))
+			{
+				for (int i = 0; i < 256; ++i)
+				{
+					int _best = 0x7fffffff;
+					for (int a = 0; a < _size; ++a)
+					{
+						for (int b = 0; b < _size; ++b)
+						{
+							// prefer closest endpoints, interpolation of hardware can differ
+							int _ea = _expand(a), _eb = _expand(b);
+							int _error = abs(_Lerp13(_ea, _eb) - i) * 1000 + abs(_ea - _eb);
+							if (_error < _best)
+							{
+								_best = _error;
+								_table[i][0] = (uint8)a;
+								_table[i][1] = (uint8)b;
+							}
+						}
+					}
+				}
+			}
+
+			uint8 match5[256][2];
+			uint8 match6[256][2];
+		};
+
+		const SingleColorTables& _GetSingleColorTables(void)
+		{
+			static const SingleColorTables _tables;
+			return _tables;
+		}
+
+		void _DecodeColor565(uint _c, int* _rgb)
+		{
+			_rgb[0] = _Expand5((_c >> 11) & 0x1f);
+			_rgb[1] = _Expand6((_c >> 5) & 0x3f);
+			_rgb[2] = _Expand5(_c & 0x1f);
+		}
+
+		uint _EncodeColor565(const float* _rgb)
+		{
+			return (_Quantize5(_rgb[0]) << 11) | (_Quantize6(_rgb[1]) << 5) | _Quantize5(_rgb[2]);
+		}
+
+		/// Build palette of color block. Index 3 of 3-color palette is black (or transparent). \return number of colors (3 or 4).
+		uint _ColorPalette(uint _c0, uint _c1, bool _forceFour, int(*_pal)[3])
+		{
+			_DecodeColor565(_c0, _pal[0]);
+			_DecodeColor565(_c1, _pal[1]);
+			if (_c0 > _c1 || _forceFour)
+			{
+				for (uint i = 0; i < 3; ++i)
+				{
+					_pal[2][i] = _Lerp13(_pal[0][i], _pal[1][i]);
+					_pal[3][i] = _Lerp13(_pal[1][i], _pal[0][i]);
+				}
+				return 4;
+			}
+			for (uint i = 0; i < 3; ++i)
+			{
+				_pal[2][i] = _Lerp12(_pal[0][i], _pal[1][i]);
+				_pal[3][i] = 0;
+			}
+			return 3;
+		}
+
+		/// Find nearest color of palette for each pixel. Transparent pixels take index 3. \return sum of squared errors.
+		uint _ColorIndices(const uint8(*_rgba)[4], const int(*_pal)[3], uint _numColors, uint _transparent, uint8* _indices)
+		{
+			uint _error = 0;
+			for (uint i = 0; i < 16; ++i)
+			{
+				if (_transparent & (1 << i))
+				{
+					_indices[i] = 3;
+					continue;
+				}
+
+				uint _best = 0xffffffff;
+				for (uint j = 0; j < _numColors; ++j)
+				{
+					int _dr = _rgba[i][0] - _pal[j][0], _dg = _rgba[i][1] - _pal[j][1], _db = _rgba[i][2] - _pal[j][2];
+					uint _d = (uint)(_dr * _dr + _dg * _dg + _db * _db);
+					if (_d < _best)
+					{
+						_best = _d;
+						_indices[i] = (uint8)j;
+					}
+				}
+				_error += _best;
+			}
+			return _error;
+		}
+
+		void _WriteColorBlock(uint _c0, uint _c1, const uint8* _indices, uint8* _dst)
+		{
+			uint32 _bits = 0;
+			for (uint i = 0; i < 16; ++i)
+				_bits |= _indices[i] << (i * 2);
+
+			_dst[0] = (uint8)_c0;
+			_dst[1] = (uint8)(_c0 >> 8);
+			_dst[2] = (uint8)_c1;
+			_dst[3] = (uint8)(_c1 >> 8);
+			_dst[4] = (uint8)_bits;
+			_dst[5] = (uint8)(_bits >> 8);
+			_dst[6] = (uint8)(_bits >> 16);
+			_dst[7] = (uint8)(_bits >> 24);
+		}
+
+		void _DecodeColorBlock(const uint8* _src, uint8(*_rgba)[4], bool _forceFour, bool _transparent)
+		{
+			uint _c0 = _src[0] | (_src[1] << 8);
+			uint _c1 = _src[2] | (_src[3] << 8);
+			uint32 _bits = _src[4] | (_src[5] << 8) | (_src[6] << 16) | ((uint32)_src[7] << 24);
+
+			int _pal[4][3];
+			uint _numColors = _ColorPalette(_c0, _c1, _forceFour, _pal);
+			for (uint i = 0; i < 16; ++i, _bits >>= 2)
+			{
+				uint _index = _bits & 3;
+				_rgba[i][0] = (uint8)_pal[_index][0];
+				_rgba[i][1] = (uint8)_pal[_index][1];
+				_rgba[i][2] = (uint8)_pal[_index][2];
+				_rgba[i][3] = (_numColors == 3 && _index == 3 && _transparent) ? 0 : 255;
+			}
+		}
+
+		/// Get principal axis of points (eigenvector of covariance matrix with largest eigenvalue) by power iteration.
+		void _PrincipalAxis(const float(*_points)[3], uint _numPoints, float* _axis)
+		{
+			float _mean[3] = { 0, 0, 0 };
+			for (uint i = 0; i < _numPoints; ++i)
+				for (uint j = 0; j < 3; ++j)
+					_mean[j] += _points[i][j];
+			for (uint j = 0; j < 3; ++j)
+				_mean[j] /= _numPoints;
+
+			float _cov[3][3] = {};
+			for (uint i = 0; i < _numPoints; ++i)
+			{
+				float _d[3] = { _points[i][0] - _mean[0], _points[i][1] - _mean[1], _points[i][2] - _mean[2] };
+				for (uint j = 0; j < 3; ++j)
+					for (uint k = 0; k < 3; ++k)
+						_cov[j][k] += _d[j] * _d[k];
+			}
+
+			// start from row with the largest variance
+			uint _row = _cov[1][1] > _cov[0][0] ? 1 : 0;
+			_row = _cov[2][2] > _cov[_row][_row] ? 2 : _row;
+			float _v[3] = { _cov[_row][0], _cov[_row][1], _cov[_row][2] };
+			for (uint _iter = 0; _iter < 8; ++_iter)
+			{
+				float _w[3];
+				for (uint j = 0; j < 3; ++j)
+					_w[j] = _cov[j][0] * _v[0] + _cov[j][1] * _v[1] + _cov[j][2] * _v[2];
+				float _max = Max(fabsf(_w[0]), fabsf(_w[1]), fabsf(_w[2]));
+				if (_max < 1e-6f)
+					break;
+				for (uint j = 0; j < 3; ++j)
+					_v[j] = _w[j] / _max;
+			}
+
+			if (Max(fabsf(_v[0]), fabsf(_v[1]), fabsf(_v[2])) < 1e-6f)
+				_v[0] = _v[1] = _v[2] = 1;
+			_axis[0] = _v[0];
+			_axis[1] = _v[1];
+			_axis[2] = _v[2];
+		}
+
+		/// Color block being encoded. Keeps best encoding of all tried endpoints.
+		struct ColorBlock
+		{
+			const uint8(*rgba)[4];
+			uint transparent; //!< mask of transparent pixels
+			bool threeColors; //!< 3-color mode is allowed (DXT1)
+			bool forceFour; //!< block is always decoded in 4-color mode (DXT3, DXT5)
+			float points[16][3]; //!< opaque pixels
+			uint numPoints;
+			uint bestError;
+			uint8 best[8];
+
+			void Try(uint _c0, uint _c1, bool _four)
+			{
+				if (_four ? _c0 < _c1 : _c0 > _c1)
+					Swap(_c0, _c1);
+
+				int _pal[4][3];
+				uint8 _indices[16];
+				uint _numColors = _ColorPalette(_c0, _c1, forceFour, _pal);
+				uint _error = _ColorIndices(rgba, _pal, _numColors, transparent, _indices);
+				if (_error < bestError)
+				{
+					bestError = _error;
+					_WriteColorBlock(_c0, _c1, _indices, best);
+				}
+			}
+
+			void Try(const float* _a, const float* _b, bool _four)
+			{
+				Try(_EncodeColor565(_a), _EncodeColor565(_b), _four);
+			}
+		};
+
+		void _RangeFit(ColorBlock& _block)
+		{
+			float _axis[3];
+			_PrincipalAxis(_block.points, _block.numPoints, _axis);
+
+			uint _min = 0, _max = 0;
+			float _minDot = FLT_MAX, _maxDot = -FLT_MAX;
+			for (uint i = 0; i < _block.numPoints; ++i)
+			{
+				const float* _p = _block.points[i];
+				float _dot = _p[0] * _axis[0] + _p[1] * _axis[1] + _p[2] * _axis[2];
+				if (_dot < _minDot)
+					_minDot = _dot, _min = i;
+				if (_dot > _maxDot)
+					_maxDot = _dot, _max = i;
+			}
+
+			if (!_block.transparent)
+				_block.Try(_block.points[_max], _block.points[_min], true);
+			if (_block.threeColors)
+				_block.Try(_block.points[_max], _block.points[_min], false);
+		}
+
+		///\brief Cluster fit. Points are ordered along principal axis and each ordered partition into 4 (or 3) clusters gives least squares endpoints.
+		/// Partition with the smallest error of quantized endpoints gives new axis for next iteration, until order of points is changed.
+		///\see "squish" library by Simon Brown.
+		void _ClusterFit(ColorBlock& _block, bool _four, uint _maxIterations)
+		{
+			const uint _n = _block.numPoints;
+			float _axis[3];
+			_PrincipalAxis(_block.points, _n, _axis);
+
+			// weights of first endpoint for each cluster
+			const float _w1 = _four ? 2.f / 3.f : 0.5f;
+			const float _w2 = _four ? 1.f / 3.f : 0.5f;
+
+			// snap to 565 grid, lane 3 is unused
+			const __m128 _zero = _mm_setzero_ps();
+			const __m128 _max = _mm_set1_ps(255);
+			const __m128 _toGrid = _mm_setr_ps(31.f / 255.f, 63.f / 255.f, 31.f / 255.f, 0);
+			const __m128 _fromGrid = _mm_setr_ps(255.f / 31.f, 255.f / 63.f, 255.f / 31.f, 0);
+
+			uint8 _order[16], _prevOrder[16];
+			__m128 _bestA = _zero, _bestB = _zero;
+			float _bestError = FLT_MAX;
+			for (uint _iter = 0; _iter < _maxIterations; ++_iter)
+			{
+				float _dots[16];
+				for (uint i = 0; i < _n; ++i)
+				{
+					const float* _p = _block.points[i];
+					float _dot = _p[0] * _axis[0] + _p[1] * _axis[1] + _p[2] * _axis[2];
+					uint j = i;
+					for (; j > 0 && _dots[j - 1] > _dot; --j)
+					{
+						_dots[j] = _dots[j - 1];
+						_order[j] = _order[j - 1];
+					}
+					_dots[j] = _dot;
+					_order[j] = (uint8)i;
+				}
+				if (_iter > 0 && !memcmp(_order, _prevOrder, _n))
+					break;
+				memcpy(_prevOrder, _order, _n);
+
+				// prefix sums of ordered points
+				__m128 _sums[17];
+				_sums[0] = _zero;
+				for (uint i = 0; i < _n; ++i)
+				{
+					const float* _p = _block.points[_order[i]];
+					_sums[i + 1] = _mm_add_ps(_sums[i], _mm_setr_ps(_p[0], _p[1], _p[2], 0));
+				}
+				const __m128 _total = _sums[_n];
+
+				bool _improved = false;
+				// clusters: [0, i) is first endpoint, [i, j) and [j, k) are interpolated (same cluster in 3-color mode), [k, n) is second endpoint
+				for (uint i = 0; i <= _n; ++i)
+				{
+					for (uint j = i; j <= _n; ++j)
+					{
+						for (uint k = _four ? j : _n; k <= _n; ++k)
+						{
+							// in 3-color mode [j, n) is second endpoint
+							uint _end = _four ? k : j;
+							float _c1 = (float)(j - i), _c2 = (float)(_end - j), _c3 = (float)(_n - _end);
+							float _alpha2 = i + _c1 * _w1 * _w1 + _c2 * _w2 * _w2;
+							float _beta2 = _c3 + _c1 * _w2 * _w2 + _c2 * _w1 * _w1;
+							float _alphaBeta = (_c1 + _c2) * _w1 * _w2;
+							float _det = _alpha2 * _beta2 - _alphaBeta * _alphaBeta;
+							if (_det < 1e-3f)
+								continue;
+							float _invDet = 1 / _det;
+
+							__m128 _alphaX = _mm_add_ps(_sums[i], _mm_add_ps(
+								_mm_mul_ps(_mm_sub_ps(_sums[j], _sums[i]), _mm_set1_ps(_w1)),
+								_mm_mul_ps(_mm_sub_ps(_sums[_end], _sums[j]), _mm_set1_ps(_w2))));
+							__m128 _betaX = _mm_sub_ps(_total, _alphaX);
+							__m128 _a = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(_alphaX, _mm_set1_ps(_beta2)), _mm_mul_ps(_betaX, _mm_set1_ps(_alphaBeta))), _mm_set1_ps(_invDet));
+							__m128 _b = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(_betaX, _mm_set1_ps(_alpha2)), _mm_mul_ps(_alphaX, _mm_set1_ps(_alphaBeta))), _mm_set1_ps(_invDet));
+							_a = _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(_a, _zero), _max), _toGrid))), _fromGrid);
+							_b = _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(_b, _zero), _max), _toGrid))), _fromGrid);
+
+							// error without constant sum of squared points
+							__m128 _e = _mm_add_ps(
+								_mm_add_ps(_mm_mul_ps(_mm_mul_ps(_a, _a), _mm_set1_ps(_alpha2)), _mm_mul_ps(_mm_mul_ps(_b, _b), _mm_set1_ps(_beta2))),
+								_mm_mul_ps(_mm_sub_ps(_mm_mul_ps(_mm_mul_ps(_a, _b), _mm_set1_ps(_alphaBeta)), _mm_add_ps(_mm_mul_ps(_a, _alphaX), _mm_mul_ps(_b, _betaX))), _mm_set1_ps(2)));
+							_e = _mm_add_ps(_e, _mm_movehl_ps(_e, _e));
+							_e = _mm_add_ss(_e, _mm_shuffle_ps(_e, _e, _MM_SHUFFLE(1, 1, 1, 1)));
+							float _error = _mm_cvtss_f32(_e);
+
+							if (_error < _bestError)
+							{
+								_bestError = _error;
+								_bestA = _a;
+								_bestB = _b;
+								_improved = true;
+							}
+						}
+					}
+				}
+
+				if (!_improved)
+					break;
+				_mm_storeu_ps(_dots, _mm_sub_ps(_bestB, _bestA));
+				memcpy(_axis, _dots, sizeof(_axis));
+			}
+
+			if (_bestError < FLT_MAX)
+			{
+				float _a[4], _b[4];
+				_mm_storeu_ps(_a, _bestA);
+				_mm_storeu_ps(_b, _bestB);
+				_block.Try(_a, _b, _four);
+			}
+		}
+
+		void _EncodeColorBlock(const uint8* _rgba, uint8* _dst, PixelFormat _format, BlockCompressionQuality _quality)
+		{
+			ColorBlock _block;
+			_block.rgba = reinterpret_cast<const uint8(*)[4]>(_rgba);
+			_block.transparent = 0;
+			_block.threeColors = _format == PF_DXT1 || _format == PF_DXT1A;
+			_block.forceFour = !_block.threeColors;
+			_block.numPoints = 0;
+			_block.bestError = 0xffffffff;
+
+			for (uint i = 0; i < 16; ++i)
+			{
+				if (_format == PF_DXT1A && _block.rgba[i][3] < 128)
+				{
+					_block.transparent |= 1 << i;
+					continue;
+				}
+				for (uint c = 0; c < 3; ++c)
+					_block.points[_block.numPoints][c] = _block.rgba[i][c];
+				++_block.numPoints;
+			}
+
+			if (!_block.numPoints)
+			{
+				static const uint8 _allTransparent[16] = { 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3 };
+				_WriteColorBlock(0, 0, _allTransparent, _dst);
+				return;
+			}
+
+			bool _solid = true;
+			for (uint i = 1; i < _block.numPoints && _solid; ++i)
+				_solid = !memcmp(_block.points[i], _block.points[0], sizeof(_block.points[0]));
+
+			if (_solid)
+			{
+				const SingleColorTables& _tables = _GetSingleColorTables();
+				uint _r = (uint)_block.points[0][0], _g = (uint)_block.points[0][1], _b = (uint)_block.points[0][2];
+				if (!_block.transparent)
+				{
+					uint _c0 = (_tables.match5[_r][0] << 11) | (_tables.match6[_g][0] << 5) | _tables.match5[_b][0];
+					uint _c1 = (_tables.match5[_r][1] << 11) | (_tables.match6[_g][1] << 5) | _tables.match5[_b][1];
+					_block.Try(_c0, _c1, true);
+				}
+				if (_block.threeColors)
+					_block.Try(_block.points[0], _block.points[0], false);
+			}
+			else
+			{
+				_RangeFit(_block);
+				if (_quality != BCQ_Fast)
+				{
+					uint _iterations = _quality == BCQ_High ? CLUSTER_FIT_ITERATIONS : 1;
+					if (!_block.transparent)
+						_ClusterFit(_block, true, _iterations);
+					if (_block.threeColors)
+						_ClusterFit(_block, false, _iterations);
+				}
+			}
+
+			memcpy(_dst, _block.best, 8);
+		}
+
+		//----------------------------------------------------------------------------//
+		// Alpha block
+		//----------------------------------------------------------------------------//
+
+		/// Build palette of alpha block. 6-value palette (_a0 <= _a1) also has 0 and 255.
+		void _AlphaPalette(int _a0, int _a1, int* _pal)
+		{
+			_pal[0] = _a0;
+			_pal[1] = _a1;
+			if (_a0 > _a1)
+			{
+				for (int i = 1; i < 7; ++i)
+					_pal[i + 1] = ((7 - i) * _a0 + i * _a1 + 3) / 7;
+			}
+			else
+			{
+				for (int i = 1; i < 5; ++i)
+					_pal[i + 1] = ((5 - i) * _a0 + i * _a1 + 2) / 5;
+				_pal[6] = 0;
+				_pal[7] = 255;
+			}
+		}
+
+		/// Alpha block being encoded. Values are taken from RGBA8 pixels.
+		struct AlphaBlock
+		{
+			const uint8* values; //!< first value, stride is 4 bytes
+			uint bestError;
+			int bestA0, bestA1;
+			uint8 best[8];
+
+			/// \return sum of squared errors
+			uint Try(int _a0, int _a1, uint8* _indices)
+			{
+				int _pal[8];
+				_AlphaPalette(_a0, _a1, _pal);
+
+				uint _error = 0;
+				for (uint i = 0; i < 16; ++i)
+				{
+					int _v = values[i * 4];
+					uint _best = 0xffffffff;
+					for (uint j = 0; j < 8; ++j)
+					{
+						uint _d = (uint)((_v - _pal[j]) * (_v - _pal[j]));
+						if (_d < _best)
+						{
+							_best = _d;
+							_indices[i] = (uint8)j;
+						}
+					}
+					_error += _best;
+				}
+
+				if (_error < bestError)
+				{
+					uint64 _bits = 0;
+					for (uint i = 0; i < 16; ++i)
+						_bits |= (uint64)_indices[i] << (i * 3);
+
+					bestError = _error;
+					bestA0 = _a0;
+					bestA1 = _a1;
+					best[0] = (uint8)_a0;
+					best[1] = (uint8)_a1;
+					for (uint i = 0; i < 6; ++i)
+						best[i + 2] = (uint8)(_bits >> (i * 8));
+				}
+				return _error;
+			}
+
+			/// Refine endpoints by least squares with fixed indices.
+			void Refine(int _a0, int _a1)
+			{
+				uint8 _indices[16];
+				Try(_a0, _a1, _indices);
+				for (uint _iter = 0; _iter < ALPHA_REFINE_ITERATIONS; ++_iter)
+				{
+					bool _eight = _a0 > _a1;
+					float _alpha2 = 0, _beta2 = 0, _alphaBeta = 0, _alphaX = 0, _betaX = 0;
+					for (uint i = 0; i < 16; ++i)
+					{
+						uint _index = _indices[i];
+						if (!_eight && _index >= 6)
+							continue; // explicit 0 and 255
+						float _beta = _index < 2 ? (float)_index : (_index - 1) / (_eight ? 7.f : 5.f);
+						float _alpha = 1 - _beta, _x = values[i * 4];
+						_alpha2 += _alpha * _alpha;
+						_beta2 += _beta * _beta;
+						_alphaBeta += _alpha * _beta;
+						_alphaX += _alpha * _x;
+						_betaX += _beta * _x;
+					}
+
+					float _det = _alpha2 * _beta2 - _alphaBeta * _alphaBeta;
+					if (_det < 1e-3f)
+						break;
+					int _n0 = (int)(_Clamp255((_alphaX * _beta2 - _betaX * _alphaBeta) / _det) + 0.5f);
+					int _n1 = (int)(_Clamp255((_betaX * _alpha2 - _alphaX * _alphaBeta) / _det) + 0.5f);
+					if (_eight ? _n0 < _n1 : _n0 > _n1)
+						Swap(_n0, _n1);
+					if (_eight && _n0 == _n1)
+						break;
+					if (_n0 == _a0 && _n1 == _a1)
+						break;
+
+					_a0 = _n0;
+					_a1 = _n1;
+					Try(_a0, _a1, _indices);
+				}
+			}
+		};
+
+		void _EncodeAlphaBlock(const uint8* _values, uint8* _dst, BlockCompressionQuality _quality)
+		{
+			int _min = 255, _max = 0, _innerMin = 255, _innerMax = 0;
+			for (uint i = 0; i < 16; ++i)
+			{
+				int _v = _values[i * 4];
+				_min = Min(_min, _v);
+				_max = Max(_max, _v);
+				if (_v > 0 && _v < 255)
+				{
+					_innerMin = Min(_innerMin, _v);
+					_innerMax = Max(_innerMax, _v);
+				}
+			}
+
+			AlphaBlock _block;
+			_block.values = _values;
+			_block.bestError = 0xffffffff;
+
+			uint8 _indices[16];
+			_block.Try(_max, _min, _indices);
+			if (_quality != BCQ_Fast && _block.bestError)
+			{
+				_block.Refine(_max, _min);
+				if (_innerMin <= _innerMax)
+				{
+					// 6-value palette with explicit 0 and 255
+					_block.Refine(_innerMin, _innerMax);
+				}
+			}
+
+			memcpy(_dst, _block.best, 8);
+		}
+
+		void _DecodeAlphaBlock(const uint8* _src, uint8* _dst)
+		{
+			int _pal[8];
+			_AlphaPalette(_src[0], _src[1], _pal);
+
+			uint64 _bits = 0;
+			for (uint i = 0; i < 6; ++i)
+				_bits |= (uint64)_src[i + 2] << (i * 8);
+			for (uint i = 0; i < 16; ++i, _bits >>= 3)
+				_dst[i * 4] = (uint8)_pal[_bits & 7];
+		}
+
+		void _EncodeExplicitAlpha(const uint8* _values, uint8* _dst)
+		{
+			for (uint i = 0; i < 8; ++i)
+			{
+				uint _a0 = (_values[i * 8] + 8) / 17;
+				uint _a1 = (_values[i * 8 + 4] + 8) / 17;
+				_dst[i] = (uint8)(_a0 | (_a1 << 4));
+			}
+		}
+
+		void _DecodeExplicitAlpha(const uint8* _src, uint8* _dst)
+		{
+			for (uint i = 0; i < 8; ++i)
+			{
+				_dst[i * 8] = (_src[i] & 0xf) * 17;
+				_dst[i * 8 + 4] = (_src[i] >> 4) * 17;
+			}
+		}
+
+		//----------------------------------------------------------------------------//
+		// Image
+		//----------------------------------------------------------------------------//
+
+		struct CompressImageJob
+		{
+			PixelFormat format;
+			BlockCompressionQuality quality;
+			const uint8* src;
+			uint8* dst;
+			uint width;
+			uint height;
+			uint pitch;
+			uint blockSize;
+			uint numBlocksX;
+			uint numBlocksY;
+			Atomic<uint> nextRow;
+		};
+
+		/// Compress rows of blocks until all rows are taken.
+		void _CompressBlockRows(CompressImageJob* _job)
+		{
+			uint8 _rgba[16 * 4];
+			for (uint _y; (_y = _job->nextRow++) < _job->numBlocksY;)
+			{
+				uint8* _dst = _job->dst + (size_t)_y * _job->numBlocksX * _job->blockSize;
+				for (uint _x = 0; _x < _job->numBlocksX; ++_x, _dst += _job->blockSize)
+				{
+					for (uint i = 0; i < 4; ++i)
+					{
+						const uint8* _row = _job->src + (size_t)Min(_y * 4 + i, _job->height - 1) * _job->pitch;
+						for (uint j = 0; j < 4; ++j)
+							memcpy(_rgba + (i * 4 + j) * 4, _row + Min(_x * 4 + j, _job->width - 1) * 4, 4);
+					}
+					CompressBlock(_job->format, _rgba, _dst, _job->quality);
+				}
+			}
+		}
+	}
+
+	//----------------------------------------------------------------------------//
+	// Block compression
+	//----------------------------------------------------------------------------//
+
+	//----------------------------------------------------------------------------//
+	bool IsCompressedFormat(PixelFormat _format)
+	{
+		return GetCompressedBlockSize(_format) != 0;
+	}
+	//----------------------------------------------------------------------------//
+	uint GetCompressedBlockSize(PixelFormat _format)
+	{
+		switch (_format)
+		{
+		case PF_RGTC1:
+		case PF_DXT1:
+		case PF_DXT1A:
+			return 8;
+		case PF_RGTC2:
+		case PF_DXT3:
+		case PF_DXT5:
+			return 16;
+		default:
+			return 0;
+		}
+	}
+	//----------------------------------------------------------------------------//
+	size_t GetCompressedImageSize(PixelFormat _format, uint _width, uint _height)
+	{
+		return (size_t)((_width + 3) >> 2) * ((_height + 3) >> 2) * GetCompressedBlockSize(_format);
+	}
+	//----------------------------------------------------------------------------//
+	void CompressBlock(PixelFormat _format, const uint8* _rgba, void* _dst, BlockCompressionQuality _quality)
+	{
+		uint8* _block = reinterpret_cast<uint8*>(_dst);
+		switch (_format)
+		{
+		case PF_RGTC1:
+			_EncodeAlphaBlock(_rgba, _block, _quality);
+			break;
+		case PF_RGTC2:
+			_EncodeAlphaBlock(_rgba, _block, _quality);
+			_EncodeAlphaBlock(_rgba + 1, _block + 8, _quality);
+			break;
+		case PF_DXT1:
+		case PF_DXT1A:
+			_EncodeColorBlock(_rgba, _block, _format, _quality);
+			break;
+		case PF_DXT3:
+			_EncodeExplicitAlpha(_rgba + 3, _block);
+			_EncodeColorBlock(_rgba, _block + 8, _format, _quality);
+			break;
+		case PF_DXT5:
+			_EncodeAlphaBlock(_rgba + 3, _block, _quality);
+			_EncodeColorBlock(_rgba, _block + 8, _format, _quality);
+			break;
+		default:
+			ASSERT(false, "Uncompressed format");
+			break;
+		}
+	}
+	//----------------------------------------------------------------------------//
+	void DecompressBlock(PixelFormat _format, const void* _src, uint8* _rgba)
+	{
+		const uint8* _block = reinterpret_cast<const uint8*>(_src);
+		uint8(*_pixels)[4] = reinterpret_cast<uint8(*)[4]>(_rgba);
+		switch (_format)
+		{
+		case PF_RGTC1:
+		case PF_RGTC2:
+			for (uint i = 0; i < 16; ++i)
+			{
+				_pixels[i][1] = 0;
+				_pixels[i][2] = 0;
+				_pixels[i][3] = 255;
+			}
+			_DecodeAlphaBlock(_block, _rgba);
+			if (_format == PF_RGTC2)
+				_DecodeAlphaBlock(_block + 8, _rgba + 1);
+			break;
+		case PF_DXT1:
+		case PF_DXT1A:
+			_DecodeColorBlock(_block, _pixels, false, _format == PF_DXT1A);
+			break;
+		case PF_DXT3:
+			_DecodeColorBlock(_block + 8, _pixels, true, false);
+			_DecodeExplicitAlpha(_block, _rgba + 3);
+			break;
+		case PF_DXT5:
+			_DecodeColorBlock(_block + 8, _pixels, true, false);
+			_DecodeAlphaBlock(_block, _rgba + 3);
+			break;
+		default:
+			ASSERT(false, "Uncompressed format");
+			break;
+		}
+	}
+	//----------------------------------------------------------------------------//
+	bool CompressImage(PixelFormat _format, const void* _src, uint _width, uint _height, uint _srcPitch, void* _dst, BlockCompressionQuality _quality, uint _numThreads)
+	{
+		uint _blockSize = GetCompressedBlockSize(_format);
+		if (!_blockSize)
+			return false;
+		if (!_width || !_height)
+			return true;
+
+		CompressImageJob _job;
+		_job.format = _format;
+		_job.quality = _quality;
+		_job.src = reinterpret_cast<const uint8*>(_src);
+		_job.dst = reinterpret_cast<uint8*>(_dst);
+		_job.width = _width;
+		_job.height = _height;
+		_job.pitch = _srcPitch;
+		_job.blockSize = _blockSize;
+		_job.numBlocksX = (_width + 3) >> 2;
+		_job.numBlocksY = (_height + 3) >> 2;
+
+		if (!_numThreads)
+			_numThreads = Thread::GetNumCores();
+		_numThreads = Min(_numThreads, _job.numBlocksY);
+
+		Array<Thread> _threads(_numThreads - 1);
+		for (Thread& _thread : _threads)
+			_thread = Thread(&_CompressBlockRows, &_job);
+		_CompressBlockRows(&_job);
+		for (Thread& _thread : _threads)
+			_thread.Wait();
+
+		return true;
+	}
+	//----------------------------------------------------------------------------//
+	bool DecompressImage(PixelFormat _format, const void* _src, uint _width, uint _height, void* _dst, uint _dstPitch)
+	{
+		uint _blockSize = GetCompressedBlockSize(_format);
+		if (!_blockSize)
+			return false;
+
+		const uint8* _block = reinterpret_cast<const uint8*>(_src);
+		uint8 _rgba[16 * 4];
+		for (uint _y = 0; _y < _height; _y += 4)
+		{
+			for (uint _x = 0; _x < _width; _x += 4, _block += _blockSize)
+			{
+				DecompressBlock(_format, _block, _rgba);
+				uint _w = Min(_width - _x, 4u), _h = Min(_height - _y, 4u);
+				for (uint i = 0; i < _h; ++i)
+					memcpy(reinterpret_cast<uint8*>(_dst) + (size_t)(_y + i) * _dstPitch + _x * 4, _rgba + i * 16, _w * 4);
+			}
+		}
+
+		return true;
+	}
+	//----------------------------------------------------------------------------//
+	float ComputePSNR(const void* _a, const void* _b, uint _width, uint _height, uint _pitch, uint _channelMask)
+	{
+		uint _numChannels = 0;
+		for (uint c = 0; c < 4; ++c)
+			_numChannels += (_channelMask >> c) & 1;
+		if (!_numChannels || !_width || !_height)
+			return INFINITY;
+
+		uint64 _sum = 0;
+		for (uint _y = 0; _y < _height; ++_y)
+		{
+			const uint8* _pa = reinterpret_cast<const uint8*>(_a) + (size_t)_y * _pitch;
+			const uint8* _pb = reinterpret_cast<const uint8*>(_b) + (size_t)_y * _pitch;
+			for (uint i = 0; i < _width * 4; ++i)
+			{
+				if (_channelMask & (1 << (i & 3)))
+				{
+					int _d = _pa[i] - _pb[i];
+					_sum += _d * _d;
+				}
+			}
+		}
+		if (!_sum)
+			return INFINITY;
+
+		double _mse = (double)_sum / ((double)_width * _height * _numChannels);
+		return (float)(10 * log10(255.0 * 255.0 / _mse));
+	}
+	//----------------------------------------------------------------------------//
+}
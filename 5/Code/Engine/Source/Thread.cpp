@@ -419,6 +419,11 @@ namespace Engine
 		SDL_Delay(_timeMs);
 	}
 	//----------------------------------------------------------------------------//
+	uint Thread::GetNumCores(void)
+	{
+		return (uint)SDL_GetCPUCount();
+	}
+	//----------------------------------------------------------------------------//
 	void Thread::SetName(uint _id, const char* _name)
 	{
 		SCOPE_LOCK(g_threadNamesMutex);
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "Graphics.hpp"
+
+namespace Engine
+{
+	//----------------------------------------------------------------------------//
+	// Block compression
+	//----------------------------------------------------------------------------//
+
+	///\brief Quality of color endpoints search for DXT1/DXT3/DXT5.
+	///\note RGTC and alpha blocks are refined by least squares at BCQ_Normal and BCQ_High.
+	enum BlockCompressionQuality
+	{
+		BCQ_Fast, //!< range fit: endpoints from extents of colors along principal axis.
+		BCQ_Normal, //!< cluster fit: least squares endpoints for each ordered partition of colors.
+		BCQ_High, //!< iterative cluster fit: colors are reordered along axis of best endpoints until order is changed.
+	};
+
+	/// Verify that format is one of block compressed formats (RGTC1, RGTC2, DXT1, DXT1A, DXT3, DXT5).
+	bool IsCompressedFormat(PixelFormat _format);
+	/// Get size of one 4x4 block in bytes. \return zero for uncompressed format.
+	uint GetCompressedBlockSize(PixelFormat _format);
+	/// Get size of compressed image in bytes. Image is padded to multiple of 4 pixels.
+	size_t GetCompressedImageSize(PixelFormat _format, uint _width, uint _height);
+
+	///\brief Compress one block of 4x4 RGBA8 pixels (stored row by row).
+	///\note RGTC1 takes red channel, RGTC2 takes red and green channels. DXT1 ignores alpha, DXT1A uses alpha < 128 as transparent.
+	void CompressBlock(PixelFormat _format, const uint8* _rgba, void* _dst, BlockCompressionQuality _quality = BCQ_Fast);
+	///\brief Decompress one block to 4x4 RGBA8 pixels.
+	///\note RGTC1 gives (r, 0, 0, 255), RGTC2 gives (r, g, 0, 255).
+	void DecompressBlock(PixelFormat _format, const void* _src, uint8* _rgba);
+
+	///\brief Compress RGBA8 image. Rows of blocks are distributed between _numThreads threads (including calling thread), zero is number of cores.
+	///\note Edge pixels are replicated if size of image is not multiple of 4.
+	///\return false if format is not compressed.
+	bool CompressImage(PixelFormat _format, const void* _src, uint _width, uint _height, uint _srcPitch, void* _dst, BlockCompressionQuality _quality = BCQ_Fast, uint _numThreads = 0);
+	/// Decompress image to RGBA8 pixels. \return false if format is not compressed.
+	bool DecompressImage(PixelFormat _format, const void* _src, uint _width, uint _height, void* _dst, uint _dstPitch);
+	/// Get peak signal-to-noise ratio (in dB) of two RGBA8 images for channels in _channelMask (0x1 = red, 0x2 = green, 0x4 = blue, 0x8 = alpha). \return infinity for equal images.
+	float ComputePSNR(const void* _a, const void* _b, uint _width, uint _height, uint _pitch, uint _channelMask = 0x7);
+
+	//----------------------------------------------------------------------------//
+	//
+	//----------------------------------------------------------------------------//
+}
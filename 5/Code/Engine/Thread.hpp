@@ -360,6 +360,8 @@ namespace Engine
 		static bool IsMain(void) { return s_mainThreadId == GetCurrentId(); }
 		/// Pause of current thread.
 		static void Pause(uint _timeMs);
+		/// Get number of logical CPU cores.
+		static uint GetNumCores(void);
 		/// Set name of thread.
 		static void SetName(uint _id, const char* _name);
 		/// Get name of thread.
@@ -351,10 +351,453 @@ protected:
 
 
 
+//----------------------------------------------------------------------------//
+// Name
+//----------------------------------------------------------------------------//
+
+struct TestNamesParams
+{
+	const StringArray* names;
+	uint seed;
+	uint count;
+	bool useTable;
+};
+
+HashMap<uint, String> gTestNamesMap; // global map with single lock, as the names were interned before
+SpinLock gTestNamesLock;
+
+void _TestNamesThread(TestNamesParams* _params)
+{
+	const StringArray& _names = *_params->names;
+	uint _seed = _params->seed;
+	for (uint i = 0; i < _params->count; ++i)
+	{
+		_seed = _seed * 1664525 + 1013904223;
+		const String& _str = _names[(_seed >> 8) % _names.size()];
+		if (_params->useTable)
+		{
+			Name _name(_str);
+		}
+		else
+		{
+			uint _hash = _str.Hashi();
+			SCOPE_LOCK(gTestNamesLock);
+			auto _it = gTestNamesMap.find(_hash);
+			if (_it == gTestNamesMap.end())
+				gTestNamesMap[_hash] = _str;
+		}
+	}
+}
+
+void _TestNames(void)
+{
+	const uint _numNames = 50000;
+	const uint _numOps = 400000; // per thread
+
+	StringArray _names(_numNames);
+	for (uint i = 0; i < _numNames; ++i)
+		_names[i] = String::Format(i & 1 ? "Mesh/Part%u_LOD%u" : "material_%u.mtl", i, i % 4);
+
+	double _freq = 1000.0 / SDL_GetPerformanceFrequency();
+	for (uint _numThreads = 1; _numThreads <= 8; _numThreads <<= 1)
+	{
+		double _time[2];
+		for (uint p = 0; p < 2; ++p)
+		{
+			TestNamesParams _params[8];
+			Thread _threads[8];
+			uint64 _st = SDL_GetPerformanceCounter();
+			for (uint i = 0; i < _numThreads; ++i)
+			{
+				_params[i] = { &_names, i * 7919, _numOps, p != 0 };
+				_threads[i] = Thread(&_TestNamesThread, &_params[i]);
+			}
+			for (uint i = 0; i < _numThreads; ++i)
+				_threads[i].Wait();
+			_time[p] = (SDL_GetPerformanceCounter() - _st) * _freq;
+		}
+		printf("%u threads: %u names, global lock %.2f ms (%.1f ns/name), table %.2f ms (%.1f ns/name), %.1fx\n", _numThreads, _numOps * _numThreads,
+			_time[0], _time[0] * 1e6 / (_numOps * _numThreads), _time[1], _time[1] * 1e6 / (_numOps * _numThreads), _time[0] / _time[1]);
+	}
+
+	uint _errors = 0;
+	for (uint i = 0; i < _numNames; ++i)
+	{
+		Name _a(_names[i]), _b(_names[i].CStr()), _c(_names[(i + 1) % _numNames]);
+		_errors += _a != _b || _a == _c || _a.Hash() != NameHash(_names[i]);
+	}
+
+	uint _count = Name::GetCount();
+	size_t _memory = Name::GetMemoryUse();
+	printf("%u names interned, %.2f KB (%.1f bytes per name), %s\n", _count, _memory / 1024.0, (double)_memory / _count, _errors ? "NAMES ARE DIFFERENT" : "names are equal");
+
+	gTestNamesMap.clear();
+}
+
+//----------------------------------------------------------------------------//
+// DeferredRenderContext
+//----------------------------------------------------------------------------//
+
+struct TestRecordParams
+{
+	DeferredRenderContext* context;
+	HardwareBufferPtr* vertexBuffers;
+	HardwareBufferPtr* indexBuffers;
+	uint first;
+	uint count;
+	uint order;
+	uint numFrames;
+	Condition start;
+	Condition finished;
+};
+
+void _TestRecordCommands(TestRecordParams* _p)
+{
+	DeferredRenderContext* _ctx = _p->context;
+	for (uint _frame = 0; _frame < _p->numFrames; ++_frame)
+	{
+		_p->start.Wait();
+		_ctx->BeginCommands();
+		for (uint i = _p->first; i < _p->first + _p->count; ++i)
+		{
+			// typical scene: few instances of each mesh
+			_ctx->SetPrimitiveType(PT_Triangles);
+			_ctx->SetVertexBuffer(0, _p->vertexBuffers[(i >> 3) & 15], 0, 32);
+			_ctx->SetIndexBuffer(_p->indexBuffers[(i >> 6) & 3], IF_UShort, 0);
+			_ctx->DrawIndexed(36, 1, i % 100, 0);
+		}
+		_ctx->EndCommands();
+		gRenderSystem->Submit(_ctx, _p->order);
+		_p->finished.Signal();
+	}
+}
+
+void _TestDeferredContext(void)
+{
+	const uint _numThreads = 8;
+	const uint _numDraws = 100000;
+	const uint _numFrames = 20;
+
+	if (!RenderSystem::Create(RST_Null))
+		return;
+
+	HardwareBufferPtr _vertexBuffers[16], _indexBuffers[4];
+	for (uint i = 0; i < 16; ++i)
+		_vertexBuffers[i] = gRenderSystem->CreateBuffer(HBT_Vertex, HBU_Default, 1024, 32);
+	for (uint i = 0; i < 4; ++i)
+		_indexBuffers[i] = gRenderSystem->CreateBuffer(HBT_Index, HBU_Default, 1024, 2);
+
+	DeferredRenderContext _contexts[_numThreads];
+	TestRecordParams _params[_numThreads];
+	Thread _threads[_numThreads];
+	for (uint i = 0; i < _numThreads; ++i)
+	{
+		TestRecordParams& _p = _params[i];
+		_p.context = &_contexts[i];
+		_p.vertexBuffers = _vertexBuffers;
+		_p.indexBuffers = _indexBuffers;
+		_p.first = i * _numDraws / _numThreads;
+		_p.count = _numDraws / _numThreads;
+		_p.order = _numThreads - i; // reverse order of submission to check the merging
+		_p.numFrames = _numFrames;
+		_threads[i] = Thread(&_TestRecordCommands, &_p);
+	}
+
+	double _freq = 1000.0 / SDL_GetPerformanceFrequency();
+	double _recordTime = 0, _replayTime = 0;
+	uint32 _hash = 0;
+	uint _errors = 0;
+
+	for (uint _frame = 0; _frame < _numFrames; ++_frame)
+	{
+		uint64 _st = SDL_GetPerformanceCounter();
+		for (uint i = 0; i < _numThreads; ++i)
+			_params[i].start.Signal();
+		for (uint i = 0; i < _numThreads; ++i)
+			_params[i].finished.Wait();
+		uint64 _recorded = SDL_GetPerformanceCounter();
+		gRenderSystem->EndFrame(); // replay of submitted commands
+		uint64 _replayed = SDL_GetPerformanceCounter();
+
+		_recordTime += (_recorded - _st) * _freq;
+		_replayTime += (_replayed - _recorded) * _freq;
+
+		// threads finish in random order, but replayed commands must be the same in each frame
+		const RenderFrameStats& _stats = gRenderSystem->GetFrameStats();
+		if (_frame == 0)
+			_hash = _stats.commandsHash;
+		_errors += _stats.commandsHash != _hash;
+		_errors += _stats.numDraws != _numDraws;
+	}
+
+	for (uint i = 0; i < _numThreads; ++i)
+		_threads[i].Wait();
+
+	// reference: lists executed directly in ascending order of submission, i.e. from last thread to first
+	for (uint i = _numThreads; i-- > 0;)
+		_contexts[i].Execute(gRenderSystem);
+	gRenderSystem->EndFrame();
+	uint32 _orderedHash = gRenderSystem->GetFrameStats().commandsHash;
+	_errors += _orderedHash != _hash;
+
+	// order of threads must give other result, otherwise the checksum can't detect wrong merging
+	for (uint i = 0; i < _numThreads; ++i)
+		_contexts[i].Execute(gRenderSystem);
+	gRenderSystem->EndFrame();
+	_errors += gRenderSystem->GetFrameStats().commandsHash == _hash;
+
+	uint _size = 0, _numCommands = 0;
+	for (uint i = 0; i < _numThreads; ++i)
+	{
+		_size += _contexts[i].GetSize();
+		_numCommands += _contexts[i].GetNumCommands();
+	}
+
+	printf("%u draws in %u threads: record %.3f ms, replay %.3f ms per frame, %u commands (%u KB), replay checksum %08x, %u errors\n", _numDraws, _numThreads, _recordTime / _numFrames, _replayTime / _numFrames,
+		_numCommands, _size / 1024, _hash, _errors);
+
+	for (uint i = 0; i < 16; ++i)
+		_vertexBuffers[i] = nullptr;
+	for (uint i = 0; i < 4; ++i)
+		_indexBuffers[i] = nullptr;
+
+	RenderSystem::Destroy();
+}
+
+//----------------------------------------------------------------------------//
+// TextureCompression
+//----------------------------------------------------------------------------//
+
+/// Make RGBA8 image with smooth gradients, hard edges, noise and alpha cutouts.
+void _MakeTestImage(Array<uint8>& _rgba, uint _width, uint _height)
+{
+	_rgba.resize(_width * _height * 4);
+	uint _seed = 12345;
+	for (uint y = 0; y < _height; ++y)
+	{
+		for (uint x = 0; x < _width; ++x)
+		{
+			_seed = _seed * 1103515245 + 12345;
+			int _noise = (int)((_seed >> 16) & 15) - 8;
+			float _u = (float)x / _width, _v = (float)y / _height;
+			bool _tile = (((x >> 7) ^ (y >> 7)) & 1) != 0;
+			float _wave = sinf(_u * 23 + _v * 7) * cosf(_v * 17 - _u * 5);
+
+			uint8* _p = &_rgba[(y * _width + x) * 4];
+			_p[0] = (uint8)Clamp<int>((int)(_u * 255 * (_tile ? 1.f : 0.6f)) + _noise, 0, 255);
+			_p[1] = (uint8)Clamp<int>((int)(128 + _wave * 120) + _noise, 0, 255);
+			_p[2] = (uint8)Clamp<int>((int)(_v * 255) - (_tile ? 60 : 0) + _noise / 2, 0, 255);
+			_p[3] = (uint8)Clamp<int>((int)(128 + _wave * 200), 0, 255);
+		}
+	}
+}
+
+void _TestTextureCompression(uint _size = 4096)
+{
+	const PixelFormat _formats[] = { PF_DXT1, PF_DXT3, PF_DXT5, PF_RGTC1, PF_RGTC2 };
+	const char* _formatNames[] = { "DXT1", "DXT3", "DXT5", "RGTC1", "RGTC2" };
+	const uint _channels[] = { 0x7, 0xf, 0xf, 0x1, 0x3 };
+	const char* _qualityNames[] = { "fast", "normal", "high" };
+
+	Array<uint8> _src, _dst(_size * _size * 4);
+	_MakeTestImage(_src, _size, _size);
+	double _freq = 1000.0 / SDL_GetPerformanceFrequency();
+
+	for (uint i = 0; i < sizeof(_formats) / sizeof(_formats[0]); ++i)
+	{
+		Array<uint8> _blocks(GetCompressedImageSize(_formats[i], _size, _size));
+		float _psnr[3];
+		for (uint _quality = BCQ_Fast; _quality <= BCQ_High; ++_quality)
+		{
+			uint64 _st = SDL_GetPerformanceCounter();
+			CompressImage(_formats[i], _src.data(), _size, _size, _size * 4, _blocks.data(), (BlockCompressionQuality)_quality);
+			double _time = (SDL_GetPerformanceCounter() - _st) * _freq;
+
+			DecompressImage(_formats[i], _blocks.data(), _size, _size, _dst.data(), _size * 4);
+			_psnr[_quality] = ComputePSNR(_src.data(), _dst.data(), _size, _size, _size * 4, _channels[i]);
+			printf("%s %s: %.2f MP/s, PSNR %.2f dB\n", _formatNames[i], _qualityNames[_quality], _size * _size / (_time * 1000), _psnr[_quality]);
+		}
+		if (_psnr[BCQ_Normal] < _psnr[BCQ_Fast] || _psnr[BCQ_High] < _psnr[BCQ_Normal])
+			printf("%s: higher quality gives lower PSNR\n", _formatNames[i]);
+	}
+
+	// DXT1A keeps 1-bit alpha exactly
+	Array<uint8> _blocks(GetCompressedImageSize(PF_DXT1A, _size, _size));
+	CompressImage(PF_DXT1A, _src.data(), _size, _size, _size * 4, _blocks.data(), BCQ_Normal);
+	DecompressImage(PF_DXT1A, _blocks.data(), _size, _size, _dst.data(), _size * 4);
+	uint _alphaErrors = 0;
+	for (uint i = 3; i < _src.size(); i += 4)
+		_alphaErrors += (_src[i] < 128) != (_dst[i] == 0);
+	if (_alphaErrors)
+		printf("DXT1A: %u pixels with wrong alpha\n", _alphaErrors);
+
+	// size isn't multiple of 4, multithreaded compression must give the same blocks as single thread
+	const uint _w = 37, _h = 23;
+	Array<uint8> _blocks1(GetCompressedImageSize(PF_DXT5, _w, _h)), _blocks2(_blocks1.size());
+	CompressImage(PF_DXT5, _src.data(), _w, _h, _size * 4, _blocks1.data(), BCQ_High, 1);
+	CompressImage(PF_DXT5, _src.data(), _w, _h, _size * 4, _blocks2.data(), BCQ_High, 4);
+	if (_blocks1 != _blocks2)
+		printf("DXT5: multithreaded compression differs\n");
+}
+
+//----------------------------------------------------------------------------//
+// MipMaps
+//----------------------------------------------------------------------------//
+
+/// Make reference mip chain of RGBA8 image by box filter in double precision. Each level is made from unrounded previous level.
+void _MakeReferenceMipMaps(const Array<uint8>& _rgba, uint _width, uint _height, bool _srgb, Array<Array<uint8>>& _levels)
+{
+	Array<double> _src(_rgba.size()), _dst;
+	for (size_t i = 0; i < _rgba.size(); ++i)
+	{
+		double _c = _rgba[i] / 255.0;
+		_src[i] = (_srgb && (i & 3) != 3) ? (_c <= 0.04045 ? _c / 12.92 : pow((_c + 0.055) / 1.055, 2.4)) : _c;
+	}
+
+	_levels.assign(1, _rgba);
+	while (_width > 1 || _height > 1)
+	{
+		uint _w = Max(_width >> 1, 1u), _h = Max(_height >> 1, 1u);
+		uint _sx = _width / _w, _sy = _height / _h;
+		_dst.resize(_w * _h * 4);
+		_levels.push_back(Array<uint8>(_w * _h * 4));
+		for (uint y = 0; y < _h; ++y)
+		{
+			for (uint x = 0; x < _w; ++x)
+			{
+				for (uint c = 0; c < 4; ++c)
+				{
+					double _sum = 0;
+					for (uint j = 0; j < _sy; ++j)
+						for (uint i = 0; i < _sx; ++i)
+							_sum += _src[((y * _sy + j) * _width + x * _sx + i) * 4 + c];
+
+					double _v = _sum / (_sx * _sy);
+					_dst[(y * _w + x) * 4 + c] = _v;
+					if (_srgb && c != 3)
+						_v = _v <= 0.0031308 ? _v * 12.92 : 1.055 * pow(_v, 1 / 2.4) - 0.055;
+					_levels.back()[(y * _w + x) * 4 + c] = (uint8)(_v * 255 + 0.5);
+				}
+			}
+		}
+		_src.swap(_dst);
+		_width = _w;
+		_height = _h;
+	}
+}
+
+float _GetAlphaCoverage(const MipLevel& _level, float _ref)
+{
+	uint _count = 0;
+	for (size_t i = 3; i < _level.data.size(); i += 4)
+		_count += _level.data[i] > _ref * 255;
+	return (float)_count / (_level.width * _level.height);
+}
+
+void _TestMipMaps(uint _size = 4096)
+{
+	const char* _filterNames[] = { "box", "kaiser" };
+	Array<uint8> _src;
+	Array<MipLevel> _levels;
+
+	// box filter must match reference in linear and sRGB space
+	_MakeTestImage(_src, 256, 128);
+	for (uint _srgb = 0; _srgb < 2; ++_srgb)
+	{
+		MipMapParams _params;
+		_params.srgb = _srgb != 0;
+		GenerateMipMaps(PF_RGBA8, _src.data(), 256, 128, 256 * 4, _levels, _params);
+
+		Array<Array<uint8>> _reference;
+		_MakeReferenceMipMaps(_src, 256, 128, _params.srgb, _reference);
+		int _maxError = _levels.size() == _reference.size() ? 0 : 255;
+		for (uint i = 0; i < _levels.size() && i < _reference.size(); ++i)
+			for (size_t j = 0; j < _reference[i].size(); ++j)
+				_maxError = Max(_maxError, abs(_levels[i].data[j] - _reference[i][j]));
+		printf("box %s: %u levels, max error %d\n", _params.srgb ? "srgb" : "linear", (uint)_levels.size(), _maxError);
+	}
+
+	// constant image must stay constant for all formats and filters, including odd sizes
+	const uint _w = 37, _h = 23;
+	const uint8 _color[] = { 200, 100, 50, 128 };
+	Array<uint8> _rgba(_w * _h * 4), _r(_w * _h, 77);
+	Array<uint16> _half(_w * _h * 4, FloatToHalf(0.3f));
+	for (uint i = 0; i < _rgba.size(); ++i)
+		_rgba[i] = _color[i & 3];
+	for (uint _filter = MF_Box; _filter <= MF_Kaiser; ++_filter)
+	{
+		MipMapParams _params;
+		_params.filter = (MipFilter)_filter;
+		_params.srgb = true;
+		uint _errors = 0;
+
+		GenerateMipMaps(PF_RGBA8, _rgba.data(), _w, _h, _w * 4, _levels, _params);
+		for (const MipLevel& _level : _levels)
+			_errors += memcmp(_level.data.data(), _rgba.data(), _level.data.size()) != 0;
+		GenerateMipMaps(PF_R8, _r.data(), _w, _h, _w, _levels, _params);
+		for (const MipLevel& _level : _levels)
+			_errors += memcmp(_level.data.data(), _r.data(), _level.data.size()) != 0;
+		GenerateMipMaps(PF_RGBA16F, _half.data(), _w, _h, _w * 8, _levels, _params);
+		for (const MipLevel& _level : _levels)
+			_errors += memcmp(_level.data.data(), _half.data(), _level.data.size()) != 0;
+
+		if (_errors)
+			printf("%s: %u levels of constant image are changed\n", _filterNames[_filter], _errors);
+	}
+
+	// alpha test coverage
+	_MakeTestImage(_src, 512, 512);
+	for (uint _preserve = 0; _preserve < 2; ++_preserve)
+	{
+		MipMapParams _params;
+		_params.filter = MF_Kaiser;
+		_params.alphaRef = _preserve ? 0.5f : 0;
+		GenerateMipMaps(PF_RGBA8, _src.data(), 512, 512, 512 * 4, _levels, _params);
+
+		float _coverage = _GetAlphaCoverage(_levels[0], 0.5f), _maxError = 0;
+		for (const MipLevel& _level : _levels)
+		{
+			if (_level.width >= 8)
+				_maxError = Max(_maxError, fabsf(_GetAlphaCoverage(_level, 0.5f) - _coverage));
+		}
+		printf("coverage %.3f, %s: max error %.3f\n", _coverage, _preserve ? "preserved" : "not preserved", _maxError);
+	}
+
+	// benchmark of sRGB chain and compression of all levels
+	_MakeTestImage(_src, _size, _size);
+	double _freq = 1000.0 / SDL_GetPerformanceFrequency();
+	for (uint _filter = MF_Box; _filter <= MF_Kaiser; ++_filter)
+	{
+		MipMapParams _params;
+		_params.filter = (MipFilter)_filter;
+		_params.srgb = true;
+		_params.alphaRef = 0.5f;
+
+		uint64 _st = SDL_GetPerformanceCounter();
+		GenerateMipMaps(PF_RGBA8, _src.data(), _size, _size, _size * 4, _levels, _params);
+		double _time = (SDL_GetPerformanceCounter() - _st) * _freq;
+		printf("%s %ux%u: %.1f ms, %.1f MP/s\n", _filterNames[_filter], _size, _size, _time, _size * _size / (_time * 1000));
+	}
+
+	Array<uint8> _blocks;
+	uint64 _st = SDL_GetPerformanceCounter();
+	CompressMipMaps(PF_RGBA8, _levels, PF_DXT5, _blocks);
+	printf("DXT5 of %u levels: %.1f ms, %u KB\n", (uint)_levels.size(), (SDL_GetPerformanceCounter() - _st) * _freq, (uint)(_blocks.size() / 1024));
+}
+
+//----------------------------------------------------------------------------//
+// 
+//----------------------------------------------------------------------------//
+
 int main(void)
 {
 	try
 	{
+		//_TestNames();
+		//_TestDeferredContext();
+		//_TestTextureCompression();
+		//_TestMipMaps();
+
 
 		system("pause");
 		return 0;